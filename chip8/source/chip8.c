@@ -1,9 +1,8 @@
-#include "chip8.h"
+#include "chip8_internal.h"
 
 #include <assert.h>
 #include <string.h>
 #include <stdint.h>
-#include <stdio.h>
 #include <stdlib.h>
 
 
@@ -29,30 +28,42 @@ static const uint8_t font_data[] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80,
 };
 
-// 8-bit low and high nibble
-// Example
-// x -> 0101 0111
-// HIGH_NIBBLE(x) -> 0000 0101
-// LOW_NIBBLE(x) -> 0000 0111
-#define LOW_NIBBLE(x) ( (x) & 0x0F )
-#define HIGH_NIBBLE(x) ( ((x) >> 4) & 0x0F )
-
-// Get bit b for x (results in either 0x0 or 0x1)
-#define BIT(x, b) ( ((x) >> (b)) & 0x1 )
-
-// Make a uint16_t out of two uint8_t
-#define U16(a, b) ( ((a)<<8) | (b) )
+// Large font data (0-F), 10 bytes each, for the SUPER-CHIP Fx30.
+// SUPER-CHIP only has 0-9, A-F follow Octo
+static const uint8_t hires_font_data[] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF,
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF,
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03,
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18,
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC,
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0,
+};
 
 
 Chip8* chip8_new()
 {
-    Chip8* ch8 = malloc(sizeof(Chip8));
+    Chip8* ch8 = calloc(1, sizeof(Chip8));
     return ch8;
 }
 
 
 void chip8_delete(Chip8* ch8)
 {
+    if (ch8)
+    {
+        free(ch8->xo);
+        free(ch8->mega);
+    }
     free(ch8);
 }
 
@@ -62,453 +73,393 @@ void chip8_init(Chip8* chip8)
     // Initialize memory
     memset(chip8, 0x0, sizeof(Chip8));
     memcpy(&chip8->memory[0x0], &font_data[0], sizeof(font_data)/sizeof(font_data[0]));
+    memcpy(&chip8->memory[CHIP8_HIRES_FONT_LOCATION], &hires_font_data[0], sizeof(hires_font_data)/sizeof(hires_font_data[0]));
     chip8->pc = CHIP8_PROGRAM_START_LOCATION;
+    chip8->dirty_pages = 0xFFFF;
+    chip8_seed(chip8, 0);
 }
 
 
-int chip8_load_rom(Chip8* chip8, const char* rom_path)
+void chip8_seed(Chip8* chip8, uint32_t seed)
 {
-    FILE* rom = fopen(rom_path, "rb");
-    if (!rom)
-    {
-        printf("Rom file could not be loaded.\n");
-        return -1;
-    }
+    // Spread the seed over all bits, xorshift32 is stuck at 0 and slow to leave small states
+    uint32_t state = seed * 2654435761u + 0x6D2B79F5u;
+    chip8->rng = state ? state : 0x6D2B79F5u;
+}
+
 
-    fseek(rom, 0, SEEK_END);
-    chip8->rom_size = ftell(rom);
-    fseek(rom, 0, SEEK_SET);
+int chip8_set_quirks(Chip8* chip8, Chip8Quirks quirks)
+{
+    quirks = (quirks < CHIP8_QUIRKS_COUNT) ? quirks : CHIP8_QUIRKS_DEFAULT;
 
-    for (size_t i = 0; i < chip8->rom_size; ++i)
+    /*
+    Only XO-CHIP machines pay for its 64 KB of memory and second plane, and
+    only MEGA-CHIP ones for its 16 MB and palette display: the others keep
+    their memory inline, so batches of them stay small. The first 4 KB move
+    along, so switching modes keeps the loaded ROM. The new state is
+    allocated before the old one goes, so a failure changes nothing.
+    */
+    Chip8Xo* xo = chip8->xo;
+    Chip8Mega* mega = chip8->mega;
+    if (quirks == CHIP8_QUIRKS_XOCHIP && !xo)
+    {
+        xo = calloc(1, sizeof(Chip8Xo));
+        if (!xo)
+        {
+            return -1;
+        }
+        memcpy(xo->memory, CHIP8_MEMORY(chip8), CHIP8_MEMORY_SIZE);
+        xo->planes = 0x1;
+        xo->pitch = 64; // 4000 samples per second
+    }
+    else if (quirks == CHIP8_QUIRKS_MEGACHIP && !mega)
     {
-        fread(&chip8->memory[CHIP8_PROGRAM_START_LOCATION + i], sizeof(uint8_t), 1, rom);
+        mega = calloc(1, sizeof(Chip8Mega));
+        if (!mega)
+        {
+            return -1;
+        }
+        memcpy(mega->memory, CHIP8_MEMORY(chip8), CHIP8_MEMORY_SIZE);
+        mega->sprite_width = 8;
+        mega->sprite_height = 1;
+        mega->alpha = 0xFF;
     }
 
-    fclose(rom);  
+    if (quirks != CHIP8_QUIRKS_XOCHIP)
+    {
+        xo = NULL;
+    }
+    if (quirks != CHIP8_QUIRKS_MEGACHIP)
+    {
+        mega = NULL;
+    }
+    if (chip8->xo != xo || chip8->mega != mega)
+    {
+        if ((chip8->xo && !xo) || (chip8->mega && !mega))
+        {
+            memcpy(chip8->memory, CHIP8_MEMORY(chip8), CHIP8_MEMORY_SIZE);
+            chip8->dirty_pages = 0xFFFF;
+        }
+        if (chip8->xo != xo)
+        {
+            free(chip8->xo);
+        }
+        if (chip8->mega != mega)
+        {
+            free(chip8->mega);
+        }
+        chip8->xo = xo;
+        chip8->mega = mega;
+    }
 
-    return 0;  
+    chip8->quirks = (uint8_t)quirks;
+    return 0;
 }
 
 
-void chip8_disassemble_at(Chip8* chip8, uint16_t at, char* dst)
+const char* chip8_quirks_name(Chip8Quirks quirks)
 {
-    uint8_t* code = &chip8->memory[at];
+    switch(quirks)
+    {
+        case CHIP8_QUIRKS_DEFAULT: { return "default"; }
+        case CHIP8_QUIRKS_VIP: { return "vip"; }
+        case CHIP8_QUIRKS_CHIP48: { return "chip48"; }
+        case CHIP8_QUIRKS_SCHIP: { return "schip"; }
+        case CHIP8_QUIRKS_XOCHIP: { return "xochip"; }
+        case CHIP8_QUIRKS_MEGACHIP: { return "megachip"; }
+        default: { return NULL; }
+    }
+}
 
-    switch(HIGH_NIBBLE(code[0]))
+
+void chip8_vram_unpack(const Chip8* chip8, uint8_t* dst)
+{
+    for (int y = 0; y < VRAM_HEIGHT(chip8); ++y)
     {
-        case 0x0: {
-            switch(U16(code[0], code[1]))
-            {
-                case 0x00E0: { sprintf(dst, "$%04X | 0x%02X%02X -> disp_clear()\n", at, code[0], code[1]); break; }
-                case 0x00EE: { sprintf(dst, "$%04X | 0x%02X%02X -> return\n", at, code[0], code[1]); break; }
-                default: { sprintf(dst, "$%04X | 0x%02X%02X -> call subroutine at 0x%03X\n", at, code[0], code[1], U16(code[0], code[1]) & 0x0FFF); break; }
-            }
-            break;
-        }
-        case 0x1: { sprintf(dst, "$%04X | 0x%02X%02X -> goto $%03X\n", at, code[0], code[1], U16(code[0], code[1]) & 0x0FFF); break; }
-        case 0x2: { sprintf(dst, "$%04X | 0x%02X%02X -> *(0x%03X)()\n", at, code[0], code[1], U16(code[0], code[1]) & 0x0FFF); break; }
-        case 0x3: { sprintf(dst, "$%04X | 0x%02X%02X -> skip if (V%1X == 0x%02X)\n", at, code[0], code[1], LOW_NIBBLE(code[0]), code[1]); break; }
-        case 0x4: { sprintf(dst, "$%04X | 0x%02X%02X -> skip if (V%1X != 0x%02X)\n", at, code[0], code[1], LOW_NIBBLE(code[0]), code[1]); break; }
-        case 0x5: { if(LOW_NIBBLE(code[1]) == 0) { sprintf(dst, "$%04X | 0x%02X%02X -> skip if (V%1X == V%1X)\n", at, code[0], code[1], LOW_NIBBLE(code[0]), HIGH_NIBBLE(code[1])); break; } }
-        case 0x6: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X = 0x%02X\n", at, code[0], code[1], LOW_NIBBLE(code[0]), code[1]); break; }
-        case 0x7: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X += 0x%02X\n", at, code[0], code[1], LOW_NIBBLE(code[0]), code[1]); break; }
-        case 0x8: {
-            switch(LOW_NIBBLE(code[1]))
-            {
-                case 0x0: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X = V%1X\n", at, code[0], code[1], LOW_NIBBLE(code[0]), HIGH_NIBBLE(code[1])); break; }
-                case 0x1: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X |= V%1X\n", at, code[0], code[1], LOW_NIBBLE(code[0]), HIGH_NIBBLE(code[1])); break; }
-                case 0x2: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X &= V%1X\n", at, code[0], code[1], LOW_NIBBLE(code[0]), HIGH_NIBBLE(code[1])); break; }
-                case 0x3: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X ^= V%1X\n", at, code[0], code[1], LOW_NIBBLE(code[0]), HIGH_NIBBLE(code[1])); break; }
-                case 0x4: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X += V%1X\n", at, code[0], code[1], LOW_NIBBLE(code[0]), HIGH_NIBBLE(code[1])); break; }
-                case 0x5: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X -= V%1X\n", at, code[0], code[1], LOW_NIBBLE(code[0]), HIGH_NIBBLE(code[1])); break; }
-                case 0x6: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X >>= 1\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-                case 0x7: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X = V%1X - V%1X\n", at, code[0], code[1], LOW_NIBBLE(code[0]), HIGH_NIBBLE(code[1]), LOW_NIBBLE(code[0])); break; }
-                case 0xE: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X <<= 1\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-            }
-            break; 
-        }
-        case 0x9: { if(LOW_NIBBLE(code[1]) == 0) { sprintf(dst, "$%04X | 0x%02X%02X -> skip if (V%1X != V%1X)\n", at, code[0], code[1], LOW_NIBBLE(code[0]), HIGH_NIBBLE(code[1])); break; } }
-        case 0xA: { sprintf(dst, "$%04X | 0x%02X%02X -> I = 0x%03X\n", at, code[0], code[1], U16(code[0], code[1]) & 0x0FFF); break; }
-        case 0xB: { sprintf(dst, "$%04X | 0x%02X%02X -> PC = V0 + 0x%03X\n", at, code[0], code[1], U16(code[0], code[1]) & 0x0FFF); break; }
-        case 0xC: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X = rand() & 0x%02X\n", at, code[0], code[1], LOW_NIBBLE(code[0]), code[1]); break; }
-        case 0xD: { sprintf(dst, "$%04X | 0x%02X%02X -> draw(V%1X, V%1X, 0x%1X)\n", at, code[0], code[1], LOW_NIBBLE(code[0]), HIGH_NIBBLE(code[1]), LOW_NIBBLE(code[1])); break; }
-        case 0xE: {
-            switch(code[1])
-            {
-                case 0x9E: { sprintf(dst, "$%04X | 0x%02X%02X -> skip if (is_key_pressed(V%1X))\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-                case 0xA1: { sprintf(dst, "$%04X | 0x%02X%02X -> skip if (!is_key_pressed(V%1X))\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-            }
-            break; 
-        }
-        case 0xF: { 
-            switch(code[1])
-            {
-                case 0x07: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X = delay_timer\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-                case 0x0A: { sprintf(dst, "$%04X | 0x%02X%02X -> V%1X = key_pressed\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-                case 0x15: { sprintf(dst, "$%04X | 0x%02X%02X -> delay_timer = V%1X\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-                case 0x18: { sprintf(dst, "$%04X | 0x%02X%02X -> sound_timer = V%1X\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-                case 0x1E: { sprintf(dst, "$%04X | 0x%02X%02X -> I += V%1X\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-                case 0x29: { sprintf(dst, "$%04X | 0x%02X%02X -> I = sprite_addr[V%1X]\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-                case 0x33: { sprintf(dst, "$%04X | 0x%02X%02X -> set_BCD(V%1X)\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-                case 0x55: { sprintf(dst, "$%04X | 0x%02X%02X -> reg_dump(V%1X, &I)\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-                case 0x65: { sprintf(dst, "$%04X | 0x%02X%02X -> reg_load(V%1X, &I)\n", at, code[0], code[1], LOW_NIBBLE(code[0])); break; }
-            }
-            break; 
+        for (int x = 0; x < VRAM_WIDTH(chip8); ++x)
+        {
+            dst[VRAM_AT(x, y)] = VRAM_COLOR(chip8, x, y);
         }
     }
 }
 
 
-static void unimplemented_instruction(uint8_t* code)
+/*
+Disassembly text by instruction kind, written out by __chip8_format without
+printf. A % takes the next character as an operand: %x and %y the register
+digits, %n the last nibble in hex, %d in decimal, %p the second nibble in
+decimal, %b nn in hex, %c nn in decimal, %s nn as a size (0 for 256), %o nn as
+a sample loop mode, %a nnn in hex and %w the word after the instruction in hex.
+*/
+static const char* disassembly_formats[CHIP8_OP_COUNT] = {
+    [CHIP8_OP_NONE] = "invalid",
+    [CHIP8_OP_INVALID] = "invalid",
+    [CHIP8_OP_CLS] = "disp_clear()",
+    [CHIP8_OP_RET] = "return",
+    [CHIP8_OP_SYS] = "call subroutine at 0x%a",
+    [CHIP8_OP_JP] = "goto $%a",
+    [CHIP8_OP_CALL] = "*(0x%a)()",
+    [CHIP8_OP_SE_VX_NN] = "skip if (V%x == 0x%b)",
+    [CHIP8_OP_SNE_VX_NN] = "skip if (V%x != 0x%b)",
+    [CHIP8_OP_SE_VX_VY] = "skip if (V%x == V%y)",
+    [CHIP8_OP_LD_VX_NN] = "V%x = 0x%b",
+    [CHIP8_OP_ADD_VX_NN] = "V%x += 0x%b",
+    [CHIP8_OP_LD_VX_VY] = "V%x = V%y",
+    [CHIP8_OP_OR] = "V%x |= V%y",
+    [CHIP8_OP_AND] = "V%x &= V%y",
+    [CHIP8_OP_XOR] = "V%x ^= V%y",
+    [CHIP8_OP_ADD_VX_VY] = "V%x += V%y",
+    [CHIP8_OP_SUB] = "V%x -= V%y",
+    [CHIP8_OP_SHR] = "V%x >>= 1",
+    [CHIP8_OP_SUBN] = "V%x = V%y - V%x",
+    [CHIP8_OP_SHL] = "V%x <<= 1",
+    [CHIP8_OP_SNE_VX_VY] = "skip if (V%x != V%y)",
+    [CHIP8_OP_LD_I] = "I = 0x%a",
+    [CHIP8_OP_JP_V0] = "PC = V0 + 0x%a",
+    [CHIP8_OP_RND] = "V%x = rand() & 0x%b",
+    [CHIP8_OP_DRW] = "draw(V%x, V%y, 0x%n)",
+    [CHIP8_OP_SKP] = "skip if (is_key_pressed(V%x))",
+    [CHIP8_OP_SKNP] = "skip if (!is_key_pressed(V%x))",
+    [CHIP8_OP_LD_VX_DT] = "V%x = delay_timer",
+    [CHIP8_OP_LD_VX_K] = "V%x = key_pressed",
+    [CHIP8_OP_LD_DT_VX] = "delay_timer = V%x",
+    [CHIP8_OP_LD_ST_VX] = "sound_timer = V%x",
+    [CHIP8_OP_ADD_I_VX] = "I += V%x",
+    [CHIP8_OP_LD_F_VX] = "I = sprite_addr[V%x]",
+    [CHIP8_OP_LD_B_VX] = "set_BCD(V%x)",
+    [CHIP8_OP_LD_MEM_VX] = "reg_dump(V%x, &I)",
+    [CHIP8_OP_LD_VX_MEM] = "reg_load(V%x, &I)",
+    [CHIP8_OP_SCD] = "scroll_down(%d)",
+    [CHIP8_OP_SCR] = "scroll_right(4)",
+    [CHIP8_OP_SCL] = "scroll_left(4)",
+    [CHIP8_OP_EXIT] = "exit()",
+    [CHIP8_OP_LOW] = "lores()",
+    [CHIP8_OP_HIGH] = "hires()",
+    [CHIP8_OP_LD_HF_VX] = "I = large_sprite_addr[V%x]",
+    [CHIP8_OP_LD_R_VX] = "flags_dump(V%x)",
+    [CHIP8_OP_LD_VX_R] = "flags_load(V%x)",
+    [CHIP8_OP_SAVE_RANGE] = "save(V%x..V%y, &I)",
+    [CHIP8_OP_LOAD_RANGE] = "load(V%x..V%y, &I)",
+    [CHIP8_OP_LD_I_LONG] = "I = 0x%w",
+    [CHIP8_OP_PLANE] = "plane(%p)",
+    [CHIP8_OP_AUDIO] = "audio_pattern(&I)",
+    [CHIP8_OP_PITCH] = "pitch = V%x",
+    [CHIP8_OP_MEGA_OFF] = "mega_off()",
+    [CHIP8_OP_MEGA_ON] = "mega_on()",
+    [CHIP8_OP_SCU] = "scroll_up(%d)",
+    [CHIP8_OP_LD_I_24] = "I = 0x%b%w",
+    [CHIP8_OP_LDPAL] = "load_palette(&I, %c)",
+    [CHIP8_OP_SPRW] = "sprite_width = %s",
+    [CHIP8_OP_SPRH] = "sprite_height = %s",
+    [CHIP8_OP_ALPHA] = "alpha = 0x%b",
+    [CHIP8_OP_DIGISND] = "play_sample(&I, %o)",
+    [CHIP8_OP_STOPSND] = "stop_sample()",
+    [CHIP8_OP_BMODE] = "blend_mode = %d",
+    [CHIP8_OP_CCOL] = "collision_color = 0x%b",
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+
+// Writes the `digits` lowest hex digits of `value`, returning the end
+static char* __chip8_put_hex(char* dst, uint32_t value, int digits)
 {
-    printf("Unimplemented instruction -> %02X%02X\n", code[0], code[1]);
-    exit(-1);
+    for (int i = digits - 1; i >= 0; --i)
+    {
+        dst[i] = hex_digits[value & 0xF];
+        value >>= 4;
+    }
+    return dst + digits;
 }
 
 
-static void __chip8_draw(Chip8* chip8, uint8_t rx, uint8_t ry, uint8_t n)
+// Writes `value` (up to 999) in decimal, returning the end
+static char* __chip8_put_decimal(char* dst, uint32_t value)
 {
-    /*
-    Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels 
-    and a height of N pixels. Each row of 8 pixels is read as bit-coded 
-    starting from memory location I; I value does not change after the 
-    execution of this instruction. As described above, VF is set to 1 if 
-    any screen pixels are flipped from set to unset when the sprite is 
-    drawn, and to 0 if that does not happen
-    */
-   chip8->v[0xF] = 0x0;
-   uint8_t x, y;
-   for (uint32_t row = 0; row < n; ++row)
-   {
-       x = chip8->v[rx];
-       y = chip8->v[ry] + row;
-       if (y >= CHIP8_DISPLAY_HEIGHT) continue;
-       uint8_t pixel_data = chip8->memory[chip8->I + row];
-       
-       for (int p_id = 0; p_id < 8; ++p_id)
-       {
-           if (x >= CHIP8_DISPLAY_WIDTH) continue;
-           uint8_t pixel = ( pixel_data >> (7-p_id) ) & 0x1;
-           if (chip8->VRAM[VRAM_AT(x, y)] && pixel)
-           {
-               chip8->v[0xF] = 0x1;
-           }
-           
-           chip8->VRAM[VRAM_AT(x, y)] = chip8->VRAM[VRAM_AT(x, y)] ^ pixel;
-           x++;
-       }
-   }
+    if (value >= 100)
+    {
+        *dst++ = (char)('0' + value / 100);
+    }
+    if (value >= 10)
+    {
+        *dst++ = (char)('0' + value / 10 % 10);
+    }
+    *dst++ = (char)('0' + value % 10);
+    return dst;
 }
 
 
-void chip8_execute(Chip8* chip8)
+// Writes the line of the instruction at `at` into `dst`, with its newline but no terminator.
+// `dst` must hold CHIP8_DISASSEMBLY_LINE_SIZE bytes. Returns the bytes written
+static size_t __chip8_format(char* dst, const uint8_t* memory, uint32_t mask, uint32_t at, Chip8Instruction ins)
 {
-    uint8_t* code = &chip8->memory[chip8->pc];
+    char* out = dst;
+    *out++ = '$';
+    out = __chip8_put_hex(out, at, at > 0xFFFF ? 6 : 4);
+    memcpy(out, " | 0x", 5);
+    out = __chip8_put_hex(out + 5, U16(memory[at & mask], memory[(at + 1) & mask]), 4);
+    memcpy(out, " -> ", 4);
+    out += 4;
 
-    switch((code[0] & 0xF0) >> 4)
+    for (const char* format = disassembly_formats[ins.op]; *format; ++format)
     {
-        case 0x0: {
-            uint16_t opcode = (code[0] << 8) | code[1];
-            if (opcode == 0x00E0) // Display clear
-            {
-                memset(chip8->VRAM, 0x0, CHIP8_VRAM_SIZE);
-                chip8->pc+=2;
-            }
-            else if (opcode == 0x00EE) // return
-            {
-                // Recover subroutine call address from the stack and set program counter to it
-                // Decrease stack pointer and increase program counter
-                chip8->sp--;
-                chip8->pc = chip8->stack[chip8->sp];
-                chip8->pc += 2;
-            }
-            else 
-            {
-                uint16_t nnn = opcode & 0x0FFF;
-                unimplemented_instruction(code);
-                chip8->pc += 2;
-            }
-            break;
-        }
-        case 0x1: {
-            uint16_t goto_address = ((code[0] & 0x0F) << 8) | code[1];
-            chip8->pc = goto_address;
-            break;
-        }
-        case 0x2: { 
-            uint16_t nnn = ((code[0] & 0x0F) << 8) | code[1];
-            // Store sburoutine call address at current stack position
-            // Increase stack pointer and set program counter to new subroutine address
-            chip8->stack[chip8->sp] = chip8->pc;
-            chip8->sp++;
-            chip8->pc = nnn;
-            break; 
-        }
-        case 0x3: { 
-            uint8_t x = code[0] & 0x0F;
-            uint8_t nn = code[1];
-            if (chip8->v[x] == nn)
-            {
-                chip8->pc += 2;
-            }
-            chip8->pc += 2;
-            break; 
+        if (*format != '%')
+        {
+            *out++ = *format;
+            continue;
         }
-        case 0x4: { 
-            uint8_t x = code[0] & 0x0F;
-            uint8_t nn = code[1];
-            if (chip8->v[x] != nn)
-            {
-                chip8->pc += 2;
+        switch(*++format)
+        {
+            case 'x': { *out++ = hex_digits[ins.x]; break; }
+            case 'y': { *out++ = hex_digits[ins.y]; break; }
+            case 'n': { *out++ = hex_digits[ins.n]; break; }
+            case 'd': { out = __chip8_put_decimal(out, ins.n); break; }
+            case 'p': { out = __chip8_put_decimal(out, ins.x); break; }
+            case 'b': { out = __chip8_put_hex(out, ins.nn, 2); break; }
+            case 'c': { out = __chip8_put_decimal(out, ins.nn); break; }
+            case 's': { out = __chip8_put_decimal(out, ins.nn ? ins.nn : 256); break; }
+            case 'o': {
+                memcpy(out, ins.n ? "once" : "loop", 4);
+                out += 4;
+                break;
             }
-            chip8->pc += 2;
-            break; 
-        }
-        case 0x5: {
-            if ((code[1] & 0x0F) == 0)
-            {
-                uint8_t x = code[0] & 0x0F;
-                uint8_t y = (code[1] & 0xF0) >> 4;
-                if (chip8->v[x] == chip8->v[y])
-                {
-                    chip8->pc += 2;
-                }
-                chip8->pc += 2;
-            }
-            break; 
-        }
-        case 0x6: { 
-            uint8_t x = code[0] & 0x0F;
-            uint8_t nn = code[1];
-            chip8->v[x] = nn;
-            chip8->pc += 2;
-            break; 
+            case 'a': { out = __chip8_put_hex(out, ins.nnn, 3); break; }
+            case 'w': { out = __chip8_put_hex(out, U16(memory[(at + 2) & mask], memory[(at + 3) & mask]), 4); break; }
         }
-        case 0x7: {
-            uint8_t x = code[0] & 0x0F;
-            uint8_t nn = code[1];
-            chip8->v[x] += nn;
-            chip8->pc += 2;
-            break;
-        }
-        case 0x8: {
-            uint8_t x = code[0] & 0x0F;
-            uint8_t y = (code[1] & 0xF0) >> 4;
-            switch(code[1] & 0x0F)
-            {
-                case 0x0: {
-                    chip8->v[x] = chip8->v[y];
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x1: {
-                    chip8->v[x] |= chip8->v[y];
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x2: {
-                    chip8->v[x] &= chip8->v[y];
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x3: {
-                    chip8->v[x] ^= chip8->v[y];
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x4: {
-                    uint16_t result = chip8->v[x] + chip8->v[y];
-                    chip8->v[x] = result & 0xFF;
-                    chip8->v[0xF] = (result > 0xFF) ? 0x1 : 0x0;
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x5: {
-                    uint16_t result = chip8->v[x] - chip8->v[y];
-                    chip8->v[0xF] = (chip8->v[x] < chip8->v[y]) ? 0x0 : 0x1;
-                    chip8->v[x] = result & 0xFF;
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x6: {
-                    chip8->v[0xF] = chip8->v[x] & 0x01;
-                    chip8->v[x] = chip8->v[x] >> 1;
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x7: {
-                    uint16_t result = chip8->v[y] - chip8->v[x];
-                    chip8->v[0xF] = (chip8->v[x] > chip8->v[y]) ? 0x0 : 0x1;
-                    chip8->v[x] = result & 0xFF;
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0xE: {
-                    chip8->v[0xF] = (chip8->v[x] >> 7) & 0x1;
-                    chip8->v[x] = chip8->v[x] << 1;
-                    chip8->pc += 2;
-                    break;
-                }
-            }
-            break; 
-        }
-        case 0x9: { 
-            if ((code[1] & 0x0F) == 0)
-            {
-                uint8_t x = code[0] & 0x0F;
-                uint8_t y = (code[1] & 0xF0) >> 4;
-                if (chip8->v[x] != chip8->v[y])
-                {
-                    chip8->pc += 2;
-                }
-                chip8->pc += 2;
-            }
-            break; 
-        }
-        case 0xA: { 
-            uint16_t nnn = ((code[0] & 0x0F) << 8) | code[1];
-            chip8->I = nnn;
-            chip8->pc += 2;
-            break; 
-        }
-        case 0xB: { 
-            uint16_t nnn = ((code[0] & 0x0F) << 8) | code[1];
-            chip8->pc = nnn + chip8->v[0];
-            break; 
-        }
-        case 0xC: { 
-            uint8_t x = code[0] & 0x0F;
-            uint8_t nn = code[1];
-            chip8->v[x] = rand() % (nn + 1);
-            chip8->pc += 2;
-            break; 
-        }
-        case 0xD: { 
-            uint8_t x = code[0] & 0x0F;
-            uint8_t y = (code[1] & 0xF0) >> 4;
-            uint8_t n = code[1] & 0x0F;
-            __chip8_draw(chip8, x, y, n);
-            chip8->pc += 2;
-            break; 
-        }
-        case 0xE: { 
-            uint8_t x = code[0] & 0x0F;
-            if (code[1] == 0x9E)
-            {
-                if (chip8->keyboard[chip8->v[x]] == 1)
-                {
-                    chip8->pc += 2;
-                }
-                chip8->pc += 2;
-            }
-            else if (code[1] == 0xA1)
-            {
-                if (chip8->keyboard[chip8->v[x]] == 0)
-                {
-                    chip8->pc += 2;
-                }
-                chip8->pc += 2; 
-            }
-            break; 
+    }
+    *out++ = '\n';
+    return (size_t)(out - dst);
+}
+
+
+size_t chip8_disassemble_at(const Chip8* chip8, uint16_t at, char* dst)
+{
+    // Bytes past the end wrap around, as the interpreter fetches them
+    const uint8_t* memory = CHIP8_MEMORY(chip8);
+    const uint32_t mask = CHIP8_MEMORY_BYTES(chip8) - 1;
+    size_t length = __chip8_format(dst, memory, mask, at, chip8_decode_at(chip8, at, NULL));
+    dst[length] = '\0';
+    return length;
+}
+
+
+size_t chip8_disassemble_range(const Chip8* chip8, uint32_t begin, uint32_t end, char* dst, size_t size, uint32_t* next)
+{
+    const uint8_t* memory = CHIP8_MEMORY(chip8);
+    const uint32_t mask = CHIP8_MEMORY_BYTES(chip8) - 1;
+    // Kind followed by an address word in this mode, as chip8_decode_at has it
+    const uint8_t word_op = chip8->xo ? CHIP8_OP_LD_I_LONG : chip8->mega ? CHIP8_OP_LD_I_24 : CHIP8_OP_COUNT;
+    char line[CHIP8_DISASSEMBLY_LINE_SIZE];
+    size_t written = 0;
+    uint32_t at = begin;
+
+    while (at < end && size > 0)
+    {
+        Chip8Instruction ins = chip8_decode(memory[at & mask], memory[(at + 1) & mask]);
+        const uint32_t length = (ins.op == word_op) ? 4 : 2;
+        if (size - written > CHIP8_DISASSEMBLY_LINE_SIZE)
+        {
+            // Room for the longest line, formatted in place
+            written += __chip8_format(dst + written, memory, mask, at, ins);
         }
-        case 0xF: { 
-            uint8_t x = code[0] & 0x0F;
-            switch(code[1])
+        else
+        {
+            size_t bytes = __chip8_format(line, memory, mask, at, ins);
+            if (bytes >= size - written)
             {
-                case 0x07: {
-                    chip8->v[x] = chip8->delay_timer;
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x0A: {
-                    static int awaiting_key = 0;
-                    static int saved_keyboard[CHIP8_KEYBOARD_SIZE] = {0};
-
-                    if (!awaiting_key)
-                    {
-                        awaiting_key = 1;
-                        memcpy(&saved_keyboard, &chip8->keyboard, CHIP8_KEYBOARD_SIZE);
-                    }
-                    else
-                    {
-                        // Compare key by key, and check if one has changed from 0 to 1
-                        int key_changed = -1;
-                        for (int key = 0; key < CHIP8_KEYBOARD_SIZE; ++key)
-                        {
-                            if(!saved_keyboard[key] && chip8->keyboard[key])
-                            {
-                                key_changed = key;
-                                break;
-                            }
-                        }
-                        if (key_changed > -1)
-                        {
-                            awaiting_key = 0;
-                            chip8->v[x] = key_changed & 0xFF;
-                            chip8->pc += 2;
-                        }
-                    }
-                    
-                    break;
-                }
-                case 0x15: {
-                    chip8->delay_timer = chip8->v[x];
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x18: {
-                    chip8->sound_timer = chip8->v[x];
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x1E: {
-                    chip8->I += chip8->v[x];
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x29: {
-                    // NOTE[JCH]: Font data stored at 0x0 in memory, each sprite 5 bytes
-                    chip8->I = 5*chip8->v[x];
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x33: {
-                    /*
-                    Stores the binary-coded decimal representation of VX, with 
-                    the most significant of three digits at the address in I,
-                     the middle digit at I plus 1, and the least significant digit 
-                     at I plus 2. (In other words, take the decimal representation 
-                     of VX, place the hundreds digit in memory at location in I, 
-                     the tens digit at location I+1, and the ones digit at location I+2.); 
-                    */
-                   
-                    uint8_t temp = chip8->v[x];
-                    uint8_t hundreds = temp / 100;
-                    temp -= hundreds*100;
-                    uint8_t tens = temp / 10;
-                    temp -= tens*10;
-
-                    chip8->memory[chip8->I] = hundreds;
-                    chip8->memory[chip8->I + 1] = tens;
-                    chip8->memory[chip8->I + 2] = temp;
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x55: { // Dump
-                    memcpy(&chip8->memory[chip8->I], &chip8->v, x+1);
-                    chip8->pc += 2;
-                    break;
-                }
-                case 0x65: { // Load
-                    memcpy(&chip8->v, &chip8->memory[chip8->I], x+1);
-                    chip8->pc += 2;
-                    break;
-                }
+                break;
             }
-            break; 
-        }
-        default: {
-            unimplemented_instruction(code);
+            memcpy(dst + written, line, bytes);
+            written += bytes;
         }
+        at += length;
     }
+
+    if (size > 0)
+    {
+        dst[written] = '\0';
+    }
+    if (next)
+    {
+        *next = at;
+    }
+    return written;
+}
+
+
+const char* chip8_op_name(Chip8Op op)
+{
+    static const char* names[CHIP8_OP_COUNT] = {
+        [CHIP8_OP_NONE] = "-",
+        [CHIP8_OP_INVALID] = "INVALID",
+        [CHIP8_OP_CLS] = "CLS",
+        [CHIP8_OP_RET] = "RET",
+        [CHIP8_OP_SYS] = "SYS",
+        [CHIP8_OP_JP] = "JP",
+        [CHIP8_OP_CALL] = "CALL",
+        [CHIP8_OP_SE_VX_NN] = "SE Vx, nn",
+        [CHIP8_OP_SNE_VX_NN] = "SNE Vx, nn",
+        [CHIP8_OP_SE_VX_VY] = "SE Vx, Vy",
+        [CHIP8_OP_LD_VX_NN] = "LD Vx, nn",
+        [CHIP8_OP_ADD_VX_NN] = "ADD Vx, nn",
+        [CHIP8_OP_LD_VX_VY] = "LD Vx, Vy",
+        [CHIP8_OP_OR] = "OR",
+        [CHIP8_OP_AND] = "AND",
+        [CHIP8_OP_XOR] = "XOR",
+        [CHIP8_OP_ADD_VX_VY] = "ADD Vx, Vy",
+        [CHIP8_OP_SUB] = "SUB",
+        [CHIP8_OP_SHR] = "SHR",
+        [CHIP8_OP_SUBN] = "SUBN",
+        [CHIP8_OP_SHL] = "SHL",
+        [CHIP8_OP_SNE_VX_VY] = "SNE Vx, Vy",
+        [CHIP8_OP_LD_I] = "LD I, nnn",
+        [CHIP8_OP_JP_V0] = "JP V0, nnn",
+        [CHIP8_OP_RND] = "RND",
+        [CHIP8_OP_DRW] = "DRW",
+        [CHIP8_OP_SKP] = "SKP",
+        [CHIP8_OP_SKNP] = "SKNP",
+        [CHIP8_OP_LD_VX_DT] = "LD Vx, DT",
+        [CHIP8_OP_LD_VX_K] = "LD Vx, K",
+        [CHIP8_OP_LD_DT_VX] = "LD DT, Vx",
+        [CHIP8_OP_LD_ST_VX] = "LD ST, Vx",
+        [CHIP8_OP_ADD_I_VX] = "ADD I, Vx",
+        [CHIP8_OP_LD_F_VX] = "LD F, Vx",
+        [CHIP8_OP_LD_B_VX] = "LD B, Vx",
+        [CHIP8_OP_LD_MEM_VX] = "LD [I], Vx",
+        [CHIP8_OP_LD_VX_MEM] = "LD Vx, [I]",
+        [CHIP8_OP_SCD] = "SCD",
+        [CHIP8_OP_SCR] = "SCR",
+        [CHIP8_OP_SCL] = "SCL",
+        [CHIP8_OP_EXIT] = "EXIT",
+        [CHIP8_OP_LOW] = "LOW",
+        [CHIP8_OP_HIGH] = "HIGH",
+        [CHIP8_OP_LD_HF_VX] = "LD HF, Vx",
+        [CHIP8_OP_LD_R_VX] = "LD R, Vx",
+        [CHIP8_OP_LD_VX_R] = "LD Vx, R",
+        [CHIP8_OP_SAVE_RANGE] = "SAVE Vx-Vy",
+        [CHIP8_OP_LOAD_RANGE] = "LOAD Vx-Vy",
+        [CHIP8_OP_LD_I_LONG] = "LD I, nnnn",
+        [CHIP8_OP_PLANE] = "PLANE",
+        [CHIP8_OP_AUDIO] = "AUDIO",
+        [CHIP8_OP_PITCH] = "PITCH",
+        [CHIP8_OP_MEGA_OFF] = "MEGAOFF",
+        [CHIP8_OP_MEGA_ON] = "MEGAON",
+        [CHIP8_OP_SCU] = "SCU",
+        [CHIP8_OP_LD_I_24] = "LD I, nnnnnn",
+        [CHIP8_OP_LDPAL] = "LDPAL",
+        [CHIP8_OP_SPRW] = "SPRW",
+        [CHIP8_OP_SPRH] = "SPRH",
+        [CHIP8_OP_ALPHA] = "ALPHA",
+        [CHIP8_OP_DIGISND] = "DIGISND",
+        [CHIP8_OP_STOPSND] = "STOPSND",
+        [CHIP8_OP_BMODE] = "BMODE",
+        [CHIP8_OP_CCOL] = "CCOL",
+    };
+    return (op >= 0 && op < CHIP8_OP_COUNT) ? names[op] : "?";
+}
+
+
+Chip8StopReason chip8_execute(Chip8* chip8)
+{
+    return chip8_run(chip8, 1, NULL);
 }
\ No newline at end of file
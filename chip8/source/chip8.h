@@ -1,3 +1,6 @@
+#pragma once
+
+#include <stddef.h>
 #include <stdint.h>
 
 #define CHIP8_NUM_REGISTERS 0x10
@@ -5,13 +8,82 @@
 #define CHIP8_PROGRAM_START_LOCATION 0x0200
 #define CHIP8_DISPLAY_WIDTH 64
 #define CHIP8_DISPLAY_HEIGHT 32
-#define CHIP8_VRAM_SIZE CHIP8_DISPLAY_WIDTH*CHIP8_DISPLAY_HEIGHT
+#define CHIP8_HIRES_WIDTH 128 // SUPER-CHIP high resolution mode (00FF)
+#define CHIP8_HIRES_HEIGHT 64
+#define CHIP8_VRAM_SIZE CHIP8_HIRES_WIDTH*CHIP8_HIRES_HEIGHT // In pixels, enough for either mode
+#define CHIP8_VRAM_WORDS 2 // 64-bit words per VRAM row
+#define CHIP8_NUM_FLAGS 0x10 // SUPER-CHIP user flags
+#define CHIP8_HIRES_FONT_LOCATION 0x50 // 8x10 digits for Fx30, after the 8x5 ones at 0x0
+#define CHIP8_XO_MEMORY_SIZE 0x10000 // XO-CHIP address space
+#define CHIP8_XO_PLANES 2 // XO-CHIP display planes, see Fn01
+#define CHIP8_XO_PATTERN_SIZE 16 // XO-CHIP audio pattern bytes, see F002
+#define CHIP8_MEGA_MEMORY_SIZE 0x1000000 // MEGA-CHIP address space, I is 24 bits
+#define CHIP8_MEGA_WIDTH 256 // MEGA-CHIP display, one ARGB color per pixel
+#define CHIP8_MEGA_HEIGHT 192
+#define CHIP8_MEGA_COLORS 256 // MEGA-CHIP palette entries, 0 is transparent
 #define CHIP8_STACK_SIZE 16
 #define CHIP8_KEYBOARD_SIZE 16
 #define CHIP8_DELAY_TIMER_FREQ 60
+#define CHIP8_DISASSEMBLY_LINE_SIZE 64 // Longest line of chip8_disassemble_at, with its newline and terminator
+
+
+// Index of pixel (x, y) in a byte-per-pixel buffer, see chip8_vram_unpack
+#define VRAM_AT(x, y) ((x) + (y) * CHIP8_HIRES_WIDTH)
+// Bit of key k in Chip8::keys
+#define CHIP8_KEY(k) ( (uint16_t)(1u << (k)) )
+// Pixel (x, y) of the packed VRAM, either 0x0 or 0x1
+#define VRAM_PIXEL(chip8, x, y) ( ((chip8)->VRAM[(y)][(x) >> 6] >> (63 - ((x) & 63))) & 0x1 )
+// Pixel (x, y) across the display planes: VRAM_PIXEL, plus 0x2 when set in the second XO-CHIP plane
+#define VRAM_COLOR(chip8, x, y) ( VRAM_PIXEL(chip8, x, y) | ((chip8)->xo ? (((chip8)->xo->VRAM[(y)][(x) >> 6] >> (63 - ((x) & 63))) & 0x1) << 1 : 0) )
+// Display size in the current mode
+#define VRAM_WIDTH(chip8) ( (chip8)->hires ? CHIP8_HIRES_WIDTH : CHIP8_DISPLAY_WIDTH )
+#define VRAM_HEIGHT(chip8) ( (chip8)->hires ? CHIP8_HIRES_HEIGHT : CHIP8_DISPLAY_HEIGHT )
+// Program memory of the machine and its size: Chip8Xo::memory in XO-CHIP, Chip8Mega::memory
+// in MEGA-CHIP, Chip8::memory otherwise
+#define CHIP8_MEMORY(chip8) ( (chip8)->xo ? (chip8)->xo->memory : (chip8)->mega ? (chip8)->mega->memory : (chip8)->memory )
+#define CHIP8_MEMORY_BYTES(chip8) ( (chip8)->xo ? CHIP8_XO_MEMORY_SIZE : (chip8)->mega ? CHIP8_MEGA_MEMORY_SIZE : CHIP8_MEMORY_SIZE )
+
 
+// XO-CHIP state, only allocated for machines in that mode (see chip8_set_quirks), so
+// the others keep their 4 KB inline
+typedef struct _Chip8Xo {
+    uint8_t memory[CHIP8_XO_MEMORY_SIZE]; // Program memory, used instead of Chip8::memory. Addresses are 16 bits, I is not wrapped
+    uint64_t VRAM[CHIP8_HIRES_HEIGHT][CHIP8_VRAM_WORDS]; // Second display plane, laid out as Chip8::VRAM (the first one)
+    uint8_t planes; // Planes drawn, cleared and scrolled (Fn01): bit 0 for Chip8::VRAM, bit 1 for the one above
+    uint8_t pattern[CHIP8_XO_PATTERN_SIZE]; // Audio pattern (F002): 128 one-bit samples, most significant first, looped while the sound timer runs
+    uint8_t pitch; // Audio pitch (Fx3A): the pattern plays at 4000 * 2^((pitch - 64) / 48) samples per second
+} Chip8Xo;
 
-#define VRAM_AT(x, y) ((x) + (y) * CHIP8_DISPLAY_WIDTH)
+// MEGA-CHIP blend modes (080n): how sprite colors combine with the display, see chip8_mega.c
+typedef enum _Chip8MegaBlend {
+    CHIP8_MEGA_BLEND_NORMAL = 0, // Sprite colors over the display
+    CHIP8_MEGA_BLEND_25, // Same, at 25% opacity
+    CHIP8_MEGA_BLEND_50,
+    CHIP8_MEGA_BLEND_75,
+    CHIP8_MEGA_BLEND_ADD, // Sprite colors added to the display
+    CHIP8_MEGA_BLEND_MULTIPLY, // Display multiplied by the sprite colors
+} Chip8MegaBlend;
+
+// MEGA-CHIP state, only allocated for machines in that mode (see chip8_set_quirks).
+// Until 0011 turns the mode on, such machines run as SUPER-CHIP ones on Chip8::VRAM
+typedef struct _Chip8Mega {
+    uint8_t memory[CHIP8_MEGA_MEMORY_SIZE]; // Program memory, used instead of Chip8::memory. The program counter stays within the first 64 KB
+    uint32_t screen[CHIP8_MEGA_HEIGHT][CHIP8_MEGA_WIDTH]; // ARGB per pixel, sprites blended in. 0 (transparent) where nothing was drawn
+    uint8_t indices[CHIP8_MEGA_HEIGHT][CHIP8_MEGA_WIDTH]; // Palette index last drawn per pixel (0 where none was), for the 09nn collision test
+    uint32_t palette[CHIP8_MEGA_COLORS]; // ARGB, loaded by 02nn from index 1 on
+    uint8_t on; // 0011 (1) or 0010 (0)
+    uint8_t I_high; // Bits 16 to 23 of I, the rest are Chip8::I
+    uint16_t sprite_width; // 03nn, 1 to 256
+    uint16_t sprite_height; // 04nn, 1 to 256
+    uint8_t alpha; // 05nn, opacity of the sprites drawn, 255 for opaque
+    uint8_t blend; // 080n, Chip8MegaBlend
+    uint8_t collision; // 09nn, palette index a sprite pixel must land on to set VF
+    uint8_t sound_loop; // 060n with n = 0
+    uint8_t sound_playing; // 060n until 0700
+    uint16_t sound_rate; // 060n, samples per second, from the sample header
+    uint32_t sound_address; // 060n, first 8-bit sample
+    uint32_t sound_length; // 060n, in samples
+} Chip8Mega;
 
 
 typedef struct _Chip8 {
@@ -19,34 +91,319 @@ typedef struct _Chip8 {
     uint16_t I; // Address register
     uint16_t pc; // Program counter
     uint8_t memory[CHIP8_MEMORY_SIZE]; // Program memory
-    uint8_t VRAM[CHIP8_VRAM_SIZE]; // Video buffer
-    uint16_t rom_size;
+    uint64_t VRAM[CHIP8_HIRES_HEIGHT][CHIP8_VRAM_WORDS]; // Video buffer, one bit per pixel. Left-most pixel of a row is the most significant bit of its first word.
+                                                         // In low resolution only the first word of the first CHIP8_DISPLAY_HEIGHT rows is used, the rest stays 0
+    uint32_t rom_size;
     uint16_t sp; // Stack pointer
     uint16_t stack[CHIP8_STACK_SIZE];
     uint8_t delay_timer;
     uint8_t sound_timer;
-    int keyboard[CHIP8_KEYBOARD_SIZE]; // Pressed state
+    uint16_t keys; // Pressed state, bit k set while key k is held
+    uint8_t key_wait; // 1 while Fx0A waits for a key press
+    uint16_t key_wait_keys; // While waiting, keys held since the wait started. Only keys outside it count as a press
+    uint32_t rng; // Cxnn random generator state (xorshift32), never 0. See chip8_seed
+    uint32_t timer_cycles; // Cycles since the timers last ticked
+    uint64_t cycles; // Cycles performed since init
+    uint16_t dirty_pages; // Bit p set when 256-byte memory page p was written since the last snapshot. See chip8_snapshot.h
+    uint32_t snapshot_generation; // Chip8Snapshot::generation of that snapshot, 0 when there is none
+    uint32_t snapshot_generations; // Highest generation given to or loaded from a snapshot
+    uint64_t idle_cycles; // Cycles of `cycles` fast-forwarded through idle loops (CHIP8_RUN_SKIP_IDLE)
+    uint8_t quirks; // Chip8Quirks, see chip8_set_quirks
+    uint8_t hires; // 1 in SUPER-CHIP high resolution mode, CHIP8_HIRES_WIDTH by CHIP8_HIRES_HEIGHT pixels
+    uint8_t flags[CHIP8_NUM_FLAGS]; // SUPER-CHIP user flags (the HP-48 RPL registers), see Fx75/Fx85
+    Chip8Xo* xo; // Owned, only in CHIP8_QUIRKS_XOCHIP and NULL otherwise. Such machines cannot be copied bytewise
+    Chip8Mega* mega; // Same, in CHIP8_QUIRKS_MEGACHIP
 } Chip8;
 
 
+/*
+Behaviors of the instructions that CHIP-8 interpreters disagree on, as a
+profile per machine. ROMs written for one of them may misbehave on another.
+
+                      DEFAULT     VIP         CHIP48      SCHIP       XOCHIP      MEGACHIP
+    8xy6/8xyE shift   Vx          Vy into Vx  Vx          Vx          Vy into Vx  Vx
+    Fx55/Fx65 I       unchanged   I + x + 1   I + x       unchanged   I + x + 1   unchanged
+    Bnnn adds         V0          V0          Vx (Bxnn)   Vx (Bxnn)   V0          Vx (Bxnn)
+    8xy1/2/3 VF       unchanged   cleared     unchanged   unchanged   unchanged   unchanged
+    8xy5/6/7/E VF     before Vx   after Vx    after Vx    after Vx    after Vx    after Vx
+    Dxyn off screen   not drawn   wraps       wraps       wraps       wraps       wraps
+    Dxyn past edges   clipped     clipped     clipped     clipped     wrap        clipped
+
+The first Dxyn row is whether a position outside the display wraps into it
+first, the second whether the pixels of a sprite running past the right or
+bottom edge are dropped or drawn from the other edge. Where VF is written
+only matters when x is F.
+
+XO-CHIP is also a mode of its own: 64 KB of memory, two display planes and
+the XO-CHIP instructions (5xy2, 5xy3, F000 nnnn, Fn01, F002, Fx3A), which
+fault in every other profile. Skips step over F000 nnnn whole.
+
+MEGA-CHIP is another: 16 MB of memory and, once 0011 turned it on, a
+256x192 ARGB display drawn with palette sprites of any size (03nn, 04nn),
+one byte per pixel, blended in by alpha (05nn) and blend mode (080n). Its instructions (0010, 0011, 00Bn, 01nn nnnn and
+02nn to 09nn) fault in every other profile. Skips step over 01nn nnnn whole.
+*/
+typedef enum _Chip8Quirks {
+    CHIP8_QUIRKS_DEFAULT = 0, // This emulator's historical behavior
+    CHIP8_QUIRKS_VIP, // COSMAC VIP, the original interpreter
+    CHIP8_QUIRKS_CHIP48, // CHIP-48 on HP-48 calculators
+    CHIP8_QUIRKS_SCHIP, // SUPER-CHIP 1.1
+    CHIP8_QUIRKS_XOCHIP, // XO-CHIP, as in Octo
+    CHIP8_QUIRKS_MEGACHIP, // MEGA-CHIP 8
+    CHIP8_QUIRKS_COUNT
+} Chip8Quirks;
+
+
+// Kinds of instructions, as produced by the decoder
+typedef enum _Chip8Op {
+    CHIP8_OP_NONE = 0, // Not decoded yet
+    CHIP8_OP_INVALID, // Unknown or unimplemented instruction
+    CHIP8_OP_CLS, // 00E0
+    CHIP8_OP_RET, // 00EE
+    CHIP8_OP_SYS, // 0nnn
+    CHIP8_OP_JP, // 1nnn
+    CHIP8_OP_CALL, // 2nnn
+    CHIP8_OP_SE_VX_NN, // 3xnn
+    CHIP8_OP_SNE_VX_NN, // 4xnn
+    CHIP8_OP_SE_VX_VY, // 5xy0
+    CHIP8_OP_LD_VX_NN, // 6xnn
+    CHIP8_OP_ADD_VX_NN, // 7xnn
+    CHIP8_OP_LD_VX_VY, // 8xy0
+    CHIP8_OP_OR, // 8xy1
+    CHIP8_OP_AND, // 8xy2
+    CHIP8_OP_XOR, // 8xy3
+    CHIP8_OP_ADD_VX_VY, // 8xy4
+    CHIP8_OP_SUB, // 8xy5
+    CHIP8_OP_SHR, // 8xy6
+    CHIP8_OP_SUBN, // 8xy7
+    CHIP8_OP_SHL, // 8xyE
+    CHIP8_OP_SNE_VX_VY, // 9xy0
+    CHIP8_OP_LD_I, // Annn
+    CHIP8_OP_JP_V0, // Bnnn
+    CHIP8_OP_RND, // Cxnn
+    CHIP8_OP_DRW, // Dxyn
+    CHIP8_OP_SKP, // Ex9E
+    CHIP8_OP_SKNP, // ExA1
+    CHIP8_OP_LD_VX_DT, // Fx07
+    CHIP8_OP_LD_VX_K, // Fx0A
+    CHIP8_OP_LD_DT_VX, // Fx15
+    CHIP8_OP_LD_ST_VX, // Fx18
+    CHIP8_OP_ADD_I_VX, // Fx1E
+    CHIP8_OP_LD_F_VX, // Fx29
+    CHIP8_OP_LD_B_VX, // Fx33
+    CHIP8_OP_LD_MEM_VX, // Fx55
+    CHIP8_OP_LD_VX_MEM, // Fx65
+    // SUPER-CHIP
+    CHIP8_OP_SCD, // 00Cn, scroll down n rows
+    CHIP8_OP_SCR, // 00FB, scroll right 4 pixels
+    CHIP8_OP_SCL, // 00FC, scroll left 4 pixels
+    CHIP8_OP_EXIT, // 00FD, halts: the program counter stays on it
+    CHIP8_OP_LOW, // 00FE, low resolution
+    CHIP8_OP_HIGH, // 00FF, high resolution
+    CHIP8_OP_LD_HF_VX, // Fx30, large digit
+    CHIP8_OP_LD_R_VX, // Fx75, store to flags
+    CHIP8_OP_LD_VX_R, // Fx85, load from flags
+    // XO-CHIP
+    CHIP8_OP_SAVE_RANGE, // 5xy2, stores Vx to Vy (either way round) at I
+    CHIP8_OP_LOAD_RANGE, // 5xy3, loads Vx to Vy (either way round) from I
+    CHIP8_OP_LD_I_LONG, // F000 nnnn, I = the 16-bit word after it
+    CHIP8_OP_PLANE, // Fn01, selects the display planes in n
+    CHIP8_OP_AUDIO, // F002, loads the audio pattern from I
+    CHIP8_OP_PITCH, // Fx3A, sets the audio pitch
+    // MEGA-CHIP
+    CHIP8_OP_MEGA_OFF, // 0010, back to the SUPER-CHIP display
+    CHIP8_OP_MEGA_ON, // 0011, 256x192 palette display
+    CHIP8_OP_SCU, // 00Bn, scroll up n rows
+    CHIP8_OP_LD_I_24, // 01nn nnnn, I = nn followed by the 16-bit word after it
+    CHIP8_OP_LDPAL, // 02nn, loads nn ARGB colors from I into the palette
+    CHIP8_OP_SPRW, // 03nn, sprite width (0 for 256)
+    CHIP8_OP_SPRH, // 04nn, sprite height (0 for 256)
+    CHIP8_OP_ALPHA, // 05nn, screen alpha
+    CHIP8_OP_DIGISND, // 060n, plays the sample at I, looping when n is 0
+    CHIP8_OP_STOPSND, // 0700, stops the sample
+    CHIP8_OP_BMODE, // 080n, blend mode
+    CHIP8_OP_CCOL, // 09nn, collision color
+    CHIP8_OP_COUNT
+} Chip8Op;
+
+// An instruction split into its operands. Fields not used by `op` are still filled in
+typedef struct _Chip8Instruction {
+    uint8_t op; // Chip8Op
+    uint8_t x; // Second nibble
+    uint8_t y; // Third nibble
+    uint8_t n; // Fourth nibble
+    uint8_t nn; // Low byte
+    uint8_t reserved;
+    uint16_t nnn; // Low 12 bits
+} Chip8Instruction;
+
+// Predecoded instructions of a Chip8 memory, keyed by address
+typedef struct _Chip8DecodeCache Chip8DecodeCache;
+
+// Instructions and pixels by emulated subroutine, see chip8_callgraph.h
+typedef struct _Chip8CallGraph Chip8CallGraph;
+
+// Why chip8_run returned
+typedef enum _Chip8StopReason {
+    CHIP8_STOP_BUDGET = 0, // Every requested cycle was performed
+    CHIP8_STOP_KEY_WAIT, // Waiting for a key press (Fx0A). The rest of the budget was spent waiting
+    CHIP8_STOP_BREAKPOINT, // Program counter reached a breakpoint, its instruction was not performed
+    CHIP8_STOP_FAULT, // Invalid instruction or stack over/underflow, program counter left on it
+    CHIP8_STOP_DRAW, // Display was drawn to (only with CHIP8_RUN_STOP_ON_DRAW)
+} Chip8StopReason;
+
+// Result of loading a ROM. Errors are negative, so `!= 0` checks keep working
+typedef enum _Chip8LoadResult {
+    CHIP8_LOAD_OK = 0,
+    CHIP8_LOAD_ERROR_OPEN = -1, // File could not be opened or mapped
+    CHIP8_LOAD_ERROR_READ = -2, // File could not be read
+    CHIP8_LOAD_ERROR_EMPTY = -3, // ROM has no bytes
+    CHIP8_LOAD_ERROR_TOO_LARGE = -4, // ROM does not fit between CHIP8_PROGRAM_START_LOCATION and the end of memory
+} Chip8LoadResult;
+
+// Largest ROM that fits in memory, in bytes, and in XO-CHIP and MEGA-CHIP memory
+#define CHIP8_ROM_MAX_SIZE (CHIP8_MEMORY_SIZE - CHIP8_PROGRAM_START_LOCATION)
+#define CHIP8_XO_ROM_MAX_SIZE (CHIP8_XO_MEMORY_SIZE - CHIP8_PROGRAM_START_LOCATION)
+#define CHIP8_MEGA_ROM_MAX_SIZE (CHIP8_MEGA_MEMORY_SIZE - CHIP8_PROGRAM_START_LOCATION)
+
+// chip8_run flags
+#define CHIP8_RUN_STOP_ON_DRAW 0x1 // Return after 00E0, Dxyn and the SUPER-CHIP scrolls and mode changes
+#define CHIP8_RUN_SKIP_IDLE 0x2 // Fast-forward idle loops, see chip8_run
+#define CHIP8_RUN_FUSE 0x4 // Run common instruction sequences as single handlers (needs a cache), see chip8_run
+
+/*
+Execution counters, filled in by chip8_run when the library is built with
+CHIP8_PROFILE defined (CMake option CHIP8_PROFILE). Without it the counting
+code is not compiled in at all, and Chip8RunConfig::profile is ignored.
+
+Each instruction counts once per execution: by kind, by the path it took
+through its handler, by the address it was fetched from, and by the quirk
+profile running it. Paths are CHIP8_PATH_* below, and what each one means
+depends on the instruction (chip8_profile_path_name); instructions with a
+single path only count path 0. What the quirk profile changes in a handler
+(chip8_quirks_behavior) is the same on every path, so it is not a path of
+its own.
+*/
+#define CHIP8_PROFILE_PATHS 4
+
+#define CHIP8_PATH_PLAIN 0 // The only path of most instructions, and the one not skipping, setting VF or clipping
+#define CHIP8_PATH_SKIPPED 1 // 3xnn, 4xnn, 5xy0, 9xy0, Ex9E and ExA1 skipped the next instruction
+#define CHIP8_PATH_FLAG_SET 1 // 8xy4 carried, 8xy5 and 8xy7 did not borrow, 8xy6 and 8xyE shifted a 1 out
+#define CHIP8_PATH_COLLIDED 1 // Dxyn turned a pixel off, may be ORed with CHIP8_PATH_CLIPPED
+#define CHIP8_PATH_CLIPPED 2 // Dxyn sprite cut at the right or bottom edge, may be ORed with CHIP8_PATH_COLLIDED
+#define CHIP8_PATH_KEY_WAITING 1 // Fx0A still waiting, path 0 being the wait starting
+#define CHIP8_PATH_KEY_PRESSED 2 // Fx0A got its key
+
+typedef struct _Chip8Profile {
+    uint64_t ops[CHIP8_OP_COUNT]; // Executions, by Chip8Op
+    uint64_t paths[CHIP8_OP_COUNT][CHIP8_PROFILE_PATHS]; // Executions, by Chip8Op and path
+    uint64_t pcs[CHIP8_MEMORY_SIZE]; // Executions, by address (wrapped into CHIP8_MEMORY_SIZE in XO-CHIP)
+    uint64_t quirks[CHIP8_QUIRKS_COUNT]; // Executions, by the Chip8Quirks of the machine running them
+} Chip8Profile;
+
+typedef struct _Chip8RunConfig {
+    uint32_t cycles_per_timer_tick; // Cycles per 60 Hz delay/sound timer tick, 0 leaves the timers alone
+    uint32_t flags; // CHIP8_RUN_* flags
+    const uint8_t* breakpoints; // Optional, one bit per memory address (CHIP8_MEMORY_SIZE / 8 bytes). XO-CHIP addresses past them never break
+    Chip8DecodeCache* cache; // Optional, decodes each address only once
+    Chip8Profile* profile; // Optional, counts executions (CHIP8_PROFILE builds only)
+    Chip8CallGraph* callgraph; // Optional, counts by subroutine (CHIP8_PROFILE builds only)
+} Chip8RunConfig;
+
+
 // Returns a new Chip8 object
 Chip8* chip8_new();
-// Deletes existing Chip8 object
+// Deletes existing Chip8 object, and its XO-CHIP or MEGA-CHIP state if any
 void chip8_delete(Chip8* ch8);
 
-// Initializes the whole Chip8 object
+// Initializes the whole Chip8 object, in CHIP8_QUIRKS_DEFAULT. Every field is written and
+// none is read, so `chip8` may be uninitialized memory. Its XO-CHIP or MEGA-CHIP state is
+// not freed: leave those modes first (chip8_set_quirks with another profile), or it leaks.
+// The random generator starts from seed 0
 void chip8_init(Chip8* chip8);
 
-// Load given ROM from given path into the Chip8 memory
-// Returns 0 if OK, otherwise -1
-int chip8_load_rom(Chip8* chip8, const char* rom_path);
+// Seeds the Cxnn random generator. Same seed and inputs give the same run
+void chip8_seed(Chip8* chip8, uint32_t seed);
+
+// Selects the instruction behaviors of `chip8`, CHIP8_QUIRKS_DEFAULT after chip8_init.
+// Each profile has its own interpreter loop, so this costs nothing per instruction.
+// Entering CHIP8_QUIRKS_XOCHIP (CHIP8_QUIRKS_MEGACHIP) allocates Chip8::xo (Chip8::mega),
+// starting its memory as a copy of the first CHIP8_MEMORY_SIZE bytes of the current one;
+// leaving it copies them back into Chip8::memory and frees it.
+// Returns 0 if OK, otherwise -1 (out of memory, `chip8` untouched)
+int chip8_set_quirks(Chip8* chip8, Chip8Quirks quirks);
+// Short name of a quirk profile, such as "vip", or NULL past CHIP8_QUIRKS_COUNT
+const char* chip8_quirks_name(Chip8Quirks quirks);
+
+// Loads the ROM at given path into the Chip8 memory (CHIP8_MEMORY), mapping the file rather than reading it.
+// Set the quirks first: XO-CHIP and MEGA-CHIP machines take larger ROMs.
+// Nothing is printed, and `chip8` is left untouched on error
+// Returns CHIP8_LOAD_OK (0) if OK, otherwise a negative Chip8LoadResult
+Chip8LoadResult chip8_load_rom(Chip8* chip8, const char* rom_path);
+// Loads a ROM already in memory, such as one mapped once and shared by many Chip8s
+// Returns CHIP8_LOAD_OK (0) if OK, otherwise a negative Chip8LoadResult
+Chip8LoadResult chip8_load_rom_from_memory(Chip8* chip8, const uint8_t* rom, size_t size);
+// Short description of a load result, for error messages
+const char* chip8_load_result_string(Chip8LoadResult result);
+
+// Converts the packed VRAM into one byte per pixel (VRAM_COLOR, 0x0 to 0x3), indexed with VRAM_AT.
+// Only the VRAM_WIDTH by VRAM_HEIGHT pixels of the current mode are written.
+// `dst` must hold CHIP8_VRAM_SIZE bytes
+void chip8_vram_unpack(const Chip8* chip8, uint8_t* dst);
+// Copies the MEGA-CHIP display out as ARGB colors, row after row.
+// `dst` must hold CHIP8_MEGA_WIDTH * CHIP8_MEGA_HEIGHT words. Only for machines with Chip8::mega
+void chip8_mega_unpack(const Chip8* chip8, uint32_t* dst);
+
+// Writes the disassembly line of the instruction at `at`, such as "$0200 | 0x00E0 -> disp_clear()\n",
+// and a terminator. `dst` must hold CHIP8_DISASSEMBLY_LINE_SIZE bytes. Returns the length of the line
+size_t chip8_disassemble_at(const Chip8* chip8, uint16_t at, char* dst);
+// Writes the disassembly lines of the instructions from `begin` up to `end`, stepping over the
+// address words of F000 (XO-CHIP) and 01nn (MEGA-CHIP), into the `size` bytes at `dst`.
+// Only whole lines are written, followed by a terminator when `size` is not 0. Returns the bytes
+// written before the terminator. `next` (may be NULL) is set to the address of the first
+// instruction not written, `end` or past it once the range is done, to go on from with more room
+size_t chip8_disassemble_range(const Chip8* chip8, uint32_t begin, uint32_t end, char* dst, size_t size, uint32_t* next);
+
+// Decodes the instruction made of the given big-endian bytes
+Chip8Instruction chip8_decode(uint8_t hi, uint8_t lo);
+// Decodes the instruction at `at` in the memory of the Chip8, wrapping past its end.
+// `length` (may be NULL) is set to the bytes it takes in the machine's mode: 4 for F000 in
+// XO-CHIP and 01nn in MEGA-CHIP, which are followed by an address word, 2 otherwise
+Chip8Instruction chip8_decode_at(const Chip8* chip8, uint32_t at, uint32_t* length);
+// Mnemonic of an instruction kind, such as "DRW" for Dxyn
+const char* chip8_op_name(Chip8Op op);
+
+// Performs an execution cycle of the Chip8, leaving the timers alone
+Chip8StopReason chip8_execute(Chip8* chip8);
 
-#if 0
-void chip8_disassemble_all(Chip8* chip8);
-#endif
+// Performs up to `max_cycles` execution cycles in one go, counting the timers
+// down by cycle count. A breakpoint on the current program counter is ignored,
+// so a run can resume from it. `config` may be NULL for defaults.
+// With CHIP8_RUN_SKIP_IDLE, a loop that went round once without changing
+// anything (typically polling the delay timer or keys) is fast-forwarded to
+// the next timer tick, or to the end of the budget, as if it had kept looping:
+// the end state is the same as without the flag. Disabled while profiling.
+// With CHIP8_RUN_FUSE, the cache also records where common sequences start
+// (such as Annn Dxyn), and those run without dispatching between their
+// instructions. Budget, timers and breakpoints still apply to each of them
+Chip8StopReason chip8_run(Chip8* chip8, uint32_t max_cycles, const Chip8RunConfig* config);
 
-// Write disassembly of given instruction to pointer
-void chip8_disassemble_at(Chip8* chip8, uint16_t at, char* dst);
+// Zeroes every counter of the profile
+void chip8_profile_reset(Chip8Profile* profile);
+// What `path` (CHIP8_PATH_*) of an instruction kind means, such as "Skipped" for 3xnn,
+// or NULL if instructions of that kind never take it
+const char* chip8_profile_path_name(Chip8Op op, uint32_t path);
+// How an instruction kind behaves in a quirk profile, such as "Vy shifted" for 8xy6
+// in CHIP8_QUIRKS_VIP, or NULL if it behaves the same in all of them
+const char* chip8_quirks_behavior(Chip8Op op, Chip8Quirks quirks);
 
-// Performs an execution cycle of the Chip8
-void chip8_execute(Chip8* chip8);
\ No newline at end of file
+// Returns a new, empty decode cache, or NULL if out of memory. Runs work without one
+// (Chip8RunConfig::cache may be NULL), decoding every instruction as it comes
+Chip8DecodeCache* chip8_decode_cache_new();
+// Deletes existing decode cache
+void chip8_decode_cache_delete(Chip8DecodeCache* cache);
+// Forgets every decoded instruction. Needed after loading a new ROM
+void chip8_decode_cache_reset(Chip8DecodeCache* cache);
+// Forgets decoded instructions overlapping [at, at + size). Needed after writing
+// into memory from outside the Chip8 (runs using the cache keep it up to date)
+void chip8_decode_cache_invalidate(Chip8DecodeCache* cache, uint16_t at, uint16_t size);
\ No newline at end of file
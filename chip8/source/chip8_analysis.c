@@ -0,0 +1,600 @@
+#include "chip8_analysis.h"
+#include "chip8_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+// Most entries followed in a Bnnn jump table, as many as V0 can index
+#define MAX_TABLE_ENTRIES 128
+// Blocks looked back through by chip8_analysis_block_at
+#define MAX_OVERLAPPING_BLOCKS 8
+// I while the walk does not know it, or knows it is past the map
+#define I_UNKNOWN UINT32_MAX
+
+
+// Path still to be walked, and what I holds when it gets there
+typedef struct _Chip8WalkPath {
+    uint16_t at;
+    uint32_t I;
+} Chip8WalkPath;
+
+// Store through I, checked against the code once every path is walked
+typedef struct _Chip8WalkStore {
+    uint16_t at; // Of the storing instruction
+    uint32_t address;
+    uint32_t bytes;
+} Chip8WalkStore;
+
+// State of an analysis while it is built, with the capacity of each growing array
+typedef struct _Chip8Walk {
+    const Chip8* chip8;
+    Chip8Analysis* analysis;
+    Chip8WalkPath* paths;
+    uint32_t path_count, path_capacity;
+    Chip8WalkStore* stores;
+    uint32_t store_count, store_capacity;
+    uint32_t block_capacity, successor_capacity, subroutine_capacity, loop_capacity, computed_jump_capacity, self_modifying_capacity;
+    int out_of_memory; // Once set, the walk stops and the analysis is dropped
+} Chip8Walk;
+
+
+// Makes room for one more element in an array grown by doubling. Returns the array, or NULL if out of memory,
+// leaving it and its capacity as they were
+static void* __chip8_grow(Chip8Walk* walk, void* array, uint32_t count, uint32_t* capacity, size_t element)
+{
+    if (count < *capacity)
+    {
+        return array;
+    }
+    const uint32_t grown = *capacity ? 2 * *capacity : 64;
+    void* resized = realloc(array, grown * element);
+    if (!resized)
+    {
+        walk->out_of_memory = 1;
+        return NULL;
+    }
+    *capacity = grown;
+    return resized;
+}
+
+
+static int __chip8_compare_addresses(const void* a, const void* b)
+{
+    return (int)*(const uint16_t*)a - (int)*(const uint16_t*)b;
+}
+
+
+// Whether an instruction of `length` bytes at `at` lies within the analyzed range
+static int __chip8_inside(const Chip8Analysis* analysis, uint32_t at, uint32_t length)
+{
+    return at >= analysis->begin && at + length <= analysis->end;
+}
+
+
+// Whether `op` runs in the machine's mode, rather than faulting
+static int __chip8_runs(const Chip8* chip8, uint8_t op)
+{
+    switch(op)
+    {
+        case CHIP8_OP_SYS:
+        case CHIP8_OP_INVALID: { return 0; }
+        case CHIP8_OP_SAVE_RANGE:
+        case CHIP8_OP_LOAD_RANGE:
+        case CHIP8_OP_LD_I_LONG:
+        case CHIP8_OP_PLANE:
+        case CHIP8_OP_AUDIO:
+        case CHIP8_OP_PITCH: { return chip8->xo != NULL; }
+        case CHIP8_OP_MEGA_OFF:
+        case CHIP8_OP_MEGA_ON:
+        case CHIP8_OP_SCU:
+        case CHIP8_OP_LD_I_24:
+        case CHIP8_OP_LDPAL:
+        case CHIP8_OP_SPRW:
+        case CHIP8_OP_SPRH:
+        case CHIP8_OP_ALPHA:
+        case CHIP8_OP_DIGISND:
+        case CHIP8_OP_STOPSND:
+        case CHIP8_OP_BMODE:
+        case CHIP8_OP_CCOL: { return chip8->mega != NULL; }
+        default: { return 1; }
+    }
+}
+
+
+// Where control may go after `ins`, at `at` and `length` bytes long, written to `targets`
+// (room for MAX_TABLE_ENTRIES). Returns how many, and whether it only falls through to the next one
+static uint32_t __chip8_successors(const Chip8Walk* walk, Chip8Instruction ins, uint16_t at, uint32_t length, uint16_t* targets, int* falls_through)
+{
+    const uint16_t next = (uint16_t)(at + length);
+    *falls_through = 0;
+    if (!__chip8_runs(walk->chip8, ins.op))
+    {
+        return 0;
+    }
+
+    switch(ins.op)
+    {
+        case CHIP8_OP_RET:
+        case CHIP8_OP_EXIT: { return 0; }
+        case CHIP8_OP_JP: {
+            targets[0] = ins.nnn;
+            return 1;
+        }
+        case CHIP8_OP_CALL: {
+            targets[0] = ins.nnn;
+            targets[1] = next;
+            return 2;
+        }
+        case CHIP8_OP_SE_VX_NN:
+        case CHIP8_OP_SNE_VX_NN:
+        case CHIP8_OP_SE_VX_VY:
+        case CHIP8_OP_SNE_VX_VY:
+        case CHIP8_OP_SKP:
+        case CHIP8_OP_SKNP: {
+            // Skips step over the whole next instruction, address word included
+            uint32_t skipped;
+            chip8_decode_at(walk->chip8, next, &skipped);
+            targets[0] = next;
+            targets[1] = (uint16_t)(next + skipped);
+            return 2;
+        }
+        case CHIP8_OP_JP_V0: {
+            // Only a table of jumps at the base is known to be code
+            uint32_t count = 0;
+            while (count < MAX_TABLE_ENTRIES)
+            {
+                uint32_t target = ins.nnn + 2 * count;
+                if (!__chip8_inside(walk->analysis, target, 2) || chip8_decode_at(walk->chip8, target, NULL).op != CHIP8_OP_JP)
+                {
+                    break;
+                }
+                targets[count++] = (uint16_t)target;
+            }
+            return count;
+        }
+        default: {
+            *falls_through = 1;
+            targets[0] = next;
+            return 1;
+        }
+    }
+}
+
+
+// Flags `bytes` bytes from `address` in the map, as far as the map goes
+static void __chip8_mark(Chip8Analysis* analysis, uint32_t address, uint32_t bytes, uint8_t flag)
+{
+    for (uint32_t k = 0; address != I_UNKNOWN && k < bytes && address + k < CHIP8_XO_MEMORY_SIZE; ++k)
+    {
+        analysis->map[address + k] |= flag;
+    }
+}
+
+
+// Notes the memory `ins` at `at` reads and writes through I, returning I after it
+static uint32_t __chip8_follow_i(Chip8Walk* walk, Chip8Instruction ins, uint16_t at, uint32_t I)
+{
+    Chip8Analysis* analysis = walk->analysis;
+    const uint8_t* memory = CHIP8_MEMORY(walk->chip8);
+    const uint32_t mask = CHIP8_MEMORY_BYTES(walk->chip8) - 1;
+    const uint32_t word = U16(memory[(at + 2) & mask], memory[(at + 3) & mask]);
+    uint32_t stored = 0;
+
+    switch(ins.op)
+    {
+        case CHIP8_OP_LD_I: { return ins.nnn; }
+        case CHIP8_OP_LD_I_LONG: { return word; }
+        case CHIP8_OP_LD_I_24: { return ins.nn ? I_UNKNOWN : word; }
+        case CHIP8_OP_ADD_I_VX:
+        case CHIP8_OP_LD_F_VX:
+        case CHIP8_OP_LD_HF_VX: { return I_UNKNOWN; }
+        case CHIP8_OP_DRW: {
+            // Dxy0 draws 16x16 in SUPER-CHIP
+            __chip8_mark(analysis, I, ins.n ? ins.n : 32, CHIP8_MAP_SPRITE);
+            return I;
+        }
+        case CHIP8_OP_LD_VX_MEM: {
+            // Some profiles move I past the registers, which is not followed
+            __chip8_mark(analysis, I, ins.x + 1u, CHIP8_MAP_READ);
+            return I_UNKNOWN;
+        }
+        case CHIP8_OP_LOAD_RANGE: {
+            __chip8_mark(analysis, I, (ins.x > ins.y ? ins.x - ins.y : ins.y - ins.x) + 1u, CHIP8_MAP_READ);
+            return I;
+        }
+        case CHIP8_OP_AUDIO: {
+            __chip8_mark(analysis, I, CHIP8_XO_PATTERN_SIZE, CHIP8_MAP_READ);
+            return I;
+        }
+        case CHIP8_OP_LDPAL: {
+            __chip8_mark(analysis, I, 4u * ins.nn, CHIP8_MAP_READ);
+            return I;
+        }
+        case CHIP8_OP_LD_MEM_VX: { stored = ins.x + 1u; break; }
+        case CHIP8_OP_LD_B_VX: { stored = 3; break; }
+        case CHIP8_OP_SAVE_RANGE: { stored = (ins.x > ins.y ? ins.x - ins.y : ins.y - ins.x) + 1u; break; }
+        default: { return I; }
+    }
+
+    // Stores, checked against the code once all of it is known
+    if (I != I_UNKNOWN)
+    {
+        __chip8_mark(analysis, I, stored, CHIP8_MAP_WRITTEN);
+        Chip8WalkStore* stores = __chip8_grow(walk, walk->stores, walk->store_count, &walk->store_capacity, sizeof(Chip8WalkStore));
+        if (stores)
+        {
+            walk->stores = stores;
+            walk->stores[walk->store_count++] = (Chip8WalkStore){ at, I, stored };
+        }
+    }
+    return ins.op == CHIP8_OP_LD_MEM_VX ? I_UNKNOWN : I;
+}
+
+
+// Marks every instruction reachable from the pending paths, and where blocks start
+static void __chip8_walk(Chip8Walk* walk)
+{
+    Chip8Analysis* analysis = walk->analysis;
+    uint16_t targets[MAX_TABLE_ENTRIES];
+
+    while (walk->path_count && !walk->out_of_memory)
+    {
+        Chip8WalkPath path = walk->paths[--walk->path_count];
+        uint16_t at = path.at;
+        uint32_t I = path.I;
+
+        while (1)
+        {
+            uint32_t length;
+            Chip8Instruction ins = chip8_decode_at(walk->chip8, at, &length);
+            if (!__chip8_inside(analysis, at, length))
+            {
+                break;
+            }
+            if (analysis->map[at] & CHIP8_MAP_CODE)
+            {
+                // Falling into walked code: a block starts there
+                analysis->map[at] |= CHIP8_MAP_BLOCK;
+                break;
+            }
+            analysis->map[at] |= CHIP8_MAP_CODE;
+            __chip8_mark(analysis, at + 1u, length - 1, CHIP8_MAP_OPERAND);
+            analysis->instructions++;
+            if (__chip8_runs(walk->chip8, ins.op))
+            {
+                I = __chip8_follow_i(walk, ins, at, I);
+            }
+
+            int falls_through;
+            uint32_t count = __chip8_successors(walk, ins, at, length, targets, &falls_through);
+            if (falls_through)
+            {
+                at = targets[0];
+                continue;
+            }
+
+            const uint8_t label = (ins.op == CHIP8_OP_JP || ins.op == CHIP8_OP_CALL || ins.op == CHIP8_OP_JP_V0) ? CHIP8_MAP_LABEL : 0;
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                // The return address of a call is a block, but not a label, and I is whatever the call left
+                const int returning = ins.op == CHIP8_OP_CALL && i == 1;
+                analysis->map[targets[i]] |= CHIP8_MAP_BLOCK | (returning ? 0 : label);
+                if (ins.op == CHIP8_OP_CALL && !returning)
+                {
+                    analysis->map[targets[i]] |= CHIP8_MAP_SUBROUTINE;
+                }
+
+                Chip8WalkPath* paths = __chip8_grow(walk, walk->paths, walk->path_count, &walk->path_capacity, sizeof(Chip8WalkPath));
+                if (!paths)
+                {
+                    return;
+                }
+                walk->paths = paths;
+                walk->paths[walk->path_count++] = (Chip8WalkPath){ targets[i], returning ? I_UNKNOWN : I };
+            }
+            break;
+        }
+    }
+}
+
+
+// Splits the walked instructions into blocks, from every block start to the next one or a branch
+static void __chip8_split(Chip8Walk* walk)
+{
+    Chip8Analysis* analysis = walk->analysis;
+    uint16_t targets[MAX_TABLE_ENTRIES];
+
+    for (uint32_t start = analysis->begin; start < analysis->end; ++start)
+    {
+        const uint8_t flags = analysis->map[start];
+        if (!(flags & CHIP8_MAP_CODE) || !(flags & CHIP8_MAP_BLOCK))
+        {
+            continue;
+        }
+
+        uint16_t at = (uint16_t)start;
+        while (1)
+        {
+            uint32_t length;
+            Chip8Instruction ins = chip8_decode_at(walk->chip8, at, &length);
+            int falls_through;
+            uint32_t count = __chip8_successors(walk, ins, at, length, targets, &falls_through);
+
+            const uint32_t next = at + length;
+            if (falls_through && next < CHIP8_XO_MEMORY_SIZE && (analysis->map[next] & CHIP8_MAP_CODE) && !(analysis->map[next] & CHIP8_MAP_BLOCK))
+            {
+                at = (uint16_t)next;
+                continue;
+            }
+
+            Chip8Block* blocks = __chip8_grow(walk, analysis->blocks, analysis->block_count, &walk->block_capacity, sizeof(Chip8Block));
+            if (!blocks)
+            {
+                return;
+            }
+            analysis->blocks = blocks;
+            Chip8Block* block = &analysis->blocks[analysis->block_count++];
+            block->start = (uint16_t)start;
+            block->last = at;
+            block->end = next;
+            block->successors = analysis->successor_count;
+            block->successor_count = (uint16_t)count;
+            block->flags = (flags & CHIP8_MAP_SUBROUTINE) ? CHIP8_BLOCK_SUBROUTINE : 0;
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                uint16_t* successors = __chip8_grow(walk, analysis->successors, analysis->successor_count, &walk->successor_capacity, sizeof(uint16_t));
+                if (!successors)
+                {
+                    return;
+                }
+                analysis->successors = successors;
+                analysis->successors[analysis->successor_count++] = targets[i];
+            }
+
+            if (ins.op == CHIP8_OP_JP_V0)
+            {
+                block->flags |= CHIP8_BLOCK_COMPUTED;
+                uint16_t* computed_jumps = __chip8_grow(walk, analysis->computed_jumps, analysis->computed_jump_count, &walk->computed_jump_capacity, sizeof(uint16_t));
+                if (!computed_jumps)
+                {
+                    return;
+                }
+                analysis->computed_jumps = computed_jumps;
+                analysis->computed_jumps[analysis->computed_jump_count++] = at;
+            }
+            if (flags & CHIP8_MAP_SUBROUTINE)
+            {
+                uint16_t* subroutines = __chip8_grow(walk, analysis->subroutines, analysis->subroutine_count, &walk->subroutine_capacity, sizeof(uint16_t));
+                if (!subroutines)
+                {
+                    return;
+                }
+                analysis->subroutines = subroutines;
+                analysis->subroutines[analysis->subroutine_count++] = (uint16_t)start;
+            }
+            break;
+        }
+    }
+}
+
+
+// Index of the block starting at `at`, or -1
+static int32_t __chip8_block_index(const Chip8Analysis* analysis, uint16_t at)
+{
+    const Chip8Block* block = chip8_analysis_block_at(analysis, at);
+    return (block && block->start == at) ? (int32_t)(block - analysis->blocks) : -1;
+}
+
+
+// Finds the loops: depth first from the roots, an edge to a block still on the path goes back to it
+static void __chip8_find_loops(Chip8Walk* walk, const uint16_t* roots, uint32_t root_count)
+{
+    Chip8Analysis* analysis = walk->analysis;
+    if (!analysis->block_count)
+    {
+        return;
+    }
+
+    // 0 not visited, 1 on the path, 2 done. Each block is on the stack once, with its next successor
+    uint8_t* state = calloc(analysis->block_count, 1);
+    uint32_t* stack = malloc(analysis->block_count * sizeof(uint32_t));
+    uint32_t* next = malloc(analysis->block_count * sizeof(uint32_t));
+    if (!state || !stack || !next)
+    {
+        walk->out_of_memory = 1;
+        root_count = 0;
+    }
+
+    for (uint32_t r = 0; r < root_count; ++r)
+    {
+        int32_t root = __chip8_block_index(analysis, roots[r]);
+        if (root < 0 || state[root])
+        {
+            continue;
+        }
+
+        uint32_t depth = 0;
+        stack[depth++] = (uint32_t)root;
+        next[root] = 0;
+        state[root] = 1;
+        while (depth && !walk->out_of_memory)
+        {
+            const uint32_t b = stack[depth - 1];
+            const Chip8Block* block = &analysis->blocks[b];
+            if (next[b] == block->successor_count)
+            {
+                state[b] = 2;
+                --depth;
+                continue;
+            }
+
+            int32_t s = __chip8_block_index(analysis, analysis->successors[block->successors + next[b]++]);
+            if (s < 0)
+            {
+                continue;
+            }
+            if (state[s] == 1)
+            {
+                analysis->blocks[s].flags |= CHIP8_BLOCK_LOOP;
+                Chip8Loop* loops = __chip8_grow(walk, analysis->loops, analysis->loop_count, &walk->loop_capacity, sizeof(Chip8Loop));
+                if (loops)
+                {
+                    analysis->loops = loops;
+                    analysis->loops[analysis->loop_count++] = (Chip8Loop){ analysis->blocks[s].start, block->last };
+                }
+            }
+            else if (state[s] == 0)
+            {
+                state[s] = 1;
+                next[s] = 0;
+                stack[depth++] = (uint32_t)s;
+            }
+        }
+    }
+
+    free(next);
+    free(stack);
+    free(state);
+}
+
+
+// Lists the stores landing on walked instructions, now that all of them are known
+static void __chip8_find_self_modifying(Chip8Walk* walk)
+{
+    Chip8Analysis* analysis = walk->analysis;
+    for (uint32_t i = 0; i < walk->store_count; ++i)
+    {
+        const Chip8WalkStore* store = &walk->stores[i];
+        int modifies = 0;
+        for (uint32_t address = store->address; address < store->address + store->bytes && address < CHIP8_XO_MEMORY_SIZE; ++address)
+        {
+            if (analysis->map[address] & (CHIP8_MAP_CODE | CHIP8_MAP_OPERAND))
+            {
+                Chip8Block* block = (Chip8Block*)chip8_analysis_block_at(analysis, (uint16_t)address);
+                if (block)
+                {
+                    block->flags |= CHIP8_BLOCK_MODIFIED;
+                }
+                modifies = 1;
+            }
+        }
+        if (modifies)
+        {
+            uint16_t* self_modifying = __chip8_grow(walk, analysis->self_modifying, analysis->self_modifying_count, &walk->self_modifying_capacity, sizeof(uint16_t));
+            if (!self_modifying)
+            {
+                return;
+            }
+            analysis->self_modifying = self_modifying;
+            analysis->self_modifying[analysis->self_modifying_count++] = store->at;
+        }
+    }
+    if (analysis->self_modifying_count)
+    {
+        qsort(analysis->self_modifying, analysis->self_modifying_count, sizeof(uint16_t), __chip8_compare_addresses);
+    }
+}
+
+
+Chip8Analysis* chip8_analysis_new(const Chip8* chip8, uint32_t begin, uint32_t end, const uint16_t* roots, uint32_t root_count)
+{
+    static const uint16_t default_root = CHIP8_PROGRAM_START_LOCATION;
+    if (root_count == 0)
+    {
+        roots = &default_root;
+        root_count = 1;
+    }
+
+    // The program counter runs through the first 64 KB in XO-CHIP and MEGA-CHIP, 4 KB otherwise
+    const uint32_t size = (chip8->xo || chip8->mega) ? CHIP8_XO_MEMORY_SIZE : CHIP8_MEMORY_SIZE;
+    Chip8Analysis* analysis = calloc(1, sizeof(Chip8Analysis));
+    if (!analysis)
+    {
+        return NULL;
+    }
+    analysis->end = end < size ? end : size;
+    analysis->begin = begin < analysis->end ? begin : analysis->end;
+
+    Chip8Walk walk;
+    memset(&walk, 0x0, sizeof(walk));
+    walk.chip8 = chip8;
+    walk.analysis = analysis;
+    for (uint32_t r = 0; r < root_count; ++r)
+    {
+        analysis->map[roots[r]] |= CHIP8_MAP_BLOCK | CHIP8_MAP_LABEL;
+        Chip8WalkPath* paths = __chip8_grow(&walk, walk.paths, walk.path_count, &walk.path_capacity, sizeof(Chip8WalkPath));
+        if (!paths)
+        {
+            break;
+        }
+        walk.paths = paths;
+        walk.paths[walk.path_count++] = (Chip8WalkPath){ roots[r], I_UNKNOWN };
+    }
+
+    // Each phase needs the whole of the one before, so the first failed allocation ends the analysis
+    __chip8_walk(&walk);
+    if (!walk.out_of_memory)
+    {
+        __chip8_split(&walk);
+    }
+    if (!walk.out_of_memory)
+    {
+        __chip8_find_loops(&walk, roots, root_count);
+    }
+    if (!walk.out_of_memory)
+    {
+        __chip8_find_self_modifying(&walk);
+    }
+
+    free(walk.stores);
+    free(walk.paths);
+    if (walk.out_of_memory)
+    {
+        chip8_analysis_delete(analysis);
+        return NULL;
+    }
+    return analysis;
+}
+
+
+void chip8_analysis_delete(Chip8Analysis* analysis)
+{
+    free(analysis->self_modifying);
+    free(analysis->computed_jumps);
+    free(analysis->loops);
+    free(analysis->subroutines);
+    free(analysis->successors);
+    free(analysis->blocks);
+    free(analysis);
+}
+
+
+const Chip8Block* chip8_analysis_block_at(const Chip8Analysis* analysis, uint16_t at)
+{
+    // Last block starting at or before `at`
+    uint32_t low = 0;
+    uint32_t high = analysis->block_count;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (analysis->blocks[middle].start <= at)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    // Code reached at both odd and even addresses makes blocks overlap, the one holding `at` may start earlier
+    for (uint32_t i = low; i > 0 && low - i < MAX_OVERLAPPING_BLOCKS; --i)
+    {
+        if (at < analysis->blocks[i - 1].end)
+        {
+            return &analysis->blocks[i - 1];
+        }
+    }
+    return NULL;
+}
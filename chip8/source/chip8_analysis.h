@@ -0,0 +1,87 @@
+#pragma once
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+
+/*
+Static analysis of the code in a Chip8's memory, without running it. From the
+given roots (usually just the start of the ROM), every path is followed through
+1nnn, 2nnn, the skips and 00EE, with the instructions and lengths of the
+machine's mode, which tells the instructions reached from the bytes never run.
+The walk also follows I where Annn (F000, 01nn in their modes) sets it, so the
+sprites drawn by Dxyn and the bytes stored or loaded through I are known as far
+as a single pass can tell: I is forgotten after Fx1E, Fx29, Fx55, Fx65 and calls.
+
+From that come the basic blocks, the subroutines (2nnn targets), the loops (an
+edge back to a block still on the depth-first path), the computed jumps (Bnnn,
+followed only into a table of 1nnn at its base) and the self-modifying writes:
+stores whose bytes land on reached instructions.
+
+Addresses are those of the program counter, 16 bits. Each instruction is
+decoded once or twice, so a whole ROM takes microseconds.
+*/
+
+// Chip8Analysis::map flags, by address
+#define CHIP8_MAP_CODE 0x01 // First byte of a reached instruction
+#define CHIP8_MAP_OPERAND 0x02 // Other byte of a reached instruction, including F000 and 01nn address words
+#define CHIP8_MAP_BLOCK 0x04 // First byte of a basic block
+#define CHIP8_MAP_LABEL 0x08 // Root, or target of 1nnn, 2nnn or a Bnnn table
+#define CHIP8_MAP_SUBROUTINE 0x10 // Target of 2nnn
+#define CHIP8_MAP_SPRITE 0x20 // Drawn by a reached Dxyn
+#define CHIP8_MAP_READ 0x40 // Loaded through I by a reached Fx65, 5xy3, F002 or 02nn
+#define CHIP8_MAP_WRITTEN 0x80 // Stored to through I by a reached Fx33, Fx55 or 5xy2
+
+// Chip8Block::flags
+#define CHIP8_BLOCK_SUBROUTINE 0x1 // Starts a subroutine
+#define CHIP8_BLOCK_LOOP 0x2 // Heads a loop, see Chip8Loop
+#define CHIP8_BLOCK_COMPUTED 0x4 // Ends with Bnnn, which may also go where the walk did not
+#define CHIP8_BLOCK_MODIFIED 0x8 // Has a byte a reached store writes to
+
+// Straight run of instructions, only entered at `start`, leaving at its last instruction
+typedef struct _Chip8Block {
+    uint16_t start;
+    uint16_t last; // Address of its last instruction
+    uint32_t end; // Past its last instruction
+    uint32_t successors; // Index of the first of its successors in Chip8Analysis::successors
+    uint16_t successor_count; // Where control may go next, in or out of the code: both ways of a skip, a 2nnn target and its return
+    uint16_t flags; // CHIP8_BLOCK_*
+} Chip8Block;
+
+// Edge back to a block still running on the path that reached it
+typedef struct _Chip8Loop {
+    uint16_t head; // Start of the block heading the loop
+    uint16_t latch; // Address of the instruction going back to it
+} Chip8Loop;
+
+typedef struct _Chip8Analysis {
+    uint32_t begin; // Instructions are only followed within [begin, end)
+    uint32_t end;
+    uint32_t instructions; // Reached
+    uint8_t map[CHIP8_XO_MEMORY_SIZE]; // CHIP8_MAP_* by address
+
+    Chip8Block* blocks; // Ascending by start
+    uint32_t block_count;
+    uint16_t* successors; // Of every block, see Chip8Block::successors
+    uint32_t successor_count;
+    uint16_t* subroutines; // Starts of the subroutines, ascending
+    uint32_t subroutine_count;
+    Chip8Loop* loops; // In depth-first order
+    uint32_t loop_count;
+    uint16_t* computed_jumps; // Addresses of the reached Bnnn, ascending
+    uint32_t computed_jump_count;
+    uint16_t* self_modifying; // Addresses of the reached stores writing to reached instructions, ascending
+    uint32_t self_modifying_count;
+} Chip8Analysis;
+
+
+// Analyzes the code of `chip8` reachable from `roots` (CHIP8_PROGRAM_START_LOCATION if
+// `root_count` is 0), following instructions only within [begin, end), which is clamped
+// to the memory the program counter runs through. Returns NULL if out of memory
+Chip8Analysis* chip8_analysis_new(const Chip8* chip8, uint32_t begin, uint32_t end, const uint16_t* roots, uint32_t root_count);
+// Deletes existing analysis
+void chip8_analysis_delete(Chip8Analysis* analysis);
+
+// Block holding the instruction at `at`, or NULL if it was not reached
+const Chip8Block* chip8_analysis_block_at(const Chip8Analysis* analysis, uint16_t at);
@@ -0,0 +1,118 @@
+#include "chip8_aot.h"
+#include "chip8_internal.h"
+
+#include <string.h>
+
+
+static inline void __chip8_aot_write(Chip8* chip8, uint16_t at, uint8_t value)
+{
+    at = MEMORY_MASK(at);
+    chip8->memory[at] = value;
+    chip8->dirty_pages |= PAGE_BIT(at);
+}
+
+
+void chip8_aot_draw(Chip8* chip8, uint8_t x, uint8_t y, uint8_t n)
+{
+    chip8_draw_sprite(chip8, x, y, n);
+}
+
+
+void chip8_aot_random(Chip8* chip8, uint8_t x, uint8_t nn)
+{
+    // Same generator as chip8_run
+    uint32_t rng = chip8->rng;
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    chip8->rng = rng;
+    chip8->v[x] = (rng >> 24) & nn;
+}
+
+
+void chip8_aot_store_bcd(Chip8* chip8, uint8_t x)
+{
+    uint8_t value = chip8->v[x];
+    __chip8_aot_write(chip8, chip8->I, value / 100);
+    __chip8_aot_write(chip8, chip8->I + 1, (value / 10) % 10);
+    __chip8_aot_write(chip8, chip8->I + 2, value % 10);
+}
+
+
+void chip8_aot_store_registers(Chip8* chip8, uint8_t x)
+{
+    for (uint8_t r = 0; r <= x; ++r)
+    {
+        __chip8_aot_write(chip8, chip8->I + r, chip8->v[r]);
+    }
+}
+
+
+void chip8_aot_tick(Chip8* chip8, uint32_t period)
+{
+    chip8_timers_advance(chip8, period, 0);
+}
+
+
+/*
+Blocks only ever run whole, and settle the cycle count and timers once done.
+That is exact for the same reason as in chip8_jit.c: chip8_recompile only
+puts instructions reading or writing the timers first in a block, and blocks
+are not entered while a timer tick is still due.
+*/
+Chip8StopReason chip8_aot_run(const Chip8AotProgram* program, Chip8* chip8, uint32_t max_cycles, const Chip8RunConfig* config)
+{
+    static const Chip8RunConfig default_config = { 0 };
+    config = config ? config : &default_config;
+
+    // Translated code does not keep a decode cache up to date
+    Chip8RunConfig interpreter = *config;
+    interpreter.cache = NULL;
+
+    if (config->breakpoints || config->profile || config->callgraph || (config->flags & CHIP8_RUN_STOP_ON_DRAW) ||
+        chip8->quirks != CHIP8_QUIRKS_DEFAULT)
+    {
+        return chip8_run(chip8, max_cycles, &interpreter);
+    }
+
+    const uint32_t period = config->cycles_per_timer_tick;
+    uint32_t executed = 0;
+
+    while (executed < max_cycles)
+    {
+        uint32_t left = max_cycles - executed;
+
+        // Blocks expect the timers to have ticked when due, which a change of period may have put off
+        if (!(period && chip8->timer_cycles >= period))
+        {
+            uint32_t ran = program->run(chip8, left, period);
+            if (ran)
+            {
+                executed += ran;
+                continue;
+            }
+        }
+
+        // The interpreter takes one instruction, or a block that could not run up to
+        // the end of the budget or to its fault
+        uint32_t length = (chip8->pc < CHIP8_MEMORY_SIZE) ? program->lengths[chip8->pc] : 0;
+        uint32_t cycles = length ? (length < left ? length : left) : 1;
+        Chip8StopReason reason = chip8_run(chip8, cycles, &interpreter);
+        if (reason == CHIP8_STOP_KEY_WAIT)
+        {
+            // Still waiting: the rest of the budget goes the same way
+            if (left > cycles)
+            {
+                chip8_run(chip8, left - cycles, &interpreter);
+            }
+            return CHIP8_STOP_KEY_WAIT;
+        }
+        if (reason != CHIP8_STOP_BUDGET)
+        {
+            return reason;
+        }
+        executed += cycles;
+    }
+
+    return CHIP8_STOP_BUDGET;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+
+/*
+Runtime for ROMs translated ahead of time into C by chip8_recompile
+(tools/recompiler). The generated file holds one function per basic block of
+the code it found reachable, and a Chip8AotProgram running them in turn.
+Compiled with the rest of the program, it runs on the same Chip8 as chip8_run.
+
+Results are the same as chip8_run, cycle for cycle. Anything without a block
+(code only reached through Bnnn, code built in RAM, Fx0A, invalid
+instructions) runs on the interpreter, one instruction at a time, until the
+program counter lands on a block again. Each block checks that its
+instructions are still the ones it was translated from before running, so
+self-modifying code falls back to the interpreter as well.
+*/
+
+// Runs translated blocks one after the other from chip8->pc, for up to `budget`
+// cycles, counting cycles and timers (`period` cycles per tick) as chip8_run
+// does. Returns the cycles performed, stopping at the first address without a
+// block, or whose block cannot run whole: its instructions were overwritten
+// since, its call or return would fault, or the budget left is too short
+typedef uint32_t (*Chip8AotRun)(Chip8* chip8, uint32_t budget, uint32_t period);
+
+typedef struct _Chip8AotProgram {
+    uint64_t rom_hash; // chip8_rom_hash of the ROM it was translated from
+    Chip8AotRun run;
+    const uint8_t* lengths; // CHIP8_MEMORY_SIZE entries, instructions in the block starting at each address, 0 for none
+} Chip8AotProgram;
+
+
+// Performs up to `max_cycles` execution cycles, as chip8_run. `config->cache`
+// is not used. Runs with breakpoints, profiling or CHIP8_RUN_STOP_ON_DRAW, and
+// machines with quirks other than CHIP8_QUIRKS_DEFAULT go to chip8_run whole
+Chip8StopReason chip8_aot_run(const Chip8AotProgram* program, Chip8* chip8, uint32_t max_cycles, const Chip8RunConfig* config);
+
+// Called by translated code for the instructions it does not spell out itself
+// Dxyn
+void chip8_aot_draw(Chip8* chip8, uint8_t x, uint8_t y, uint8_t n);
+// Cxnn
+void chip8_aot_random(Chip8* chip8, uint8_t x, uint8_t nn);
+// Fx33
+void chip8_aot_store_bcd(Chip8* chip8, uint8_t x);
+// Fx55
+void chip8_aot_store_registers(Chip8* chip8, uint8_t x);
+// Ticks the timers for the cycles in chip8->timer_cycles, once they reach `period`
+void chip8_aot_tick(Chip8* chip8, uint32_t period);
@@ -0,0 +1,1067 @@
+#include "chip8_batch.h"
+#include "chip8_internal.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+
+// Lanes are padded to a multiple of this, so lane loops are whole SIMD vectors
+#define BATCH_LANE_BLOCK 32
+// Lanes are run this many at a time, a tile after the other, so that the state of
+// the lanes in a step stays in cache. A multiple of BATCH_LANE_BLOCK
+#define BATCH_TILE_LANES 64
+// Batches of fewer lanes run each of them alone, lockstep costing more than it saves
+#define BATCH_MIN_LANES 32
+// Lanes in a step performed by fewer than one lane in this many leave lockstep for the
+// rest of the run: they have diverged, and chip8_run performs them faster one by one
+#define BATCH_MIN_STEP_SHARE 8
+
+// Loops over the lanes of the tile being run, padding included. Padding lanes never run.
+// Expects the tile bounds in locals `first` and `end`, so the compiler knows they are loop invariant
+#define FOR_EACH_LANE(l) for (uint32_t l = first; l < end; ++l)
+// Loops over the lanes taking part in the current step
+#define FOR_EACH_STEP_LANE(l) FOR_EACH_LANE(l) if (batch->mask[l])
+
+// Lane masks are 0x00 or 0xFF bytes. These widen one and blend with it, without
+// branches, so that lane loops are if-converted and vectorized
+#define MASK16(m) ( (uint16_t)((m) * 0x0101u) )
+#define MASK32(m) ( (uint32_t)((m) * 0x01010101u) )
+#define MASK64(m) ( (uint64_t)(m) * 0x0101010101010101ull )
+#define SELECT(m, a, b) ( ((a) & (m)) | ((b) & ~(m)) )
+
+
+struct _Chip8Batch {
+    uint32_t lanes; // Lanes asked for
+    uint32_t stride; // Lanes allocated, a multiple of BATCH_LANE_BLOCK
+
+    // Machine state of the lanes running in lockstep, [lane] or [index][lane]
+    uint8_t* v; // [register][lane]
+    uint16_t* I;
+    uint16_t* pc;
+    uint8_t* sp;
+    uint16_t* stack; // [level][lane]
+    uint8_t* delay_timer;
+    uint8_t* sound_timer;
+    uint16_t* keys;
+    uint8_t* key_wait;
+    uint16_t* key_wait_keys;
+    uint32_t* rng;
+    uint32_t* timer_cycles; // Only up to date between runs, `tick_step` counts instead during one
+    uint64_t* cycles;
+    uint64_t* VRAM; // [row][lane]
+
+    // A machine per lane, holding its memory (lanes diverge as soon as they write) and
+    // SUPER-CHIP flags. Lanes running alone keep their whole state there instead
+    Chip8* machines;
+    Chip8DecodeCache* caches; // Of each machine, for its chip8_run
+    uint8_t* alone; // 0xFF for lanes running on their machine with chip8_run
+
+    // Scheduling state
+    uint16_t* dirty_pages; // Pages of a lane memory that may differ from `base`
+    uint16_t* stale_pages; // Pages written in lockstep since the lane last ran alone, its cache may not match them
+    uint16_t dirty_any; // Union of all dirty_pages
+    uint8_t* running; // 0xFF while the lane runs in lockstep, has cycles left and has not stopped
+    uint8_t* mask; // 0xFF for lanes taking part in the current step
+    uint8_t* reason; // Chip8StopReason of the last run
+
+    // The current run. Lanes do not count their own cycles: the run counts steps, and a
+    // lane sitting one out has its deadline and next timer tick pushed back by a step.
+    // While every lane takes part, steps cost no bookkeeping at all
+    uint32_t max_cycles;
+    uint32_t period; // Cycles per timer tick
+    uint32_t first; // First lane of the tile being run
+    uint32_t end; // Past its last lane
+    uint32_t steps; // Steps performed so far
+    uint8_t stopped; // Whether a lane stopped or left lockstep during the current step
+    uint32_t* deadline; // Step after which the lane has performed `max_cycles`
+    uint32_t* tick_step; // Step after which the lane timers next count down
+    uint32_t* remaining; // Cycles the lane had left when it stopped
+
+    uint8_t base[CHIP8_MEMORY_SIZE]; // Memory of the prototype
+    Chip8DecodeCache* cache; // Decoded `base`
+};
+
+
+// Copies the state of a plain CHIP-8 or SUPER-CHIP machine, leaving the rest of `dst` alone
+static void __copy_machine(Chip8* dst, const Chip8* src)
+{
+    memcpy(dst->v, src->v, sizeof(dst->v));
+    memcpy(dst->memory, src->memory, sizeof(dst->memory));
+    memcpy(dst->VRAM, src->VRAM, sizeof(dst->VRAM));
+    memcpy(dst->stack, src->stack, sizeof(dst->stack));
+    memcpy(dst->flags, src->flags, sizeof(dst->flags));
+    dst->I = src->I;
+    dst->pc = src->pc;
+    dst->rom_size = src->rom_size;
+    dst->sp = src->sp;
+    dst->delay_timer = src->delay_timer;
+    dst->sound_timer = src->sound_timer;
+    dst->keys = src->keys;
+    dst->key_wait = src->key_wait;
+    dst->key_wait_keys = src->key_wait_keys;
+    dst->rng = src->rng;
+    dst->timer_cycles = src->timer_cycles;
+    dst->cycles = src->cycles;
+    dst->hires = src->hires;
+}
+
+
+// Copies the lockstep state of a lane into `chip8`, whose memory and flags are left alone
+static void __lane_export(const Chip8Batch* batch, uint32_t lane, Chip8* chip8)
+{
+    uint32_t n = batch->stride;
+
+    for (int r = 0; r < CHIP8_NUM_REGISTERS; ++r)
+    {
+        chip8->v[r] = batch->v[r * n + lane];
+    }
+    for (int s = 0; s < CHIP8_STACK_SIZE; ++s)
+    {
+        chip8->stack[s] = batch->stack[s * n + lane];
+    }
+    for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; ++y)
+    {
+        chip8->VRAM[y][0] = batch->VRAM[y * n + lane];
+    }
+    chip8->I = batch->I[lane];
+    chip8->pc = batch->pc[lane];
+    chip8->sp = batch->sp[lane];
+    chip8->delay_timer = batch->delay_timer[lane];
+    chip8->sound_timer = batch->sound_timer[lane];
+    chip8->keys = batch->keys[lane];
+    chip8->key_wait = batch->key_wait[lane];
+    chip8->key_wait_keys = batch->key_wait_keys[lane];
+    chip8->rng = batch->rng[lane];
+    chip8->timer_cycles = batch->timer_cycles[lane];
+    chip8->cycles = batch->cycles[lane];
+}
+
+
+// Moves a lane from its machine into lockstep. Only low resolution machines can be
+static void __lane_attach(Chip8Batch* batch, uint32_t lane)
+{
+    uint32_t n = batch->stride;
+    const Chip8* machine = &batch->machines[lane];
+
+    for (int r = 0; r < CHIP8_NUM_REGISTERS; ++r)
+    {
+        batch->v[r * n + lane] = machine->v[r];
+    }
+    for (int s = 0; s < CHIP8_STACK_SIZE; ++s)
+    {
+        batch->stack[s * n + lane] = machine->stack[s];
+    }
+    for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; ++y)
+    {
+        batch->VRAM[y * n + lane] = machine->VRAM[y][0];
+    }
+    batch->I[lane] = machine->I;
+    batch->pc[lane] = machine->pc;
+    batch->sp[lane] = (uint8_t)machine->sp;
+    batch->delay_timer[lane] = machine->delay_timer;
+    batch->sound_timer[lane] = machine->sound_timer;
+    batch->keys[lane] = machine->keys;
+    batch->key_wait[lane] = machine->key_wait;
+    batch->key_wait_keys[lane] = machine->key_wait_keys;
+    batch->rng[lane] = machine->rng;
+    batch->timer_cycles[lane] = machine->timer_cycles;
+    batch->cycles[lane] = machine->cycles;
+
+    // The machine counts the pages it writes, since it left lockstep
+    batch->dirty_pages[lane] |= machine->dirty_pages;
+    batch->dirty_any |= machine->dirty_pages;
+    batch->alone[lane] = 0x00;
+}
+
+
+// Ends the run of a lane at the current step, which it does not perform. Its timer
+// cycle count is brought up to date, unless it performed no cycle at all: a count
+// left over from a longer period would stand for a tick that chip8_run has not made
+static void __lane_settle(Chip8Batch* batch, uint32_t lane)
+{
+    uint32_t remaining = batch->deadline[lane] - batch->steps;
+    if (batch->period && remaining != batch->max_cycles)
+    {
+        batch->timer_cycles[lane] = batch->period - (batch->tick_step[lane] - batch->steps);
+    }
+    batch->remaining[lane] = remaining;
+    batch->running[lane] = 0x0;
+    batch->mask[lane] = 0x0;
+    batch->stopped = 1;
+}
+
+
+// Moves a lane out of lockstep onto its machine, for the rest of the run at least.
+// The cycles it ran in lockstep so far are counted on the way
+static void __lane_detach(Chip8Batch* batch, uint32_t lane)
+{
+    __lane_settle(batch, lane);
+
+    Chip8* machine = &batch->machines[lane];
+    __lane_export(batch, lane, machine);
+    machine->cycles += batch->max_cycles - batch->remaining[lane];
+    machine->dirty_pages = 0;
+
+    for (uint32_t page = 0; page < CHIP8_MEMORY_SIZE >> 8; ++page)
+    {
+        if (batch->stale_pages[lane] & (1u << page))
+        {
+            chip8_decode_cache_invalidate(&batch->caches[lane], (uint16_t)(page << 8), 256);
+        }
+    }
+    batch->stale_pages[lane] = 0;
+    batch->alone[lane] = 0xFF;
+}
+
+
+Chip8Batch* chip8_batch_new(const Chip8* prototype, uint32_t lanes)
+{
+    if (prototype->quirks != CHIP8_QUIRKS_DEFAULT || lanes == 0)
+    {
+        return NULL;
+    }
+
+    Chip8Batch* batch = calloc(1, sizeof(Chip8Batch));
+    if (!batch)
+    {
+        return NULL;
+    }
+    batch->lanes = lanes;
+    batch->stride = (lanes + BATCH_LANE_BLOCK - 1) / BATCH_LANE_BLOCK * BATCH_LANE_BLOCK;
+    uint32_t n = batch->stride;
+
+    batch->v = calloc(CHIP8_NUM_REGISTERS * n, sizeof(uint8_t));
+    batch->I = calloc(n, sizeof(uint16_t));
+    batch->pc = calloc(n, sizeof(uint16_t));
+    batch->sp = calloc(n, sizeof(uint8_t));
+    batch->stack = calloc(CHIP8_STACK_SIZE * n, sizeof(uint16_t));
+    batch->delay_timer = calloc(n, sizeof(uint8_t));
+    batch->sound_timer = calloc(n, sizeof(uint8_t));
+    batch->keys = calloc(n, sizeof(uint16_t));
+    batch->key_wait = calloc(n, sizeof(uint8_t));
+    batch->key_wait_keys = calloc(n, sizeof(uint16_t));
+    batch->rng = calloc(n, sizeof(uint32_t));
+    batch->timer_cycles = calloc(n, sizeof(uint32_t));
+    batch->cycles = calloc(n, sizeof(uint64_t));
+    batch->VRAM = calloc(CHIP8_DISPLAY_HEIGHT * n, sizeof(uint64_t));
+    batch->machines = calloc(lanes, sizeof(Chip8));
+    batch->caches = calloc(lanes, sizeof(Chip8DecodeCache));
+    batch->alone = calloc(n, sizeof(uint8_t));
+    batch->dirty_pages = calloc(n, sizeof(uint16_t));
+    batch->stale_pages = calloc(n, sizeof(uint16_t));
+    batch->running = calloc(n, sizeof(uint8_t));
+    batch->mask = calloc(n, sizeof(uint8_t));
+    batch->reason = calloc(n, sizeof(uint8_t));
+    batch->deadline = calloc(n, sizeof(uint32_t));
+    batch->tick_step = calloc(n, sizeof(uint32_t));
+    batch->remaining = calloc(n, sizeof(uint32_t));
+    batch->cache = chip8_decode_cache_new();
+    if (!batch->v || !batch->I || !batch->pc || !batch->sp || !batch->stack || !batch->delay_timer || !batch->sound_timer ||
+        !batch->keys || !batch->key_wait || !batch->key_wait_keys || !batch->rng || !batch->timer_cycles || !batch->cycles ||
+        !batch->VRAM || !batch->machines || !batch->caches || !batch->alone || !batch->dirty_pages || !batch->stale_pages ||
+        !batch->running || !batch->mask || !batch->reason || !batch->deadline || !batch->tick_step || !batch->remaining || !batch->cache)
+    {
+        chip8_batch_delete(batch);
+        return NULL;
+    }
+
+    memcpy(batch->base, prototype->memory, CHIP8_MEMORY_SIZE);
+
+    // Small batches are faster run one lane after the other, and so is high resolution
+    // (lanes move into lockstep once back in low resolution). The caches start empty
+    for (uint32_t l = 0; l < lanes; ++l)
+    {
+        Chip8* machine = &batch->machines[l];
+        chip8_init(machine);
+        __copy_machine(machine, prototype);
+        machine->dirty_pages = 0;
+        batch->alone[l] = 0xFF;
+        if (lanes >= BATCH_MIN_LANES && !machine->hires)
+        {
+            __lane_attach(batch, l);
+        }
+    }
+
+    return batch;
+}
+
+
+void chip8_batch_delete(Chip8Batch* batch)
+{
+    free(batch->v);
+    free(batch->I);
+    free(batch->pc);
+    free(batch->sp);
+    free(batch->stack);
+    free(batch->delay_timer);
+    free(batch->sound_timer);
+    free(batch->keys);
+    free(batch->key_wait);
+    free(batch->key_wait_keys);
+    free(batch->rng);
+    free(batch->timer_cycles);
+    free(batch->cycles);
+    free(batch->VRAM);
+    free(batch->machines);
+    free(batch->caches);
+    free(batch->alone);
+    free(batch->dirty_pages);
+    free(batch->stale_pages);
+    free(batch->running);
+    free(batch->mask);
+    free(batch->reason);
+    free(batch->deadline);
+    free(batch->tick_step);
+    free(batch->remaining);
+    if (batch->cache)
+    {
+        chip8_decode_cache_delete(batch->cache);
+    }
+    free(batch);
+}
+
+
+uint32_t chip8_batch_lanes(const Chip8Batch* batch)
+{
+    return batch->lanes;
+}
+
+
+void chip8_batch_get(const Chip8Batch* batch, uint32_t lane, Chip8* chip8)
+{
+    chip8_init(chip8);
+    __copy_machine(chip8, &batch->machines[lane]);
+    if (!batch->alone[lane])
+    {
+        __lane_export(batch, lane, chip8);
+    }
+}
+
+
+void chip8_batch_set_keys(Chip8Batch* batch, uint32_t lane, uint16_t keys)
+{
+    batch->keys[lane] = keys;
+    batch->machines[lane].keys = keys;
+}
+
+
+void chip8_batch_seed(Chip8Batch* batch, uint32_t lane, uint32_t seed)
+{
+    chip8_seed(&batch->machines[lane], seed);
+    batch->rng[lane] = batch->machines[lane].rng;
+}
+
+
+Chip8StopReason chip8_batch_stop_reason(const Chip8Batch* batch, uint32_t lane)
+{
+    return (Chip8StopReason)batch->reason[lane];
+}
+
+
+// Memory of a lane
+static inline uint8_t* __lane_memory(Chip8Batch* batch, uint32_t lane)
+{
+    return batch->machines[lane].memory;
+}
+
+
+static inline void __lane_write(Chip8Batch* batch, uint32_t lane, uint16_t at, uint8_t value)
+{
+    __lane_memory(batch, lane)[MEMORY_MASK(at)] = value;
+    batch->dirty_pages[lane] |= PAGE_BIT(at);
+    batch->stale_pages[lane] |= PAGE_BIT(at);
+    batch->dirty_any |= PAGE_BIT(at);
+}
+
+
+// Takes a lane out of the current run
+static inline void __lane_stop(Chip8Batch* batch, uint32_t lane, Chip8StopReason reason)
+{
+    __lane_settle(batch, lane);
+    batch->reason[lane] = (uint8_t)reason;
+}
+
+
+// Dxyn for one lane, as chip8_draw_sprite
+static void __lane_draw(Chip8Batch* batch, uint32_t lane, uint8_t rx, uint8_t ry, uint8_t n)
+{
+    uint32_t stride = batch->stride;
+    uint8_t* v = &batch->v[lane];
+    const uint8_t* memory = __lane_memory(batch, lane);
+    uint8_t x = v[rx * stride];
+    uint8_t y = v[ry * stride];
+    uint64_t collision = 0;
+
+    if (x < CHIP8_DISPLAY_WIDTH)
+    {
+        for (uint32_t row = 0; row < n && y + row < CHIP8_DISPLAY_HEIGHT; ++row)
+        {
+            uint64_t sprite = memory[MEMORY_MASK(batch->I[lane] + row)];
+            uint64_t bits = (x <= CHIP8_DISPLAY_WIDTH - 8) ? sprite << (CHIP8_DISPLAY_WIDTH - 8 - x) : sprite >> (x - (CHIP8_DISPLAY_WIDTH - 8));
+            uint64_t* vram_row = &batch->VRAM[(y + row) * stride + lane];
+            collision |= *vram_row & bits;
+            *vram_row ^= bits;
+        }
+    }
+
+    v[0xF * stride] = (collision != 0) ? 0x1 : 0x0;
+}
+
+
+// Counts `cycles` elapsed cycles of a lane against its timers, as chip8_timers_advance
+static void __lane_timers_advance(Chip8Batch* batch, uint32_t lane, uint32_t period, uint32_t cycles)
+{
+    if (period == 0)
+    {
+        return;
+    }
+
+    uint64_t elapsed = (uint64_t)batch->timer_cycles[lane] + cycles;
+    uint64_t ticks = elapsed / period;
+    batch->timer_cycles[lane] = elapsed % period;
+    batch->delay_timer[lane] = (batch->delay_timer[lane] > ticks) ? batch->delay_timer[lane] - ticks : 0;
+    batch->sound_timer[lane] = (batch->sound_timer[lane] > ticks) ? batch->sound_timer[lane] - ticks : 0;
+}
+
+
+// Lowest program counter among the running lanes, UINT32_MAX when none is running
+static uint32_t __batch_lowest_pc(const Chip8Batch* batch)
+{
+    const uint32_t first = batch->first;
+    const uint32_t end = batch->end;
+    const uint8_t* running = batch->running;
+    const uint16_t* pc = batch->pc;
+    uint32_t lowest = UINT32_MAX;
+    FOR_EACH_LANE(l)
+    {
+        uint32_t at = pc[l] | ~MASK32(running[l]);
+        lowest = (at < lowest) ? at : lowest;
+    }
+    return lowest;
+}
+
+
+// Fills batch->mask with the running lanes on program counter `lowest` that hold
+// the same instruction there, and `count` with their number. Returns the lane that leads the step
+static uint32_t __batch_schedule(Chip8Batch* batch, uint32_t lowest, uint32_t* count)
+{
+    const uint32_t first = batch->first;
+    const uint32_t end = batch->end;
+    const uint8_t* running = batch->running;
+    const uint16_t* pc = batch->pc;
+    uint8_t* mask = batch->mask;
+
+    uint32_t lead = first;
+    while (!running[lead] || pc[lead] != lowest)
+    {
+        lead++;
+    }
+
+    uint32_t in_step = 0;
+    FOR_EACH_LANE(l)
+    {
+        mask[l] = running[l] & (uint8_t)-(pc[l] == lowest);
+        in_step += mask[l] & 0x1;
+    }
+
+    // Lanes normally still hold the prototype memory where they execute. Only those
+    // that wrote to these pages need their instruction compared to the lead one
+    uint16_t pages = PAGE_BIT(lowest) | PAGE_BIT(lowest + 1);
+    const uint8_t* lead_memory = __lane_memory(batch, lead);
+    uint8_t hi = lead_memory[MEMORY_MASK(lowest)];
+    uint8_t lo = lead_memory[MEMORY_MASK(lowest + 1)];
+    uint8_t base_same = (batch->base[MEMORY_MASK(lowest)] == hi && batch->base[MEMORY_MASK(lowest + 1)] == lo) ? 0xFF : 0x00;
+
+    if ((batch->dirty_any & pages) || !base_same)
+    {
+        in_step = 0;
+        FOR_EACH_STEP_LANE(l)
+        {
+            if (batch->dirty_pages[l] & pages)
+            {
+                const uint8_t* memory = __lane_memory(batch, l);
+                mask[l] = (memory[MEMORY_MASK(lowest)] == hi && memory[MEMORY_MASK(lowest + 1)] == lo) ? 0xFF : 0x00;
+            }
+            else
+            {
+                mask[l] = base_same;
+            }
+            in_step += mask[l] & 0x1;
+        }
+    }
+
+    *count = in_step;
+    return lead;
+}
+
+
+// Whether lanes performing `op` together may end up on different program counters
+static inline int __batch_branches(Chip8Op op)
+{
+    switch(op)
+    {
+        case CHIP8_OP_RET:
+        case CHIP8_OP_SE_VX_NN:
+        case CHIP8_OP_SNE_VX_NN:
+        case CHIP8_OP_SE_VX_VY:
+        case CHIP8_OP_SNE_VX_VY:
+        case CHIP8_OP_JP_V0:
+        case CHIP8_OP_SKP:
+        case CHIP8_OP_SKNP: {
+            return 1;
+        }
+        default: {
+            return 0;
+        }
+    }
+}
+
+
+// Where the running lanes stand after a step: the lowest program counter (UINT32_MAX when
+// none is running), how many they are, and the steps until one reaches its deadline or
+// timer tick. Each minimum is UINT32_MAX when no lane is running
+typedef struct {
+    uint32_t lowest;
+    uint32_t count;
+    uint32_t to_deadline;
+    uint32_t to_tick;
+} BatchSurvey;
+
+
+// Bookkeeping after a step that not every running lane performed, or that a lane has
+// its deadline or timer tick after: pushes back the lanes that sat it out, counts the
+// timers down and ends the lanes done with the run. The arrays are passed as restrict
+// parameters, which is what lets GCC vectorize the loop
+static BatchSurvey __batch_end_step_lanes(uint32_t first, uint32_t end, uint32_t steps, uint32_t period, const uint8_t* restrict mask,
+                                          const uint16_t* restrict pc, uint8_t* restrict running,
+                                          uint32_t* restrict deadline, uint32_t* restrict tick_step, uint32_t* restrict timer_cycles,
+                                          uint8_t* restrict delay_timer, uint8_t* restrict sound_timer)
+{
+    const uint32_t counting = period ? 1 : 0;
+    BatchSurvey survey = { UINT32_MAX, 0, UINT32_MAX, UINT32_MAX };
+    FOR_EACH_LANE(l)
+    {
+        uint32_t run = running[l] & 0x1;
+        uint32_t late = run & ~mask[l] & 0x1;
+        deadline[l] += late;
+        tick_step[l] += late;
+
+        uint32_t tick = run & counting & (tick_step[l] == steps);
+        delay_timer[l] -= tick & (delay_timer[l] != 0);
+        sound_timer[l] -= tick & (sound_timer[l] != 0);
+        tick_step[l] += period & (0u - tick);
+
+        // Lanes done with the run leave it with their timer cycle count up to date, as __lane_settle
+        uint32_t done = run & (deadline[l] == steps);
+        timer_cycles[l] = SELECT(0u - (done & counting), period - (tick_step[l] - steps), timer_cycles[l]);
+        running[l] &= (uint8_t)(done - 1);
+
+        uint32_t others = (0u - (run & ~done));
+        uint32_t at = pc[l] | ~others;
+        uint32_t to_deadline = (deadline[l] - steps) | ~others;
+        uint32_t to_tick = (tick_step[l] - steps) | ~others;
+        survey.lowest = (at < survey.lowest) ? at : survey.lowest;
+        survey.to_deadline = (to_deadline < survey.to_deadline) ? to_deadline : survey.to_deadline;
+        survey.to_tick = (to_tick < survey.to_tick) ? to_tick : survey.to_tick;
+        survey.count += run & ~done;
+    }
+    return survey;
+}
+
+
+static inline BatchSurvey __batch_end_step(Chip8Batch* batch)
+{
+    return __batch_end_step_lanes(batch->first, batch->end, batch->steps, batch->period, batch->mask, batch->pc, batch->running,
+                                  batch->deadline, batch->tick_step, batch->timer_cycles, batch->delay_timer, batch->sound_timer);
+}
+
+
+// Runs the lanes of tile batch->first to batch->end in lockstep, leaving those that
+// run alone or leave lockstep to chip8_batch_run
+static void __batch_run_tile(Chip8Batch* batch)
+{
+    const uint32_t stride = batch->stride;
+    const uint32_t first = batch->first;
+    const uint32_t end = batch->end;
+    const uint32_t max_cycles = batch->max_cycles;
+    const uint32_t period = batch->period;
+    const uint8_t* mask = batch->mask;
+    uint16_t* pc = batch->pc;
+
+    batch->steps = 0;
+    FOR_EACH_LANE(l)
+    {
+        batch->running[l] = (l < batch->lanes && max_cycles > 0) ? (uint8_t)~batch->alone[l] : 0x00;
+        batch->mask[l] = batch->running[l];
+        batch->deadline[l] = max_cycles;
+        // A count left over from a longer period ticks on the first cycle, as in chip8_run
+        batch->tick_step[l] = (batch->timer_cycles[l] < period) ? period - batch->timer_cycles[l] : 1;
+    }
+
+    // `converged` is set while every running lane is on program counter `lowest`, after
+    // a step they all performed: unless one wrote there, they all perform the next one too
+    BatchSurvey survey = __batch_end_step(batch);
+    uint32_t lowest = survey.lowest;
+    uint32_t running_count = survey.count;
+    uint32_t next_deadline = survey.to_deadline;
+    uint32_t next_tick = survey.to_tick;
+    uint32_t lead = 0;
+    uint32_t count = 0;
+    int converged = 0;
+    while (running_count)
+    {
+        batch->stopped = 0;
+        if (!converged || (batch->dirty_any & (PAGE_BIT(lowest) | PAGE_BIT(lowest + 1))))
+        {
+            lead = __batch_schedule(batch, lowest, &count);
+        }
+
+        uint16_t lead_pc = pc[lead];
+        Chip8Instruction ins;
+        if (batch->dirty_pages[lead] & (PAGE_BIT(lead_pc) | PAGE_BIT(lead_pc + 1)))
+        {
+            const uint8_t* memory = __lane_memory(batch, lead);
+            ins = chip8_decode(memory[MEMORY_MASK(lead_pc)], memory[MEMORY_MASK(lead_pc + 1)]);
+        }
+        else
+        {
+            Chip8Instruction* cached = &batch->cache->ops[MEMORY_MASK(lead_pc)];
+            if (cached->op == CHIP8_OP_NONE)
+            {
+                *cached = chip8_decode(batch->base[MEMORY_MASK(lead_pc)], batch->base[MEMORY_MASK(lead_pc + 1)]);
+            }
+            ins = *cached;
+        }
+
+        // Too few lanes here to pay for a step: they have diverged from the others
+        if (count * BATCH_MIN_STEP_SHARE < end - first)
+        {
+            ins.op = CHIP8_OP_NONE;
+        }
+
+        uint8_t* vx = &batch->v[ins.x * stride];
+        const uint8_t* vy = &batch->v[ins.y * stride];
+        const uint8_t nn = ins.nn;
+        const uint16_t nnn = ins.nnn;
+
+        // Most instructions are a select per lane: lanes outside the mask keep their value.
+        // Those with x, y or F overlapping are written in the same order as chip8_run
+        switch(ins.op)
+        {
+            case CHIP8_OP_CLS: {
+                for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; ++y)
+                {
+                    uint64_t* row = &batch->VRAM[y * stride];
+                    FOR_EACH_LANE(l) { row[l] &= ~MASK64(mask[l]); }
+                }
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & 2; }
+                break;
+            }
+            case CHIP8_OP_RET: {
+                FOR_EACH_STEP_LANE(l)
+                {
+                    if (batch->sp[l] == 0)
+                    {
+                        __lane_stop(batch, l, CHIP8_STOP_FAULT);
+                        continue;
+                    }
+                    batch->sp[l]--;
+                    pc[l] = batch->stack[batch->sp[l] * stride + l] + 2;
+                }
+                break;
+            }
+            case CHIP8_OP_JP: {
+                FOR_EACH_LANE(l) { pc[l] = SELECT(MASK16(mask[l]), nnn, pc[l]); }
+                break;
+            }
+            case CHIP8_OP_CALL: {
+                FOR_EACH_STEP_LANE(l)
+                {
+                    if (batch->sp[l] >= CHIP8_STACK_SIZE)
+                    {
+                        __lane_stop(batch, l, CHIP8_STOP_FAULT);
+                        continue;
+                    }
+                    batch->stack[batch->sp[l] * stride + l] = pc[l];
+                    batch->sp[l]++;
+                    pc[l] = nnn;
+                }
+                break;
+            }
+            case CHIP8_OP_SE_VX_NN: {
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & (2 + 2 * (vx[l] == nn)); }
+                break;
+            }
+            case CHIP8_OP_SNE_VX_NN: {
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & (2 + 2 * (vx[l] != nn)); }
+                break;
+            }
+            case CHIP8_OP_SE_VX_VY: {
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & (2 + 2 * (vx[l] == vy[l])); }
+                break;
+            }
+            case CHIP8_OP_SNE_VX_VY: {
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & (2 + 2 * (vx[l] != vy[l])); }
+                break;
+            }
+            case CHIP8_OP_LD_VX_NN: {
+                FOR_EACH_LANE(l) { vx[l] = SELECT(mask[l], nn, vx[l]); }
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & 2; }
+                break;
+            }
+            case CHIP8_OP_ADD_VX_NN: {
+                FOR_EACH_LANE(l) { vx[l] += mask[l] & nn; }
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & 2; }
+                break;
+            }
+            case CHIP8_OP_LD_VX_VY:
+            case CHIP8_OP_OR:
+            case CHIP8_OP_AND:
+            case CHIP8_OP_XOR: {
+                switch(ins.op)
+                {
+                    case CHIP8_OP_LD_VX_VY: { FOR_EACH_LANE(l) { vx[l] = SELECT(mask[l], vy[l], vx[l]); } break; }
+                    case CHIP8_OP_OR: { FOR_EACH_LANE(l) { vx[l] |= mask[l] & vy[l]; } break; }
+                    case CHIP8_OP_AND: { FOR_EACH_LANE(l) { vx[l] &= ~mask[l] | vy[l]; } break; }
+                    default: { FOR_EACH_LANE(l) { vx[l] ^= mask[l] & vy[l]; } break; }
+                }
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & 2; }
+                break;
+            }
+            case CHIP8_OP_ADD_VX_VY:
+            case CHIP8_OP_SUB:
+            case CHIP8_OP_SHR:
+            case CHIP8_OP_SUBN:
+            case CHIP8_OP_SHL: {
+                // Flag-setting arithmetic. Vx is read once per lane up front, which only
+                // matches chip8_run's write order while Vx is not VF itself
+                uint8_t* flag = &batch->v[0xF * stride];
+                if (ins.x == 0xF)
+                {
+                    FOR_EACH_STEP_LANE(l)
+                    {
+                        switch(ins.op)
+                        {
+                            case CHIP8_OP_ADD_VX_VY: {
+                                uint16_t result = vx[l] + vy[l];
+                                vx[l] = result & 0xFF;
+                                flag[l] = (result > 0xFF) ? 0x1 : 0x0;
+                                break;
+                            }
+                            case CHIP8_OP_SUB: {
+                                uint16_t result = vx[l] - vy[l];
+                                flag[l] = (vx[l] < vy[l]) ? 0x0 : 0x1;
+                                vx[l] = result & 0xFF;
+                                break;
+                            }
+                            case CHIP8_OP_SHR: {
+                                flag[l] = vx[l] & 0x01;
+                                vx[l] = vx[l] >> 1;
+                                break;
+                            }
+                            case CHIP8_OP_SUBN: {
+                                uint16_t result = vy[l] - vx[l];
+                                flag[l] = (vx[l] > vy[l]) ? 0x0 : 0x1;
+                                vx[l] = result & 0xFF;
+                                break;
+                            }
+                            default: {
+                                flag[l] = (vx[l] >> 7) & 0x1;
+                                vx[l] = vx[l] << 1;
+                                break;
+                            }
+                        }
+                    }
+                }
+                else
+                {
+                    switch(ins.op)
+                    {
+                        case CHIP8_OP_ADD_VX_VY: {
+                            FOR_EACH_LANE(l)
+                            {
+                                uint8_t a = vx[l], b = vy[l];
+                                vx[l] = SELECT(mask[l], (uint8_t)(a + b), a);
+                                flag[l] = SELECT(mask[l], (uint8_t)(a + b > 0xFF), flag[l]);
+                            }
+                            break;
+                        }
+                        case CHIP8_OP_SUB: {
+                            FOR_EACH_LANE(l)
+                            {
+                                uint8_t a = vx[l], b = vy[l];
+                                flag[l] = SELECT(mask[l], (uint8_t)(a >= b), flag[l]);
+                                vx[l] = SELECT(mask[l], (uint8_t)(a - b), a);
+                            }
+                            break;
+                        }
+                        case CHIP8_OP_SHR: {
+                            FOR_EACH_LANE(l)
+                            {
+                                uint8_t a = vx[l];
+                                flag[l] = SELECT(mask[l], (uint8_t)(a & 0x01), flag[l]);
+                                vx[l] = SELECT(mask[l], (uint8_t)(a >> 1), a);
+                            }
+                            break;
+                        }
+                        case CHIP8_OP_SUBN: {
+                            FOR_EACH_LANE(l)
+                            {
+                                uint8_t a = vx[l], b = vy[l];
+                                flag[l] = SELECT(mask[l], (uint8_t)(b >= a), flag[l]);
+                                vx[l] = SELECT(mask[l], (uint8_t)(b - a), a);
+                            }
+                            break;
+                        }
+                        default: {
+                            FOR_EACH_LANE(l)
+                            {
+                                uint8_t a = vx[l];
+                                flag[l] = SELECT(mask[l], (uint8_t)(a >> 7), flag[l]);
+                                vx[l] = SELECT(mask[l], (uint8_t)(a << 1), a);
+                            }
+                            break;
+                        }
+                    }
+                }
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & 2; }
+                break;
+            }
+            case CHIP8_OP_LD_I: {
+                uint16_t* I = batch->I;
+                FOR_EACH_LANE(l) { I[l] = SELECT(MASK16(mask[l]), nnn, I[l]); }
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & 2; }
+                break;
+            }
+            case CHIP8_OP_JP_V0: {
+                const uint8_t* v0 = &batch->v[0];
+                FOR_EACH_LANE(l) { pc[l] = SELECT(MASK16(mask[l]), (uint16_t)(nnn + v0[l]), pc[l]); }
+                break;
+            }
+            case CHIP8_OP_RND: {
+                uint32_t* rng = batch->rng;
+                FOR_EACH_LANE(l)
+                {
+                    uint32_t r = rng[l];
+                    r ^= r << 13;
+                    r ^= r >> 17;
+                    r ^= r << 5;
+                    rng[l] = SELECT(MASK32(mask[l]), r, rng[l]);
+                }
+                FOR_EACH_LANE(l) { vx[l] = SELECT(mask[l], (uint8_t)((rng[l] >> 24) & nn), vx[l]); }
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & 2; }
+                break;
+            }
+            case CHIP8_OP_DRW: {
+                FOR_EACH_STEP_LANE(l)
+                {
+                    // 16x16 sprites are SUPER-CHIP, as the other instructions left to the default case
+                    if (ins.n == 0)
+                    {
+                        __lane_detach(batch, l);
+                        continue;
+                    }
+                    __lane_draw(batch, l, ins.x, ins.y, ins.n);
+                    pc[l] += 2;
+                }
+                break;
+            }
+            case CHIP8_OP_SKP: {
+                const uint16_t* keys = batch->keys;
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & (2 + 2 * ((keys[l] >> LOW_NIBBLE(vx[l])) & 0x1)); }
+                break;
+            }
+            case CHIP8_OP_SKNP: {
+                const uint16_t* keys = batch->keys;
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & (4 - 2 * ((keys[l] >> LOW_NIBBLE(vx[l])) & 0x1)); }
+                break;
+            }
+            case CHIP8_OP_LD_VX_DT: {
+                const uint8_t* delay_timer = batch->delay_timer;
+                FOR_EACH_LANE(l) { vx[l] = SELECT(mask[l], delay_timer[l], vx[l]); }
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & 2; }
+                break;
+            }
+            case CHIP8_OP_LD_VX_K: {
+                FOR_EACH_STEP_LANE(l)
+                {
+                    if (!batch->key_wait[l])
+                    {
+                        batch->key_wait[l] = 1;
+                        batch->key_wait_keys[l] = batch->keys[l];
+                    }
+                    else
+                    {
+                        uint16_t pressed = batch->keys[l] & ~batch->key_wait_keys[l];
+                        batch->key_wait_keys[l] &= batch->keys[l];
+                        if (pressed)
+                        {
+                            uint8_t key = 0;
+                            while (!(pressed & CHIP8_KEY(key)))
+                            {
+                                key++;
+                            }
+                            batch->key_wait[l] = 0;
+                            batch->key_wait_keys[l] = 0;
+                            vx[l] = key;
+                            pc[l] += 2;
+                            continue;
+                        }
+                    }
+
+                    // Still waiting: the rest of the budget is spent waiting, as in chip8_run
+                    __lane_stop(batch, l, CHIP8_STOP_KEY_WAIT);
+                    __lane_timers_advance(batch, l, period, batch->remaining[l]);
+                    batch->remaining[l] = 0;
+                }
+                break;
+            }
+            case CHIP8_OP_LD_DT_VX: {
+                uint8_t* delay_timer = batch->delay_timer;
+                FOR_EACH_LANE(l) { delay_timer[l] = SELECT(mask[l], vx[l], delay_timer[l]); }
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & 2; }
+                break;
+            }
+            case CHIP8_OP_LD_ST_VX: {
+                uint8_t* sound_timer = batch->sound_timer;
+                FOR_EACH_LANE(l) { sound_timer[l] = SELECT(mask[l], vx[l], sound_timer[l]); }
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & 2; }
+                break;
+            }
+            case CHIP8_OP_ADD_I_VX: {
+                uint16_t* I = batch->I;
+                FOR_EACH_LANE(l) { I[l] += mask[l] & vx[l]; }
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & 2; }
+                break;
+            }
+            case CHIP8_OP_LD_F_VX: {
+                uint16_t* I = batch->I;
+                FOR_EACH_LANE(l) { I[l] = SELECT(MASK16(mask[l]), (uint16_t)(5 * vx[l]), I[l]); }
+                FOR_EACH_LANE(l) { pc[l] += mask[l] & 2; }
+                break;
+            }
+            case CHIP8_OP_LD_B_VX: {
+                FOR_EACH_STEP_LANE(l)
+                {
+                    uint8_t value = vx[l];
+                    __lane_write(batch, l, batch->I[l], value / 100);
+                    __lane_write(batch, l, batch->I[l] + 1, (value / 10) % 10);
+                    __lane_write(batch, l, batch->I[l] + 2, value % 10);
+                    pc[l] += 2;
+                }
+                break;
+            }
+            case CHIP8_OP_LD_MEM_VX: {
+                FOR_EACH_STEP_LANE(l)
+                {
+                    for (uint8_t r = 0; r <= ins.x; ++r)
+                    {
+                        __lane_write(batch, l, batch->I[l] + r, batch->v[r * stride + l]);
+                    }
+                    pc[l] += 2;
+                }
+                break;
+            }
+            case CHIP8_OP_LD_VX_MEM: {
+                FOR_EACH_STEP_LANE(l)
+                {
+                    const uint8_t* memory = __lane_memory(batch, l);
+                    for (uint8_t r = 0; r <= ins.x; ++r)
+                    {
+                        batch->v[r * stride + l] = memory[MEMORY_MASK(batch->I[l] + r)];
+                    }
+                    pc[l] += 2;
+                }
+                break;
+            }
+            default: {
+                // SUPER-CHIP, faulting, or diverged lanes: chip8_run takes them on
+                FOR_EACH_STEP_LANE(l)
+                {
+                    __lane_detach(batch, l);
+                }
+                break;
+            }
+        }
+
+        // The lanes that performed the step all have their deadline and timer tick on the same
+        // step, as long as they performed every other one. Only when some did not, or when one
+        // of these steps comes, does a lane loop run
+        batch->steps++;
+        int together = count == running_count && !batch->stopped;
+        if (!together || batch->steps == next_deadline || (period && batch->steps == next_tick))
+        {
+            survey = __batch_end_step(batch);
+            lowest = survey.lowest;
+            running_count = survey.count;
+            next_deadline = batch->steps + survey.to_deadline;
+            next_tick = batch->steps + survey.to_tick;
+            converged = together && running_count == count && !__batch_branches(ins.op);
+        }
+        else if (__batch_branches(ins.op))
+        {
+            lowest = __batch_lowest_pc(batch);
+            converged = 0;
+        }
+        else
+        {
+            lowest = pc[lead];
+            converged = 1;
+        }
+    }
+}
+
+
+uint32_t chip8_batch_run(Chip8Batch* batch, uint32_t max_cycles, uint32_t cycles_per_timer_tick)
+{
+    const uint32_t period = cycles_per_timer_tick;
+
+    for (uint32_t l = 0; l < batch->lanes; ++l)
+    {
+        batch->reason[l] = CHIP8_STOP_BUDGET;
+        batch->remaining[l] = max_cycles & MASK32(batch->alone[l]);
+    }
+
+    // Lanes of small batches all run alone
+    batch->max_cycles = max_cycles;
+    batch->period = period;
+    if (batch->lanes >= BATCH_MIN_LANES)
+    {
+        for (uint32_t tile = 0; tile < batch->stride; tile += BATCH_TILE_LANES)
+        {
+            batch->first = tile;
+            batch->end = (tile + BATCH_TILE_LANES < batch->stride) ? tile + BATCH_TILE_LANES : batch->stride;
+            __batch_run_tile(batch);
+        }
+    }
+
+    // The lanes running alone, from the start or since they left lockstep, spend the rest of their budget
+    Chip8RunConfig config;
+    memset(&config, 0x0, sizeof(config));
+    config.cycles_per_timer_tick = period;
+    uint32_t completed = 0;
+    for (uint32_t l = 0; l < batch->lanes; ++l)
+    {
+        if (batch->alone[l])
+        {
+            config.cache = &batch->caches[l];
+            if (batch->remaining[l])
+            {
+                batch->reason[l] = (uint8_t)chip8_run(&batch->machines[l], batch->remaining[l], &config);
+            }
+            // A machine that faulted stays on the instruction, no use moving it back
+            if (batch->lanes >= BATCH_MIN_LANES && !batch->machines[l].hires && batch->reason[l] != CHIP8_STOP_FAULT)
+            {
+                __lane_attach(batch, l);
+            }
+        }
+        else
+        {
+            batch->cycles[l] += max_cycles - batch->remaining[l];
+        }
+        completed += (batch->reason[l] == CHIP8_STOP_BUDGET) ? 1 : 0;
+    }
+    return completed;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+
+/*
+A batch of Chip8 machines running the same ROM in lockstep. State is kept in
+structure-of-arrays form (one array per register, indexed by lane), so that
+when lanes sit on the same instruction it is performed for all of them with
+straight loops over the lanes, which the compiler turns into SIMD code.
+Lanes that diverge are scheduled lowest program counter first, which tends to
+bring them back together once both sides of a branch meet again.
+Lanes that lockstep does not pay for run alone, on a Chip8 of their own with
+chip8_run: every lane of a small batch, lanes in high resolution, and for the
+rest of a run, lanes left on their own by a branch or on a SUPER-CHIP instruction.
+Every lane ends up in the same state as a Chip8 run with chip8_run
+*/
+typedef struct _Chip8Batch Chip8Batch;
+
+
+// Returns a batch of `lanes` copies of `prototype`, or NULL if out of memory, if `lanes`
+// is 0, or if `prototype` has quirks other than CHIP8_QUIRKS_DEFAULT, which lanes do not implement
+Chip8Batch* chip8_batch_new(const Chip8* prototype, uint32_t lanes);
+// Deletes existing batch
+void chip8_batch_delete(Chip8Batch* batch);
+
+// Number of lanes in the batch
+uint32_t chip8_batch_lanes(const Chip8Batch* batch);
+
+// Copies the state of a lane out into `chip8`, initializing it first (chip8_init): it may
+// be uninitialized memory, and must not be in XO-CHIP or MEGA-CHIP mode
+void chip8_batch_get(const Chip8Batch* batch, uint32_t lane, Chip8* chip8);
+
+// Sets the pressed keys of a lane (CHIP8_KEY bits)
+void chip8_batch_set_keys(Chip8Batch* batch, uint32_t lane, uint16_t keys);
+// Seeds the Cxnn random generator of a lane, as chip8_seed
+void chip8_batch_seed(Chip8Batch* batch, uint32_t lane, uint32_t seed);
+
+// Performs up to `max_cycles` execution cycles on every lane, counting the timers
+// down every `cycles_per_timer_tick` cycles (0 leaves them alone), as chip8_run.
+// Returns the number of lanes that performed the whole budget
+uint32_t chip8_batch_run(Chip8Batch* batch, uint32_t max_cycles, uint32_t cycles_per_timer_tick);
+
+// Why a lane stopped during the last chip8_batch_run, as chip8_run would return it
+// (there are no breakpoints in a batch)
+Chip8StopReason chip8_batch_stop_reason(const Chip8Batch* batch, uint32_t lane);
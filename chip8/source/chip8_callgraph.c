@@ -0,0 +1,219 @@
+#include "chip8_callgraph.h"
+#include "chip8_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#define ROOT 0
+
+
+Chip8CallGraph* chip8_callgraph_new(uint32_t max_events)
+{
+    Chip8CallGraph* callgraph = calloc(1, sizeof(Chip8CallGraph));
+    callgraph->node_capacity = 256;
+    callgraph->nodes = malloc(callgraph->node_capacity * sizeof(Chip8CallNode));
+    callgraph->max_events = max_events;
+    callgraph->events = max_events ? malloc(max_events * sizeof(Chip8CallEvent)) : NULL;
+    chip8_callgraph_reset(callgraph);
+    return callgraph;
+}
+
+
+void chip8_callgraph_delete(Chip8CallGraph* callgraph)
+{
+    free(callgraph->events);
+    free(callgraph->nodes);
+    free(callgraph);
+}
+
+
+void chip8_callgraph_reset(Chip8CallGraph* callgraph)
+{
+    memset(&callgraph->nodes[ROOT], 0x0, sizeof(Chip8CallNode));
+    callgraph->nodes[ROOT].address = CHIP8_PROGRAM_START_LOCATION;
+    callgraph->node_count = 1;
+    callgraph->current = ROOT;
+
+    memset(callgraph->frames, 0x0, sizeof(callgraph->frames));
+    callgraph->depth = 0;
+
+    callgraph->event_count = 0;
+    callgraph->dropped = 0;
+    callgraph->cycles = 0;
+}
+
+
+uint32_t chip8_callgraph_dropped(const Chip8CallGraph* callgraph)
+{
+    return callgraph->dropped;
+}
+
+
+// Index of the chain `parent` followed by a call to `address`, added on first sight
+static uint32_t __chip8_callgraph_child(Chip8CallGraph* callgraph, uint32_t parent, uint16_t address)
+{
+    for (uint32_t child = callgraph->nodes[parent].first_child; child != ROOT; child = callgraph->nodes[child].next_sibling)
+    {
+        if (callgraph->nodes[child].address == address)
+        {
+            return child;
+        }
+    }
+
+    if (callgraph->node_count == callgraph->node_capacity)
+    {
+        callgraph->node_capacity *= 2;
+        callgraph->nodes = realloc(callgraph->nodes, callgraph->node_capacity * sizeof(Chip8CallNode));
+    }
+
+    uint32_t child = callgraph->node_count++;
+    Chip8CallNode* node = &callgraph->nodes[child];
+    memset(node, 0x0, sizeof(Chip8CallNode));
+    node->address = address;
+    node->parent = parent;
+    node->next_sibling = callgraph->nodes[parent].first_child;
+    callgraph->nodes[parent].first_child = child;
+    return child;
+}
+
+
+static void __chip8_callgraph_push(Chip8CallGraph* callgraph, uint16_t address, uint64_t cycle)
+{
+    uint32_t child = __chip8_callgraph_child(callgraph, callgraph->current, address);
+    callgraph->nodes[child].calls++;
+    callgraph->depth++;
+    callgraph->frames[callgraph->depth].node = child;
+    callgraph->frames[callgraph->depth].begin = cycle;
+    callgraph->current = child;
+}
+
+
+void chip8_callgraph_sync(Chip8CallGraph* callgraph, const Chip8* chip8, uint64_t cycle)
+{
+    uint32_t sp = (chip8->sp > CHIP8_STACK_SIZE) ? CHIP8_STACK_SIZE : chip8->sp;
+    while (callgraph->depth > sp)
+    {
+        callgraph->depth--;
+    }
+    callgraph->current = callgraph->frames[callgraph->depth].node;
+
+    // The stack only holds return addresses, so the callees are unknown
+    while (callgraph->depth < sp)
+    {
+        __chip8_callgraph_push(callgraph, CHIP8_CALLGRAPH_UNKNOWN, cycle);
+    }
+}
+
+
+void chip8_callgraph_call(Chip8CallGraph* callgraph, uint16_t address, uint64_t cycle)
+{
+    // The call itself runs in the caller
+    __chip8_callgraph_push(callgraph, address, cycle + 1);
+}
+
+
+void chip8_callgraph_return(Chip8CallGraph* callgraph, uint64_t cycle)
+{
+    const Chip8CallFrame* frame = &callgraph->frames[callgraph->depth];
+    if (callgraph->event_count < callgraph->max_events)
+    {
+        Chip8CallEvent* event = &callgraph->events[callgraph->event_count++];
+        event->node = frame->node;
+        event->depth = callgraph->depth;
+        event->begin = frame->begin;
+        event->end = cycle + 1; // The return itself runs in the callee
+    }
+    else
+    {
+        callgraph->dropped++;
+    }
+
+    callgraph->depth--;
+    callgraph->current = callgraph->frames[callgraph->depth].node;
+}
+
+
+static void __chip8_callgraph_write_name(const Chip8CallGraph* callgraph, uint32_t node, FILE* out)
+{
+    uint16_t address = callgraph->nodes[node].address;
+    if (node == ROOT)
+    {
+        fputs("main", out);
+    }
+    else if (address == CHIP8_CALLGRAPH_UNKNOWN)
+    {
+        fputs("?", out);
+    }
+    else
+    {
+        fprintf(out, "sub_%03X", address);
+    }
+}
+
+
+// Writes the chain from the root down to `node`, separated by ';'
+static void __chip8_callgraph_write_chain(const Chip8CallGraph* callgraph, uint32_t node, FILE* out)
+{
+    if (node != ROOT)
+    {
+        __chip8_callgraph_write_chain(callgraph, callgraph->nodes[node].parent, out);
+        fputc(';', out);
+    }
+    __chip8_callgraph_write_name(callgraph, node, out);
+}
+
+
+int chip8_callgraph_write_folded(const Chip8CallGraph* callgraph, FILE* out, Chip8CallGraphWeight weight)
+{
+    for (uint32_t node = 0; node < callgraph->node_count; ++node)
+    {
+        const Chip8CallNode* info = &callgraph->nodes[node];
+        uint64_t count = (weight == CHIP8_CALLGRAPH_PIXELS) ? info->pixels : info->instructions;
+        if (count == 0)
+        {
+            continue;
+        }
+
+        __chip8_callgraph_write_chain(callgraph, node, out);
+        fprintf(out, " %llu\n", (unsigned long long)count);
+    }
+
+    return ferror(out) ? -1 : 0;
+}
+
+
+static void __chip8_callgraph_write_event(const Chip8CallGraph* callgraph, const Chip8CallEvent* event, double us_per_cycle, int first, FILE* out)
+{
+    // Rewinding the machine can leave calls that end before they begin
+    uint64_t cycles = (event->end > event->begin) ? event->end - event->begin : 0;
+    fprintf(out, "%s\n    {\"name\": \"", first ? "" : ",");
+    __chip8_callgraph_write_name(callgraph, event->node, out);
+    fprintf(out, "\", \"cat\": \"chip8\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"depth\": %u, \"cycles\": %llu}}",
+        event->begin * us_per_cycle, cycles * us_per_cycle, event->depth, (unsigned long long)cycles);
+}
+
+
+int chip8_callgraph_write_trace(const Chip8CallGraph* callgraph, FILE* out, uint32_t cycles_per_second)
+{
+    double us_per_cycle = 1e6 / (cycles_per_second ? cycles_per_second : 1);
+
+    fprintf(out, "{\n  \"displayTimeUnit\": \"ms\",\n");
+    fprintf(out, "  \"otherData\": {\"cycles\": %llu, \"dropped_calls\": %u},\n", (unsigned long long)callgraph->cycles, callgraph->dropped);
+    fprintf(out, "  \"traceEvents\": [");
+
+    for (uint32_t i = 0; i < callgraph->event_count; ++i)
+    {
+        __chip8_callgraph_write_event(callgraph, &callgraph->events[i], us_per_cycle, i == 0, out);
+    }
+
+    // Calls still running, the root included, end where the last run ended
+    for (uint32_t depth = 0; depth <= callgraph->depth; ++depth)
+    {
+        Chip8CallEvent open = { callgraph->frames[depth].node, depth, callgraph->frames[depth].begin, callgraph->cycles };
+        __chip8_callgraph_write_event(callgraph, &open, us_per_cycle, callgraph->event_count == 0 && depth == 0, out);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    return ferror(out) ? -1 : 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "chip8.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+/*
+Call-graph profile of the emulated program. chip8_run keeps a shadow call
+stack in step with 2nnn/00EE and charges every executed instruction, and the
+pixels each Dxyn draws, to the subroutine running it, keyed by the chain of
+calls that led there. Filled in only by CHIP8_PROFILE builds, through
+Chip8RunConfig::callgraph.
+
+Besides the totals, each completed call can be logged with the cycles it
+started and ended at, for timeline views. The log holds up to `max_events`
+calls; later calls still count towards the totals.
+
+Chip8CallGraph itself is declared in chip8.h.
+*/
+
+// What folded stacks are weighted by
+typedef enum _Chip8CallGraphWeight {
+    CHIP8_CALLGRAPH_INSTRUCTIONS = 0,
+    CHIP8_CALLGRAPH_PIXELS, // Sprite pixels processed by Dxyn, clipped ones left out
+} Chip8CallGraphWeight;
+
+
+// Returns a new, empty call graph logging up to `max_events` calls (0 for none)
+Chip8CallGraph* chip8_callgraph_new(uint32_t max_events);
+// Deletes existing call graph
+void chip8_callgraph_delete(Chip8CallGraph* callgraph);
+// Forgets everything counted and logged. Needed when switching ROMs
+void chip8_callgraph_reset(Chip8CallGraph* callgraph);
+
+// Calls dropped because the log was full
+uint32_t chip8_callgraph_dropped(const Chip8CallGraph* callgraph);
+
+// Writes one "main;sub_2A4;sub_31C count" line per call chain, the format
+// flamegraph.pl, speedscope and inferno read. Counts are the chain's own
+// `weight`, not including the subroutines it calls
+// Returns 0 if OK, otherwise -1
+int chip8_callgraph_write_folded(const Chip8CallGraph* callgraph, FILE* out, Chip8CallGraphWeight weight);
+// Writes the logged calls as Chrome trace event JSON (chrome://tracing, Perfetto),
+// one complete event per call. Cycles are turned into time at `cycles_per_second`
+// Returns 0 if OK, otherwise -1
+int chip8_callgraph_write_trace(const Chip8CallGraph* callgraph, FILE* out, uint32_t cycles_per_second);
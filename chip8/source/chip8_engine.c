@@ -0,0 +1,672 @@
+#include "chip8_internal.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+
+#define REPEAT_4(op) op, op, op, op
+#define REPEAT_16(op) REPEAT_4(op), REPEAT_4(op), REPEAT_4(op), REPEAT_4(op)
+#define REPEAT_64(op) REPEAT_16(op), REPEAT_16(op), REPEAT_16(op), REPEAT_16(op)
+#define REPEAT_256(op) REPEAT_64(op), REPEAT_64(op), REPEAT_64(op), REPEAT_64(op)
+
+/*
+Decoding is two table lookups: the first nibble picks a group, and the bits of
+the opcode in the group's mask pick the instruction kind in its table. Keys the
+table leaves at CHIP8_OP_NONE are the group's `otherwise` kind, so the groups
+of a single kind (1nnn, 6xnn, ...) have an empty mask and a one-entry table.
+A few kinds also need operand bits outside their key clear (decode_clear): the
+XO-CHIP F000 and F002 are Fx00 and Fx02 with x = 0.
+*/
+typedef struct _Chip8DecodeGroup {
+    const uint8_t* ops; // Chip8Op by key
+    uint16_t mask; // Bits of the opcode making up the key
+    uint8_t otherwise; // Chip8Op of the keys without one
+} Chip8DecodeGroup;
+
+static const uint8_t decode_none[1] = { CHIP8_OP_NONE };
+
+// 0nnn by nnn: the SUPER-CHIP 00nn, and MEGA-CHIP taking 0010, 0011 and 01nn to 09nn out of the calls
+static const uint8_t decode_0[0x1000] = {
+    [0x010] = CHIP8_OP_MEGA_OFF,
+    [0x011] = CHIP8_OP_MEGA_ON,
+    [0x0B0] = REPEAT_16(CHIP8_OP_SCU),
+    [0x0C0] = REPEAT_16(CHIP8_OP_SCD),
+    [0x0E0] = CHIP8_OP_CLS,
+    [0x0EE] = CHIP8_OP_RET,
+    [0x0FB] = CHIP8_OP_SCR,
+    [0x0FC] = CHIP8_OP_SCL,
+    [0x0FD] = CHIP8_OP_EXIT,
+    [0x0FE] = CHIP8_OP_LOW,
+    [0x0FF] = CHIP8_OP_HIGH,
+    [0x100] = REPEAT_256(CHIP8_OP_LD_I_24),
+    [0x200] = REPEAT_256(CHIP8_OP_LDPAL),
+    [0x300] = REPEAT_256(CHIP8_OP_SPRW),
+    [0x400] = REPEAT_256(CHIP8_OP_SPRH),
+    [0x500] = REPEAT_256(CHIP8_OP_ALPHA),
+    [0x600] = REPEAT_16(CHIP8_OP_DIGISND),
+    [0x700] = CHIP8_OP_STOPSND,
+    [0x800] = REPEAT_16(CHIP8_OP_BMODE),
+    [0x900] = REPEAT_256(CHIP8_OP_CCOL),
+};
+
+// 5xyn, 8xyn and 9xyn by n
+static const uint8_t decode_5[16] = {
+    [0x0] = CHIP8_OP_SE_VX_VY,
+    [0x2] = CHIP8_OP_SAVE_RANGE,
+    [0x3] = CHIP8_OP_LOAD_RANGE,
+};
+
+static const uint8_t decode_8[16] = {
+    [0x0] = CHIP8_OP_LD_VX_VY,
+    [0x1] = CHIP8_OP_OR,
+    [0x2] = CHIP8_OP_AND,
+    [0x3] = CHIP8_OP_XOR,
+    [0x4] = CHIP8_OP_ADD_VX_VY,
+    [0x5] = CHIP8_OP_SUB,
+    [0x6] = CHIP8_OP_SHR,
+    [0x7] = CHIP8_OP_SUBN,
+    [0xE] = CHIP8_OP_SHL,
+};
+
+static const uint8_t decode_9[16] = {
+    [0x0] = CHIP8_OP_SNE_VX_VY,
+};
+
+// Exnn and Fxnn by nn
+static const uint8_t decode_e[256] = {
+    [0x9E] = CHIP8_OP_SKP,
+    [0xA1] = CHIP8_OP_SKNP,
+};
+
+static const uint8_t decode_f[256] = {
+    [0x00] = CHIP8_OP_LD_I_LONG,
+    [0x01] = CHIP8_OP_PLANE,
+    [0x02] = CHIP8_OP_AUDIO,
+    [0x07] = CHIP8_OP_LD_VX_DT,
+    [0x0A] = CHIP8_OP_LD_VX_K,
+    [0x15] = CHIP8_OP_LD_DT_VX,
+    [0x18] = CHIP8_OP_LD_ST_VX,
+    [0x1E] = CHIP8_OP_ADD_I_VX,
+    [0x29] = CHIP8_OP_LD_F_VX,
+    [0x30] = CHIP8_OP_LD_HF_VX,
+    [0x33] = CHIP8_OP_LD_B_VX,
+    [0x3A] = CHIP8_OP_PITCH,
+    [0x55] = CHIP8_OP_LD_MEM_VX,
+    [0x65] = CHIP8_OP_LD_VX_MEM,
+    [0x75] = CHIP8_OP_LD_R_VX,
+    [0x85] = CHIP8_OP_LD_VX_R,
+};
+
+static const Chip8DecodeGroup decode_groups[16] = {
+    [0x0] = { decode_0, 0x0FFF, CHIP8_OP_SYS },
+    [0x1] = { decode_none, 0x0000, CHIP8_OP_JP },
+    [0x2] = { decode_none, 0x0000, CHIP8_OP_CALL },
+    [0x3] = { decode_none, 0x0000, CHIP8_OP_SE_VX_NN },
+    [0x4] = { decode_none, 0x0000, CHIP8_OP_SNE_VX_NN },
+    [0x5] = { decode_5, 0x000F, CHIP8_OP_INVALID },
+    [0x6] = { decode_none, 0x0000, CHIP8_OP_LD_VX_NN },
+    [0x7] = { decode_none, 0x0000, CHIP8_OP_ADD_VX_NN },
+    [0x8] = { decode_8, 0x000F, CHIP8_OP_INVALID },
+    [0x9] = { decode_9, 0x000F, CHIP8_OP_INVALID },
+    [0xA] = { decode_none, 0x0000, CHIP8_OP_LD_I },
+    [0xB] = { decode_none, 0x0000, CHIP8_OP_JP_V0 },
+    [0xC] = { decode_none, 0x0000, CHIP8_OP_RND },
+    [0xD] = { decode_none, 0x0000, CHIP8_OP_DRW },
+    [0xE] = { decode_e, 0x00FF, CHIP8_OP_INVALID },
+    [0xF] = { decode_f, 0x00FF, CHIP8_OP_INVALID },
+};
+
+// Opcode bits that must be clear for each kind, which decodes as its group's `otherwise` kind if not
+static const uint16_t decode_clear[CHIP8_OP_COUNT] = {
+    [CHIP8_OP_LD_I_LONG] = 0x0F00,
+    [CHIP8_OP_AUDIO] = 0x0F00,
+};
+
+#undef REPEAT_4
+#undef REPEAT_16
+#undef REPEAT_64
+#undef REPEAT_256
+
+
+Chip8Instruction chip8_decode(uint8_t hi, uint8_t lo)
+{
+    const uint16_t opcode = U16(hi, lo);
+    const Chip8DecodeGroup* group = &decode_groups[HIGH_NIBBLE(hi)];
+    uint8_t op = group->ops[opcode & group->mask];
+    if (op == CHIP8_OP_NONE || (opcode & decode_clear[op]))
+    {
+        op = group->otherwise;
+    }
+
+    Chip8Instruction ins;
+    ins.op = op;
+    ins.x = LOW_NIBBLE(hi);
+    ins.y = HIGH_NIBBLE(lo);
+    ins.n = LOW_NIBBLE(lo);
+    ins.nn = lo;
+    ins.reserved = 0;
+    ins.nnn = opcode & 0x0FFF;
+    return ins;
+}
+
+
+Chip8Instruction chip8_decode_at(const Chip8* chip8, uint32_t at, uint32_t* length)
+{
+    // Bytes past the end wrap around, as the interpreter fetches them
+    const uint8_t* memory = CHIP8_MEMORY(chip8);
+    const uint32_t mask = CHIP8_MEMORY_BYTES(chip8) - 1;
+    Chip8Instruction ins = chip8_decode(memory[at & mask], memory[(at + 1) & mask]);
+    if (length)
+    {
+        const int word = (chip8->xo && ins.op == CHIP8_OP_LD_I_LONG) || (chip8->mega && ins.op == CHIP8_OP_LD_I_24);
+        *length = word ? 4 : 2;
+    }
+    return ins;
+}
+
+
+Chip8DecodeCache* chip8_decode_cache_new()
+{
+    Chip8DecodeCache* cache = malloc(sizeof(Chip8DecodeCache));
+    if (!cache)
+    {
+        return NULL;
+    }
+    chip8_decode_cache_reset(cache);
+    return cache;
+}
+
+
+void chip8_decode_cache_delete(Chip8DecodeCache* cache)
+{
+    free(cache);
+}
+
+
+void chip8_decode_cache_reset(Chip8DecodeCache* cache)
+{
+    // CHIP8_OP_NONE is 0, so a zeroed cache holds no instruction
+    memset(cache, 0x0, sizeof(Chip8DecodeCache));
+}
+
+
+void chip8_decode_cache_invalidate(Chip8DecodeCache* cache, uint16_t at, uint16_t size)
+{
+    // The instruction starting one byte before `at` also reads the byte at `at`
+    for (uint32_t i = 0; i <= size; ++i)
+    {
+        cache->ops[MEMORY_MASK(at - 1 + i)].op = CHIP8_OP_NONE;
+    }
+}
+
+
+void chip8_profile_reset(Chip8Profile* profile)
+{
+    memset(profile, 0x0, sizeof(Chip8Profile));
+}
+
+
+const char* chip8_profile_path_name(Chip8Op op, uint32_t path)
+{
+    switch(op)
+    {
+        case CHIP8_OP_SE_VX_NN:
+        case CHIP8_OP_SNE_VX_NN:
+        case CHIP8_OP_SE_VX_VY:
+        case CHIP8_OP_SNE_VX_VY:
+        case CHIP8_OP_SKP:
+        case CHIP8_OP_SKNP: {
+            const char* names[] = { "Not skipped", "Skipped" };
+            return path < 2 ? names[path] : NULL;
+        }
+        case CHIP8_OP_ADD_VX_VY: {
+            const char* names[] = { "No carry", "Carry" };
+            return path < 2 ? names[path] : NULL;
+        }
+        case CHIP8_OP_SUB:
+        case CHIP8_OP_SUBN: {
+            const char* names[] = { "Borrow", "No borrow" };
+            return path < 2 ? names[path] : NULL;
+        }
+        case CHIP8_OP_SHR:
+        case CHIP8_OP_SHL: {
+            const char* names[] = { "0 shifted out", "1 shifted out" };
+            return path < 2 ? names[path] : NULL;
+        }
+        case CHIP8_OP_DRW: {
+            const char* names[] = { "Drawn", "Collided", "Clipped", "Collided, clipped" };
+            return path < CHIP8_PROFILE_PATHS ? names[path] : NULL;
+        }
+        case CHIP8_OP_LD_VX_K: {
+            const char* names[] = { "Wait started", "Waiting", "Pressed" };
+            return path < 3 ? names[path] : NULL;
+        }
+        default: { return path == CHIP8_PATH_PLAIN ? "Executed" : NULL; }
+    }
+}
+
+
+// Draws the sprites of __chip8_draw that do not fit one 64-bit word: any sprite in
+// high resolution, and 16x16 ones (n = 0). Draws into `vram` the sprite at `at`
+// in `memory`, wrapping addresses with `mask`. Pixels past the right or bottom
+// edge are clipped, or with `wrap` drawn from the other edge. Returns the pixels
+// turned off
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((noinline))
+#endif
+static uint64_t __chip8_draw_wide(uint64_t (*vram)[CHIP8_VRAM_WORDS], const uint8_t* memory, uint32_t mask, uint32_t at, uint8_t hires,
+                                  uint32_t x, uint32_t y, uint8_t n, uint8_t wrap)
+{
+    /*
+    A row of up to 16 pixels is left-aligned in a word, then shifted into
+    place across the two words of the VRAM row, so each row is still two
+    XORs and two ANDs. In low resolution the second word is dropped, which
+    clips at the right edge. Wrapping adds what leaves the row back onto
+    its first word: the display width is one or two whole words.
+    */
+    const uint32_t width = hires ? CHIP8_HIRES_WIDTH : CHIP8_DISPLAY_WIDTH;
+    const uint32_t height = hires ? CHIP8_HIRES_HEIGHT : CHIP8_DISPLAY_HEIGHT;
+    const uint32_t wide = (n == 0);
+    const uint32_t rows = wide ? 16 : n;
+    uint64_t collision = 0;
+
+    if (x >= width)
+    {
+        return 0;
+    }
+
+    for (uint32_t row = 0; row < rows && (wrap || y + row < height); ++row)
+    {
+        uint32_t from = at + (wide ? 2 * row : row);
+        uint64_t sprite = wide ? U16(memory[from & mask], memory[(from + 1) & mask]) : memory[from & mask];
+        uint64_t aligned = sprite << (wide ? 48 : 56);
+        uint64_t left = (x < 64) ? aligned >> x : 0;
+        uint64_t right = (x == 0) ? 0 : (x < 64) ? aligned << (64 - x) : aligned >> (x - 64);
+        if (wrap && x > width - (wide ? 16 : 8))
+        {
+            left |= hires ? aligned << (128 - x) : right;
+        }
+        right = hires ? right : 0;
+
+        uint64_t* line = vram[(y + row) & (height - 1)];
+        collision |= (line[0] & left) | (line[1] & right);
+        line[0] ^= left;
+        line[1] ^= right;
+    }
+
+    return collision;
+}
+
+
+// Draws the sprite at I to (x, y), setting VF on collision: n rows of 8 pixels,
+// or 16 rows of 16 pixels (2 bytes each) when n is 0
+static inline void __chip8_draw(Chip8* chip8, uint8_t x, uint8_t y, uint8_t n)
+{
+    /*
+    Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels
+    and a height of N pixels. Each row of 8 pixels is read as bit-coded
+    starting from memory location I; I value does not change after the
+    execution of this instruction. As described above, VF is set to 1 if
+    any screen pixels are flipped from set to unset when the sprite is
+    drawn, and to 0 if that does not happen
+
+    Sprite rows and VRAM rows share the same bit order, so each sprite row
+    is shifted into place and XORed in one go, and the collision check is
+    a single AND. Pixels past the right or bottom edge are clipped.
+    */
+    uint64_t collision = 0;
+
+    if (chip8->hires || n == 0)
+    {
+        collision = __chip8_draw_wide(chip8->VRAM, chip8->memory, CHIP8_MEMORY_SIZE - 1, chip8->I, chip8->hires, x, y, n, 0);
+    }
+    else if (x < CHIP8_DISPLAY_WIDTH)
+    {
+        for (uint32_t row = 0; row < n && y + row < CHIP8_DISPLAY_HEIGHT; ++row)
+        {
+            uint64_t sprite = chip8->memory[MEMORY_MASK(chip8->I + row)];
+            uint64_t bits = (x <= CHIP8_DISPLAY_WIDTH - 8) ? sprite << (CHIP8_DISPLAY_WIDTH - 8 - x) : sprite >> (x - (CHIP8_DISPLAY_WIDTH - 8));
+            collision |= chip8->VRAM[y + row][0] & bits;
+            chip8->VRAM[y + row][0] ^= bits;
+        }
+    }
+
+    chip8->v[0xF] = (collision != 0) ? 0x1 : 0x0;
+}
+
+
+/*
+Dxyn for machines whose memory is not Chip8::memory: XO-CHIP ones, and
+MEGA-CHIP ones with the mode off. Draws the sprite at `at` in `memory` (wrapped
+with `mask`) into each plane selected with Fn01 in turn (the only plane
+outside XO-CHIP), each next one from the bytes right after the previous
+sprite. VF is set on a collision in any of them. Pixels past the edges are
+clipped, or with `wrap` (XO-CHIP, as Octo) drawn from the other edge. Kept
+apart from __chip8_draw, as only the XO-CHIP and MEGA-CHIP interpreter loops
+call it.
+*/
+static void __chip8_draw_planes(Chip8* chip8, const uint8_t* memory, uint32_t mask, uint32_t at, uint8_t x, uint8_t y, uint8_t n, uint8_t wrap)
+{
+    Chip8Xo* xo = chip8->xo;
+    uint64_t (*planes[CHIP8_XO_PLANES])[CHIP8_VRAM_WORDS] = { chip8->VRAM, xo ? xo->VRAM : NULL };
+    const uint8_t selected = xo ? xo->planes : 0x1;
+    uint64_t collision = 0;
+
+    for (uint32_t p = 0; p < CHIP8_XO_PLANES; ++p)
+    {
+        if (BIT(selected, p))
+        {
+            collision |= __chip8_draw_wide(planes[p], memory, mask, at, chip8->hires, x, y, n, wrap);
+            at += n ? n : 32;
+        }
+    }
+
+    chip8->v[0xF] = (collision != 0) ? 0x1 : 0x0;
+}
+
+
+// 00Cn: moves every row of `vram` down by `n`, whole rows at a time, blanking the top ones
+static void __chip8_scroll_down(uint64_t (*vram)[CHIP8_VRAM_WORDS], uint8_t hires, uint8_t n)
+{
+    const uint32_t height = hires ? CHIP8_HIRES_HEIGHT : CHIP8_DISPLAY_HEIGHT;
+    n = (n < height) ? n : height;
+    memmove(vram[n], vram[0], (height - n) * sizeof(vram[0]));
+    memset(vram[0], 0x0, n * sizeof(vram[0]));
+}
+
+
+// 00Bn: moves every row of `vram` up by `n`, blanking the bottom ones
+static void __chip8_scroll_up(uint64_t (*vram)[CHIP8_VRAM_WORDS], uint8_t hires, uint8_t n)
+{
+    const uint32_t height = hires ? CHIP8_HIRES_HEIGHT : CHIP8_DISPLAY_HEIGHT;
+    n = (n < height) ? n : height;
+    memmove(vram[0], vram[n], (height - n) * sizeof(vram[0]));
+    memset(vram[height - n], 0x0, n * sizeof(vram[0]));
+}
+
+
+// 00FB and 00FC: moves every row of `vram` 4 pixels right or left, shifting its words
+static void __chip8_scroll_horizontal(uint64_t (*vram)[CHIP8_VRAM_WORDS], uint8_t hires, int right)
+{
+    const uint32_t height = hires ? CHIP8_HIRES_HEIGHT : CHIP8_DISPLAY_HEIGHT;
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        uint64_t* line = vram[y];
+        if (right)
+        {
+            // Low resolution rows are a single word, what leaves it is gone
+            line[1] = hires ? (line[1] >> 4) | (line[0] << 60) : 0;
+            line[0] >>= 4;
+        }
+        else
+        {
+            line[0] = (line[0] << 4) | (line[1] >> 60);
+            line[1] <<= 4;
+        }
+    }
+}
+
+
+// 00FE and 00FF: switches the display resolution, clearing it (every plane in XO-CHIP)
+static void __chip8_set_hires(Chip8* chip8, uint8_t hires)
+{
+    chip8->hires = hires;
+    memset(chip8->VRAM, 0x0, sizeof(chip8->VRAM));
+    if (chip8->xo)
+    {
+        memset(chip8->xo->VRAM, 0x0, sizeof(chip8->xo->VRAM));
+    }
+}
+
+
+void chip8_draw_sprite(Chip8* chip8, uint8_t rx, uint8_t ry, uint8_t n)
+{
+    __chip8_draw(chip8, chip8->v[rx], chip8->v[ry], n);
+}
+
+
+// Writes `value` into memory at `at`, keeping the decode cache (if any) coherent
+static inline void __chip8_write(Chip8* chip8, Chip8DecodeCache* cache, uint16_t at, uint8_t value)
+{
+    at = MEMORY_MASK(at);
+    chip8->memory[at] = value;
+    chip8->dirty_pages |= PAGE_BIT(at);
+    if (cache)
+    {
+        cache->ops[at].op = CHIP8_OP_NONE;
+        cache->ops[MEMORY_MASK(at - 1)].op = CHIP8_OP_NONE;
+    }
+}
+
+
+// Chip8Op of the instruction at `pc`, straight from memory. Looking ahead must not fill
+// the cache: an entry decoded there unfused would never head a superinstruction itself
+static uint8_t __chip8_peek_op(const uint8_t* memory, uint16_t pc)
+{
+    return chip8_decode(memory[MEMORY_MASK(pc)], memory[MEMORY_MASK(pc + 1)]).op;
+}
+
+
+// Turns the cache entry at `pc` into a superinstruction when a fusable sequence starts there
+static void __chip8_fuse(Chip8DecodeCache* cache, const uint8_t* memory, uint16_t pc)
+{
+    Chip8Instruction* first = &cache->ops[MEMORY_MASK(pc)];
+    uint8_t second = __chip8_peek_op(memory, pc + 2);
+    uint8_t fused = CHIP8_OP_NONE;
+
+    switch(first->op)
+    {
+        case CHIP8_OP_LD_I: { if (second == CHIP8_OP_DRW) fused = CHIP8_OP_FUSED_LD_I_DRW; break; }
+        case CHIP8_OP_LD_VX_NN: { if (second == CHIP8_OP_LD_VX_NN) fused = CHIP8_OP_FUSED_LD_LD; break; }
+        case CHIP8_OP_ADD_VX_NN: {
+            if (second == CHIP8_OP_SE_VX_NN)
+            {
+                fused = (__chip8_peek_op(memory, pc + 4) == CHIP8_OP_JP) ? CHIP8_OP_FUSED_ADD_SE_JP : CHIP8_OP_FUSED_ADD_SE;
+            }
+            break;
+        }
+        case CHIP8_OP_LD_VX_DT: { if (second == CHIP8_OP_SE_VX_NN) fused = CHIP8_OP_FUSED_DT_SE; break; }
+    }
+
+    if (fused != CHIP8_OP_NONE)
+    {
+        first->reserved = first->op;
+        first->op = fused;
+    }
+}
+
+
+// Decodes the instruction at `pc` into the cache. Kept out of line, as misses are rare
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((noinline))
+#endif
+static void __chip8_decode_cache_fill(Chip8DecodeCache* cache, const uint8_t* memory, uint16_t pc, int fuse)
+{
+    cache->ops[MEMORY_MASK(pc)] = chip8_decode(memory[MEMORY_MASK(pc)], memory[MEMORY_MASK(pc + 1)]);
+    if (fuse)
+    {
+        __chip8_fuse(cache, memory, pc);
+    }
+}
+
+
+// Decodes the instruction at `pc` into `dst`, for runs without a cache. `mask`
+// wraps addresses into the memory: CHIP8_MEMORY_SIZE - 1, 0xFFFF in XO-CHIP or
+// 0xFFFFFF in MEGA-CHIP
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((noinline))
+#endif
+static void __chip8_decode_at(Chip8Instruction* dst, const uint8_t* memory, uint16_t pc, uint32_t mask)
+{
+    *dst = chip8_decode(memory[pc & mask], memory[(pc + 1) & mask]);
+}
+
+
+// State of a loop as its backward jump was last reached, see IDLE_CHECK
+typedef struct _Chip8IdleLoop {
+    uint32_t pc; // Of the jump, CHIP8_XO_MEMORY_SIZE (past any address) while none was seen
+    uint16_t I;
+    uint8_t delay_timer;
+    uint8_t v[CHIP8_NUM_REGISTERS];
+    uint32_t executed;
+    uint32_t effects;
+} Chip8IdleLoop;
+
+
+void chip8_timers_advance(Chip8* chip8, uint32_t period, uint32_t cycles)
+{
+    if (period == 0)
+    {
+        return;
+    }
+
+    uint64_t elapsed = (uint64_t)chip8->timer_cycles + cycles;
+    uint64_t ticks = elapsed / period;
+    chip8->timer_cycles = elapsed % period;
+    chip8->delay_timer = (chip8->delay_timer > ticks) ? chip8->delay_timer - ticks : 0;
+    chip8->sound_timer = (chip8->sound_timer > ticks) ? chip8->sound_timer - ticks : 0;
+}
+
+
+/*
+One interpreter loop per quirk profile, see chip8_engine.inl. chip8_run picks
+the one matching the machine once per run, not per instruction.
+*/
+#define CHIP8_RUN_NAME __chip8_run_default
+#define QUIRK_SHIFT_VY 0
+#define QUIRK_MEMORY_INCREMENT(x) 0
+#define QUIRK_JUMP_VX 0
+#define QUIRK_VF_RESET 0
+#define QUIRK_FLAG_LAST 0
+#define QUIRK_SPRITE_WRAP 0
+#define QUIRK_PIXEL_WRAP 0
+#define QUIRK_XO 0
+#define QUIRK_MEGA 0
+#include "chip8_engine.inl"
+
+#define CHIP8_RUN_NAME __chip8_run_vip
+#define QUIRK_SHIFT_VY 1
+#define QUIRK_MEMORY_INCREMENT(x) ((x) + 1)
+#define QUIRK_JUMP_VX 0
+#define QUIRK_VF_RESET 1
+#define QUIRK_FLAG_LAST 1
+#define QUIRK_SPRITE_WRAP 1
+#define QUIRK_PIXEL_WRAP 0
+#define QUIRK_XO 0
+#define QUIRK_MEGA 0
+#include "chip8_engine.inl"
+
+#define CHIP8_RUN_NAME __chip8_run_chip48
+#define QUIRK_SHIFT_VY 0
+#define QUIRK_MEMORY_INCREMENT(x) (x)
+#define QUIRK_JUMP_VX 1
+#define QUIRK_VF_RESET 0
+#define QUIRK_FLAG_LAST 1
+#define QUIRK_SPRITE_WRAP 1
+#define QUIRK_PIXEL_WRAP 0
+#define QUIRK_XO 0
+#define QUIRK_MEGA 0
+#include "chip8_engine.inl"
+
+#define CHIP8_RUN_NAME __chip8_run_schip
+#define QUIRK_SHIFT_VY 0
+#define QUIRK_MEMORY_INCREMENT(x) 0
+#define QUIRK_JUMP_VX 1
+#define QUIRK_VF_RESET 0
+#define QUIRK_FLAG_LAST 1
+#define QUIRK_SPRITE_WRAP 1
+#define QUIRK_PIXEL_WRAP 0
+#define QUIRK_XO 0
+#define QUIRK_MEGA 0
+#include "chip8_engine.inl"
+
+#define CHIP8_RUN_NAME __chip8_run_xochip
+#define QUIRK_SHIFT_VY 1
+#define QUIRK_MEMORY_INCREMENT(x) ((x) + 1)
+#define QUIRK_JUMP_VX 0
+#define QUIRK_VF_RESET 0
+#define QUIRK_FLAG_LAST 1
+#define QUIRK_SPRITE_WRAP 1
+#define QUIRK_PIXEL_WRAP 1
+#define QUIRK_XO 1
+#define QUIRK_MEGA 0
+#include "chip8_engine.inl"
+
+#define CHIP8_RUN_NAME __chip8_run_megachip
+#define QUIRK_SHIFT_VY 0
+#define QUIRK_MEMORY_INCREMENT(x) 0
+#define QUIRK_JUMP_VX 1
+#define QUIRK_VF_RESET 0
+#define QUIRK_FLAG_LAST 1
+#define QUIRK_SPRITE_WRAP 1
+#define QUIRK_PIXEL_WRAP 0
+#define QUIRK_XO 0
+#define QUIRK_MEGA 1
+#include "chip8_engine.inl"
+
+
+Chip8StopReason chip8_run(Chip8* chip8, uint32_t max_cycles, const Chip8RunConfig* config)
+{
+    switch(chip8->quirks)
+    {
+        case CHIP8_QUIRKS_VIP: { return __chip8_run_vip(chip8, max_cycles, config); }
+        case CHIP8_QUIRKS_CHIP48: { return __chip8_run_chip48(chip8, max_cycles, config); }
+        case CHIP8_QUIRKS_SCHIP: { return __chip8_run_schip(chip8, max_cycles, config); }
+        case CHIP8_QUIRKS_XOCHIP: { return __chip8_run_xochip(chip8, max_cycles, config); }
+        case CHIP8_QUIRKS_MEGACHIP: { return __chip8_run_megachip(chip8, max_cycles, config); }
+        default: { return __chip8_run_default(chip8, max_cycles, config); }
+    }
+}
+
+
+const char* chip8_quirks_behavior(Chip8Op op, Chip8Quirks quirks)
+{
+    // The QUIRK_* definitions of each interpreter loop above, by Chip8Quirks
+    static const struct {
+        uint8_t shift_vy, memory_increment, jump_vx, vf_reset, flag_last, sprite_wrap, pixel_wrap;
+    } loops[CHIP8_QUIRKS_COUNT] = {
+        [CHIP8_QUIRKS_DEFAULT] = { 0, 0, 0, 0, 0, 0, 0 },
+        [CHIP8_QUIRKS_VIP] = { 1, 2, 0, 1, 1, 1, 0 },
+        [CHIP8_QUIRKS_CHIP48] = { 0, 1, 1, 0, 1, 1, 0 },
+        [CHIP8_QUIRKS_SCHIP] = { 0, 0, 1, 0, 1, 1, 0 },
+        [CHIP8_QUIRKS_XOCHIP] = { 1, 2, 0, 0, 1, 1, 1 },
+        [CHIP8_QUIRKS_MEGACHIP] = { 0, 0, 1, 0, 1, 1, 0 },
+    };
+    if ((uint32_t)quirks >= CHIP8_QUIRKS_COUNT)
+    {
+        return NULL;
+    }
+
+    switch(op)
+    {
+        case CHIP8_OP_OR:
+        case CHIP8_OP_AND:
+        case CHIP8_OP_XOR: { return loops[quirks].vf_reset ? "VF cleared" : "VF kept"; }
+        case CHIP8_OP_SUB:
+        case CHIP8_OP_SUBN: { return loops[quirks].flag_last ? "VF written last" : "VF written first"; }
+        case CHIP8_OP_SHR:
+        case CHIP8_OP_SHL: {
+            if (loops[quirks].shift_vy)
+            {
+                return "Vy shifted, VF written last";
+            }
+            return loops[quirks].flag_last ? "Vx shifted, VF written last" : "Vx shifted, VF written first";
+        }
+        case CHIP8_OP_LD_MEM_VX:
+        case CHIP8_OP_LD_VX_MEM: {
+            const char* increments[] = { "I kept", "I += x", "I += x + 1" };
+            return increments[loops[quirks].memory_increment];
+        }
+        case CHIP8_OP_JP_V0: { return loops[quirks].jump_vx ? "To xnn + Vx" : "To nnn + V0"; }
+        case CHIP8_OP_DRW: {
+            if (loops[quirks].pixel_wrap)
+            {
+                return "Pixels wrapped";
+            }
+            return loops[quirks].sprite_wrap ? "Position wrapped, pixels clipped" : "Clipped";
+        }
+        default: { return NULL; }
+    }
+}
@@ -0,0 +1,1155 @@
+/*
+Body of the interpreter loop, compiled once per quirk profile (Chip8Quirks) by
+chip8_engine.c. Each copy has its quirks fixed at compile time, so the
+instructions interpreters disagree on cost nothing more than in a build
+supporting one behavior only. Before including, define:
+
+    CHIP8_RUN_NAME                 Name of the function
+    QUIRK_SHIFT_VY                 1: 8xy6/8xyE shift Vy into Vx, 0: shift Vx in place
+    QUIRK_MEMORY_INCREMENT(x)      Added to I by Fx55/Fx65: 0, (x) or ((x) + 1)
+    QUIRK_JUMP_VX                  1: Bxnn jumps to xnn + Vx, 0: Bnnn jumps to nnn + V0
+    QUIRK_VF_RESET                 1: 8xy1/8xy2/8xy3 clear VF
+    QUIRK_FLAG_LAST                1: 8xy5/8xy6/8xy7/8xyE write VF after Vx, 0: before it
+    QUIRK_SPRITE_WRAP              1: Dxyn wraps its position into the display, 0: draws nothing off it
+    QUIRK_PIXEL_WRAP               1: Dxyn pixels past an edge wrap to the other one, 0: they are clipped
+    QUIRK_XO                       1: XO-CHIP mode (Chip8::xo), 0: its instructions fault
+    QUIRK_MEGA                     1: MEGA-CHIP mode (Chip8::mega), 0: its instructions fault
+
+All of them are undefined again at the end.
+*/
+
+#if QUIRK_SHIFT_VY && !QUIRK_FLAG_LAST
+#error "Shifting Vy needs QUIRK_FLAG_LAST, Vx is only read again in place"
+#endif
+#if QUIRK_XO && !QUIRK_SPRITE_WRAP
+#error "XO-CHIP sprites wrap"
+#endif
+#if QUIRK_PIXEL_WRAP && !(QUIRK_XO || QUIRK_MEGA)
+#error "Only __chip8_draw_planes wraps pixels"
+#endif
+#if QUIRK_XO && QUIRK_MEGA
+#error "XO-CHIP and MEGA-CHIP are separate machines"
+#endif
+
+
+/*
+The interpreter loop. Every address is decoded once into the cache and then
+dispatched straight to its handler: with GCC/Clang each handler jumps to the
+next one through a table of label addresses (threaded code), so there is no
+central switch for the branch predictor to choke on. Without a cache, each
+instruction is decoded into a local instead.
+
+Program counter, cycle count and timer progress live in locals for the whole
+run, and are only written back to the Chip8 when the run stops.
+
+The XO-CHIP loop runs on Chip8Xo::memory with 16-bit addresses, and without a
+cache: a 64 KB one would be 512 KB per machine, for ROMs that mostly run
+small inner loops anyway. The MEGA-CHIP loop does the same on Chip8Mega::memory
+with 24-bit data addresses, its program counter staying in the first 64 KB.
+*/
+static Chip8StopReason CHIP8_RUN_NAME(Chip8* chip8, uint32_t max_cycles, const Chip8RunConfig* config)
+{
+    static const Chip8RunConfig default_config = { 0 };
+    if (!config)
+    {
+        config = &default_config;
+    }
+
+#if QUIRK_XO || QUIRK_MEGA
+    Chip8DecodeCache* const cache = NULL;
+#else
+    Chip8DecodeCache* cache = config->cache;
+#endif
+    const uint8_t* breakpoints = config->breakpoints;
+    const uint32_t timer_period = config->cycles_per_timer_tick;
+    const int stop_on_draw = (config->flags & CHIP8_RUN_STOP_ON_DRAW) != 0;
+    const int fuse = (config->flags & CHIP8_RUN_FUSE) != 0;
+#ifdef CHIP8_PROFILE
+    Chip8Profile* profile = config->profile;
+    Chip8CallGraph* callgraph = config->callgraph;
+    if (callgraph)
+    {
+        chip8_callgraph_sync(callgraph, chip8, chip8->cycles);
+    }
+    // Skipped iterations would be missing from the counts
+    const int skip_idle = (config->flags & CHIP8_RUN_SKIP_IDLE) && !profile && !callgraph;
+#else
+    const int skip_idle = (config->flags & CHIP8_RUN_SKIP_IDLE) != 0;
+#endif
+    uint32_t effects = 0; // Instructions run so far that change more than registers and I, or read more than memory
+    Chip8IdleLoop idle;
+    idle.pc = CHIP8_XO_MEMORY_SIZE;
+
+    uint8_t* v = chip8->v;
+#if QUIRK_XO
+    uint8_t* memory = chip8->xo->memory;
+#elif QUIRK_MEGA
+    uint8_t* memory = chip8->mega->memory;
+#else
+    uint8_t* memory = chip8->memory;
+#endif
+    uint16_t pc = chip8->pc; // Kept in a local so it can live in a host register
+    uint32_t executed = 0;
+    uint32_t timer_cycles = chip8->timer_cycles;
+    Chip8StopReason reason = CHIP8_STOP_BUDGET;
+    Chip8Instruction decoded;
+    const Chip8Instruction* ins;
+
+    if (max_cycles == 0)
+    {
+        return CHIP8_STOP_BUDGET;
+    }
+
+#ifdef CHIP8_THREADED_DISPATCH
+    static const void* dispatch_table[CHIP8_OP_FUSED_COUNT] = {
+        [CHIP8_OP_NONE] = &&op_DECODE,
+        [CHIP8_OP_INVALID] = &&op_INVALID,
+        [CHIP8_OP_CLS] = &&op_CLS,
+        [CHIP8_OP_RET] = &&op_RET,
+        [CHIP8_OP_SYS] = &&op_SYS,
+        [CHIP8_OP_JP] = &&op_JP,
+        [CHIP8_OP_CALL] = &&op_CALL,
+        [CHIP8_OP_SE_VX_NN] = &&op_SE_VX_NN,
+        [CHIP8_OP_SNE_VX_NN] = &&op_SNE_VX_NN,
+        [CHIP8_OP_SE_VX_VY] = &&op_SE_VX_VY,
+        [CHIP8_OP_LD_VX_NN] = &&op_LD_VX_NN,
+        [CHIP8_OP_ADD_VX_NN] = &&op_ADD_VX_NN,
+        [CHIP8_OP_LD_VX_VY] = &&op_LD_VX_VY,
+        [CHIP8_OP_OR] = &&op_OR,
+        [CHIP8_OP_AND] = &&op_AND,
+        [CHIP8_OP_XOR] = &&op_XOR,
+        [CHIP8_OP_ADD_VX_VY] = &&op_ADD_VX_VY,
+        [CHIP8_OP_SUB] = &&op_SUB,
+        [CHIP8_OP_SHR] = &&op_SHR,
+        [CHIP8_OP_SUBN] = &&op_SUBN,
+        [CHIP8_OP_SHL] = &&op_SHL,
+        [CHIP8_OP_SNE_VX_VY] = &&op_SNE_VX_VY,
+        [CHIP8_OP_LD_I] = &&op_LD_I,
+        [CHIP8_OP_JP_V0] = &&op_JP_V0,
+        [CHIP8_OP_RND] = &&op_RND,
+        [CHIP8_OP_DRW] = &&op_DRW,
+        [CHIP8_OP_SKP] = &&op_SKP,
+        [CHIP8_OP_SKNP] = &&op_SKNP,
+        [CHIP8_OP_LD_VX_DT] = &&op_LD_VX_DT,
+        [CHIP8_OP_LD_VX_K] = &&op_LD_VX_K,
+        [CHIP8_OP_LD_DT_VX] = &&op_LD_DT_VX,
+        [CHIP8_OP_LD_ST_VX] = &&op_LD_ST_VX,
+        [CHIP8_OP_ADD_I_VX] = &&op_ADD_I_VX,
+        [CHIP8_OP_LD_F_VX] = &&op_LD_F_VX,
+        [CHIP8_OP_LD_B_VX] = &&op_LD_B_VX,
+        [CHIP8_OP_LD_MEM_VX] = &&op_LD_MEM_VX,
+        [CHIP8_OP_LD_VX_MEM] = &&op_LD_VX_MEM,
+        [CHIP8_OP_SCD] = &&op_SCD,
+        [CHIP8_OP_SCR] = &&op_SCR,
+        [CHIP8_OP_SCL] = &&op_SCL,
+        [CHIP8_OP_EXIT] = &&op_EXIT,
+        [CHIP8_OP_LOW] = &&op_LOW,
+        [CHIP8_OP_HIGH] = &&op_HIGH,
+        [CHIP8_OP_LD_HF_VX] = &&op_LD_HF_VX,
+        [CHIP8_OP_LD_R_VX] = &&op_LD_R_VX,
+        [CHIP8_OP_LD_VX_R] = &&op_LD_VX_R,
+        [CHIP8_OP_SAVE_RANGE] = &&op_SAVE_RANGE,
+        [CHIP8_OP_LOAD_RANGE] = &&op_LOAD_RANGE,
+        [CHIP8_OP_LD_I_LONG] = &&op_LD_I_LONG,
+        [CHIP8_OP_PLANE] = &&op_PLANE,
+        [CHIP8_OP_AUDIO] = &&op_AUDIO,
+        [CHIP8_OP_PITCH] = &&op_PITCH,
+        [CHIP8_OP_MEGA_OFF] = &&op_MEGA_OFF,
+        [CHIP8_OP_MEGA_ON] = &&op_MEGA_ON,
+        [CHIP8_OP_SCU] = &&op_SCU,
+        [CHIP8_OP_LD_I_24] = &&op_LD_I_24,
+        [CHIP8_OP_LDPAL] = &&op_LDPAL,
+        [CHIP8_OP_SPRW] = &&op_SPRW,
+        [CHIP8_OP_SPRH] = &&op_SPRH,
+        [CHIP8_OP_ALPHA] = &&op_ALPHA,
+        [CHIP8_OP_DIGISND] = &&op_DIGISND,
+        [CHIP8_OP_STOPSND] = &&op_STOPSND,
+        [CHIP8_OP_BMODE] = &&op_BMODE,
+        [CHIP8_OP_CCOL] = &&op_CCOL,
+        [CHIP8_OP_FUSED_LD_I_DRW] = &&op_FUSED_LD_I_DRW,
+        [CHIP8_OP_FUSED_LD_LD] = &&op_FUSED_LD_LD,
+        [CHIP8_OP_FUSED_ADD_SE] = &&op_FUSED_ADD_SE,
+        [CHIP8_OP_FUSED_ADD_SE_JP] = &&op_FUSED_ADD_SE_JP,
+        [CHIP8_OP_FUSED_DT_SE] = &&op_FUSED_DT_SE,
+    };
+    #define OPCODE(name) op_##name
+    #define DISPATCH() goto *dispatch_table[ins->op]
+    #define DISPATCH_TO(name) goto op_##name
+#else
+    #define OPCODE(name) case CHIP8_OP_##name
+    #define CHIP8_OP_DECODE CHIP8_OP_NONE
+    #define DISPATCH() goto dispatch
+    #define DISPATCH_TO(name) goto dispatch
+#endif
+
+    // Quirks, see the top of this file
+#if QUIRK_SHIFT_VY
+    #define SHIFT_SOURCE v[ins->y]
+#else
+    #define SHIFT_SOURCE v[ins->x]
+#endif
+#if QUIRK_FLAG_LAST
+    #define SET_FLAG_AND_RESULT(flag, result) \
+        do { \
+            uint8_t carry = (flag); \
+            v[ins->x] = (result); \
+            v[0xF] = carry; \
+        } while(0)
+#else
+    // Vx is read again after VF is written, which matters when x is F
+    #define SET_FLAG_AND_RESULT(flag, result) \
+        do { \
+            v[0xF] = (flag); \
+            v[ins->x] = (result); \
+        } while(0)
+#endif
+#if QUIRK_VF_RESET
+    #define VF_RESET() v[0xF] = 0x0
+#else
+    #define VF_RESET() do { } while(0)
+#endif
+
+    // Memory accesses. XO-CHIP memory spans every 16-bit address, MEGA-CHIP memory
+    // every 24-bit one; neither is cached nor tracked for snapshots. The
+    // breakpoint bitmap only covers the first CHIP8_MEMORY_SIZE addresses.
+    // Display instructions act on the planes selected with Fn01, each in turn as
+    // `plane`. I_ADDRESS is I with its MEGA-CHIP high byte, which SET_I updates
+    // as well: a change of it counts as an effect, as IDLE_CHECK only compares I
+#if QUIRK_MEGA
+    #define ADDRESS_MASK (CHIP8_MEGA_MEMORY_SIZE - 1)
+    #define WRITE(at, value) memory[(at) & ADDRESS_MASK] = (value)
+    #define BREAKPOINT_AT(a) ((a) < CHIP8_MEMORY_SIZE && BIT(breakpoints[(a) >> 3], (a) & 0x7))
+    #define SKIP_SIZE ((memory[(pc + 2) & ADDRESS_MASK] == 0x01) ? 6 : 4)
+    #define I_ADDRESS (((uint32_t)chip8->mega->I_high << 16) | chip8->I)
+    #define SET_I(value) \
+        do { \
+            uint32_t address = (value) & ADDRESS_MASK; \
+            effects += (chip8->mega->I_high != (address >> 16)); \
+            chip8->mega->I_high = (uint8_t)(address >> 16); \
+            chip8->I = (uint16_t)address; \
+        } while(0)
+    #define MEGA_ON (chip8->mega->on)
+#else
+    #define I_ADDRESS chip8->I
+    #define SET_I(value) chip8->I = (value)
+    #define MEGA_ON 0
+#endif
+#if QUIRK_MEGA
+    #define FOR_EACH_PLANE(statement) \
+        do { \
+            uint64_t (*plane)[CHIP8_VRAM_WORDS] = chip8->VRAM; \
+            statement; \
+        } while(0)
+#elif QUIRK_XO
+    #define ADDRESS_MASK 0xFFFF
+    #define WRITE(at, value) memory[(at) & ADDRESS_MASK] = (value)
+    #define BREAKPOINT_AT(a) ((a) < CHIP8_MEMORY_SIZE && BIT(breakpoints[(a) >> 3], (a) & 0x7))
+    #define SKIP_SIZE ((memory[(pc + 2) & ADDRESS_MASK] == 0xF0 && memory[(pc + 3) & ADDRESS_MASK] == 0x00) ? 6 : 4)
+    #define FOR_EACH_PLANE(statement) \
+        do { \
+            uint64_t (*planes[CHIP8_XO_PLANES])[CHIP8_VRAM_WORDS] = { chip8->VRAM, chip8->xo->VRAM }; \
+            for (uint32_t p = 0; p < CHIP8_XO_PLANES; ++p) \
+            { \
+                uint64_t (*plane)[CHIP8_VRAM_WORDS] = planes[p]; \
+                if (BIT(chip8->xo->planes, p)) statement; \
+            } \
+        } while(0)
+#else
+    #define ADDRESS_MASK (CHIP8_MEMORY_SIZE - 1)
+    #define WRITE(at, value) __chip8_write(chip8, cache, (at), (value))
+    #define BREAKPOINT_AT(a) BIT(breakpoints[MEMORY_MASK(a) >> 3], (a) & 0x7)
+    #define SKIP_SIZE 4
+    #define FOR_EACH_PLANE(statement) \
+        do { \
+            uint64_t (*plane)[CHIP8_VRAM_WORDS] = chip8->VRAM; \
+            statement; \
+        } while(0)
+#endif
+
+    // Points `ins` at the decoded instruction for the current program counter.
+    // Cache entries not decoded yet dispatch to DECODE, which fills them in
+    #define FETCH() \
+        do { \
+            if (cache) \
+            { \
+                ins = &cache->ops[MEMORY_MASK(pc)]; \
+            } \
+            else \
+            { \
+                __chip8_decode_at(&decoded, memory, pc, ADDRESS_MASK); \
+                ins = &decoded; \
+            } \
+        } while(0)
+
+    // Accounts for the cycle just performed, ticking the timers when due
+    #define END_CYCLE() \
+        do { \
+            ++executed; \
+            if (timer_period && ++timer_cycles >= timer_period) \
+            { \
+                timer_cycles = 0; \
+                if (chip8->delay_timer) chip8->delay_timer--; \
+                if (chip8->sound_timer) chip8->sound_timer--; \
+            } \
+        } while(0)
+
+    // Jumps into the next cycle, unless the budget is exhausted or a breakpoint is hit
+    #define CONTINUE() \
+        do { \
+            if (executed == max_cycles) goto done; \
+            FETCH(); \
+            if (breakpoints && BREAKPOINT_AT(pc)) \
+            { \
+                reason = CHIP8_STOP_BREAKPOINT; \
+                goto done; \
+            } \
+            DISPATCH(); \
+        } while(0)
+
+    #define NEXT() \
+        do { \
+            END_CYCLE(); \
+            CONTINUE(); \
+        } while(0)
+
+    // NEXT for instructions that changed the display, which stop runs with CHIP8_RUN_STOP_ON_DRAW
+    #define NEXT_DRAWN() \
+        do { \
+            END_CYCLE(); \
+            if (stop_on_draw) \
+            { \
+                reason = CHIP8_STOP_DRAW; \
+                goto done; \
+            } \
+            CONTINUE(); \
+        } while(0)
+
+    // Counts the instruction at `pc` as executed through `path`, and charges it to
+    // the running subroutine. Must come before `pc` moves on. The CALLGRAPH_*
+    // hooks follow calls, returns and pixels drawn. All compiled out entirely
+    // without CHIP8_PROFILE
+#ifdef CHIP8_PROFILE
+    #define PROFILE_AS(op, path) \
+        do { \
+            if (profile) \
+            { \
+                profile->ops[(op)]++; \
+                profile->paths[(op)][(path)]++; \
+                profile->pcs[MEMORY_MASK(pc)]++; \
+                profile->quirks[chip8->quirks]++; \
+            } \
+            if (callgraph) \
+            { \
+                callgraph->nodes[callgraph->current].instructions++; \
+            } \
+        } while(0)
+    #define CALLGRAPH_CALL(address) \
+        do { \
+            if (callgraph) chip8_callgraph_call(callgraph, (address), chip8->cycles + executed); \
+        } while(0)
+    #define CALLGRAPH_RETURN() \
+        do { \
+            if (callgraph) chip8_callgraph_return(callgraph, chip8->cycles + executed); \
+        } while(0)
+    #define CALLGRAPH_PIXELS(count) \
+        do { \
+            if (callgraph) callgraph->nodes[callgraph->current].pixels += (count); \
+        } while(0)
+#else
+    #define PROFILE_AS(op, path) do { } while(0)
+    #define CALLGRAPH_CALL(address) do { } while(0)
+    #define CALLGRAPH_RETURN() do { } while(0)
+    #define CALLGRAPH_PIXELS(count) do { } while(0)
+#endif
+
+    /*
+    Run at every backward jump. An iteration of a loop depends only on the
+    registers, I, delay timer, memory, keys, display, stack and random state.
+    If since the same jump was last reached no instruction touched the last
+    five (`effects`), keys cannot change during a run, and the first three
+    read the same again, the next iteration is bound to repeat this one
+    exactly until the delay timer ticks. So whole iterations are skipped up to
+    just before the next tick (or the end of the budget, when the delay timer
+    is 0 and ticks cannot change it), leaving the same state looping would.
+    */
+    #define IDLE_CHECK() \
+        do { \
+            if (idle.pc == pc && idle.effects == effects && idle.I == chip8->I && \
+                idle.delay_timer == chip8->delay_timer && memcmp(idle.v, v, sizeof(idle.v)) == 0 && \
+                (timer_period == 0 || timer_cycles < timer_period)) \
+            { \
+                uint32_t length = executed - idle.executed; \
+                uint32_t room = max_cycles - executed; \
+                if (timer_period && chip8->delay_timer) \
+                { \
+                    uint32_t to_tick = timer_period - 1 - timer_cycles; \
+                    room = (to_tick < room) ? to_tick : room; \
+                } \
+                uint32_t skipped = room - room % length; \
+                chip8->timer_cycles = timer_cycles; \
+                chip8_timers_advance(chip8, timer_period, skipped); \
+                timer_cycles = chip8->timer_cycles; \
+                executed += skipped; \
+                chip8->idle_cycles += skipped; \
+            } \
+            idle.pc = pc; \
+            idle.I = chip8->I; \
+            idle.delay_timer = chip8->delay_timer; \
+            memcpy(idle.v, v, sizeof(idle.v)); \
+            idle.executed = executed; \
+            idle.effects = effects; \
+        } while(0)
+
+    #define PROFILE(path) PROFILE_AS(ins->op, path)
+
+    // In a superinstruction, points `ins` at the instruction now at `pc` and carries on
+    // if it is `name`. Otherwise stops or dispatches, as CONTINUE would
+    #define FUSED_FETCH(name) \
+        do { \
+            if (executed == max_cycles) goto done; \
+            ins = &cache->ops[MEMORY_MASK(pc)]; \
+            if (breakpoints && BREAKPOINT_AT(pc)) \
+            { \
+                reason = CHIP8_STOP_BREAKPOINT; \
+                goto done; \
+            } \
+            if (ins->op != CHIP8_OP_##name) DISPATCH(); \
+        } while(0)
+
+    // Ends the first instruction of a superinstruction, going straight to the handler of the next
+    #define FUSED_NEXT(name) \
+        do { \
+            END_CYCLE(); \
+            FUSED_FETCH(name); \
+            DISPATCH_TO(name); \
+        } while(0)
+
+    #define FAULT() \
+        do { \
+            reason = CHIP8_STOP_FAULT; \
+            goto done; \
+        } while(0)
+
+    // The first instruction runs even when sitting on a breakpoint, so runs can resume from it
+    FETCH();
+
+#ifdef CHIP8_THREADED_DISPATCH
+    DISPATCH();
+#else
+dispatch:
+    switch(ins->op)
+    {
+#endif
+
+    OPCODE(DECODE): {
+        __chip8_decode_cache_fill(cache, memory, pc, fuse);
+        DISPATCH();
+    }
+    OPCODE(SYS):
+    OPCODE(INVALID): {
+        FAULT();
+    }
+    OPCODE(CLS): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        if (MEGA_ON)
+        {
+            chip8_mega_clear(chip8->mega);
+        }
+        else
+        {
+            FOR_EACH_PLANE(memset(plane, 0x0, sizeof(chip8->VRAM)));
+        }
+        pc += 2;
+        NEXT_DRAWN();
+    }
+    OPCODE(RET): {
+        effects++;
+        // Recover subroutine call address from the stack and set program counter to it
+        // Decrease stack pointer and increase program counter
+        if (chip8->sp == 0) FAULT();
+        PROFILE(CHIP8_PATH_PLAIN);
+        CALLGRAPH_RETURN();
+        chip8->sp--;
+        pc = chip8->stack[chip8->sp];
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(JP): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        if (skip_idle && ins->nnn <= pc)
+        {
+            IDLE_CHECK();
+            if (executed == max_cycles) goto done; // Skipped to the end, still on the jump
+        }
+        pc = ins->nnn;
+        NEXT();
+    }
+    OPCODE(CALL): {
+        effects++;
+        // Store sburoutine call address at current stack position
+        // Increase stack pointer and set program counter to new subroutine address
+        if (chip8->sp >= CHIP8_STACK_SIZE) FAULT();
+        PROFILE(CHIP8_PATH_PLAIN);
+        CALLGRAPH_CALL(ins->nnn);
+        chip8->stack[chip8->sp] = pc;
+        chip8->sp++;
+        pc = ins->nnn;
+        NEXT();
+    }
+    OPCODE(SE_VX_NN): {
+        PROFILE(v[ins->x] == ins->nn);
+        pc += (v[ins->x] == ins->nn) ? SKIP_SIZE : 2;
+        NEXT();
+    }
+    OPCODE(SNE_VX_NN): {
+        PROFILE(v[ins->x] != ins->nn);
+        pc += (v[ins->x] != ins->nn) ? SKIP_SIZE : 2;
+        NEXT();
+    }
+    OPCODE(SE_VX_VY): {
+        PROFILE(v[ins->x] == v[ins->y]);
+        pc += (v[ins->x] == v[ins->y]) ? SKIP_SIZE : 2;
+        NEXT();
+    }
+    OPCODE(LD_VX_NN): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        v[ins->x] = ins->nn;
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(ADD_VX_NN): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        v[ins->x] += ins->nn;
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(LD_VX_VY): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        v[ins->x] = v[ins->y];
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(OR): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        v[ins->x] |= v[ins->y];
+        VF_RESET();
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(AND): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        v[ins->x] &= v[ins->y];
+        VF_RESET();
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(XOR): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        v[ins->x] ^= v[ins->y];
+        VF_RESET();
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(ADD_VX_VY): {
+        PROFILE(v[ins->x] + v[ins->y] > 0xFF);
+        uint16_t result = v[ins->x] + v[ins->y];
+        v[ins->x] = result & 0xFF;
+        v[0xF] = (result > 0xFF) ? 0x1 : 0x0;
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(SUB): {
+        PROFILE(v[ins->x] >= v[ins->y]);
+        uint16_t result = v[ins->x] - v[ins->y];
+        SET_FLAG_AND_RESULT((v[ins->x] < v[ins->y]) ? 0x0 : 0x1, result & 0xFF);
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(SHR): {
+        PROFILE(SHIFT_SOURCE & 0x01);
+        SET_FLAG_AND_RESULT(SHIFT_SOURCE & 0x01, SHIFT_SOURCE >> 1);
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(SUBN): {
+        PROFILE(v[ins->y] >= v[ins->x]);
+        uint16_t result = v[ins->y] - v[ins->x];
+        SET_FLAG_AND_RESULT((v[ins->x] > v[ins->y]) ? 0x0 : 0x1, result & 0xFF);
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(SHL): {
+        PROFILE(SHIFT_SOURCE >> 7);
+        SET_FLAG_AND_RESULT((SHIFT_SOURCE >> 7) & 0x1, SHIFT_SOURCE << 1);
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(SNE_VX_VY): {
+        PROFILE(v[ins->x] != v[ins->y]);
+        pc += (v[ins->x] != v[ins->y]) ? SKIP_SIZE : 2;
+        NEXT();
+    }
+    OPCODE(LD_I): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        SET_I(ins->nnn);
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(JP_V0): {
+        PROFILE(CHIP8_PATH_PLAIN);
+#if QUIRK_JUMP_VX
+        pc = ins->nnn + v[ins->x];
+#else
+        pc = ins->nnn + v[0];
+#endif
+        NEXT();
+    }
+    OPCODE(RND): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        // xorshift32, its high byte is the best mixed
+        uint32_t rng = chip8->rng;
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        chip8->rng = rng;
+        v[ins->x] = (rng >> 24) & ins->nn;
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(DRW): {
+        effects++;
+#if QUIRK_MEGA
+        if (MEGA_ON)
+        {
+            // Sprites of sprite_width by sprite_height palette indices, clipped and never wrapped
+            Chip8Mega* mega = chip8->mega;
+#ifdef CHIP8_PROFILE
+            uint32_t mega_columns = CHIP8_MEGA_WIDTH - v[ins->x];
+            uint32_t mega_rows = (v[ins->y] < CHIP8_MEGA_HEIGHT) ? CHIP8_MEGA_HEIGHT - v[ins->y] : 0;
+            uint8_t mega_clipped = mega_columns < mega->sprite_width || mega_rows < mega->sprite_height;
+            CALLGRAPH_PIXELS((mega_columns < mega->sprite_width ? mega_columns : mega->sprite_width) *
+                             (mega_rows < mega->sprite_height ? mega_rows : mega->sprite_height));
+#endif
+            v[0xF] = chip8_mega_draw(mega, I_ADDRESS, v[ins->x], v[ins->y]);
+            PROFILE(v[0xF] | (mega_clipped ? CHIP8_PATH_CLIPPED : 0));
+            pc += 2;
+            NEXT_DRAWN();
+        }
+#endif
+#if QUIRK_SPRITE_WRAP
+        // Display sizes are powers of two
+        uint8_t sprite_x = v[ins->x] & (VRAM_WIDTH(chip8) - 1);
+        uint8_t sprite_y = v[ins->y] & (VRAM_HEIGHT(chip8) - 1);
+#else
+        uint8_t sprite_x = v[ins->x];
+        uint8_t sprite_y = v[ins->y];
+#endif
+#ifdef CHIP8_PROFILE
+        uint32_t sprite_width = ins->n ? 8 : 16;
+        uint32_t sprite_height = ins->n ? ins->n : 16;
+#if QUIRK_PIXEL_WRAP
+        // Every pixel is drawn, some from the other edge
+        uint8_t clipped = 0;
+        uint32_t columns = sprite_width;
+        uint32_t rows = sprite_height;
+#else
+        uint32_t width = VRAM_WIDTH(chip8);
+        uint32_t height = VRAM_HEIGHT(chip8);
+        uint8_t clipped = sprite_x + sprite_width > width || sprite_y + sprite_height > height;
+        uint32_t columns = (sprite_x < width) ? width - sprite_x : 0;
+        uint32_t rows = (sprite_y < height) ? height - sprite_y : 0;
+#endif
+        CALLGRAPH_PIXELS((columns < sprite_width ? columns : sprite_width) * (rows < sprite_height ? rows : sprite_height));
+#endif
+#if QUIRK_XO || QUIRK_MEGA
+        __chip8_draw_planes(chip8, memory, ADDRESS_MASK, I_ADDRESS, sprite_x, sprite_y, ins->n, QUIRK_PIXEL_WRAP);
+#else
+        __chip8_draw(chip8, sprite_x, sprite_y, ins->n);
+#endif
+        PROFILE(v[0xF] | (clipped ? CHIP8_PATH_CLIPPED : 0));
+        pc += 2;
+        NEXT_DRAWN();
+    }
+    OPCODE(SKP): {
+        PROFILE((chip8->keys & CHIP8_KEY(LOW_NIBBLE(v[ins->x]))) != 0);
+        pc += (chip8->keys & CHIP8_KEY(LOW_NIBBLE(v[ins->x]))) ? SKIP_SIZE : 2;
+        NEXT();
+    }
+    OPCODE(SKNP): {
+        PROFILE((chip8->keys & CHIP8_KEY(LOW_NIBBLE(v[ins->x]))) == 0);
+        pc += (chip8->keys & CHIP8_KEY(LOW_NIBBLE(v[ins->x]))) ? 2 : SKIP_SIZE;
+        NEXT();
+    }
+    OPCODE(LD_VX_DT): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        v[ins->x] = chip8->delay_timer;
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(LD_VX_K): {
+        effects++;
+        // A press is a key going down while waiting. Keys already held when the
+        // wait started only count once they have been released and pressed again
+        if (!chip8->key_wait)
+        {
+            PROFILE(CHIP8_PATH_PLAIN);
+            chip8->key_wait = 1;
+            chip8->key_wait_keys = chip8->keys;
+        }
+        else
+        {
+            uint16_t pressed = chip8->keys & ~chip8->key_wait_keys;
+            chip8->key_wait_keys &= chip8->keys;
+            if (pressed)
+            {
+                PROFILE(CHIP8_PATH_KEY_PRESSED);
+                uint8_t key = 0;
+                while (!(pressed & CHIP8_KEY(key)))
+                {
+                    key++;
+                }
+                chip8->key_wait = 0;
+                chip8->key_wait_keys = 0;
+                v[ins->x] = key;
+                pc += 2;
+                NEXT();
+            }
+            PROFILE(CHIP8_PATH_KEY_WAITING);
+        }
+
+        // The keyboard cannot change during a run, so the rest of the budget is
+        // spent waiting: timers keep counting down as they would on hardware
+        chip8->timer_cycles = timer_cycles;
+        chip8_timers_advance(chip8, timer_period, max_cycles - executed);
+        timer_cycles = chip8->timer_cycles;
+        executed = max_cycles;
+        reason = CHIP8_STOP_KEY_WAIT;
+        goto done;
+    }
+    OPCODE(LD_DT_VX): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->delay_timer = v[ins->x];
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(LD_ST_VX): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->sound_timer = v[ins->x];
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(ADD_I_VX): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        SET_I(I_ADDRESS + v[ins->x]);
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(LD_F_VX): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        // NOTE[JCH]: Font data stored at 0x0 in memory, each sprite 5 bytes
+        SET_I(5*v[ins->x]);
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(LD_B_VX): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        // Binary-coded decimal representation of VX: hundreds at I, tens at I+1, ones at I+2
+        uint8_t value = v[ins->x];
+        WRITE(I_ADDRESS, value / 100);
+        WRITE(I_ADDRESS + 1, (value / 10) % 10);
+        WRITE(I_ADDRESS + 2, value % 10);
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(LD_MEM_VX): { // Dump
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        for (uint8_t r = 0; r <= ins->x; ++r)
+        {
+            WRITE(I_ADDRESS + r, v[r]);
+        }
+        SET_I(I_ADDRESS + QUIRK_MEMORY_INCREMENT(ins->x));
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(LD_VX_MEM): { // Load
+        PROFILE(CHIP8_PATH_PLAIN);
+        for (uint8_t r = 0; r <= ins->x; ++r)
+        {
+            v[r] = memory[(I_ADDRESS + r) & ADDRESS_MASK];
+        }
+        SET_I(I_ADDRESS + QUIRK_MEMORY_INCREMENT(ins->x));
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(SCD): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        if (MEGA_ON)
+        {
+            chip8_mega_scroll_vertical(chip8->mega, ins->n);
+        }
+        else
+        {
+            FOR_EACH_PLANE(__chip8_scroll_down(plane, chip8->hires, ins->n));
+        }
+        pc += 2;
+        NEXT_DRAWN();
+    }
+    OPCODE(SCR): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        if (MEGA_ON)
+        {
+            chip8_mega_scroll_horizontal(chip8->mega, 1);
+        }
+        else
+        {
+            FOR_EACH_PLANE(__chip8_scroll_horizontal(plane, chip8->hires, 1));
+        }
+        pc += 2;
+        NEXT_DRAWN();
+    }
+    OPCODE(SCL): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        if (MEGA_ON)
+        {
+            chip8_mega_scroll_horizontal(chip8->mega, 0);
+        }
+        else
+        {
+            FOR_EACH_PLANE(__chip8_scroll_horizontal(plane, chip8->hires, 0));
+        }
+        pc += 2;
+        NEXT_DRAWN();
+    }
+    OPCODE(EXIT): {
+        // The program is over: stays on it, as a jump to itself would
+        PROFILE(CHIP8_PATH_PLAIN);
+        NEXT();
+    }
+    OPCODE(LOW): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        __chip8_set_hires(chip8, 0);
+        pc += 2;
+        NEXT_DRAWN();
+    }
+    OPCODE(HIGH): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        __chip8_set_hires(chip8, 1);
+        pc += 2;
+        NEXT_DRAWN();
+    }
+    OPCODE(LD_HF_VX): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        SET_I(CHIP8_HIRES_FONT_LOCATION + 10 * LOW_NIBBLE(v[ins->x]));
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(LD_R_VX): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        memcpy(chip8->flags, v, ins->x + 1);
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(LD_VX_R): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        memcpy(v, chip8->flags, ins->x + 1);
+        pc += 2;
+        NEXT();
+    }
+#if QUIRK_XO
+    OPCODE(SAVE_RANGE): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        // Vx first, counting down to Vy when y is below x. I stays
+        uint8_t count = (ins->x <= ins->y) ? ins->y - ins->x + 1 : ins->x - ins->y + 1;
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            WRITE(chip8->I + i, v[(ins->x <= ins->y) ? ins->x + i : ins->x - i]);
+        }
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(LOAD_RANGE): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        uint8_t count = (ins->x <= ins->y) ? ins->y - ins->x + 1 : ins->x - ins->y + 1;
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            v[(ins->x <= ins->y) ? ins->x + i : ins->x - i] = memory[(chip8->I + i) & ADDRESS_MASK];
+        }
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(LD_I_LONG): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->I = U16(memory[(pc + 2) & ADDRESS_MASK], memory[(pc + 3) & ADDRESS_MASK]);
+        pc += 4;
+        NEXT();
+    }
+    OPCODE(PLANE): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->xo->planes = ins->x & 0x3;
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(AUDIO): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        for (uint8_t i = 0; i < CHIP8_XO_PATTERN_SIZE; ++i)
+        {
+            chip8->xo->pattern[i] = memory[(chip8->I + i) & ADDRESS_MASK];
+        }
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(PITCH): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->xo->pitch = v[ins->x];
+        pc += 2;
+        NEXT();
+    }
+#else
+    OPCODE(SAVE_RANGE):
+    OPCODE(LOAD_RANGE):
+    OPCODE(LD_I_LONG):
+    OPCODE(PLANE):
+    OPCODE(AUDIO):
+    OPCODE(PITCH): {
+        // XO-CHIP only
+        FAULT();
+    }
+#endif
+#if QUIRK_MEGA
+    OPCODE(MEGA_OFF): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->mega->on = 0;
+        FOR_EACH_PLANE(memset(plane, 0x0, sizeof(chip8->VRAM)));
+        pc += 2;
+        NEXT_DRAWN();
+    }
+    OPCODE(MEGA_ON): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->mega->on = 1;
+        chip8_mega_clear(chip8->mega);
+        pc += 2;
+        NEXT_DRAWN();
+    }
+    OPCODE(SCU): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        if (MEGA_ON)
+        {
+            chip8_mega_scroll_vertical(chip8->mega, -(int)ins->n);
+        }
+        else
+        {
+            FOR_EACH_PLANE(__chip8_scroll_up(plane, chip8->hires, ins->n));
+        }
+        pc += 2;
+        NEXT_DRAWN();
+    }
+    OPCODE(LD_I_24): {
+        PROFILE(CHIP8_PATH_PLAIN);
+        SET_I(((uint32_t)ins->nn << 16) | U16(memory[(pc + 2) & ADDRESS_MASK], memory[(pc + 3) & ADDRESS_MASK]));
+        pc += 4;
+        NEXT();
+    }
+    OPCODE(LDPAL): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8_mega_load_palette(chip8->mega, I_ADDRESS, ins->nn);
+        pc += 2;
+        NEXT_DRAWN();
+    }
+    OPCODE(SPRW): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->mega->sprite_width = ins->nn ? ins->nn : 256;
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(SPRH): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->mega->sprite_height = ins->nn ? ins->nn : 256;
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(ALPHA): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->mega->alpha = ins->nn;
+        pc += 2;
+        NEXT_DRAWN();
+    }
+    OPCODE(DIGISND): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8_mega_play(chip8->mega, I_ADDRESS, ins->n == 0);
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(STOPSND): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->mega->sound_playing = 0;
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(BMODE): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->mega->blend = (ins->n <= CHIP8_MEGA_BLEND_MULTIPLY) ? ins->n : CHIP8_MEGA_BLEND_NORMAL;
+        pc += 2;
+        NEXT();
+    }
+    OPCODE(CCOL): {
+        effects++;
+        PROFILE(CHIP8_PATH_PLAIN);
+        chip8->mega->collision = ins->nn;
+        pc += 2;
+        NEXT();
+    }
+#else
+    OPCODE(MEGA_OFF):
+    OPCODE(MEGA_ON):
+    OPCODE(SCU):
+    OPCODE(LD_I_24):
+    OPCODE(LDPAL):
+    OPCODE(SPRW):
+    OPCODE(SPRH):
+    OPCODE(ALPHA):
+    OPCODE(DIGISND):
+    OPCODE(STOPSND):
+    OPCODE(BMODE):
+    OPCODE(CCOL): {
+        // MEGA-CHIP only
+        FAULT();
+    }
+#endif
+
+    /*
+    Superinstructions. Each performs its first instruction as its own handler
+    would, then jumps straight into the handler of the next one instead of
+    dispatching, after the same budget and breakpoint checks. The next cache
+    entry is checked too: a write may have changed that instruction since, it
+    may not be decoded yet, or it may head a superinstruction of its own.
+    */
+    OPCODE(FUSED_LD_I_DRW): {
+        PROFILE_AS(CHIP8_OP_LD_I, CHIP8_PATH_PLAIN);
+        chip8->I = ins->nnn;
+        pc += 2;
+        FUSED_NEXT(DRW);
+    }
+    OPCODE(FUSED_LD_LD): {
+        PROFILE_AS(CHIP8_OP_LD_VX_NN, CHIP8_PATH_PLAIN);
+        v[ins->x] = ins->nn;
+        pc += 2;
+        FUSED_NEXT(LD_VX_NN);
+    }
+    OPCODE(FUSED_ADD_SE): {
+        PROFILE_AS(CHIP8_OP_ADD_VX_NN, CHIP8_PATH_PLAIN);
+        v[ins->x] += ins->nn;
+        pc += 2;
+        FUSED_NEXT(SE_VX_NN);
+    }
+    OPCODE(FUSED_ADD_SE_JP): {
+        PROFILE_AS(CHIP8_OP_ADD_VX_NN, CHIP8_PATH_PLAIN);
+        v[ins->x] += ins->nn;
+        pc += 2;
+        END_CYCLE();
+        FUSED_FETCH(SE_VX_NN);
+        PROFILE(v[ins->x] == ins->nn);
+        if (v[ins->x] == ins->nn)
+        {
+            // Skipped over the jump
+            pc += 4;
+            NEXT();
+        }
+        pc += 2;
+        FUSED_NEXT(JP);
+    }
+    OPCODE(FUSED_DT_SE): {
+        PROFILE_AS(CHIP8_OP_LD_VX_DT, CHIP8_PATH_PLAIN);
+        v[ins->x] = chip8->delay_timer;
+        pc += 2;
+        FUSED_NEXT(SE_VX_NN);
+    }
+
+#ifndef CHIP8_THREADED_DISPATCH
+        default: {
+            FAULT();
+        }
+    }
+#endif
+
+done:
+    chip8->pc = pc;
+    chip8->timer_cycles = timer_cycles;
+    chip8->cycles += executed;
+#ifdef CHIP8_PROFILE
+    if (callgraph)
+    {
+        callgraph->cycles = chip8->cycles;
+    }
+#endif
+    return reason;
+
+    #undef FAULT
+    #undef MEGA_ON
+    #undef SET_I
+    #undef I_ADDRESS
+    #undef FOR_EACH_PLANE
+    #undef SKIP_SIZE
+    #undef BREAKPOINT_AT
+    #undef WRITE
+    #undef ADDRESS_MASK
+    #undef VF_RESET
+    #undef SET_FLAG_AND_RESULT
+    #undef SHIFT_SOURCE
+    #undef IDLE_CHECK
+    #undef CALLGRAPH_PIXELS
+    #undef CALLGRAPH_RETURN
+    #undef CALLGRAPH_CALL
+    #undef PROFILE
+    #undef PROFILE_AS
+    #undef FUSED_NEXT
+    #undef FUSED_FETCH
+    #undef NEXT_DRAWN
+    #undef NEXT
+    #undef CONTINUE
+    #undef END_CYCLE
+    #undef FETCH
+    #undef DISPATCH_TO
+    #undef DISPATCH
+    #undef OPCODE
+#ifndef CHIP8_THREADED_DISPATCH
+    #undef CHIP8_OP_DECODE
+#endif
+}
+
+
+#undef QUIRK_MEGA
+#undef QUIRK_XO
+#undef QUIRK_PIXEL_WRAP
+#undef QUIRK_SPRITE_WRAP
+#undef QUIRK_FLAG_LAST
+#undef QUIRK_VF_RESET
+#undef QUIRK_JUMP_VX
+#undef QUIRK_MEMORY_INCREMENT
+#undef QUIRK_SHIFT_VY
+#undef CHIP8_RUN_NAME
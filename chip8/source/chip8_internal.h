@@ -0,0 +1,126 @@
+#pragma once
+
+// Internal helpers shared between the translation units of the chip8 library.
+// Not meant to be included by library users.
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+
+// 8-bit low and high nibble
+// Example
+// x -> 0101 0111
+// HIGH_NIBBLE(x) -> 0000 0101
+// LOW_NIBBLE(x) -> 0000 0111
+#define LOW_NIBBLE(x) ( (x) & 0x0F )
+#define HIGH_NIBBLE(x) ( ((x) >> 4) & 0x0F )
+
+// Get bit b for x (results in either 0x0 or 0x1)
+#define BIT(x, b) ( ((x) >> (b)) & 0x1 )
+
+// Make a uint16_t out of two uint8_t
+#define U16(a, b) ( ((a)<<8) | (b) )
+
+// Wraps an address into the Chip8 memory
+#define MEMORY_MASK(a) ( (a) & (CHIP8_MEMORY_SIZE - 1) )
+
+// Bit of the 256-byte memory page holding address a, as in Chip8::dirty_pages
+#define PAGE_BIT(a) ( (uint16_t)(1u << (MEMORY_MASK(a) >> 8)) )
+
+// Computed goto is a GNU extension, other compilers fall back to a switch
+#if defined(__GNUC__) || defined(__clang__)
+#define CHIP8_THREADED_DISPATCH 1
+#endif
+
+
+/*
+Superinstructions: cache entries of CHIP8_RUN_FUSE runs that stand for a
+common sequence starting at their address. Such an entry keeps the operands
+of its own instruction, and its Chip8Op in `reserved`. The instructions after
+it are read from their own entries. Never returned by chip8_decode.
+*/
+typedef enum _Chip8FusedOp {
+    CHIP8_OP_FUSED_LD_I_DRW = CHIP8_OP_COUNT, // Annn Dxyn, sprite drawing
+    CHIP8_OP_FUSED_LD_LD, // 6xnn 6ynn, coordinates and such
+    CHIP8_OP_FUSED_ADD_SE, // 7xnn 3ynn, counting
+    CHIP8_OP_FUSED_ADD_SE_JP, // 7xnn 3ynn 1nnn, counting loop
+    CHIP8_OP_FUSED_DT_SE, // Fx07 3ynn, delay timer poll
+    CHIP8_OP_FUSED_COUNT
+} Chip8FusedOp;
+
+struct _Chip8DecodeCache {
+    Chip8Instruction ops[CHIP8_MEMORY_SIZE]; // Indexed by address, CHIP8_OP_NONE when not decoded yet
+};
+
+
+// Shared by the interpreter and chip8_jit.c
+// Draws the n-row sprite at I to (Vrx, Vry), setting VF on collision
+void chip8_draw_sprite(Chip8* chip8, uint8_t rx, uint8_t ry, uint8_t n);
+// Counts `cycles` elapsed cycles against the 60 Hz timers, `period` cycles per tick
+void chip8_timers_advance(Chip8* chip8, uint32_t period, uint32_t cycles);
+
+
+// MEGA-CHIP display and sound, for the MEGA-CHIP interpreter loop (chip8_mega.c).
+// Addresses are into Chip8Mega::memory and wrap at CHIP8_MEGA_MEMORY_SIZE
+// Draws the sprite_width by sprite_height sprite at `at` to (x, y), blending its colors
+// in. Returns 1 if one of its pixels landed on the collision color, 0 otherwise
+uint8_t chip8_mega_draw(Chip8Mega* mega, uint32_t at, uint8_t x, uint8_t y);
+void chip8_mega_clear(Chip8Mega* mega);
+// Moves the display `rows` rows down, or up when negative
+void chip8_mega_scroll_vertical(Chip8Mega* mega, int rows);
+// Moves the display 4 pixels right or left
+void chip8_mega_scroll_horizontal(Chip8Mega* mega, int right);
+// Loads `count` ARGB colors at `at` into the palette from index 1 on
+void chip8_mega_load_palette(Chip8Mega* mega, uint32_t at, uint8_t count);
+// Starts the sample whose header is at `at`
+void chip8_mega_play(Chip8Mega* mega, uint32_t at, uint8_t loop);
+
+
+// Call chain in a Chip8CallGraph: one per distinct chain of subroutine calls
+typedef struct _Chip8CallNode {
+    uint16_t address; // Subroutine entry, CHIP8_CALLGRAPH_UNKNOWN when not seen called
+    uint32_t parent; // Index of the calling chain, the root is its own parent
+    uint32_t first_child;
+    uint32_t next_sibling; // 0 ends the list, the root is never anyone's child
+    uint64_t calls;
+    uint64_t instructions; // Executed in this chain itself, not in its callees
+    uint64_t pixels; // Drawn by this chain itself
+} Chip8CallNode;
+
+// Entry of a frame that was already on the stack when profiling started
+#define CHIP8_CALLGRAPH_UNKNOWN 0xFFFF
+
+typedef struct _Chip8CallEvent {
+    uint32_t node;
+    uint32_t depth;
+    uint64_t begin; // Cycles
+    uint64_t end;
+} Chip8CallEvent;
+
+typedef struct _Chip8CallFrame {
+    uint32_t node;
+    uint64_t begin; // Cycle the call was made at
+} Chip8CallFrame;
+
+struct _Chip8CallGraph {
+    Chip8CallNode* nodes; // Node 0 is the root, the program outside any subroutine
+    uint32_t node_count;
+    uint32_t node_capacity;
+    uint32_t current; // Node of the running subroutine, kept out of `frames` for the per-instruction counts
+
+    Chip8CallFrame frames[CHIP8_STACK_SIZE + 1]; // Shadow call stack, frames[0] is the root
+    uint32_t depth; // Frames in use beyond the root, follows Chip8::sp
+
+    Chip8CallEvent* events; // Completed calls, in the order they returned
+    uint32_t event_count;
+    uint32_t max_events;
+    uint32_t dropped;
+    uint64_t cycles; // Cycle the last run ended at, closes calls still open when exporting
+};
+
+// Hooks for chip8_run, CHIP8_PROFILE builds only. `cycle` is the cycle the instruction runs at
+// Brings the shadow stack in line with chip8->sp, which may have moved outside chip8_run (snapshots, rewind)
+void chip8_callgraph_sync(Chip8CallGraph* callgraph, const Chip8* chip8, uint64_t cycle);
+void chip8_callgraph_call(Chip8CallGraph* callgraph, uint16_t address, uint64_t cycle);
+void chip8_callgraph_return(Chip8CallGraph* callgraph, uint64_t cycle);
@@ -0,0 +1,921 @@
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+#endif
+
+#include "chip8_jit.h"
+#include "chip8_internal.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__amd64__)) && (defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__))
+#define CHIP8_JIT_SUPPORTED 1
+#include <sys/mman.h>
+#endif
+
+
+#define JIT_MAX_BLOCK_INSTRUCTIONS 64
+#define JIT_MAX_BLOCK_BYTES 4096 // Native code, generous for JIT_MAX_BLOCK_INSTRUCTIONS
+#define JIT_ARENA_SIZE (1 << 20)
+
+// Why translated code went back to chip8_jit_run
+#define JIT_EXIT_LOOKUP 0 // No translation at the returned address yet
+#define JIT_EXIT_GUARD 1 // The block at the returned address cannot run whole: too little budget, or its call/return faults
+
+
+struct _Chip8Jit {
+    // Read and written by the translated code
+    uint32_t remaining; // Cycles left in the run
+    uint32_t period; // Cycles per timer tick, 0 for none
+    uint32_t exit; // JIT_EXIT_*
+    const uint8_t* entries[CHIP8_MEMORY_SIZE]; // Translated block starting at each address, NULL when none
+
+    uint8_t lengths[CHIP8_MEMORY_SIZE]; // Instructions in the block starting at each address
+    uint16_t code_pages; // Bit p set when memory page p holds translated instructions (PAGE_BIT)
+    uint32_t translated;
+    uint32_t blocks;
+
+    uint8_t* arena; // Executable memory, the entry stub first
+    size_t arena_used;
+    size_t code_start; // Where blocks start, after the entry stub
+    size_t exit_stub; // Offset of the code going back to C
+};
+
+
+#ifdef CHIP8_JIT_SUPPORTED
+
+/*
+Translated code keeps the Chip8 in rbx, the Chip8Jit in r12, the remaining
+cycles in r13d, the timer period in r14d and the entry table in r15, all
+preserved across calls into C. Chip8 state stays in memory: blocks load and
+store registers around each instruction, which is still a few host
+instructions per emulated one.
+
+Each block starts by checking that it can run whole within the budget, then
+takes its full length off the budget up front. Timers are settled once at the
+end of the block. That is exact because instructions reading or writing the
+timers only ever come first in a block, before any tick the block accounts for.
+*/
+
+typedef uint32_t (*Chip8JitEnter)(Chip8Jit* jit, Chip8* chip8, const uint8_t* block);
+
+// Emitter over the arena
+typedef struct _Chip8JitCode {
+    uint8_t* base;
+    size_t at;
+} Chip8JitCode;
+
+
+#define V_OFFSET(x) ( (uint32_t)(offsetof(Chip8, v) + (x)) )
+#define CHIP8_OFFSET(field) ( (uint32_t)offsetof(Chip8, field) )
+#define JIT_OFFSET(field) ( (uint32_t)offsetof(Chip8Jit, field) )
+
+
+static void __emit(Chip8JitCode* code, const uint8_t* bytes, size_t size)
+{
+    memcpy(&code->base[code->at], bytes, size);
+    code->at += size;
+}
+
+
+#define EMIT(...) \
+    do { \
+        const uint8_t bytes[] = { __VA_ARGS__ }; \
+        __emit(code, bytes, sizeof(bytes)); \
+    } while(0)
+
+
+static void __emit_u16(Chip8JitCode* code, uint16_t value)
+{
+    EMIT(value & 0xFF, value >> 8);
+}
+
+
+static void __emit_u32(Chip8JitCode* code, uint32_t value)
+{
+    EMIT(value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24);
+}
+
+
+static void __emit_u64(Chip8JitCode* code, uint64_t value)
+{
+    __emit_u32(code, (uint32_t)value);
+    __emit_u32(code, (uint32_t)(value >> 32));
+}
+
+
+// Opcode bytes followed by a 32-bit displacement off rbx (the Chip8), `modrm` already holding mod 10 and rm rbx
+#define EMIT_RBX(displacement, ...) \
+    do { \
+        EMIT(__VA_ARGS__); \
+        __emit_u32(code, (displacement)); \
+    } while(0)
+
+
+// Emits a jump or conditional jump (`opcode` bytes) with its 32-bit offset left to patch, returns where that offset is
+static size_t __emit_jump(Chip8JitCode* code, const uint8_t* opcode, size_t size)
+{
+    __emit(code, opcode, size);
+    size_t patch = code->at;
+    __emit_u32(code, 0);
+    return patch;
+}
+
+
+static void __patch_jump(Chip8JitCode* code, size_t patch, size_t target)
+{
+    int32_t relative = (int32_t)((int64_t)target - (int64_t)(patch + 4));
+    memcpy(&code->base[patch], &relative, sizeof(relative));
+}
+
+
+#define JMP(code) __emit_jump((code), (const uint8_t[]){ 0xE9 }, 1)
+#define JCC(code, condition) __emit_jump((code), (const uint8_t[]){ 0x0F, (condition) }, 2)
+
+#define CC_B 0x82
+#define CC_AE 0x83
+#define CC_E 0x84
+#define CC_NE 0x85
+#define CC_A 0x87
+
+
+// Leaves the translated code with `pc` (already in eax when `pc` is negative) and JIT_EXIT_* `reason`
+static void __emit_exit(Chip8JitCode* code, const Chip8Jit* jit, int32_t pc, uint32_t reason)
+{
+    if (pc >= 0)
+    {
+        EMIT(0xB8); __emit_u32(code, (uint32_t)pc); // mov eax, pc
+    }
+    EMIT(0x41, 0xC7, 0x84, 0x24); __emit_u32(code, JIT_OFFSET(exit)); __emit_u32(code, reason); // mov dword [r12 + exit], reason
+    __patch_jump(code, JMP(code), jit->exit_stub);
+}
+
+
+// Goes on to the block at constant address `target`, through the entry table
+static void __emit_chain(Chip8JitCode* code, const Chip8Jit* jit, uint32_t target)
+{
+    if (target > CHIP8_MEMORY_SIZE - 2)
+    {
+        // Past the end of memory, left to the interpreter
+        __emit_exit(code, jit, (int32_t)target, JIT_EXIT_LOOKUP);
+        return;
+    }
+
+    EMIT(0x49, 0x8B, 0x87); __emit_u32(code, target * 8); // mov rax, [r15 + target * 8]
+    EMIT(0x48, 0x85, 0xC0); // test rax, rax
+    size_t missing = JCC(code, CC_E);
+    EMIT(0xFF, 0xE0); // jmp rax
+    __patch_jump(code, missing, code->at);
+    __emit_exit(code, jit, (int32_t)target, JIT_EXIT_LOOKUP);
+}
+
+
+// Goes on to the block at the address in eax
+static void __emit_chain_eax(Chip8JitCode* code, const Chip8Jit* jit)
+{
+    EMIT(0x3D); __emit_u32(code, CHIP8_MEMORY_SIZE - 2); // cmp eax, CHIP8_MEMORY_SIZE - 2
+    size_t outside = JCC(code, CC_A);
+    EMIT(0x49, 0x8B, 0x0C, 0xC7); // mov rcx, [r15 + rax * 8]
+    EMIT(0x48, 0x85, 0xC9); // test rcx, rcx
+    size_t missing = JCC(code, CC_E);
+    EMIT(0xFF, 0xE1); // jmp rcx
+    __patch_jump(code, outside, code->at);
+    __patch_jump(code, missing, code->at);
+    __emit_exit(code, jit, -1, JIT_EXIT_LOOKUP);
+}
+
+
+typedef void (*Chip8JitHelper)(Chip8Jit* jit, Chip8* chip8, uint32_t a, uint32_t b, uint32_t c);
+
+// Calls helper(jit, chip8, a, b, c)
+static void __emit_call(Chip8JitCode* code, Chip8JitHelper helper, uint32_t a, uint32_t b, uint32_t c)
+{
+    EMIT(0x4C, 0x89, 0xE7); // mov rdi, r12
+    EMIT(0x48, 0x89, 0xDE); // mov rsi, rbx
+    EMIT(0xBA); __emit_u32(code, a); // mov edx, a
+    EMIT(0xB9); __emit_u32(code, b); // mov ecx, b
+    EMIT(0x41, 0xB8); __emit_u32(code, c); // mov r8d, c
+    EMIT(0x48, 0xB8); __emit_u64(code, (uint64_t)(uintptr_t)helper); // mov rax, helper
+    EMIT(0xFF, 0xD0); // call rax
+}
+
+
+// Memory write from translated code, dropping the translations it overwrites
+static void __chip8_jit_write(Chip8Jit* jit, Chip8* chip8, uint16_t at, uint8_t value)
+{
+    at = MEMORY_MASK(at);
+    chip8->memory[at] = value;
+    chip8->dirty_pages |= PAGE_BIT(at);
+    if (jit->code_pages & PAGE_BIT(at))
+    {
+        chip8_jit_invalidate(jit, at, 1);
+    }
+}
+
+
+static void __helper_cls(Chip8Jit* jit, Chip8* chip8, uint32_t a, uint32_t b, uint32_t c)
+{
+    (void)jit; (void)a; (void)b; (void)c;
+    memset(chip8->VRAM, 0x0, sizeof(chip8->VRAM));
+}
+
+
+static void __helper_rnd(Chip8Jit* jit, Chip8* chip8, uint32_t x, uint32_t nn, uint32_t c)
+{
+    (void)jit; (void)c;
+    // Same generator as chip8_run
+    uint32_t rng = chip8->rng;
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    chip8->rng = rng;
+    chip8->v[x] = (rng >> 24) & nn;
+}
+
+
+static void __helper_drw(Chip8Jit* jit, Chip8* chip8, uint32_t x, uint32_t y, uint32_t n)
+{
+    (void)jit;
+    chip8_draw_sprite(chip8, (uint8_t)x, (uint8_t)y, (uint8_t)n);
+}
+
+
+static void __helper_ld_b_vx(Chip8Jit* jit, Chip8* chip8, uint32_t x, uint32_t b, uint32_t c)
+{
+    (void)b; (void)c;
+    uint8_t value = chip8->v[x];
+    __chip8_jit_write(jit, chip8, chip8->I, value / 100);
+    __chip8_jit_write(jit, chip8, chip8->I + 1, (value / 10) % 10);
+    __chip8_jit_write(jit, chip8, chip8->I + 2, value % 10);
+}
+
+
+static void __helper_ld_mem_vx(Chip8Jit* jit, Chip8* chip8, uint32_t x, uint32_t b, uint32_t c)
+{
+    (void)b; (void)c;
+    for (uint32_t r = 0; r <= x; ++r)
+    {
+        __chip8_jit_write(jit, chip8, chip8->I + r, chip8->v[r]);
+    }
+}
+
+
+static void __helper_ld_vx_mem(Chip8Jit* jit, Chip8* chip8, uint32_t x, uint32_t b, uint32_t c)
+{
+    (void)jit; (void)b; (void)c;
+    for (uint32_t r = 0; r <= x; ++r)
+    {
+        chip8->v[r] = chip8->memory[MEMORY_MASK(chip8->I + r)];
+    }
+}
+
+
+// Timer ticks due at the end of a block: timer_cycles has reached the period
+static void __helper_tick(Chip8Jit* jit, Chip8* chip8, uint32_t a, uint32_t b, uint32_t c)
+{
+    (void)a; (void)b; (void)c;
+    chip8_timers_advance(chip8, jit->period, 0);
+}
+
+
+// Whether `ins` can be part of a block, at `position` in it
+static int __translatable(const Chip8Instruction* ins, uint32_t position)
+{
+    switch(ins->op)
+    {
+        case CHIP8_OP_SYS:
+        case CHIP8_OP_INVALID:
+        case CHIP8_OP_LD_VX_K: { return 0; }
+        // SUPER-CHIP display and flag instructions are rare, the interpreter runs them
+        case CHIP8_OP_SCD:
+        case CHIP8_OP_SCR:
+        case CHIP8_OP_SCL:
+        case CHIP8_OP_EXIT:
+        case CHIP8_OP_LOW:
+        case CHIP8_OP_HIGH:
+        case CHIP8_OP_LD_HF_VX:
+        case CHIP8_OP_LD_R_VX:
+        case CHIP8_OP_LD_VX_R: { return 0; }
+        // XO-CHIP instructions only run in their own profile, never translated
+        case CHIP8_OP_SAVE_RANGE:
+        case CHIP8_OP_LOAD_RANGE:
+        case CHIP8_OP_LD_I_LONG:
+        case CHIP8_OP_PLANE:
+        case CHIP8_OP_AUDIO:
+        case CHIP8_OP_PITCH: { return 0; }
+        // Neither are the MEGA-CHIP ones
+        case CHIP8_OP_MEGA_OFF:
+        case CHIP8_OP_MEGA_ON:
+        case CHIP8_OP_SCU:
+        case CHIP8_OP_LD_I_24:
+        case CHIP8_OP_LDPAL:
+        case CHIP8_OP_SPRW:
+        case CHIP8_OP_SPRH:
+        case CHIP8_OP_ALPHA:
+        case CHIP8_OP_DIGISND:
+        case CHIP8_OP_STOPSND:
+        case CHIP8_OP_BMODE:
+        case CHIP8_OP_CCOL: { return 0; }
+        case CHIP8_OP_LD_VX_DT:
+        case CHIP8_OP_LD_DT_VX:
+        case CHIP8_OP_LD_ST_VX: { return position == 0; }
+        default: { return 1; }
+    }
+}
+
+
+// Whether `ins` ends a block
+static int __terminator(const Chip8Instruction* ins)
+{
+    switch(ins->op)
+    {
+        case CHIP8_OP_RET:
+        case CHIP8_OP_JP:
+        case CHIP8_OP_CALL:
+        case CHIP8_OP_SE_VX_NN:
+        case CHIP8_OP_SNE_VX_NN:
+        case CHIP8_OP_SE_VX_VY:
+        case CHIP8_OP_SNE_VX_VY:
+        case CHIP8_OP_JP_V0:
+        case CHIP8_OP_SKP:
+        case CHIP8_OP_SKNP:
+        case CHIP8_OP_LD_B_VX:
+        case CHIP8_OP_LD_MEM_VX: { return 1; }
+        default: { return 0; }
+    }
+}
+
+
+// Emits an instruction that does not end its block
+static void __emit_instruction(Chip8JitCode* code, const Chip8Instruction* ins)
+{
+    const uint32_t vx = V_OFFSET(ins->x);
+    const uint32_t vy = V_OFFSET(ins->y);
+    const uint32_t vf = V_OFFSET(0xF);
+
+    switch(ins->op)
+    {
+        case CHIP8_OP_CLS: { __emit_call(code, __helper_cls, 0, 0, 0); break; }
+        case CHIP8_OP_LD_VX_NN: { EMIT_RBX(vx, 0xC6, 0x83); EMIT(ins->nn); break; } // mov byte [vx], nn
+        case CHIP8_OP_ADD_VX_NN: { EMIT_RBX(vx, 0x80, 0x83); EMIT(ins->nn); break; } // add byte [vx], nn
+        case CHIP8_OP_LD_VX_VY: {
+            EMIT_RBX(vy, 0x0F, 0xB6, 0x83); // movzx eax, byte [vy]
+            EMIT_RBX(vx, 0x88, 0x83); // mov [vx], al
+            break;
+        }
+        case CHIP8_OP_OR:
+        case CHIP8_OP_AND:
+        case CHIP8_OP_XOR: {
+            uint8_t opcode = (ins->op == CHIP8_OP_OR) ? 0x08 : (ins->op == CHIP8_OP_AND) ? 0x20 : 0x30;
+            EMIT_RBX(vy, 0x0F, 0xB6, 0x83); // movzx eax, byte [vy]
+            EMIT_RBX(vx, opcode, 0x83); // or/and/xor [vx], al
+            break;
+        }
+        case CHIP8_OP_ADD_VX_VY: {
+            EMIT_RBX(vx, 0x0F, 0xB6, 0x83); // movzx eax, byte [vx]
+            EMIT_RBX(vy, 0x0F, 0xB6, 0x8B); // movzx ecx, byte [vy]
+            EMIT(0x01, 0xC8); // add eax, ecx
+            EMIT_RBX(vx, 0x88, 0x83); // mov [vx], al
+            EMIT(0xC1, 0xE8, 0x08); // shr eax, 8
+            EMIT_RBX(vf, 0x88, 0x83); // mov [vf], al
+            break;
+        }
+        case CHIP8_OP_SUB:
+        case CHIP8_OP_SUBN: {
+            EMIT_RBX(vx, 0x0F, 0xB6, 0x83); // movzx eax, byte [vx]
+            EMIT_RBX(vy, 0x0F, 0xB6, 0x8B); // movzx ecx, byte [vy]
+            if (ins->op == CHIP8_OP_SUB)
+            {
+                EMIT(0x89, 0xC2); // mov edx, eax
+                EMIT(0x29, 0xCA); // sub edx, ecx
+            }
+            else
+            {
+                EMIT(0x89, 0xCA); // mov edx, ecx
+                EMIT(0x29, 0xC2); // sub edx, eax
+            }
+            EMIT(0x0F, 0x93, 0xC0); // setae al, no borrow
+            EMIT_RBX(vf, 0x88, 0x83); // mov [vf], al
+            EMIT_RBX(vx, 0x88, 0x93); // mov [vx], dl
+            break;
+        }
+        case CHIP8_OP_SHR:
+        case CHIP8_OP_SHL: {
+            // VF first, then Vx shifted as read again: 8FF6 and 8FFE shift the flag, as in chip8_run
+            EMIT_RBX(vx, 0x0F, 0xB6, 0x83); // movzx eax, byte [vx]
+            if (ins->op == CHIP8_OP_SHR)
+            {
+                EMIT(0x83, 0xE0, 0x01); // and eax, 1
+            }
+            else
+            {
+                EMIT(0xC1, 0xE8, 0x07); // shr eax, 7
+            }
+            EMIT_RBX(vf, 0x88, 0x83); // mov [vf], al
+            EMIT_RBX(vx, 0x0F, 0xB6, 0x83); // movzx eax, byte [vx]
+            if (ins->op == CHIP8_OP_SHR)
+            {
+                EMIT(0xD1, 0xE8); // shr eax, 1
+            }
+            else
+            {
+                EMIT(0xD1, 0xE0); // shl eax, 1
+            }
+            EMIT_RBX(vx, 0x88, 0x83); // mov [vx], al
+            break;
+        }
+        case CHIP8_OP_LD_I: { EMIT_RBX(CHIP8_OFFSET(I), 0x66, 0xC7, 0x83); __emit_u16(code, ins->nnn); break; } // mov word [I], nnn
+        case CHIP8_OP_RND: { __emit_call(code, __helper_rnd, ins->x, ins->nn, 0); break; }
+        case CHIP8_OP_DRW: { __emit_call(code, __helper_drw, ins->x, ins->y, ins->n); break; }
+        case CHIP8_OP_LD_VX_DT: {
+            EMIT_RBX(CHIP8_OFFSET(delay_timer), 0x0F, 0xB6, 0x83); // movzx eax, byte [delay_timer]
+            EMIT_RBX(vx, 0x88, 0x83); // mov [vx], al
+            break;
+        }
+        case CHIP8_OP_LD_DT_VX:
+        case CHIP8_OP_LD_ST_VX: {
+            uint32_t timer = (ins->op == CHIP8_OP_LD_DT_VX) ? CHIP8_OFFSET(delay_timer) : CHIP8_OFFSET(sound_timer);
+            EMIT_RBX(vx, 0x0F, 0xB6, 0x83); // movzx eax, byte [vx]
+            EMIT_RBX(timer, 0x88, 0x83); // mov [timer], al
+            break;
+        }
+        case CHIP8_OP_ADD_I_VX: {
+            EMIT_RBX(vx, 0x0F, 0xB6, 0x83); // movzx eax, byte [vx]
+            EMIT_RBX(CHIP8_OFFSET(I), 0x66, 0x01, 0x83); // add [I], ax
+            break;
+        }
+        case CHIP8_OP_LD_F_VX: {
+            EMIT_RBX(vx, 0x0F, 0xB6, 0x83); // movzx eax, byte [vx]
+            EMIT(0x8D, 0x04, 0x80); // lea eax, [rax + rax * 4]
+            EMIT_RBX(CHIP8_OFFSET(I), 0x66, 0x89, 0x83); // mov [I], ax
+            break;
+        }
+        case CHIP8_OP_LD_VX_MEM: { __emit_call(code, __helper_ld_vx_mem, ins->x, 0, 0); break; }
+    }
+}
+
+
+// Emits the instruction ending a block at `pc`, and the jumps to the blocks after it
+static void __emit_terminator(Chip8JitCode* code, const Chip8Jit* jit, const Chip8Instruction* ins, uint16_t pc)
+{
+    const uint32_t vx = V_OFFSET(ins->x);
+    const uint32_t vy = V_OFFSET(ins->y);
+    size_t taken = 0;
+
+    switch(ins->op)
+    {
+        case CHIP8_OP_RET: {
+            EMIT_RBX(CHIP8_OFFSET(sp), 0x66, 0xFF, 0x8B); // dec word [sp]
+            EMIT_RBX(CHIP8_OFFSET(sp), 0x0F, 0xB7, 0x83); // movzx eax, word [sp]
+            EMIT(0x0F, 0xB7, 0x84, 0x43); __emit_u32(code, CHIP8_OFFSET(stack)); // movzx eax, word [rbx + rax * 2 + stack]
+            EMIT(0x83, 0xC0, 0x02); // add eax, 2
+            EMIT(0x0F, 0xB7, 0xC0); // movzx eax, ax
+            __emit_chain_eax(code, jit);
+            return;
+        }
+        case CHIP8_OP_JP: { __emit_chain(code, jit, ins->nnn); return; }
+        case CHIP8_OP_CALL: {
+            EMIT_RBX(CHIP8_OFFSET(sp), 0x0F, 0xB7, 0x83); // movzx eax, word [sp]
+            EMIT(0x66, 0xC7, 0x84, 0x43); __emit_u32(code, CHIP8_OFFSET(stack)); __emit_u16(code, pc); // mov word [rbx + rax * 2 + stack], pc
+            EMIT_RBX(CHIP8_OFFSET(sp), 0x66, 0xFF, 0x83); // inc word [sp]
+            __emit_chain(code, jit, ins->nnn);
+            return;
+        }
+        case CHIP8_OP_JP_V0: {
+            EMIT_RBX(V_OFFSET(0), 0x0F, 0xB6, 0x83); // movzx eax, byte [v0]
+            EMIT(0x05); __emit_u32(code, ins->nnn); // add eax, nnn
+            __emit_chain_eax(code, jit);
+            return;
+        }
+        case CHIP8_OP_SE_VX_NN:
+        case CHIP8_OP_SNE_VX_NN: {
+            EMIT_RBX(vx, 0x80, 0xBB); EMIT(ins->nn); // cmp byte [vx], nn
+            taken = JCC(code, (ins->op == CHIP8_OP_SE_VX_NN) ? CC_E : CC_NE);
+            break;
+        }
+        case CHIP8_OP_SE_VX_VY:
+        case CHIP8_OP_SNE_VX_VY: {
+            EMIT_RBX(vx, 0x0F, 0xB6, 0x83); // movzx eax, byte [vx]
+            EMIT_RBX(vy, 0x3A, 0x83); // cmp al, [vy]
+            taken = JCC(code, (ins->op == CHIP8_OP_SE_VX_VY) ? CC_E : CC_NE);
+            break;
+        }
+        case CHIP8_OP_SKP:
+        case CHIP8_OP_SKNP: {
+            EMIT_RBX(vx, 0x0F, 0xB6, 0x83); // movzx eax, byte [vx]
+            EMIT(0x83, 0xE0, 0x0F); // and eax, 0xF
+            EMIT_RBX(CHIP8_OFFSET(keys), 0x0F, 0xB7, 0x8B); // movzx ecx, word [keys]
+            EMIT(0x0F, 0xA3, 0xC1); // bt ecx, eax
+            taken = JCC(code, (ins->op == CHIP8_OP_SKP) ? CC_B : CC_AE);
+            break;
+        }
+        case CHIP8_OP_LD_B_VX: {
+            __emit_call(code, __helper_ld_b_vx, ins->x, 0, 0);
+            __emit_chain(code, jit, pc + 2u);
+            return;
+        }
+        case CHIP8_OP_LD_MEM_VX: {
+            __emit_call(code, __helper_ld_mem_vx, ins->x, 0, 0);
+            __emit_chain(code, jit, pc + 2u);
+            return;
+        }
+    }
+
+    // Skips: on to the next instruction, or the one after when taken
+    __emit_chain(code, jit, pc + 2u);
+    __patch_jump(code, taken, code->at);
+    __emit_chain(code, jit, pc + 4u);
+}
+
+
+// Settles the timers for the `length` cycles of a block
+static void __emit_timers(Chip8JitCode* code, uint32_t length)
+{
+    EMIT(0x45, 0x85, 0xF6); // test r14d, r14d
+    size_t no_timers = JCC(code, CC_E);
+    EMIT_RBX(CHIP8_OFFSET(timer_cycles), 0x81, 0x83); __emit_u32(code, length); // add dword [timer_cycles], length
+    EMIT_RBX(CHIP8_OFFSET(timer_cycles), 0x44, 0x39, 0xB3); // cmp [timer_cycles], r14d
+    size_t no_tick = JCC(code, CC_B);
+    __emit_call(code, __helper_tick, 0, 0, 0);
+    __patch_jump(code, no_timers, code->at);
+    __patch_jump(code, no_tick, code->at);
+}
+
+
+static void __chip8_jit_protect(Chip8Jit* jit, int writable)
+{
+    mprotect(jit->arena, JIT_ARENA_SIZE, writable ? (PROT_READ | PROT_WRITE) : (PROT_READ | PROT_EXEC));
+}
+
+
+// Entry stub: saves the callee-saved registers, loads the block registers and jumps to the block.
+// The exit stub after it stores the budget left and returns the program counter in eax
+static void __emit_stubs(Chip8Jit* jit)
+{
+    Chip8JitCode stub = { jit->arena, 0 };
+    Chip8JitCode* code = &stub;
+
+    EMIT(0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57); // push rbx, rbp, r12-r15
+    EMIT(0x48, 0x83, 0xEC, 0x08); // sub rsp, 8, keeping calls 16-byte aligned
+    EMIT(0x49, 0x89, 0xFC); // mov r12, rdi
+    EMIT(0x48, 0x89, 0xF3); // mov rbx, rsi
+    EMIT(0x45, 0x8B, 0xAC, 0x24); __emit_u32(code, JIT_OFFSET(remaining)); // mov r13d, [r12 + remaining]
+    EMIT(0x45, 0x8B, 0xB4, 0x24); __emit_u32(code, JIT_OFFSET(period)); // mov r14d, [r12 + period]
+    EMIT(0x4D, 0x8D, 0xBC, 0x24); __emit_u32(code, JIT_OFFSET(entries)); // lea r15, [r12 + entries]
+    EMIT(0xFF, 0xE2); // jmp rdx
+
+    jit->exit_stub = code->at;
+    EMIT(0x45, 0x89, 0xAC, 0x24); __emit_u32(code, JIT_OFFSET(remaining)); // mov [r12 + remaining], r13d
+    EMIT(0x48, 0x83, 0xC4, 0x08); // add rsp, 8
+    EMIT(0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B); // pop r15-r12, rbp, rbx
+    EMIT(0xC3); // ret
+
+    jit->code_start = (code->at + 15) & ~(size_t)15;
+}
+
+
+// Translates the block starting at `pc`. Returns its code, or NULL if its first instruction is left to the interpreter
+static const uint8_t* __chip8_jit_translate(Chip8Jit* jit, const Chip8* chip8, uint16_t pc)
+{
+    Chip8Instruction instructions[JIT_MAX_BLOCK_INSTRUCTIONS];
+    uint32_t count = 0;
+    uint16_t at = pc;
+    int terminated = 0;
+
+    while (count < JIT_MAX_BLOCK_INSTRUCTIONS && at <= CHIP8_MEMORY_SIZE - 2)
+    {
+        Chip8Instruction ins = chip8_decode(chip8->memory[at], chip8->memory[at + 1]);
+        if (!__translatable(&ins, count))
+        {
+            break;
+        }
+        instructions[count++] = ins;
+        at += 2;
+        if (__terminator(&ins))
+        {
+            terminated = 1;
+            break;
+        }
+    }
+
+    if (count == 0)
+    {
+        return NULL;
+    }
+
+    if (jit->arena_used + JIT_MAX_BLOCK_BYTES > JIT_ARENA_SIZE)
+    {
+        chip8_jit_reset(jit);
+    }
+
+    __chip8_jit_protect(jit, 1);
+
+    Chip8JitCode block = { jit->arena, jit->arena_used };
+    Chip8JitCode* code = &block;
+    const uint8_t* entry = &jit->arena[jit->arena_used];
+    const Chip8Instruction* last = &instructions[count - 1];
+
+    // Guards: enough budget for the whole block, and no stack fault at its end
+    EMIT(0x41, 0x81, 0xFD); __emit_u32(code, count); // cmp r13d, count
+    size_t short_budget = JCC(code, CC_B);
+    size_t stack_fault = 0;
+    if (terminated && last->op == CHIP8_OP_CALL)
+    {
+        EMIT_RBX(CHIP8_OFFSET(sp), 0x66, 0x81, 0xBB); __emit_u16(code, CHIP8_STACK_SIZE); // cmp word [sp], CHIP8_STACK_SIZE
+        stack_fault = JCC(code, CC_AE);
+    }
+    else if (terminated && last->op == CHIP8_OP_RET)
+    {
+        EMIT_RBX(CHIP8_OFFSET(sp), 0x66, 0x81, 0xBB); __emit_u16(code, 0); // cmp word [sp], 0
+        stack_fault = JCC(code, CC_E);
+    }
+    EMIT(0x41, 0x81, 0xED); __emit_u32(code, count); // sub r13d, count
+
+    for (uint32_t i = 0; i < count - (terminated ? 1 : 0); ++i)
+    {
+        __emit_instruction(code, &instructions[i]);
+    }
+    __emit_timers(code, count);
+
+    if (terminated)
+    {
+        __emit_terminator(code, jit, last, (uint16_t)(at - 2));
+    }
+    else
+    {
+        __emit_chain(code, jit, at);
+    }
+
+    __patch_jump(code, short_budget, code->at);
+    if (stack_fault)
+    {
+        __patch_jump(code, stack_fault, code->at);
+    }
+    __emit_exit(code, jit, pc, JIT_EXIT_GUARD);
+
+    jit->arena_used = (code->at + 15) & ~(size_t)15;
+    __chip8_jit_protect(jit, 0);
+
+    jit->entries[pc] = entry;
+    jit->lengths[pc] = (uint8_t)count;
+    for (uint32_t byte = pc; byte < at; byte += 0x100)
+    {
+        jit->code_pages |= PAGE_BIT(byte);
+    }
+    jit->code_pages |= PAGE_BIT(at - 1);
+    jit->translated += count;
+    jit->blocks++;
+    return entry;
+}
+
+#endif
+
+
+Chip8Jit* chip8_jit_new()
+{
+#ifdef CHIP8_JIT_SUPPORTED
+    void* arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    Chip8Jit* jit = calloc(1, sizeof(Chip8Jit));
+    if (!jit)
+    {
+        munmap(arena, JIT_ARENA_SIZE);
+        return NULL;
+    }
+    jit->arena = arena;
+    __emit_stubs(jit);
+
+    // Some systems refuse executable memory altogether
+    if (mprotect(jit->arena, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(jit->arena, JIT_ARENA_SIZE);
+        free(jit);
+        return NULL;
+    }
+
+    chip8_jit_reset(jit);
+    return jit;
+#else
+    return NULL;
+#endif
+}
+
+
+void chip8_jit_delete(Chip8Jit* jit)
+{
+#ifdef CHIP8_JIT_SUPPORTED
+    munmap(jit->arena, JIT_ARENA_SIZE);
+#endif
+    free(jit);
+}
+
+
+void chip8_jit_reset(Chip8Jit* jit)
+{
+    // Blocks already in the arena are only reached through the entries, so they can be overwritten
+    memset(jit->entries, 0x0, sizeof(jit->entries));
+    memset(jit->lengths, 0x0, sizeof(jit->lengths));
+    jit->code_pages = 0;
+    jit->translated = 0;
+    jit->blocks = 0;
+    jit->arena_used = jit->code_start;
+}
+
+
+void chip8_jit_invalidate(Chip8Jit* jit, uint16_t at, uint16_t size)
+{
+    // Blocks are at most JIT_MAX_BLOCK_INSTRUCTIONS long, so only those starting
+    // that far before the range can reach into it
+    uint32_t first = (at > 2 * JIT_MAX_BLOCK_INSTRUCTIONS) ? at - 2 * JIT_MAX_BLOCK_INSTRUCTIONS : 0;
+    uint32_t end = (uint32_t)at + size;
+    for (uint32_t start = first; start < end && start < CHIP8_MEMORY_SIZE; ++start)
+    {
+        if (jit->entries[start] && start + 2u * jit->lengths[start] > at)
+        {
+            jit->entries[start] = NULL;
+            jit->lengths[start] = 0;
+            jit->blocks--;
+        }
+    }
+}
+
+
+uint32_t chip8_jit_translated(const Chip8Jit* jit)
+{
+    return jit->translated;
+}
+
+
+uint32_t chip8_jit_blocks(const Chip8Jit* jit)
+{
+    return jit->blocks;
+}
+
+
+// Runs the interpreter, dropping the translations of whatever memory it writes.
+// Chip8::dirty_pages tells which pages those are
+static Chip8StopReason __chip8_jit_interpret(Chip8Jit* jit, Chip8* chip8, uint32_t cycles, const Chip8RunConfig* config)
+{
+    uint16_t dirty_pages = chip8->dirty_pages;
+    chip8->dirty_pages = 0;
+    Chip8StopReason reason = chip8_run(chip8, cycles, config);
+
+    uint16_t written = chip8->dirty_pages & jit->code_pages;
+    chip8->dirty_pages |= dirty_pages;
+    for (uint32_t page = 0; written; ++page, written >>= 1)
+    {
+        if (written & 0x1)
+        {
+            chip8_jit_invalidate(jit, (uint16_t)(page << 8), 0x100);
+        }
+    }
+    return reason;
+}
+
+
+Chip8StopReason chip8_jit_run(Chip8Jit* jit, Chip8* chip8, uint32_t max_cycles, const Chip8RunConfig* config)
+{
+    static const Chip8RunConfig default_config = { 0 };
+    config = config ? config : &default_config;
+
+    // The interpreter keeps its own cache out of this: translated code does not update it
+    Chip8RunConfig interpreter = *config;
+    interpreter.cache = NULL;
+
+    if (config->breakpoints || config->profile || config->callgraph || (config->flags & CHIP8_RUN_STOP_ON_DRAW) ||
+        chip8->quirks != CHIP8_QUIRKS_DEFAULT)
+    {
+        return __chip8_jit_interpret(jit, chip8, max_cycles, &interpreter);
+    }
+
+#ifdef CHIP8_JIT_SUPPORTED
+    const uint32_t period = config->cycles_per_timer_tick;
+    uint32_t executed = 0;
+    jit->period = period;
+
+    while (executed < max_cycles)
+    {
+        uint32_t left = max_cycles - executed;
+        uint16_t pc = chip8->pc;
+
+        // Blocks expect the timers to have ticked when due, which a change of period may have put off
+        const uint8_t* block = NULL;
+        if (pc <= CHIP8_MEMORY_SIZE - 2 && !(period && chip8->timer_cycles >= period))
+        {
+            block = jit->entries[pc] ? jit->entries[pc] : __chip8_jit_translate(jit, chip8, pc);
+        }
+
+        if (!block)
+        {
+            Chip8StopReason reason = __chip8_jit_interpret(jit, chip8, 1, &interpreter);
+            if (reason == CHIP8_STOP_KEY_WAIT)
+            {
+                // Still waiting: the rest of the budget goes the same way
+                if (left > 1)
+                {
+                    __chip8_jit_interpret(jit, chip8, left - 1, &interpreter);
+                }
+                return CHIP8_STOP_KEY_WAIT;
+            }
+            if (reason != CHIP8_STOP_BUDGET)
+            {
+                return reason;
+            }
+            executed++;
+            continue;
+        }
+
+        jit->remaining = left;
+        Chip8JitEnter enter = (Chip8JitEnter)(void*)jit->arena;
+        chip8->pc = (uint16_t)enter(jit, chip8, block);
+        chip8->cycles += left - jit->remaining;
+        executed += left - jit->remaining;
+
+        if (jit->exit == JIT_EXIT_GUARD)
+        {
+            // The interpreter takes the block up to the end of the budget, or to its fault
+            uint32_t length = jit->lengths[chip8->pc];
+            uint32_t cycles = (length && length < max_cycles - executed) ? length : max_cycles - executed;
+            Chip8StopReason reason = __chip8_jit_interpret(jit, chip8, cycles, &interpreter);
+            if (reason != CHIP8_STOP_BUDGET)
+            {
+                return reason;
+            }
+            executed += cycles;
+        }
+    }
+
+    return CHIP8_STOP_BUDGET;
+#else
+    return __chip8_jit_interpret(jit, chip8, max_cycles, &interpreter);
+#endif
+}
+
+
+// Makes `*state` a copy of the `size` bytes at `from`, reusing its allocation, or frees
+// it when `from` is NULL. Returns 0 if OK, otherwise -1 (out of memory)
+static int __chip8_shadow_state(void** state, const void* from, size_t size)
+{
+    if (!from)
+    {
+        free(*state);
+        *state = NULL;
+        return 0;
+    }
+    if (!*state)
+    {
+        *state = malloc(size);
+        if (!*state)
+        {
+            return -1;
+        }
+    }
+    memcpy(*state, from, size);
+    return 0;
+}
+
+
+int chip8_jit_lockstep(Chip8Jit* jit, Chip8* chip8, Chip8* shadow, uint32_t max_cycles, const Chip8RunConfig* config, Chip8StopReason* reason)
+{
+    /*
+    XO-CHIP and MEGA-CHIP state lives outside the Chip8, so the shadow gets
+    copies of its own: sharing them would run both machines on one memory,
+    compare nothing, and free it twice. Those machines always run in the
+    interpreter, which is still checked against itself for determinism.
+    */
+    void* xo = shadow->xo;
+    void* mega = shadow->mega;
+    if (__chip8_shadow_state(&xo, chip8->xo, sizeof(Chip8Xo)) != 0 ||
+        __chip8_shadow_state(&mega, chip8->mega, sizeof(Chip8Mega)) != 0)
+    {
+        shadow->xo = xo;
+        shadow->mega = mega;
+        *reason = CHIP8_STOP_BUDGET;
+        return -1;
+    }
+    memcpy(shadow, chip8, sizeof(Chip8));
+    shadow->xo = xo;
+    shadow->mega = mega;
+
+    Chip8StopReason expected = chip8_run(shadow, max_cycles, config);
+    *reason = chip8_jit_run(jit, chip8, max_cycles, config);
+
+    // Idle skipping is up to the interpreter, the JIT runs those loops instead
+    shadow->idle_cycles = chip8->idle_cycles;
+    int same = (*reason == expected) &&
+        (!chip8->xo || memcmp(chip8->xo, shadow->xo, sizeof(Chip8Xo)) == 0) &&
+        (!chip8->mega || memcmp(chip8->mega, shadow->mega, sizeof(Chip8Mega)) == 0);
+
+    // Compared without the pointers, which differ
+    shadow->xo = chip8->xo;
+    shadow->mega = chip8->mega;
+    same = same && memcmp(chip8, shadow, sizeof(Chip8)) == 0;
+    shadow->xo = xo;
+    shadow->mega = mega;
+    return same ? 0 : -1;
+}
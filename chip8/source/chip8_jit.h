@@ -0,0 +1,51 @@
+#pragma once
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+
+/*
+Dynamic recompiler for x86-64 hosts. Runs of instructions up to a jump, call,
+return, skip or memory store (basic blocks) are translated into machine code
+the first time they are reached, and later runs go straight to that code.
+Blocks hand over to the next one through a table indexed by address, so a
+chain of translated blocks runs without coming back to C.
+
+Results are the same as chip8_run, cycle for cycle. Whatever the translator
+leaves out (Fx0A, invalid instructions, the last few cycles of a budget, runs
+with breakpoints, profiling or CHIP8_RUN_STOP_ON_DRAW, machines with quirks
+other than CHIP8_QUIRKS_DEFAULT) is run by chip8_run.
+
+Like a decode cache, translations follow memory writes made while running
+(Fx33, Fx55), but not writes made from outside: call chip8_jit_invalidate or
+chip8_jit_reset after editing memory, loading a ROM or restoring a snapshot.
+*/
+typedef struct _Chip8Jit Chip8Jit;
+
+
+// Returns a new recompiler, or NULL if the host cannot run one (not x86-64,
+// no executable memory, or out of memory). Callers then use chip8_run instead
+Chip8Jit* chip8_jit_new();
+// Deletes existing recompiler, and all its translations
+void chip8_jit_delete(Chip8Jit* jit);
+// Drops every translation. Needed when switching ROMs
+void chip8_jit_reset(Chip8Jit* jit);
+// Drops the translations of instructions touching the `size` bytes from `at`
+void chip8_jit_invalidate(Chip8Jit* jit, uint16_t at, uint16_t size);
+
+// Performs up to `max_cycles` execution cycles, as chip8_run. CHIP8_RUN_SKIP_IDLE
+// and CHIP8_RUN_FUSE change nothing here, and `config->cache` is not used
+Chip8StopReason chip8_jit_run(Chip8Jit* jit, Chip8* chip8, uint32_t max_cycles, const Chip8RunConfig* config);
+
+// Test mode: runs `chip8` with chip8_jit_run, and a copy of it taken beforehand
+// with chip8_run into `shadow`. Both machines must end up the same (idle_cycles aside).
+// `shadow` keeps copies of its own of the XO-CHIP or MEGA-CHIP state, freed by chip8_delete;
+// pass it from chip8_new, or an earlier lockstep.
+// Returns 0 if they do, otherwise -1 (or out of memory, nothing run). `reason` gets the
+// stop reason of the JIT run
+int chip8_jit_lockstep(Chip8Jit* jit, Chip8* chip8, Chip8* shadow, uint32_t max_cycles, const Chip8RunConfig* config, Chip8StopReason* reason);
+
+// Instructions translated since the last reset, and blocks they make up
+uint32_t chip8_jit_translated(const Chip8Jit* jit);
+uint32_t chip8_jit_blocks(const Chip8Jit* jit);
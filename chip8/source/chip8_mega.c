@@ -0,0 +1,243 @@
+#include "chip8_internal.h"
+
+#include <string.h>
+#include <stdint.h>
+
+
+// Wraps an address into the MEGA-CHIP memory
+#define MEGA_MASK(a) ( (a) & (CHIP8_MEGA_MEMORY_SIZE - 1) )
+
+
+/*
+Sprites are drawn a row at a time, as spans: a row of the sprite and the
+part of the display row it lands on are two runs of pixels, and every pixel
+of the span goes through the same branchless steps. Straight loops of that
+shape over arrays are what the compiler turns into SIMD code, several pixels
+per instruction, the same way the lanes of chip8_batch.c are. Clipping happens
+once per span, never per pixel.
+
+Each span is two passes. The first works on palette indices: is the sprite
+pixel opaque (not index 0), was the display pixel the collision color, keep
+the index. The second blends the colors into the ARGB display: the sprite
+color covers the display pixel by its own alpha, times the 05nn alpha, times
+25%, 50% or 75% in those blend modes. What it covers with depends on 080n:
+the color itself, the color added to the display, or multiplied with it.
+The alpha channel blends as the colors do with the sprite's taken as opaque,
+so hosts show through where nothing covered the display yet.
+*/
+static uint8_t __chip8_mega_index_span(uint8_t* restrict dst, const uint8_t* restrict src, uint32_t count, uint8_t collision)
+{
+    uint8_t hit = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint8_t opaque = (uint8_t)-(src[i] != 0);
+        hit |= opaque & (uint8_t)-(dst[i] == collision);
+        dst[i] = (src[i] & opaque) | (dst[i] & ~opaque);
+    }
+    return hit;
+}
+
+
+// `d` moved towards `s` by `w` out of 256, two 8-bit channels per multiply
+static inline uint32_t __chip8_mega_mix(uint32_t d, uint32_t s, uint32_t w)
+{
+    uint32_t rb = ((d & 0x00FF00FF) * (256 - w) + (s & 0x00FF00FF) * w) >> 8;
+    uint32_t ag = (((d >> 8) & 0x00FF00FF) * (256 - w) + ((s >> 8) & 0x00FF00FF) * w) >> 8;
+    return (rb & 0x00FF00FF) | ((ag & 0x00FF00FF) << 8);
+}
+
+
+// `d` plus `w` out of 256 of `s`, each channel saturating at 255
+static inline uint32_t __chip8_mega_add(uint32_t d, uint32_t s, uint32_t w)
+{
+    uint32_t rb = (d & 0x00FF00FF) + ((((s & 0x00FF00FF) * w) >> 8) & 0x00FF00FF);
+    uint32_t ag = ((d >> 8) & 0x00FF00FF) + (((((s >> 8) & 0x00FF00FF) * w) >> 8) & 0x00FF00FF);
+    // A channel past 255 carried into bit 8 of its lane, which turns into 0xFF
+    rb |= 0x01000100 - ((rb >> 8) & 0x00010001);
+    ag |= 0x01000100 - ((ag >> 8) & 0x00010001);
+    return (rb & 0x00FF00FF) | ((ag & 0x00FF00FF) << 8);
+}
+
+
+// Channel `shift` bits up of `d` times that of `s`, 255 being 1
+#define MEGA_PRODUCT(d, s, shift) ( (((((d) >> (shift)) & 0xFF) * ((((s) >> (shift)) & 0xFF) + 1)) >> 8) << (shift) )
+
+
+// Channels of `d` times those of `s`
+static inline uint32_t __chip8_mega_multiply(uint32_t d, uint32_t s)
+{
+    return MEGA_PRODUCT(d, s, 0) | MEGA_PRODUCT(d, s, 8) | MEGA_PRODUCT(d, s, 16) | MEGA_PRODUCT(d, s, 24);
+}
+
+
+static void __chip8_mega_color_span(uint32_t* restrict dst, const uint8_t* restrict src, uint32_t count, const uint32_t* palette,
+                                    uint32_t scale, uint8_t blend)
+{
+    uint32_t colors[CHIP8_MEGA_WIDTH];
+    uint32_t weights[CHIP8_MEGA_WIDTH];
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t color = palette[src[i]];
+        uint32_t alpha = color >> 24;
+        colors[i] = color | 0xFF000000u;
+        weights[i] = (src[i] != 0) * (((alpha + (alpha >> 7)) * scale) >> 8);
+    }
+
+    // One loop per mode, so each stays a straight one
+    switch(blend)
+    {
+        case CHIP8_MEGA_BLEND_ADD: {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                dst[i] = __chip8_mega_add(dst[i], colors[i], weights[i]);
+            }
+            break;
+        }
+        case CHIP8_MEGA_BLEND_MULTIPLY: {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                dst[i] = __chip8_mega_mix(dst[i], __chip8_mega_multiply(dst[i], colors[i]), weights[i]);
+            }
+            break;
+        }
+        default: {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                dst[i] = __chip8_mega_mix(dst[i], colors[i], weights[i]);
+            }
+            break;
+        }
+    }
+}
+
+
+uint8_t chip8_mega_draw(Chip8Mega* mega, uint32_t at, uint8_t x, uint8_t y)
+{
+    const uint32_t width = mega->sprite_width;
+    const uint32_t room = CHIP8_MEGA_WIDTH - (uint32_t)x;
+    const uint32_t columns = (width <= room) ? width : room;
+    uint8_t hit = 0;
+
+    // Coverage out of 256 for an opaque palette color, from 05nn and the blend mode
+    static const uint32_t opacity[] = {
+        [CHIP8_MEGA_BLEND_NORMAL] = 256,
+        [CHIP8_MEGA_BLEND_25] = 64,
+        [CHIP8_MEGA_BLEND_50] = 128,
+        [CHIP8_MEGA_BLEND_75] = 192,
+        [CHIP8_MEGA_BLEND_ADD] = 256,
+        [CHIP8_MEGA_BLEND_MULTIPLY] = 256,
+    };
+    const uint32_t scale = ((mega->alpha + (mega->alpha >> 7)) * opacity[mega->blend]) >> 8;
+
+    for (uint32_t row = 0; row < mega->sprite_height && y + row < CHIP8_MEGA_HEIGHT; ++row)
+    {
+        uint32_t from = MEGA_MASK(at + row * width);
+        const uint8_t* pixels = &mega->memory[from];
+        uint8_t wrapped[CHIP8_MEGA_WIDTH];
+        if (from + columns > CHIP8_MEGA_MEMORY_SIZE)
+        {
+            // The one row running off the end of memory wraps around to its start
+            for (uint32_t i = 0; i < columns; ++i)
+            {
+                wrapped[i] = mega->memory[MEGA_MASK(from + i)];
+            }
+            pixels = wrapped;
+        }
+        hit |= __chip8_mega_index_span(&mega->indices[y + row][x], pixels, columns, mega->collision);
+        __chip8_mega_color_span(&mega->screen[y + row][x], pixels, columns, mega->palette, scale, mega->blend);
+    }
+
+    return hit ? 0x1 : 0x0;
+}
+
+
+void chip8_mega_clear(Chip8Mega* mega)
+{
+    memset(mega->screen, 0x0, sizeof(mega->screen));
+    memset(mega->indices, 0x0, sizeof(mega->indices));
+}
+
+
+// Moves the display rows of `row` bytes each at `rows` down by `n`, or up when negative, blanking those left behind
+static void __chip8_mega_scroll_rows(void* rows, size_t row, int n)
+{
+    uint8_t* bytes = rows;
+    size_t count = (size_t)(n < 0 ? -n : n);
+    count = (count < CHIP8_MEGA_HEIGHT) ? count : CHIP8_MEGA_HEIGHT;
+    const size_t kept = (CHIP8_MEGA_HEIGHT - count) * row;
+
+    if (n >= 0)
+    {
+        memmove(&bytes[count * row], bytes, kept);
+        memset(bytes, 0x0, count * row);
+    }
+    else
+    {
+        memmove(bytes, &bytes[count * row], kept);
+        memset(&bytes[kept], 0x0, count * row);
+    }
+}
+
+
+void chip8_mega_scroll_vertical(Chip8Mega* mega, int rows)
+{
+    __chip8_mega_scroll_rows(mega->screen, sizeof(mega->screen[0]), rows);
+    __chip8_mega_scroll_rows(mega->indices, sizeof(mega->indices[0]), rows);
+}
+
+
+void chip8_mega_scroll_horizontal(Chip8Mega* mega, int right)
+{
+    for (uint32_t y = 0; y < CHIP8_MEGA_HEIGHT; ++y)
+    {
+        uint32_t* line = mega->screen[y];
+        uint8_t* indices = mega->indices[y];
+        if (right)
+        {
+            memmove(&line[4], &line[0], (CHIP8_MEGA_WIDTH - 4) * sizeof(line[0]));
+            memset(&line[0], 0x0, 4 * sizeof(line[0]));
+            memmove(&indices[4], &indices[0], CHIP8_MEGA_WIDTH - 4);
+            memset(&indices[0], 0x0, 4);
+        }
+        else
+        {
+            memmove(&line[0], &line[4], (CHIP8_MEGA_WIDTH - 4) * sizeof(line[0]));
+            memset(&line[CHIP8_MEGA_WIDTH - 4], 0x0, 4 * sizeof(line[0]));
+            memmove(&indices[0], &indices[4], CHIP8_MEGA_WIDTH - 4);
+            memset(&indices[CHIP8_MEGA_WIDTH - 4], 0x0, 4);
+        }
+    }
+}
+
+
+void chip8_mega_load_palette(Chip8Mega* mega, uint32_t at, uint8_t count)
+{
+    // Index 0 stays transparent, so at most 255 colors fit
+    for (uint32_t i = 0; i < count && i + 1 < CHIP8_MEGA_COLORS; ++i)
+    {
+        uint32_t from = at + 4 * i;
+        mega->palette[i + 1] = ((uint32_t)mega->memory[MEGA_MASK(from)] << 24) |
+                               ((uint32_t)mega->memory[MEGA_MASK(from + 1)] << 16) |
+                               ((uint32_t)mega->memory[MEGA_MASK(from + 2)] << 8) |
+                               mega->memory[MEGA_MASK(from + 3)];
+    }
+}
+
+
+void chip8_mega_play(Chip8Mega* mega, uint32_t at, uint8_t loop)
+{
+    // Header: rate (16 bits), length (24 bits) and a reserved byte, then 8-bit samples
+    mega->sound_rate = U16(mega->memory[MEGA_MASK(at)], mega->memory[MEGA_MASK(at + 1)]);
+    mega->sound_length = ((uint32_t)mega->memory[MEGA_MASK(at + 2)] << 16) |
+                         ((uint32_t)mega->memory[MEGA_MASK(at + 3)] << 8) |
+                         mega->memory[MEGA_MASK(at + 4)];
+    mega->sound_address = MEGA_MASK(at + 6);
+    mega->sound_loop = loop;
+    mega->sound_playing = 1;
+}
+
+
+void chip8_mega_unpack(const Chip8* chip8, uint32_t* dst)
+{
+    memcpy(dst, chip8->mega->screen, sizeof(chip8->mega->screen));
+}
@@ -0,0 +1,370 @@
+#include "chip8_movie.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define MOVIE_HEADER_SIZE 32
+
+// Event kinds, stored in the low bit of the cycle delta
+#define EVENT_KEYS 0
+#define EVENT_TIMER 1
+
+
+typedef struct _Chip8MovieEvent {
+    uint64_t cycle;
+    uint32_t value; // Keys or cycles per timer tick
+    uint8_t kind;
+} Chip8MovieEvent;
+
+struct _Chip8Movie {
+    uint32_t seed;
+    uint32_t cycles_per_timer_tick; // At the start
+    uint8_t quirks;
+    uint64_t rom_hash;
+    uint64_t length;
+
+    Chip8MovieEvent* events;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+
+uint64_t chip8_rom_hash(const uint8_t* rom, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= rom[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+
+Chip8Movie* chip8_movie_new(uint32_t seed, uint32_t cycles_per_timer_tick, Chip8Quirks quirks, const uint8_t* rom, size_t rom_size)
+{
+    Chip8Movie* movie = calloc(1, sizeof(Chip8Movie));
+    if (!movie)
+    {
+        return NULL;
+    }
+    movie->seed = seed;
+    movie->cycles_per_timer_tick = cycles_per_timer_tick;
+    movie->quirks = (uint8_t)quirks;
+    movie->rom_hash = chip8_rom_hash(rom, rom_size);
+    return movie;
+}
+
+
+void chip8_movie_delete(Chip8Movie* movie)
+{
+    free(movie->events);
+    free(movie);
+}
+
+
+// Returns 0 if OK, otherwise -1 (out of memory, the movie is left as it was)
+static int __chip8_movie_push(Chip8Movie* movie, uint64_t cycle, uint8_t kind, uint32_t value)
+{
+    if (movie->count == movie->capacity)
+    {
+        uint32_t capacity = movie->capacity ? movie->capacity * 2 : 256;
+        Chip8MovieEvent* events = realloc(movie->events, capacity * sizeof(Chip8MovieEvent));
+        if (!events)
+        {
+            return -1;
+        }
+        movie->events = events;
+        movie->capacity = capacity;
+    }
+
+    Chip8MovieEvent* event = &movie->events[movie->count++];
+    event->cycle = cycle;
+    event->kind = kind;
+    event->value = value;
+
+    if (cycle > movie->length)
+    {
+        movie->length = cycle;
+    }
+    return 0;
+}
+
+
+// Value of the last event of `kind`, or `otherwise` when there is none
+static uint32_t __chip8_movie_last(const Chip8Movie* movie, uint8_t kind, uint32_t otherwise)
+{
+    for (uint32_t i = movie->count; i > 0; --i)
+    {
+        if (movie->events[i - 1].kind == kind)
+        {
+            return movie->events[i - 1].value;
+        }
+    }
+    return otherwise;
+}
+
+
+int chip8_movie_record_keys(Chip8Movie* movie, uint64_t cycle, uint16_t keys)
+{
+    if (__chip8_movie_last(movie, EVENT_KEYS, 0) != keys)
+    {
+        return __chip8_movie_push(movie, cycle, EVENT_KEYS, keys);
+    }
+    return 0;
+}
+
+
+int chip8_movie_record_timer(Chip8Movie* movie, uint64_t cycle, uint32_t cycles_per_timer_tick)
+{
+    if (__chip8_movie_last(movie, EVENT_TIMER, movie->cycles_per_timer_tick) != cycles_per_timer_tick)
+    {
+        return __chip8_movie_push(movie, cycle, EVENT_TIMER, cycles_per_timer_tick);
+    }
+    return 0;
+}
+
+
+void chip8_movie_end(Chip8Movie* movie, uint64_t cycle)
+{
+    movie->length = cycle;
+}
+
+
+void chip8_movie_truncate(Chip8Movie* movie, uint64_t cycle)
+{
+    while (movie->count > 0 && movie->events[movie->count - 1].cycle >= cycle)
+    {
+        movie->count--;
+    }
+    movie->length = cycle;
+}
+
+
+uint32_t chip8_movie_seed(const Chip8Movie* movie)
+{
+    return movie->seed;
+}
+
+
+Chip8Quirks chip8_movie_quirks(const Chip8Movie* movie)
+{
+    return (Chip8Quirks)movie->quirks;
+}
+
+
+uint64_t chip8_movie_rom_hash(const Chip8Movie* movie)
+{
+    return movie->rom_hash;
+}
+
+
+uint64_t chip8_movie_length(const Chip8Movie* movie)
+{
+    return movie->length;
+}
+
+
+static void __put_le(uint8_t* dst, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        dst[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+
+static uint64_t __get_le(const uint8_t* src, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+    {
+        value |= (uint64_t)src[i] << (8 * i);
+    }
+    return value;
+}
+
+
+static void __put_varint(FILE* file, uint64_t value)
+{
+    do
+    {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        fputc(byte | (value ? 0x80 : 0x00), file);
+    } while (value);
+}
+
+
+// Returns 0 if OK, otherwise -1 (end of file or overlong)
+static int __get_varint(FILE* file, uint64_t* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = fgetc(file);
+        if (byte == EOF)
+        {
+            return -1;
+        }
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+int chip8_movie_save(const Chip8Movie* movie, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return -1;
+    }
+
+    uint8_t header[MOVIE_HEADER_SIZE] = { 'C', '8', 'M', 'V' };
+    __put_le(&header[4], CHIP8_MOVIE_VERSION, 2);
+    __put_le(&header[6], movie->quirks, 2);
+    __put_le(&header[8], movie->seed, 4);
+    __put_le(&header[12], movie->cycles_per_timer_tick, 4);
+    __put_le(&header[16], movie->rom_hash, 8);
+    __put_le(&header[24], movie->length, 8);
+    fwrite(header, 1, sizeof(header), file);
+
+    uint64_t previous = 0;
+    for (uint32_t i = 0; i < movie->count; ++i)
+    {
+        const Chip8MovieEvent* event = &movie->events[i];
+        __put_varint(file, ((event->cycle - previous) << 1) | event->kind);
+        if (event->kind == EVENT_KEYS)
+        {
+            fputc(event->value & 0xFF, file);
+            fputc((event->value >> 8) & 0xFF, file);
+        }
+        else
+        {
+            __put_varint(file, event->value);
+        }
+        previous = event->cycle;
+    }
+
+    int error = ferror(file);
+    return (fclose(file) == 0 && !error) ? 0 : -1;
+}
+
+
+Chip8Movie* chip8_movie_load(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return NULL;
+    }
+
+    uint8_t header[MOVIE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, "C8MV", 4) != 0 || __get_le(&header[4], 2) != CHIP8_MOVIE_VERSION)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    Chip8Movie* movie = calloc(1, sizeof(Chip8Movie));
+    if (!movie)
+    {
+        fclose(file);
+        return NULL;
+    }
+    movie->quirks = (uint8_t)__get_le(&header[6], 2);
+    movie->seed = (uint32_t)__get_le(&header[8], 4);
+    movie->cycles_per_timer_tick = (uint32_t)__get_le(&header[12], 4);
+    movie->rom_hash = __get_le(&header[16], 8);
+    uint64_t length = __get_le(&header[24], 8);
+
+    uint64_t cycle = 0;
+    uint64_t delta;
+    while (__get_varint(file, &delta) == 0)
+    {
+        cycle += delta >> 1;
+        uint8_t kind = delta & 0x1;
+        uint64_t value;
+        if (kind == EVENT_KEYS)
+        {
+            int lo = fgetc(file);
+            int hi = fgetc(file);
+            if (hi == EOF)
+            {
+                break;
+            }
+            value = (uint64_t)(lo | (hi << 8));
+        }
+        else if (__get_varint(file, &value) != 0)
+        {
+            break;
+        }
+        if (__chip8_movie_push(movie, cycle, kind, (uint32_t)value) != 0)
+        {
+            // A movie missing events would not replay the same
+            fclose(file);
+            chip8_movie_delete(movie);
+            return NULL;
+        }
+    }
+
+    // A truncated file still replays up to its last complete event
+    int complete = feof(file) && !ferror(file) && cycle <= length;
+    fclose(file);
+    movie->length = complete ? length : cycle;
+    return movie;
+}
+
+
+// Runs `chip8` until its cycle counter reaches `target`
+static Chip8StopReason __chip8_movie_run_until(Chip8* chip8, uint64_t target, const Chip8RunConfig* config)
+{
+    while (chip8->cycles < target)
+    {
+        uint64_t left = target - chip8->cycles;
+        uint32_t budget = (left > UINT32_MAX) ? UINT32_MAX : (uint32_t)left;
+
+        // Key waits spend the whole budget, so they do not stop the replay early
+        if (chip8_run(chip8, budget, config) == CHIP8_STOP_FAULT)
+        {
+            return CHIP8_STOP_FAULT;
+        }
+    }
+    return CHIP8_STOP_BUDGET;
+}
+
+
+Chip8StopReason chip8_movie_replay(const Chip8Movie* movie, Chip8* chip8, Chip8DecodeCache* cache)
+{
+    Chip8RunConfig config = {0};
+    config.cycles_per_timer_tick = movie->cycles_per_timer_tick;
+    config.cache = cache;
+
+    for (uint32_t i = 0; i < movie->count; ++i)
+    {
+        const Chip8MovieEvent* event = &movie->events[i];
+        if (__chip8_movie_run_until(chip8, event->cycle, &config) == CHIP8_STOP_FAULT)
+        {
+            return CHIP8_STOP_FAULT;
+        }
+
+        if (event->kind == EVENT_KEYS)
+        {
+            chip8->keys = (uint16_t)event->value;
+        }
+        else
+        {
+            config.cycles_per_timer_tick = event->value;
+        }
+    }
+
+    return __chip8_movie_run_until(chip8, movie->length, &config);
+}
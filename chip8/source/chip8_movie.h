@@ -0,0 +1,68 @@
+#pragma once
+
+#include "chip8.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+A movie is everything needed to replay a run exactly: the ROM (by hash), the
+Cxnn seed, the quirk profile, and the input, as a list of events keyed by emulated cycle. Only
+changes are stored: the keys held from a cycle on, and the timer period when
+the emulation speed changes.
+
+File layout, little-endian:
+    char magic[4]                 "C8MV"
+    uint16_t version              CHIP8_MOVIE_VERSION
+    uint16_t quirks               Chip8Quirks
+    uint32_t seed
+    uint32_t cycles_per_timer_tick
+    uint64_t rom_hash             chip8_rom_hash of the ROM
+    uint64_t length               cycles
+followed by the events up to the end of the file, each one a LEB128 varint
+of (cycles since the previous event << 1 | kind), then for keys a uint16_t
+and for the timer period a varint.
+*/
+
+#define CHIP8_MOVIE_VERSION 1
+
+typedef struct _Chip8Movie Chip8Movie;
+
+
+// 64-bit FNV-1a of the ROM bytes, identifies the ROM a movie was recorded on
+uint64_t chip8_rom_hash(const uint8_t* rom, size_t size);
+
+// Returns a new, empty movie for a run seeded with `seed` on the given ROM, or NULL if out of memory
+Chip8Movie* chip8_movie_new(uint32_t seed, uint32_t cycles_per_timer_tick, Chip8Quirks quirks, const uint8_t* rom, size_t rom_size);
+// Deletes existing movie
+void chip8_movie_delete(Chip8Movie* movie);
+
+// Records the keys held from `cycle` on. Nothing is stored when they did not change
+// Returns 0 if OK, otherwise -1 (out of memory, nothing recorded: the movie no longer matches the run)
+int chip8_movie_record_keys(Chip8Movie* movie, uint64_t cycle, uint16_t keys);
+// Records the timer period used from `cycle` on. Nothing is stored when it did not change
+// Returns 0 if OK, otherwise -1 as chip8_movie_record_keys
+int chip8_movie_record_timer(Chip8Movie* movie, uint64_t cycle, uint32_t cycles_per_timer_tick);
+// Sets the length of the movie, the cycle its replay stops at
+void chip8_movie_end(Chip8Movie* movie, uint64_t cycle);
+// Forgets the events from `cycle` on, after rewinding the recorded machine to it
+void chip8_movie_truncate(Chip8Movie* movie, uint64_t cycle);
+
+uint32_t chip8_movie_seed(const Chip8Movie* movie);
+Chip8Quirks chip8_movie_quirks(const Chip8Movie* movie);
+uint64_t chip8_movie_rom_hash(const Chip8Movie* movie);
+uint64_t chip8_movie_length(const Chip8Movie* movie);
+
+// Writes the movie to a file
+// Returns 0 if OK, otherwise -1
+int chip8_movie_save(const Chip8Movie* movie, const char* path);
+// Reads a movie from a file
+// Returns NULL if it cannot be read, is not a movie of this version or does not fit in memory
+Chip8Movie* chip8_movie_load(const char* path);
+
+// Replays the movie on `chip8`, which must be freshly initialized, seeded with
+// chip8_movie_seed, set to chip8_movie_quirks and have the movie ROM loaded. Runs unthrottled, in as few
+// chip8_run calls as the events allow. `cache` may be NULL.
+// Returns CHIP8_STOP_FAULT if the run faulted before the end, CHIP8_STOP_BUDGET otherwise
+Chip8StopReason chip8_movie_replay(const Chip8Movie* movie, Chip8* chip8, Chip8DecodeCache* cache);
@@ -0,0 +1,410 @@
+#include "chip8_rewind.h"
+#include "chip8_snapshot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+Records are laid out back to back in the buffer:
+    uint32_t size      whole record, header and trailer included
+    uint8_t keyframe   1 for keyframes
+    uint8_t reserved[3]
+    payload            encoded snapshot
+    uint32_t size      again, to walk back from the newest record
+A record never straddles the end of the buffer. When the next one does not
+fit, writing wraps to the start and `wrap_end` remembers where data ends.
+
+The payload is a list of (uint16_t zeros, uint16_t literals, literal bytes)
+runs covering the snapshot, taken from the snapshot XOR its keyframe (or the
+snapshot itself for keyframes). Short zero runs are kept in the literals.
+*/
+#define RECORD_HEADER 8
+#define RECORD_TRAILER 4
+#define RLE_MIN_ZEROS 4
+#define ENCODED_MAX (2 * CHIP8_SNAPSHOT_SIZE)
+#define RECORD_MAX (RECORD_HEADER + ENCODED_MAX + RECORD_TRAILER)
+
+
+struct _Chip8Rewind {
+    uint8_t* buffer;
+    uint32_t capacity;
+    uint32_t tail; // Start of the oldest record
+    uint32_t head; // End of the newest record
+    uint32_t wrap_end; // End of the data before the wrap, while wrapped
+    uint8_t wrapped; // Records run from `tail` to `wrap_end`, then from 0 to `head`
+
+    uint32_t frames;
+    uint32_t used; // Bytes of the records held
+    uint32_t keyframe_interval;
+    uint32_t since_key; // Frames stored after the newest keyframe
+
+    void* storage; // Holds the snapshots below, aligned
+    Chip8Snapshot* key; // Decoded keyframe of the newest frame
+    Chip8Snapshot* current; // Frame being stored or restored
+    uint8_t* encoded; // ENCODED_MAX bytes
+    uint8_t* delta; // CHIP8_SNAPSHOT_SIZE bytes
+};
+
+
+static uint32_t __read32(const uint8_t* at)
+{
+    uint32_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+
+static void __write32(uint8_t* at, uint32_t value)
+{
+    memcpy(at, &value, sizeof(value));
+}
+
+
+static void __write16(uint8_t* at, uint16_t value)
+{
+    memcpy(at, &value, sizeof(value));
+}
+
+
+static uint16_t __read16(const uint8_t* at)
+{
+    uint16_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+
+// Encodes `data` XOR `reference` (or `data` alone when `reference` is NULL) into `out`,
+// using `delta` (CHIP8_SNAPSHOT_SIZE bytes) as scratch. Returns the encoded size
+static uint32_t __rle_xor_encode(const uint8_t* data, const uint8_t* reference, uint8_t* delta, uint8_t* out)
+{
+    // XOR a word at a time first, so zero runs can be skipped a word at a time too
+    for (uint32_t i = 0; i < CHIP8_SNAPSHOT_SIZE; i += sizeof(uint64_t))
+    {
+        uint64_t word, other = 0;
+        memcpy(&word, &data[i], sizeof(word));
+        if (reference)
+        {
+            memcpy(&other, &reference[i], sizeof(other));
+        }
+        word ^= other;
+        memcpy(&delta[i], &word, sizeof(word));
+    }
+
+    uint32_t size = 0;
+    uint32_t at = 0;
+    while (at < CHIP8_SNAPSHOT_SIZE)
+    {
+        uint32_t zeros = 0;
+        while (at + zeros + sizeof(uint64_t) <= CHIP8_SNAPSHOT_SIZE)
+        {
+            uint64_t word;
+            memcpy(&word, &delta[at + zeros], sizeof(word));
+            if (word)
+            {
+                break;
+            }
+            zeros += sizeof(uint64_t);
+        }
+        while (at + zeros < CHIP8_SNAPSHOT_SIZE && delta[at + zeros] == 0)
+        {
+            zeros++;
+        }
+
+        // Literals run until RLE_MIN_ZEROS zero bytes in a row, or the end
+        uint32_t start = at + zeros;
+        uint32_t end = start;
+        uint32_t literal_end = start;
+        while (end < CHIP8_SNAPSHOT_SIZE && end - literal_end < RLE_MIN_ZEROS)
+        {
+            if (delta[end])
+            {
+                literal_end = end + 1;
+            }
+            end++;
+        }
+
+        uint32_t literals = literal_end - start;
+        __write16(&out[size], (uint16_t)zeros);
+        __write16(&out[size + 2], (uint16_t)literals);
+        size += 4;
+        for (uint32_t i = 0; i < literals; ++i)
+        {
+            out[size + i] = delta[start + i];
+        }
+        size += literals;
+        at = literal_end;
+    }
+
+    return size;
+}
+
+
+// Decodes `size` bytes of `encoded` against `reference` (zeros when NULL) into `out`
+static void __rle_xor_decode(const uint8_t* encoded, uint32_t size, const uint8_t* reference, uint8_t* out)
+{
+    if (reference)
+    {
+        memcpy(out, reference, CHIP8_SNAPSHOT_SIZE);
+    }
+    else
+    {
+        memset(out, 0x0, CHIP8_SNAPSHOT_SIZE);
+    }
+
+    uint32_t at = 0;
+    uint32_t read = 0;
+    while (read < size)
+    {
+        uint16_t zeros = __read16(&encoded[read]);
+        uint16_t literals = __read16(&encoded[read + 2]);
+        read += 4;
+        at += zeros;
+        for (uint16_t i = 0; i < literals; ++i)
+        {
+            out[at + i] ^= encoded[read + i];
+        }
+        at += literals;
+        read += literals;
+    }
+}
+
+
+static int __is_keyframe(const Chip8Rewind* rewind, uint32_t record)
+{
+    return rewind->buffer[record + 4];
+}
+
+
+// Start of the record that ends at `end`
+static uint32_t __record_before(const Chip8Rewind* rewind, uint32_t end)
+{
+    if (rewind->wrapped && end == 0)
+    {
+        end = rewind->wrap_end;
+    }
+    return end - __read32(&rewind->buffer[end - RECORD_TRAILER]);
+}
+
+
+// Decodes the record at `record` into `out`, keyframes on their own and the others against rewind->key
+static void __decode_record(const Chip8Rewind* rewind, uint32_t record, Chip8Snapshot* out)
+{
+    uint32_t size = __read32(&rewind->buffer[record]);
+    const uint8_t* reference = __is_keyframe(rewind, record) ? NULL : (const uint8_t*)rewind->key;
+    __rle_xor_decode(&rewind->buffer[record + RECORD_HEADER], size - RECORD_HEADER - RECORD_TRAILER, reference, (uint8_t*)out);
+}
+
+
+static void __drop_oldest(Chip8Rewind* rewind)
+{
+    uint32_t size = __read32(&rewind->buffer[rewind->tail]);
+    rewind->tail += size;
+    rewind->used -= size;
+    rewind->frames--;
+
+    if (rewind->wrapped && rewind->tail == rewind->wrap_end)
+    {
+        rewind->tail = 0;
+        rewind->wrapped = 0;
+        rewind->wrap_end = 0;
+    }
+    if (rewind->frames == 0)
+    {
+        chip8_rewind_clear(rewind);
+    }
+}
+
+
+// Drops the oldest keyframe and the frames that depend on it
+static void __drop_oldest_group(Chip8Rewind* rewind)
+{
+    __drop_oldest(rewind);
+    while (rewind->frames > 0 && !__is_keyframe(rewind, rewind->tail))
+    {
+        __drop_oldest(rewind);
+    }
+}
+
+
+// Makes room for a record of `size` bytes at rewind->head, dropping old frames as needed
+static void __reserve(Chip8Rewind* rewind, uint32_t size)
+{
+    for (;;)
+    {
+        if (!rewind->wrapped)
+        {
+            if (rewind->head + size <= rewind->capacity)
+            {
+                return;
+            }
+            rewind->wrap_end = rewind->head;
+            rewind->head = 0;
+            rewind->wrapped = 1;
+        }
+
+        if (rewind->head + size <= rewind->tail)
+        {
+            return;
+        }
+        __drop_oldest_group(rewind);
+    }
+}
+
+
+Chip8Rewind* chip8_rewind_new(uint32_t capacity, uint32_t keyframe_interval)
+{
+    Chip8Rewind* rewind = calloc(1, sizeof(Chip8Rewind));
+    if (!rewind)
+    {
+        return NULL;
+    }
+    rewind->capacity = (capacity < RECORD_MAX) ? RECORD_MAX : capacity;
+    rewind->buffer = malloc(rewind->capacity);
+    rewind->keyframe_interval = (keyframe_interval == 0) ? 1 : keyframe_interval;
+
+    // Snapshots are cache line aligned, which malloc does not guarantee
+    rewind->storage = malloc(2 * sizeof(Chip8Snapshot) + 63);
+    rewind->encoded = malloc(ENCODED_MAX);
+    rewind->delta = malloc(CHIP8_SNAPSHOT_SIZE);
+    if (!rewind->buffer || !rewind->storage || !rewind->encoded || !rewind->delta)
+    {
+        // Frees whichever of them were allocated
+        chip8_rewind_delete(rewind);
+        return NULL;
+    }
+    uintptr_t aligned = ((uintptr_t)rewind->storage + 63) & ~(uintptr_t)63;
+    rewind->key = (Chip8Snapshot*)aligned;
+    rewind->current = rewind->key + 1;
+
+    chip8_rewind_clear(rewind);
+    return rewind;
+}
+
+
+void chip8_rewind_delete(Chip8Rewind* rewind)
+{
+    free(rewind->encoded);
+    free(rewind->delta);
+    free(rewind->storage);
+    free(rewind->buffer);
+    free(rewind);
+}
+
+
+void chip8_rewind_clear(Chip8Rewind* rewind)
+{
+    rewind->tail = 0;
+    rewind->head = 0;
+    rewind->wrap_end = 0;
+    rewind->wrapped = 0;
+    rewind->frames = 0;
+    rewind->used = 0;
+    rewind->since_key = 0;
+}
+
+
+int chip8_rewind_push(Chip8Rewind* rewind, Chip8* chip8)
+{
+    if (chip8_snapshot_save(chip8, rewind->current) != 0)
+    {
+        return -1;
+    }
+
+    uint8_t keyframe = rewind->frames == 0 || rewind->since_key + 1 >= rewind->keyframe_interval;
+    uint32_t size = __rle_xor_encode((const uint8_t*)rewind->current, keyframe ? NULL : (const uint8_t*)rewind->key, rewind->delta, rewind->encoded);
+    __reserve(rewind, RECORD_HEADER + size + RECORD_TRAILER);
+
+    // Making room dropped the keyframe this frame was encoded against (and so everything)
+    if (!keyframe && rewind->frames == 0)
+    {
+        keyframe = 1;
+        size = __rle_xor_encode((const uint8_t*)rewind->current, NULL, rewind->delta, rewind->encoded);
+        __reserve(rewind, RECORD_HEADER + size + RECORD_TRAILER);
+    }
+
+    uint32_t total = RECORD_HEADER + size + RECORD_TRAILER;
+    uint8_t* record = &rewind->buffer[rewind->head];
+    __write32(record, total);
+    record[4] = keyframe;
+    record[5] = record[6] = record[7] = 0;
+    memcpy(&record[RECORD_HEADER], rewind->encoded, size);
+    __write32(&record[total - RECORD_TRAILER], total);
+
+    rewind->head += total;
+    rewind->used += total;
+    rewind->frames++;
+
+    if (keyframe)
+    {
+        memcpy(rewind->key, rewind->current, sizeof(Chip8Snapshot));
+        rewind->since_key = 0;
+    }
+    else
+    {
+        rewind->since_key++;
+    }
+    return 0;
+}
+
+
+int chip8_rewind_pop(Chip8Rewind* rewind, Chip8* chip8)
+{
+    if (rewind->frames == 0)
+    {
+        return -1;
+    }
+
+    if (rewind->wrapped && rewind->head == 0)
+    {
+        rewind->head = rewind->wrap_end;
+        rewind->wrapped = 0;
+        rewind->wrap_end = 0;
+    }
+
+    uint32_t record = __record_before(rewind, rewind->head);
+    uint32_t size = __read32(&rewind->buffer[record]);
+    int keyframe = __is_keyframe(rewind, record);
+    __decode_record(rewind, record, rewind->current);
+
+    rewind->head = record;
+    rewind->used -= size;
+    rewind->frames--;
+
+    if (rewind->frames == 0)
+    {
+        chip8_rewind_clear(rewind);
+    }
+    else if (keyframe)
+    {
+        // The newest frame now belongs to the previous keyframe, find and decode it
+        uint32_t since_key = 0;
+        uint32_t previous = __record_before(rewind, rewind->head);
+        while (!__is_keyframe(rewind, previous))
+        {
+            since_key++;
+            previous = __record_before(rewind, previous);
+        }
+        __decode_record(rewind, previous, rewind->key);
+        rewind->since_key = since_key;
+    }
+    else
+    {
+        rewind->since_key--;
+    }
+
+    return chip8_snapshot_load(chip8, rewind->current);
+}
+
+
+uint32_t chip8_rewind_frames(const Chip8Rewind* rewind)
+{
+    return rewind->frames;
+}
+
+
+uint32_t chip8_rewind_bytes(const Chip8Rewind* rewind)
+{
+    return rewind->used;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+
+/*
+Rewind history: a ring buffer of machine states, newest last, stored in a
+fixed number of bytes. Every `keyframe_interval` frames a keyframe is stored
+whole; the frames in between are stored as the XOR against their keyframe.
+Both are run-length encoded on zero bytes, so a frame costs roughly the
+bytes that changed since its keyframe. When the buffer is full, the oldest
+keyframe is dropped together with the frames that depend on it.
+*/
+typedef struct _Chip8Rewind Chip8Rewind;
+
+
+// Returns a new rewind history of `capacity` bytes, with a keyframe every `keyframe_interval` frames,
+// or NULL if out of memory
+Chip8Rewind* chip8_rewind_new(uint32_t capacity, uint32_t keyframe_interval);
+// Deletes existing rewind history
+void chip8_rewind_delete(Chip8Rewind* rewind);
+
+// Forgets every frame
+void chip8_rewind_clear(Chip8Rewind* rewind);
+
+// Records the current state of `chip8` as the newest frame. Takes a full
+// snapshot, which clears chip8->dirty_pages.
+// Returns 0 if OK, otherwise -1 (XO-CHIP or MEGA-CHIP machine, which snapshots
+// cannot hold, see chip8_snapshot.h. Nothing is recorded)
+int chip8_rewind_push(Chip8Rewind* rewind, Chip8* chip8);
+// Restores `chip8` to the newest frame and drops it from the history.
+// Returns 0 if OK, otherwise -1 (no frames left, `chip8` untouched)
+int chip8_rewind_pop(Chip8Rewind* rewind, Chip8* chip8);
+
+// Number of frames held
+uint32_t chip8_rewind_frames(const Chip8Rewind* rewind);
+// Bytes of the buffer in use
+uint32_t chip8_rewind_bytes(const Chip8Rewind* rewind);
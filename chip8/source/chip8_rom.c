@@ -0,0 +1,127 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "chip8_internal.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+Chip8LoadResult chip8_load_rom_from_memory(Chip8* chip8, const uint8_t* rom, size_t size)
+{
+    if (size == 0)
+    {
+        return CHIP8_LOAD_ERROR_EMPTY;
+    }
+    if (size > CHIP8_MEMORY_BYTES(chip8) - CHIP8_PROGRAM_START_LOCATION)
+    {
+        return CHIP8_LOAD_ERROR_TOO_LARGE;
+    }
+
+    memcpy(&CHIP8_MEMORY(chip8)[CHIP8_PROGRAM_START_LOCATION], rom, size);
+    chip8->rom_size = (uint32_t)size;
+    chip8->dirty_pages = 0xFFFF;
+    return CHIP8_LOAD_OK;
+}
+
+
+#if defined(_WIN32)
+
+// No mapping here: ROMs are a few KiB, a single read is just as cheap
+Chip8LoadResult chip8_load_rom(Chip8* chip8, const char* rom_path)
+{
+    FILE* file = fopen(rom_path, "rb");
+    if (!file)
+    {
+        return CHIP8_LOAD_ERROR_OPEN;
+    }
+
+    // One byte more than fits, to tell a full-size ROM from a larger one. On the
+    // heap, as MEGA-CHIP ROMs go up to 16 MB
+    const size_t capacity = CHIP8_MEMORY_BYTES(chip8) - CHIP8_PROGRAM_START_LOCATION + 1;
+    uint8_t* rom = malloc(capacity);
+    if (!rom)
+    {
+        fclose(file);
+        return CHIP8_LOAD_ERROR_READ;
+    }
+    size_t size = fread(rom, 1, capacity, file);
+    int error = ferror(file);
+    fclose(file);
+    if (error)
+    {
+        free(rom);
+        return CHIP8_LOAD_ERROR_READ;
+    }
+
+    Chip8LoadResult result = chip8_load_rom_from_memory(chip8, rom, size);
+    free(rom);
+    return result;
+}
+
+#else
+
+Chip8LoadResult chip8_load_rom(Chip8* chip8, const char* rom_path)
+{
+    int fd = open(rom_path, O_RDONLY);
+    if (fd < 0)
+    {
+        return CHIP8_LOAD_ERROR_OPEN;
+    }
+
+    // Check the size before mapping, so oversized files cost nothing more than the stat
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        close(fd);
+        return CHIP8_LOAD_ERROR_READ;
+    }
+    if (info.st_size == 0)
+    {
+        close(fd);
+        return CHIP8_LOAD_ERROR_EMPTY;
+    }
+    if ((uintmax_t)info.st_size > CHIP8_MEMORY_BYTES(chip8) - CHIP8_PROGRAM_START_LOCATION)
+    {
+        close(fd);
+        return CHIP8_LOAD_ERROR_TOO_LARGE;
+    }
+
+    size_t size = (size_t)info.st_size;
+    void* rom = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping stays valid without the descriptor
+    if (rom == MAP_FAILED)
+    {
+        return CHIP8_LOAD_ERROR_OPEN;
+    }
+
+    Chip8LoadResult result = chip8_load_rom_from_memory(chip8, rom, size);
+    munmap(rom, size);
+    return result;
+}
+
+#endif
+
+
+const char* chip8_load_result_string(Chip8LoadResult result)
+{
+    switch(result)
+    {
+        case CHIP8_LOAD_OK: { return "OK"; }
+        case CHIP8_LOAD_ERROR_OPEN: { return "ROM file could not be opened"; }
+        case CHIP8_LOAD_ERROR_READ: { return "ROM file could not be read"; }
+        case CHIP8_LOAD_ERROR_EMPTY: { return "ROM is empty"; }
+        case CHIP8_LOAD_ERROR_TOO_LARGE: { return "ROM does not fit in memory"; }
+        default: { return "Unknown error"; }
+    }
+}
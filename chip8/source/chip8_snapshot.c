@@ -0,0 +1,168 @@
+#include "chip8_snapshot.h"
+#include "chip8_internal.h"
+
+#include <string.h>
+
+
+// The layout is part of the format: fail the build if it ever changes size
+typedef char __chip8_snapshot_size_check[(sizeof(Chip8Snapshot) == CHIP8_SNAPSHOT_SIZE) ? 1 : -1];
+
+
+// Everything but memory
+static void __chip8_snapshot_save_registers(const Chip8* chip8, Chip8Snapshot* snapshot)
+{
+    snapshot->magic = CHIP8_SNAPSHOT_MAGIC;
+    snapshot->version = CHIP8_SNAPSHOT_VERSION;
+    snapshot->cycles = chip8->cycles;
+    memcpy(snapshot->VRAM, chip8->VRAM, sizeof(snapshot->VRAM));
+    memcpy(snapshot->stack, chip8->stack, sizeof(snapshot->stack));
+    snapshot->I = chip8->I;
+    snapshot->pc = chip8->pc;
+    snapshot->sp = chip8->sp;
+    snapshot->rom_size = chip8->rom_size;
+    snapshot->keys = chip8->keys;
+    snapshot->key_wait_keys = chip8->key_wait_keys;
+    snapshot->rng = chip8->rng;
+    snapshot->timer_cycles = chip8->timer_cycles;
+    memcpy(snapshot->v, chip8->v, sizeof(snapshot->v));
+    snapshot->delay_timer = chip8->delay_timer;
+    snapshot->sound_timer = chip8->sound_timer;
+    snapshot->key_wait = chip8->key_wait;
+    snapshot->quirks = chip8->quirks;
+    snapshot->hires = chip8->hires;
+    memcpy(snapshot->flags, chip8->flags, sizeof(snapshot->flags));
+    memset(snapshot->reserved, 0x0, sizeof(snapshot->reserved));
+}
+
+
+static void __chip8_snapshot_load_registers(Chip8* chip8, const Chip8Snapshot* snapshot)
+{
+    chip8->cycles = snapshot->cycles;
+    memcpy(chip8->VRAM, snapshot->VRAM, sizeof(chip8->VRAM));
+    memcpy(chip8->stack, snapshot->stack, sizeof(chip8->stack));
+    chip8->I = snapshot->I;
+    chip8->pc = snapshot->pc;
+    chip8->sp = snapshot->sp;
+    chip8->rom_size = snapshot->rom_size;
+    chip8->keys = snapshot->keys;
+    chip8->key_wait_keys = snapshot->key_wait_keys;
+    chip8->rng = snapshot->rng;
+    chip8->timer_cycles = snapshot->timer_cycles;
+    memcpy(chip8->v, snapshot->v, sizeof(chip8->v));
+    chip8->delay_timer = snapshot->delay_timer;
+    chip8->sound_timer = snapshot->sound_timer;
+    chip8->key_wait = snapshot->key_wait;
+    chip8->quirks = snapshot->quirks;
+    chip8->hires = snapshot->hires;
+    memcpy(chip8->flags, snapshot->flags, sizeof(chip8->flags));
+}
+
+
+// Copies the memory pages set in `pages` from `src` to `dst`
+static void __chip8_copy_pages(uint8_t* dst, const uint8_t* src, uint16_t pages)
+{
+    while (pages)
+    {
+        int page = 0;
+        while (!BIT(pages, page))
+        {
+            page++;
+        }
+        pages &= pages - 1;
+        memcpy(&dst[page * CHIP8_SNAPSHOT_PAGE_SIZE], &src[page * CHIP8_SNAPSHOT_PAGE_SIZE], CHIP8_SNAPSHOT_PAGE_SIZE);
+    }
+}
+
+
+// XO-CHIP and MEGA-CHIP memory does not fit a snapshot, so neither side may be in those modes
+static int __chip8_snapshot_valid(const Chip8* chip8, const Chip8Snapshot* snapshot)
+{
+    return snapshot->magic == CHIP8_SNAPSHOT_MAGIC && snapshot->version == CHIP8_SNAPSHOT_VERSION &&
+        !chip8->xo && !chip8->mega && snapshot->quirks != CHIP8_QUIRKS_XOCHIP && snapshot->quirks != CHIP8_QUIRKS_MEGACHIP;
+}
+
+
+// Whether chip8->dirty_pages counts from `snapshot`, so only those pages differ
+static int __chip8_snapshot_current(const Chip8* chip8, const Chip8Snapshot* snapshot)
+{
+    return chip8->snapshot_generation != 0 && snapshot->generation == chip8->snapshot_generation;
+}
+
+
+// Gives `snapshot` a new generation and tracks dirty pages against it
+static void __chip8_snapshot_saved(Chip8* chip8, Chip8Snapshot* snapshot)
+{
+    snapshot->generation = ++chip8->snapshot_generations;
+    chip8->snapshot_generation = snapshot->generation;
+    chip8->dirty_pages = 0;
+}
+
+
+// Tracks dirty pages against `snapshot`, and keeps later generations past its own
+static void __chip8_snapshot_loaded(Chip8* chip8, const Chip8Snapshot* snapshot)
+{
+    if (snapshot->generation > chip8->snapshot_generations)
+    {
+        chip8->snapshot_generations = snapshot->generation;
+    }
+    chip8->snapshot_generation = snapshot->generation;
+    chip8->dirty_pages = 0;
+}
+
+
+int chip8_snapshot_save(Chip8* chip8, Chip8Snapshot* snapshot)
+{
+    if (chip8->xo || chip8->mega)
+    {
+        return -1;
+    }
+
+    __chip8_snapshot_save_registers(chip8, snapshot);
+    memcpy(snapshot->memory, chip8->memory, CHIP8_MEMORY_SIZE);
+    __chip8_snapshot_saved(chip8, snapshot);
+    return 0;
+}
+
+
+int chip8_snapshot_save_dirty(Chip8* chip8, Chip8Snapshot* snapshot)
+{
+    if (chip8->xo || chip8->mega)
+    {
+        return -1;
+    }
+
+    uint16_t pages = __chip8_snapshot_current(chip8, snapshot) ? chip8->dirty_pages : 0xFFFF;
+    __chip8_snapshot_save_registers(chip8, snapshot);
+    __chip8_copy_pages(snapshot->memory, chip8->memory, pages);
+    __chip8_snapshot_saved(chip8, snapshot);
+    return 0;
+}
+
+
+int chip8_snapshot_load(Chip8* chip8, const Chip8Snapshot* snapshot)
+{
+    if (!__chip8_snapshot_valid(chip8, snapshot))
+    {
+        return -1;
+    }
+
+    __chip8_snapshot_load_registers(chip8, snapshot);
+    memcpy(chip8->memory, snapshot->memory, CHIP8_MEMORY_SIZE);
+    __chip8_snapshot_loaded(chip8, snapshot);
+    return 0;
+}
+
+
+int chip8_snapshot_load_dirty(Chip8* chip8, const Chip8Snapshot* snapshot)
+{
+    if (!__chip8_snapshot_valid(chip8, snapshot))
+    {
+        return -1;
+    }
+
+    uint16_t pages = __chip8_snapshot_current(chip8, snapshot) ? chip8->dirty_pages : 0xFFFF;
+    __chip8_snapshot_load_registers(chip8, snapshot);
+    __chip8_copy_pages(chip8->memory, snapshot->memory, pages);
+    __chip8_snapshot_loaded(chip8, snapshot);
+    return 0;
+}
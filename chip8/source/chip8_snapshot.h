@@ -0,0 +1,88 @@
+#pragma once
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+
+/*
+Snapshots are a fixed-size copy of the whole machine state, laid out
+explicitly so they can be stored or sent as they are. Registers, stack,
+timers and VRAM are always copied (about a kilobyte). Memory is copied
+as 256-byte pages: the engine marks the pages it writes in
+Chip8::dirty_pages, and the *_dirty variants only copy those pages,
+which is what keeps repeated snapshots of a running machine cheap.
+
+Those pages are only known against one snapshot: the last one saved from
+or loaded into the machine. Each save gives its snapshot a new generation,
+and the machine remembers the generation it was last saved to or loaded
+from, so the *_dirty variants tell whether a snapshot is that one. Any
+other (saved before another one was, or loaded elsewhere since) gets its
+memory copied whole instead, which is always right, only slower. Keep
+generations to snapshots of one machine: those of another machine may
+match by chance.
+
+Machines in XO-CHIP mode (Chip8::xo) have 64 KB of memory, and MEGA-CHIP
+ones (Chip8::mega) 16 MB: neither can be snapshotted, saving and loading
+them fails.
+*/
+
+#define CHIP8_SNAPSHOT_MAGIC 0x38504843 // "CHP8", little-endian
+#define CHIP8_SNAPSHOT_VERSION 3
+#define CHIP8_SNAPSHOT_SIZE 5248 // Bytes, a multiple of the cache line
+#define CHIP8_SNAPSHOT_PAGE_SIZE 0x100
+#define CHIP8_SNAPSHOT_PAGES (CHIP8_MEMORY_SIZE / CHIP8_SNAPSHOT_PAGE_SIZE)
+
+#if defined(_MSC_VER)
+#define CHIP8_CACHE_ALIGNED __declspec(align(64))
+#else
+#define CHIP8_CACHE_ALIGNED __attribute__((aligned(64)))
+#endif
+
+
+typedef struct CHIP8_CACHE_ALIGNED _Chip8Snapshot {
+    uint32_t magic; // CHIP8_SNAPSHOT_MAGIC
+    uint32_t version; // CHIP8_SNAPSHOT_VERSION
+    uint64_t cycles;
+    uint64_t VRAM[CHIP8_HIRES_HEIGHT][CHIP8_VRAM_WORDS];
+    uint16_t stack[CHIP8_STACK_SIZE];
+    uint16_t I;
+    uint16_t pc;
+    uint16_t sp;
+    uint16_t rom_size;
+    uint16_t keys;
+    uint16_t key_wait_keys;
+    uint32_t rng;
+    uint32_t timer_cycles;
+    uint32_t generation; // Given by the save that last wrote the snapshot, see Chip8::snapshot_generation
+    uint8_t v[CHIP8_NUM_REGISTERS];
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t key_wait;
+    uint8_t quirks;
+    uint8_t hires;
+    uint8_t flags[CHIP8_NUM_FLAGS];
+    uint8_t reserved[19]; // Zero. Pads memory to a cache line boundary
+    uint8_t memory[CHIP8_MEMORY_SIZE];
+} Chip8Snapshot;
+
+
+// Copies the whole state of `chip8` into `snapshot`, and starts tracking dirty
+// pages against it (clears chip8->dirty_pages)
+// Returns 0 if OK, otherwise -1 (XO-CHIP or MEGA-CHIP, nothing written)
+int chip8_snapshot_save(Chip8* chip8, Chip8Snapshot* snapshot);
+// Same as chip8_snapshot_save, copying only the memory pages written since `snapshot`
+// was saved from or loaded into `chip8`, if no other snapshot was since. Otherwise
+// memory is copied whole. Writes done to chip8->memory from outside the engine
+// must be flagged in chip8->dirty_pages for this to see them
+int chip8_snapshot_save_dirty(Chip8* chip8, Chip8Snapshot* snapshot);
+
+// Restores the whole state of `chip8` from `snapshot`. Decode caches used with
+// `chip8` must be reset afterwards.
+// Returns 0 if OK, otherwise -1 (not a snapshot of this version, or XO-CHIP or MEGA-CHIP, `chip8` untouched)
+int chip8_snapshot_load(Chip8* chip8, const Chip8Snapshot* snapshot);
+// Same as chip8_snapshot_load, copying back only the memory pages written since
+// `snapshot` was saved from or loaded into `chip8`, if no other snapshot was since.
+// Invalidating those pages in decode caches is then enough. Otherwise memory is
+// copied whole, and decode caches must be reset
+int chip8_snapshot_load_dirty(Chip8* chip8, const Chip8Snapshot* snapshot);
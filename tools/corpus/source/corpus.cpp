@@ -0,0 +1,751 @@
+#include "corpus.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string.h>
+#include <system_error>
+
+
+static bool __is_rom(const std::filesystem::path& path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".ch8" || extension == ".c8";
+}
+
+
+std::vector<std::string> corpus_discover(const std::string& path)
+{
+    std::vector<std::string> roms;
+    std::error_code error;
+
+    if (std::filesystem::is_regular_file(path, error))
+    {
+        roms.push_back(path);
+        return roms;
+    }
+
+    auto options = std::filesystem::directory_options::skip_permission_denied;
+    for (std::filesystem::recursive_directory_iterator it(path, options, error), end; !error && it != end; it.increment(error))
+    {
+        if (it->is_regular_file(error) && __is_rom(it->path()))
+        {
+            roms.push_back(it->path().string());
+        }
+    }
+
+    std::sort(roms.begin(), roms.end());
+    return roms;
+}
+
+
+// FNV-1a over the display rows of the current mode, leftmost pixel first, so
+// hashes do not depend on the host. The second XO-CHIP plane follows the first.
+// With MEGA-CHIP on, the ARGB colors of its display instead
+static uint64_t __vram_hash(const Chip8* chip8)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    if (chip8->mega && chip8->mega->on)
+    {
+        for (int y = 0; y < CHIP8_MEGA_HEIGHT; ++y)
+        {
+            for (int x = 0; x < CHIP8_MEGA_WIDTH; ++x)
+            {
+                hash ^= chip8->mega->screen[y][x];
+                hash *= 0x100000001B3ull;
+            }
+        }
+        return hash;
+    }
+    for (int plane = 0; plane < (chip8->xo ? CHIP8_XO_PLANES : 1); ++plane)
+    {
+        const uint64_t (*vram)[CHIP8_VRAM_WORDS] = plane ? chip8->xo->VRAM : chip8->VRAM;
+        for (int y = 0; y < VRAM_HEIGHT(chip8); ++y)
+        {
+            for (int word = 0; word < VRAM_WIDTH(chip8) / 64; ++word)
+            {
+                for (int byte = 7; byte >= 0; --byte)
+                {
+                    hash ^= (vram[y][word] >> (byte * 8)) & 0xFF;
+                    hash *= 0x100000001B3ull;
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+
+// Returns a new Chip8 seeded with `seed`, set to `quirks`, with the ROM at `path` loaded,
+// or nullptr and sets `error`
+static Chip8* __load_rom(const std::string& path, uint32_t seed, Chip8Quirks quirks, std::string& error)
+{
+    Chip8* chip8 = chip8_new();
+    chip8_init(chip8);
+    chip8_seed(chip8, seed);
+    if (chip8_set_quirks(chip8, quirks) != 0)
+    {
+        error = "out of memory";
+        chip8_delete(chip8);
+        return nullptr;
+    }
+    Chip8LoadResult result = chip8_load_rom(chip8, path.c_str());
+    if (result != CHIP8_LOAD_OK)
+    {
+        error = chip8_load_result_string(result);
+        chip8_delete(chip8);
+        return nullptr;
+    }
+    return chip8;
+}
+
+
+static void __record_fault(CorpusResult& result, const Chip8* chip8)
+{
+    result.faulted = true;
+    result.fault_pc = chip8->pc;
+    const uint8_t* memory = CHIP8_MEMORY(chip8);
+    const uint32_t mask = CHIP8_MEMORY_BYTES(chip8) - 1;
+    result.fault_opcode = (memory[chip8->pc & mask] << 8) | memory[(chip8->pc + 1) & mask];
+}
+
+
+CorpusResult corpus_run_rom(const std::string& path, const CorpusOptions& options)
+{
+    CorpusResult result{};
+    result.path = path;
+
+    Chip8* chip8 = __load_rom(path, options.seed, options.quirks, result.error);
+    if (!chip8)
+    {
+        return result;
+    }
+
+    Chip8Jit* jit = nullptr;
+    Chip8* shadow = nullptr;
+    if (options.jit || options.lockstep)
+    {
+        jit = chip8_jit_new();
+        if (!jit)
+        {
+            result.error = "JIT not available on this host";
+            chip8_delete(chip8);
+            return result;
+        }
+        shadow = options.lockstep ? chip8_new() : nullptr;
+    }
+
+    Chip8DecodeCache* cache = chip8_decode_cache_new();
+    Chip8RunConfig config{};
+    config.cycles_per_timer_tick = options.cycles_per_frame;
+    config.flags = (options.skip_idle ? CHIP8_RUN_SKIP_IDLE : 0) | (options.fuse ? CHIP8_RUN_FUSE : 0);
+    config.cache = cache;
+
+    auto start = std::chrono::steady_clock::now();
+    for (result.frames = 0; result.frames < options.frames; ++result.frames)
+    {
+        // Key waits just spend the rest of the frame: with no key ever pressed,
+        // the ROM keeps waiting frame after frame, as it would on hardware
+        Chip8StopReason reason;
+        if (shadow)
+        {
+            if (chip8_jit_lockstep(jit, chip8, shadow, options.cycles_per_frame, &config, &reason) != 0)
+            {
+                result.error = "JIT and interpreter differ after frame " + std::to_string(result.frames);
+                break;
+            }
+        }
+        else if (jit)
+        {
+            reason = chip8_jit_run(jit, chip8, options.cycles_per_frame, &config);
+        }
+        else
+        {
+            reason = chip8_run(chip8, options.cycles_per_frame, &config);
+        }
+
+        if (reason == CHIP8_STOP_FAULT)
+        {
+            __record_fault(result, chip8);
+            break;
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.cycles = chip8->cycles;
+    result.idle_cycles = chip8->idle_cycles;
+    result.vram_hash = __vram_hash(chip8);
+
+    if (jit)
+    {
+        chip8_jit_delete(jit);
+    }
+    if (shadow)
+    {
+        chip8_delete(shadow);
+    }
+    chip8_decode_cache_delete(cache);
+    chip8_delete(chip8);
+    return result;
+}
+
+
+static void __count_sequence(std::unordered_map<uint32_t, CorpusSequenceCount>& counts, uint32_t key, bool adjacent)
+{
+    CorpusSequenceCount& count = counts[key];
+    count.count++;
+    count.adjacent += adjacent ? 1 : 0;
+}
+
+
+CorpusResult corpus_mine_rom(const std::string& path, const CorpusOptions& options, CorpusSequences& sequences)
+{
+    CorpusResult result{};
+    result.path = path;
+
+    Chip8* chip8 = __load_rom(path, options.seed, options.quirks, result.error);
+    if (!chip8)
+    {
+        return result;
+    }
+
+    // No idle skipping: fast-forwarded instructions would not be seen
+    Chip8DecodeCache* cache = chip8_decode_cache_new();
+    Chip8RunConfig config{};
+    config.cycles_per_timer_tick = options.cycles_per_frame;
+    config.cache = cache;
+
+    // The last two instructions executed, most recent first. An instruction follows
+    // another in memory when it starts where that one ends: F000 nnnn (XO-CHIP) and
+    // 01nn nnnn (MEGA-CHIP) take 4 bytes
+    uint8_t ops[2] = { CHIP8_OP_NONE, CHIP8_OP_NONE };
+    uint32_t pcs[2] = { 0, 0 };
+    uint32_t ends[2] = { 0, 0 };
+
+    auto start = std::chrono::steady_clock::now();
+    for (result.frames = 0; result.frames < options.frames; ++result.frames)
+    {
+        for (uint32_t cycle = 0; cycle < options.cycles_per_frame; ++cycle)
+        {
+            const uint32_t mask = CHIP8_MEMORY_BYTES(chip8) - 1;
+            uint32_t pc = chip8->pc & mask;
+            uint32_t length;
+            uint8_t op = chip8_decode_at(chip8, pc, &length).op;
+
+            Chip8StopReason reason = chip8_run(chip8, 1, &config);
+            if (reason == CHIP8_STOP_FAULT)
+            {
+                __record_fault(result, chip8);
+                break;
+            }
+            if (reason == CHIP8_STOP_KEY_WAIT)
+            {
+                // Spends the rest of the frame, as in corpus_run_rom
+                chip8_run(chip8, options.cycles_per_frame - cycle - 1, &config);
+                break;
+            }
+
+            sequences.instructions++;
+            if (ops[0] != CHIP8_OP_NONE)
+            {
+                bool adjacent = ends[0] == pc;
+                __count_sequence(sequences.pairs, ops[0] << 8 | op, adjacent);
+                if (ops[1] != CHIP8_OP_NONE)
+                {
+                    __count_sequence(sequences.triples, ops[1] << 16 | ops[0] << 8 | op, adjacent && ends[1] == pcs[0]);
+                }
+            }
+            ops[1] = ops[0];
+            pcs[1] = pcs[0];
+            ends[1] = ends[0];
+            ops[0] = op;
+            pcs[0] = pc;
+            ends[0] = (pc + length) & mask;
+        }
+
+        if (result.faulted)
+        {
+            break;
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.cycles = chip8->cycles;
+    result.vram_hash = __vram_hash(chip8);
+
+    chip8_decode_cache_delete(cache);
+    chip8_delete(chip8);
+    return result;
+}
+
+
+CorpusAnalysis corpus_analyze_rom(const std::string& path, const CorpusOptions& options)
+{
+    CorpusAnalysis result{};
+    result.path = path;
+
+    Chip8* chip8 = __load_rom(path, options.seed, options.quirks, result.error);
+    if (!chip8)
+    {
+        return result;
+    }
+
+    const uint32_t rom_end = CHIP8_PROGRAM_START_LOCATION + chip8->rom_size;
+    auto start = std::chrono::steady_clock::now();
+    Chip8Analysis* analysis = chip8_analysis_new(chip8, CHIP8_PROGRAM_START_LOCATION, rom_end, nullptr, 0);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!analysis)
+    {
+        result.error = "out of memory";
+        chip8_delete(chip8);
+        return result;
+    }
+
+    result.rom_bytes = chip8->rom_size;
+    for (uint32_t at = CHIP8_PROGRAM_START_LOCATION; at < rom_end && at < analysis->end; ++at)
+    {
+        result.code_bytes += (analysis->map[at] & (CHIP8_MAP_CODE | CHIP8_MAP_OPERAND)) ? 1 : 0;
+        result.sprite_bytes += (analysis->map[at] & CHIP8_MAP_SPRITE) ? 1 : 0;
+    }
+    result.instructions = analysis->instructions;
+    result.blocks = analysis->block_count;
+    result.subroutines = analysis->subroutine_count;
+    result.loops = analysis->loop_count;
+    result.computed_jumps = analysis->computed_jump_count;
+    result.self_modifying = analysis->self_modifying_count;
+
+    chip8_analysis_delete(analysis);
+    chip8_delete(chip8);
+    return result;
+}
+
+
+// Whether a lane of a batch ended up in the same state as its run with chip8_run
+static bool __same_state(const Chip8* lane, const Chip8* twin)
+{
+    return memcmp(lane->v, twin->v, sizeof(lane->v)) == 0 &&
+           memcmp(lane->memory, twin->memory, sizeof(lane->memory)) == 0 &&
+           memcmp(lane->VRAM, twin->VRAM, sizeof(lane->VRAM)) == 0 &&
+           memcmp(lane->stack, twin->stack, sizeof(lane->stack)) == 0 &&
+           memcmp(lane->flags, twin->flags, sizeof(lane->flags)) == 0 &&
+           lane->I == twin->I && lane->pc == twin->pc && lane->sp == twin->sp &&
+           lane->delay_timer == twin->delay_timer && lane->sound_timer == twin->sound_timer &&
+           lane->timer_cycles == twin->timer_cycles && lane->key_wait == twin->key_wait &&
+           lane->key_wait_keys == twin->key_wait_keys && lane->rng == twin->rng &&
+           lane->cycles == twin->cycles && lane->hires == twin->hires;
+}
+
+
+CorpusBatch corpus_batch_rom(const std::string& path, const CorpusOptions& options, uint32_t lanes)
+{
+    CorpusBatch result{};
+    result.path = path;
+    result.lanes = lanes;
+
+    Chip8* prototype = __load_rom(path, options.seed, options.quirks, result.error);
+    if (!prototype)
+    {
+        return result;
+    }
+    Chip8Batch* batch = chip8_batch_new(prototype, lanes);
+    if (!batch)
+    {
+        result.error = "out of memory";
+        chip8_delete(prototype);
+        return result;
+    }
+    for (uint32_t lane = 0; lane < lanes; ++lane)
+    {
+        chip8_batch_seed(batch, lane, options.seed + lane);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < options.frames; ++frame)
+    {
+        chip8_batch_run(batch, options.cycles_per_frame, options.cycles_per_frame);
+    }
+    result.batch_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // The same lanes one after the other. Unlike corpus_run_rom, lanes that fault are run
+    // on for every frame, as in the batch, which makes chip8_run return at once
+    Chip8* twin = chip8_new();
+    Chip8* lane_state = chip8_new();
+    Chip8DecodeCache* cache = chip8_decode_cache_new();
+    Chip8RunConfig config{};
+    config.cycles_per_timer_tick = options.cycles_per_frame;
+    config.cache = cache;
+    for (uint32_t lane = 0; lane < lanes; ++lane)
+    {
+        memcpy(twin, prototype, sizeof(Chip8));
+        chip8_seed(twin, options.seed + lane);
+        chip8_decode_cache_reset(cache);
+
+        start = std::chrono::steady_clock::now();
+        for (uint32_t frame = 0; frame < options.frames; ++frame)
+        {
+            chip8_run(twin, options.cycles_per_frame, &config);
+        }
+        result.scalar_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        chip8_batch_get(batch, lane, lane_state);
+        result.cycles += lane_state->cycles;
+        result.mismatched += __same_state(lane_state, twin) ? 0 : 1;
+        result.faulted += (chip8_batch_stop_reason(batch, lane) == CHIP8_STOP_FAULT) ? 1 : 0;
+    }
+
+    chip8_decode_cache_delete(cache);
+    chip8_delete(lane_state);
+    chip8_delete(twin);
+    chip8_batch_delete(batch);
+    chip8_delete(prototype);
+    return result;
+}
+
+
+void corpus_merge_sequences(CorpusSequences& into, const CorpusSequences& from)
+{
+    into.instructions += from.instructions;
+    for (const auto& [key, count] : from.pairs)
+    {
+        into.pairs[key].count += count.count;
+        into.pairs[key].adjacent += count.adjacent;
+    }
+    for (const auto& [key, count] : from.triples)
+    {
+        into.triples[key].count += count.count;
+        into.triples[key].adjacent += count.adjacent;
+    }
+}
+
+
+uint64_t corpus_rom_hash(const std::string& path)
+{
+    // The file bytes are the ROM bytes as loaded, no machine needed. Sizes no mode
+    // can load (MEGA-CHIP takes the largest ROMs) are left out, as they would not load
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(path, error);
+    if (error || size == 0 || size > CHIP8_MEGA_ROM_MAX_SIZE)
+    {
+        return 0;
+    }
+
+    std::vector<uint8_t> rom((size_t)size);
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return 0;
+    }
+    bool read_ok = fread(rom.data(), 1, rom.size(), file) == rom.size();
+    fclose(file);
+    return read_ok ? chip8_rom_hash(rom.data(), rom.size()) : 0;
+}
+
+
+CorpusResult corpus_replay(const std::string& movie_path, const std::vector<std::string>& roms, const std::vector<uint64_t>& rom_hashes)
+{
+    CorpusResult result{};
+    result.movie = movie_path;
+
+    Chip8Movie* movie = chip8_movie_load(movie_path.c_str());
+    if (!movie)
+    {
+        result.error = "Movie could not be loaded";
+        return result;
+    }
+
+    auto match = std::find(rom_hashes.begin(), rom_hashes.end(), chip8_movie_rom_hash(movie));
+    if (match == rom_hashes.end())
+    {
+        result.error = "No ROM matches the movie";
+        chip8_movie_delete(movie);
+        return result;
+    }
+    result.path = roms[match - rom_hashes.begin()];
+
+    Chip8* chip8 = __load_rom(result.path, chip8_movie_seed(movie), chip8_movie_quirks(movie), result.error);
+    if (!chip8)
+    {
+        chip8_movie_delete(movie);
+        return result;
+    }
+
+    Chip8DecodeCache* cache = chip8_decode_cache_new();
+    auto start = std::chrono::steady_clock::now();
+    if (chip8_movie_replay(movie, chip8, cache) == CHIP8_STOP_FAULT)
+    {
+        __record_fault(result, chip8);
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.cycles = chip8->cycles;
+    result.idle_cycles = chip8->idle_cycles;
+    result.vram_hash = __vram_hash(chip8);
+
+    chip8_decode_cache_delete(cache);
+    chip8_delete(chip8);
+    chip8_movie_delete(movie);
+    return result;
+}
+
+
+static void __write_string(FILE* out, const std::string& value)
+{
+    fputc('"', out);
+    for (unsigned char c : value)
+    {
+        switch(c)
+        {
+            case '"': { fputs("\\\"", out); break; }
+            case '\\': { fputs("\\\\", out); break; }
+            case '\n': { fputs("\\n", out); break; }
+            case '\t': { fputs("\\t", out); break; }
+            default: {
+                if (c < 0x20)
+                {
+                    fprintf(out, "\\u%04x", c);
+                }
+                else
+                {
+                    fputc(c, out);
+                }
+                break;
+            }
+        }
+    }
+    fputc('"', out);
+}
+
+
+static double __mips(uint64_t cycles, double seconds)
+{
+    return seconds > 0 ? cycles / seconds / 1e6 : 0;
+}
+
+
+void corpus_write_report(FILE* out, const std::vector<CorpusResult>& results, const CorpusOptions& options, double seconds)
+{
+    uint64_t total_cycles = 0;
+    size_t faults = 0;
+    size_t errors = 0;
+    for (const CorpusResult& result : results)
+    {
+        total_cycles += result.cycles;
+        faults += result.faulted ? 1 : 0;
+        errors += result.error.empty() ? 0 : 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"frames\": %u,\n", options.frames);
+    fprintf(out, "  \"cycles_per_frame\": %u,\n", options.cycles_per_frame);
+    fprintf(out, "  \"seed\": %u,\n", options.seed);
+    fprintf(out, "  \"quirks\": \"%s\",\n", chip8_quirks_name(options.quirks));
+    fprintf(out, "  \"skip_idle\": %s,\n", options.skip_idle ? "true" : "false");
+    fprintf(out, "  \"fuse\": %s,\n", options.fuse ? "true" : "false");
+    fprintf(out, "  \"jit\": \"%s\",\n", options.lockstep ? "lockstep" : options.jit ? "on" : "off");
+    fprintf(out, "  \"threads\": %u,\n", options.threads);
+    fprintf(out, "  \"wall_seconds\": %.6f,\n", seconds);
+    fprintf(out, "  \"instructions\": %llu,\n", (unsigned long long)total_cycles);
+    fprintf(out, "  \"mips\": %.3f,\n", __mips(total_cycles, seconds));
+    fprintf(out, "  \"faults\": %zu,\n", faults);
+    fprintf(out, "  \"errors\": %zu,\n", errors);
+    fprintf(out, "  \"roms\": [");
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const CorpusResult& result = results[i];
+        fprintf(out, "%s\n    {\"path\": ", i ? "," : "");
+        __write_string(out, result.path);
+        if (!result.movie.empty())
+        {
+            fprintf(out, ", \"movie\": ");
+            __write_string(out, result.movie);
+        }
+
+        if (!result.error.empty())
+        {
+            fprintf(out, ", \"error\": ");
+            __write_string(out, result.error);
+            fprintf(out, "}");
+            continue;
+        }
+
+        if (result.movie.empty())
+        {
+            fprintf(out, ", \"frames\": %u", result.frames);
+        }
+        fprintf(out, ", \"instructions\": %llu", (unsigned long long)result.cycles);
+        fprintf(out, ", \"idle_instructions\": %llu", (unsigned long long)result.idle_cycles);
+        fprintf(out, ", \"vram_hash\": \"%016llx\"", (unsigned long long)result.vram_hash);
+        fprintf(out, ", \"wall_seconds\": %.6f", result.seconds);
+        fprintf(out, ", \"mips\": %.3f", __mips(result.cycles, result.seconds));
+        if (result.faulted)
+        {
+            fprintf(out, ", \"fault\": {\"pc\": %u, \"opcode\": \"%04X\"}", result.fault_pc, result.fault_opcode);
+        }
+        else
+        {
+            fprintf(out, ", \"fault\": null");
+        }
+        fprintf(out, "}");
+    }
+
+    fprintf(out, "%s]\n}\n", results.empty() ? "" : "\n  ");
+}
+
+
+void corpus_write_analysis(FILE* out, const std::vector<CorpusAnalysis>& analyses, const CorpusOptions& options, double seconds)
+{
+    double analysis_seconds = 0;
+    size_t errors = 0;
+    for (const CorpusAnalysis& analysis : analyses)
+    {
+        analysis_seconds += analysis.seconds;
+        errors += analysis.error.empty() ? 0 : 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"quirks\": \"%s\",\n", chip8_quirks_name(options.quirks));
+    fprintf(out, "  \"threads\": %u,\n", options.threads);
+    fprintf(out, "  \"wall_seconds\": %.6f,\n", seconds);
+    fprintf(out, "  \"analysis_seconds\": %.6f,\n", analysis_seconds);
+    fprintf(out, "  \"errors\": %zu,\n", errors);
+    fprintf(out, "  \"roms\": [");
+
+    for (size_t i = 0; i < analyses.size(); ++i)
+    {
+        const CorpusAnalysis& analysis = analyses[i];
+        fprintf(out, "%s\n    {\"path\": ", i ? "," : "");
+        __write_string(out, analysis.path);
+        if (!analysis.error.empty())
+        {
+            fprintf(out, ", \"error\": ");
+            __write_string(out, analysis.error);
+            fprintf(out, "}");
+            continue;
+        }
+
+        fprintf(out, ", \"rom_bytes\": %u", analysis.rom_bytes);
+        fprintf(out, ", \"code_bytes\": %u", analysis.code_bytes);
+        fprintf(out, ", \"sprite_bytes\": %u", analysis.sprite_bytes);
+        fprintf(out, ", \"instructions\": %u", analysis.instructions);
+        fprintf(out, ", \"blocks\": %u", analysis.blocks);
+        fprintf(out, ", \"subroutines\": %u", analysis.subroutines);
+        fprintf(out, ", \"loops\": %u", analysis.loops);
+        fprintf(out, ", \"computed_jumps\": %u", analysis.computed_jumps);
+        fprintf(out, ", \"self_modifying\": %u", analysis.self_modifying);
+        fprintf(out, ", \"wall_seconds\": %.6f}", analysis.seconds);
+    }
+
+    fprintf(out, "%s]\n}\n", analyses.empty() ? "" : "\n  ");
+}
+
+
+void corpus_write_batch(FILE* out, const std::vector<CorpusBatch>& batches, const CorpusOptions& options, double seconds)
+{
+    uint64_t total_cycles = 0;
+    double batch_seconds = 0;
+    double scalar_seconds = 0;
+    uint64_t mismatched = 0;
+    uint64_t faulted = 0;
+    size_t errors = 0;
+    for (const CorpusBatch& batch : batches)
+    {
+        total_cycles += batch.cycles;
+        batch_seconds += batch.batch_seconds;
+        scalar_seconds += batch.scalar_seconds;
+        mismatched += batch.mismatched;
+        faulted += batch.faulted;
+        errors += batch.error.empty() ? 0 : 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"frames\": %u,\n", options.frames);
+    fprintf(out, "  \"cycles_per_frame\": %u,\n", options.cycles_per_frame);
+    fprintf(out, "  \"seed\": %u,\n", options.seed);
+    fprintf(out, "  \"lanes\": %u,\n", batches.empty() ? 0 : batches[0].lanes);
+    fprintf(out, "  \"threads\": %u,\n", options.threads);
+    fprintf(out, "  \"wall_seconds\": %.6f,\n", seconds);
+    fprintf(out, "  \"instructions\": %llu,\n", (unsigned long long)total_cycles);
+    fprintf(out, "  \"batch_mips\": %.3f,\n", __mips(total_cycles, batch_seconds));
+    fprintf(out, "  \"scalar_mips\": %.3f,\n", __mips(total_cycles, scalar_seconds));
+    fprintf(out, "  \"mismatched_lanes\": %llu,\n", (unsigned long long)mismatched);
+    fprintf(out, "  \"faulted_lanes\": %llu,\n", (unsigned long long)faulted);
+    fprintf(out, "  \"errors\": %zu,\n", errors);
+    fprintf(out, "  \"roms\": [");
+    for (size_t i = 0; i < batches.size(); ++i)
+    {
+        const CorpusBatch& batch = batches[i];
+        fprintf(out, "%s\n    {\"path\": ", i ? "," : "");
+        __write_string(out, batch.path);
+        if (!batch.error.empty())
+        {
+            fprintf(out, ", \"error\": ");
+            __write_string(out, batch.error);
+            fprintf(out, "}");
+            continue;
+        }
+        fprintf(out, ", \"instructions\": %llu", (unsigned long long)batch.cycles);
+        fprintf(out, ", \"batch_seconds\": %.6f", batch.batch_seconds);
+        fprintf(out, ", \"batch_mips\": %.3f", __mips(batch.cycles, batch.batch_seconds));
+        fprintf(out, ", \"scalar_seconds\": %.6f", batch.scalar_seconds);
+        fprintf(out, ", \"scalar_mips\": %.3f", __mips(batch.cycles, batch.scalar_seconds));
+        fprintf(out, ", \"mismatched_lanes\": %u", batch.mismatched);
+        fprintf(out, ", \"faulted_lanes\": %u}", batch.faulted);
+    }
+    fprintf(out, "%s]\n}\n", batches.empty() ? "" : "\n  ");
+}
+
+
+// Writes the `top` most frequent sequences of `counts`, each `length` instructions long
+static void __write_sequence_list(FILE* out, const std::unordered_map<uint32_t, CorpusSequenceCount>& counts, int length, size_t top, uint64_t instructions)
+{
+    std::vector<std::pair<uint32_t, CorpusSequenceCount>> sorted(counts.begin(), counts.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return (a.second.count != b.second.count) ? a.second.count > b.second.count : a.first < b.first;
+    });
+    sorted.resize(std::min(top, sorted.size()));
+
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        fprintf(out, "%s\n    {\"ops\": [", i ? "," : "");
+        for (int op = length - 1; op >= 0; --op)
+        {
+            fprintf(out, "\"%s\"%s", chip8_op_name((Chip8Op)((sorted[i].first >> (op * 8)) & 0xFF)), op ? ", " : "");
+        }
+        const CorpusSequenceCount& count = sorted[i].second;
+        fprintf(out, "], \"count\": %llu", (unsigned long long)count.count);
+        fprintf(out, ", \"percent\": %.3f", instructions ? 100.0 * count.count / instructions : 0.0);
+        fprintf(out, ", \"adjacent\": %llu}", (unsigned long long)count.adjacent);
+    }
+
+    fprintf(out, "%s]", sorted.empty() ? "" : "\n  ");
+}
+
+
+void corpus_write_sequences(FILE* out, const CorpusSequences& sequences, size_t top, const std::vector<CorpusResult>& results, const CorpusOptions& options, double seconds)
+{
+    size_t faults = 0;
+    size_t errors = 0;
+    for (const CorpusResult& result : results)
+    {
+        faults += result.faulted ? 1 : 0;
+        errors += result.error.empty() ? 0 : 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"frames\": %u,\n", options.frames);
+    fprintf(out, "  \"cycles_per_frame\": %u,\n", options.cycles_per_frame);
+    fprintf(out, "  \"seed\": %u,\n", options.seed);
+    fprintf(out, "  \"quirks\": \"%s\",\n", chip8_quirks_name(options.quirks));
+    fprintf(out, "  \"wall_seconds\": %.6f,\n", seconds);
+    fprintf(out, "  \"roms\": %zu,\n", results.size());
+    fprintf(out, "  \"faults\": %zu,\n", faults);
+    fprintf(out, "  \"errors\": %zu,\n", errors);
+    fprintf(out, "  \"instructions\": %llu,\n", (unsigned long long)sequences.instructions);
+    fprintf(out, "  \"pairs\": [");
+    __write_sequence_list(out, sequences.pairs, 2, top, sequences.instructions);
+    fprintf(out, ",\n  \"triples\": [");
+    __write_sequence_list(out, sequences.triples, 3, top, sequences.instructions);
+    fprintf(out, "\n}\n");
+}
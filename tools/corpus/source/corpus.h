@@ -0,0 +1,135 @@
+#pragma once
+
+extern "C" {
+    #include "chip8.h"
+    #include "chip8_analysis.h"
+    #include "chip8_batch.h"
+    #include "chip8_jit.h"
+    #include "chip8_movie.h"
+}
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+struct CorpusOptions
+{
+    uint32_t frames; // emulated frames to run each ROM for
+    uint32_t cycles_per_frame; // instructions per 60 Hz frame, also the timer period
+    uint32_t seed; // Cxnn seed, fixed so reports are reproducible
+    Chip8Quirks quirks; // behavior of the ambiguous instructions, movies bring their own
+    bool skip_idle; // fast-forward idle loops, same results in less time
+    bool fuse; // run common instruction sequences as superinstructions, same results
+    bool jit; // run translated to host code (chip8_jit_run), same results
+    bool lockstep; // run both translated and interpreted, stopping where they differ
+    unsigned int threads;
+};
+
+struct CorpusResult
+{
+    std::string path;
+    std::string movie; // replayed movie, empty for plain runs
+    std::string error; // empty when the ROM (and movie) loaded
+
+    uint64_t cycles; // instructions executed, key waits included
+    uint64_t idle_cycles; // of those, fast-forwarded through idle loops
+    uint32_t frames; // frames run before stopping, plain runs only
+    uint64_t vram_hash; // FNV-1a of the final display
+    double seconds; // wall time
+
+    bool faulted;
+    uint16_t fault_pc;
+    uint16_t fault_opcode;
+};
+
+// Static analysis of a ROM (chip8_analysis), without running it
+struct CorpusAnalysis
+{
+    std::string path;
+    std::string error; // empty when the ROM loaded
+
+    uint32_t rom_bytes;
+    uint32_t code_bytes; // of the ROM, in reachable instructions
+    uint32_t sprite_bytes; // of the ROM, drawn by reachable Dxyn
+    uint32_t instructions; // reachable
+    uint32_t blocks;
+    uint32_t subroutines;
+    uint32_t loops;
+    uint32_t computed_jumps;
+    uint32_t self_modifying; // stores writing over reachable instructions
+    double seconds; // wall time of the analysis alone
+};
+
+// A ROM run as a batch of lanes (chip8_batch), each lane then run alone with chip8_run
+// to check the batch against. Lane l is seeded with the options seed plus l
+struct CorpusBatch
+{
+    std::string path;
+    std::string error; // empty when the ROM loaded
+
+    uint32_t lanes;
+    uint64_t cycles; // instructions executed by all the lanes, key waits included
+    uint32_t mismatched; // lanes whose final state differs from their chip8_run run
+    uint32_t faulted; // lanes stopped on a fault
+    double batch_seconds; // wall time of the batch
+    double scalar_seconds; // wall time of the chip8_run runs
+};
+
+// How often an instruction sequence ran, and how often its instructions followed
+// each other in memory, the only sequences chip8_run can fuse
+struct CorpusSequenceCount
+{
+    uint64_t count;
+    uint64_t adjacent;
+};
+
+// Instruction sequences executed, keyed by their Chip8Op kinds, first one in the highest byte
+struct CorpusSequences
+{
+    uint64_t instructions;
+    std::unordered_map<uint32_t, CorpusSequenceCount> pairs;
+    std::unordered_map<uint32_t, CorpusSequenceCount> triples;
+};
+
+
+// Finds every .ch8/.c8 file under `path` (or `path` itself when it is a file), sorted
+std::vector<std::string> corpus_discover(const std::string& path);
+
+// Runs one ROM headless, with no key pressed, for options.frames frames or until it faults
+CorpusResult corpus_run_rom(const std::string& path, const CorpusOptions& options);
+
+// Runs one ROM as corpus_run_rom does, one instruction at a time, adding the
+// pairs and triples of instructions it executes to `sequences`. Key waits are left out
+CorpusResult corpus_mine_rom(const std::string& path, const CorpusOptions& options, CorpusSequences& sequences);
+
+// Analyzes the code of one ROM from its start, as loaded with options.quirks
+CorpusAnalysis corpus_analyze_rom(const std::string& path, const CorpusOptions& options);
+
+// Runs one ROM as a batch of `lanes` lanes, with no key pressed, for options.frames frames.
+// Idle loops are never skipped, lanes do not skip them
+CorpusBatch corpus_batch_rom(const std::string& path, const CorpusOptions& options, uint32_t lanes);
+
+// Adds the counts of `from` to `into`
+void corpus_merge_sequences(CorpusSequences& into, const CorpusSequences& from);
+
+// chip8_rom_hash of the ROM at `path` as loaded, 0 if it cannot be read or no mode can load it.
+// Reads the file alone, without building a Chip8
+uint64_t corpus_rom_hash(const std::string& path);
+
+// Replays a movie unthrottled on the ROM of `roms` whose hash (`rom_hashes`, same order) it was recorded on
+CorpusResult corpus_replay(const std::string& movie_path, const std::vector<std::string>& roms, const std::vector<uint64_t>& rom_hashes);
+
+// Writes the JSON report for a whole corpus run
+void corpus_write_report(FILE* out, const std::vector<CorpusResult>& results, const CorpusOptions& options, double seconds);
+
+// Writes the JSON report of a static analysis run
+void corpus_write_analysis(FILE* out, const std::vector<CorpusAnalysis>& analyses, const CorpusOptions& options, double seconds);
+
+// Writes the JSON report of a batch run
+void corpus_write_batch(FILE* out, const std::vector<CorpusBatch>& batches, const CorpusOptions& options, double seconds);
+
+// Writes the JSON report of a sequence mining run: the `top` most frequent pairs and triples
+void corpus_write_sequences(FILE* out, const CorpusSequences& sequences, size_t top, const std::vector<CorpusResult>& results, const CorpusOptions& options, double seconds);
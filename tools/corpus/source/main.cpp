@@ -0,0 +1,233 @@
+#include "corpus.h"
+#include "work_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+
+static void __usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [options] [path ...]\n"
+        "Runs every CHIP-8 ROM (.ch8/.c8) found under the given paths headless and\n"
+        "prints a JSON report. Defaults to data/chip8-roms.\n"
+        "\n"
+        "  --frames N     emulated 60 Hz frames per ROM (default 600)\n"
+        "  --ipf N        instructions per frame (default 13, about 800 per second)\n"
+        "  --seed N       Cxnn random seed (default 0)\n"
+        "  --quirks NAME  behavior of the ambiguous instructions: default, vip,\n"
+        "                 chip48, schip, xochip or megachip (default: default)\n"
+        "  --no-skip-idle execute idle loops instead of fast-forwarding them\n"
+        "                 (same results, for measuring the interpreter)\n"
+        "  --fuse         run common instruction sequences as superinstructions\n"
+        "                 (same results)\n"
+        "  --jit          translate ROMs to host code as they run (x86-64 only,\n"
+        "                 same results)\n"
+        "  --lockstep     run each frame both translated and interpreted, reporting\n"
+        "                 the ROMs where the two differ as errors\n"
+        "  --threads N    worker threads (default: all cores)\n"
+        "  --output FILE  write the report to FILE instead of stdout\n"
+        "  --replay FILE  replay a recorded movie on its ROM instead, unthrottled.\n"
+        "                 Repeat for several movies, the ROM is found by hash\n"
+        "  --sequences N  report the N most frequent instruction pairs and triples\n"
+        "                 executed across all ROMs instead\n"
+        "  --analyze      report the code, sprites, blocks, subroutines and loops\n"
+        "                 found in each ROM by static analysis instead of running it\n"
+        "  --batch N      run each ROM as a batch of N lanes (lane l seeded with the\n"
+        "                 seed plus l), then each lane alone, reporting both speeds\n"
+        "                 and the lanes that differ. Default quirks only\n",
+        program);
+}
+
+
+// Parses the value of a numeric option, exits on anything else
+static uint32_t __number(const char* program, const char* option, const char* value)
+{
+    char* end = nullptr;
+    unsigned long number = value ? strtoul(value, &end, 0) : 0;
+    if (!value || *end != '\0')
+    {
+        fprintf(stderr, "%s: %s expects a number\n", program, option);
+        exit(EXIT_FAILURE);
+    }
+    return (uint32_t)number;
+}
+
+
+// Parses the value of --quirks, exits on anything else
+static Chip8Quirks __quirks(const char* program, const char* value)
+{
+    for (int quirks = 0; quirks < CHIP8_QUIRKS_COUNT && value; ++quirks)
+    {
+        if (strcmp(value, chip8_quirks_name((Chip8Quirks)quirks)) == 0)
+        {
+            return (Chip8Quirks)quirks;
+        }
+    }
+    fprintf(stderr, "%s: --quirks expects default, vip, chip48, schip, xochip or megachip\n", program);
+    exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char** argv)
+{
+    CorpusOptions options{};
+    options.frames = 600;
+    options.cycles_per_frame = 13;
+    options.seed = 0;
+    options.quirks = CHIP8_QUIRKS_DEFAULT;
+    options.skip_idle = true;
+    options.fuse = false;
+    options.jit = false;
+    options.lockstep = false;
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
+
+    const char* output = nullptr;
+    uint32_t sequences_top = 0;
+    bool analyze = false;
+    uint32_t batch_lanes = 0;
+    std::vector<std::string> paths;
+    std::vector<std::string> movies;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (strcmp(arg, "--frames") == 0) { options.frames = __number(argv[0], arg, value); ++i; }
+        else if (strcmp(arg, "--ipf") == 0) { options.cycles_per_frame = __number(argv[0], arg, value); ++i; }
+        else if (strcmp(arg, "--seed") == 0) { options.seed = __number(argv[0], arg, value); ++i; }
+        else if (strcmp(arg, "--quirks") == 0) { options.quirks = __quirks(argv[0], value); ++i; }
+        else if (strcmp(arg, "--no-skip-idle") == 0) { options.skip_idle = false; }
+        else if (strcmp(arg, "--fuse") == 0) { options.fuse = true; }
+        else if (strcmp(arg, "--jit") == 0) { options.jit = true; }
+        else if (strcmp(arg, "--lockstep") == 0) { options.lockstep = true; }
+        else if (strcmp(arg, "--sequences") == 0) { sequences_top = __number(argv[0], arg, value); ++i; }
+        else if (strcmp(arg, "--analyze") == 0) { analyze = true; }
+        else if (strcmp(arg, "--batch") == 0) { batch_lanes = __number(argv[0], arg, value); ++i; }
+        else if (strcmp(arg, "--threads") == 0) { options.threads = __number(argv[0], arg, value); ++i; }
+        else if (strcmp(arg, "--output") == 0 && value) { output = value; ++i; }
+        else if (strcmp(arg, "--replay") == 0 && value) { movies.push_back(value); ++i; }
+        else if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) { __usage(argv[0]); return EXIT_SUCCESS; }
+        else if (strncmp(arg, "--", 2) == 0) { __usage(argv[0]); return EXIT_FAILURE; }
+        else { paths.push_back(arg); }
+    }
+
+    if (options.cycles_per_frame == 0 || options.threads == 0)
+    {
+        __usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (batch_lanes && options.quirks != CHIP8_QUIRKS_DEFAULT)
+    {
+        fprintf(stderr, "%s: --batch runs with the default quirks only\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (paths.empty())
+    {
+        paths.push_back("data/chip8-roms");
+    }
+
+    std::vector<std::string> roms;
+    for (const std::string& path : paths)
+    {
+        std::vector<std::string> found = corpus_discover(path);
+        roms.insert(roms.end(), found.begin(), found.end());
+    }
+    if (roms.empty())
+    {
+        fprintf(stderr, "%s: no ROMs found\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Every job writes its own slot, so results need no locking and keep the discovery order
+    std::vector<CorpusResult> results;
+    std::chrono::steady_clock::time_point start;
+    std::vector<CorpusAnalysis> analyses;
+    std::vector<CorpusBatch> batches;
+    CorpusSequences sequences{};
+    if (analyze)
+    {
+        analyses.resize(roms.size());
+        start = std::chrono::steady_clock::now();
+        work_pool_run(roms.size(), options.threads, [&](size_t job) {
+            analyses[job] = corpus_analyze_rom(roms[job], options);
+        });
+    }
+    else if (batch_lanes)
+    {
+        batches.resize(roms.size());
+        start = std::chrono::steady_clock::now();
+        work_pool_run(roms.size(), options.threads, [&](size_t job) {
+            batches[job] = corpus_batch_rom(roms[job], options, batch_lanes);
+        });
+    }
+    else if (sequences_top)
+    {
+        // Each job counts on its own, merged once all are done
+        std::vector<CorpusSequences> counts(roms.size());
+        results.resize(roms.size());
+        start = std::chrono::steady_clock::now();
+        work_pool_run(roms.size(), options.threads, [&](size_t job) {
+            results[job] = corpus_mine_rom(roms[job], options, counts[job]);
+        });
+        for (const CorpusSequences& count : counts)
+        {
+            corpus_merge_sequences(sequences, count);
+        }
+    }
+    else if (movies.empty())
+    {
+        results.resize(roms.size());
+        start = std::chrono::steady_clock::now();
+        work_pool_run(roms.size(), options.threads, [&](size_t job) {
+            results[job] = corpus_run_rom(roms[job], options);
+        });
+    }
+    else
+    {
+        std::vector<uint64_t> hashes(roms.size());
+        work_pool_run(roms.size(), options.threads, [&](size_t job) {
+            hashes[job] = corpus_rom_hash(roms[job]);
+        });
+
+        results.resize(movies.size());
+        start = std::chrono::steady_clock::now();
+        work_pool_run(movies.size(), options.threads, [&](size_t job) {
+            results[job] = corpus_replay(movies[job], roms, hashes);
+        });
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "%s: could not open %s\n", argv[0], output);
+        return EXIT_FAILURE;
+    }
+    if (analyze)
+    {
+        corpus_write_analysis(out, analyses, options, seconds);
+    }
+    else if (batch_lanes)
+    {
+        corpus_write_batch(out, batches, options, seconds);
+    }
+    else if (sequences_top)
+    {
+        corpus_write_sequences(out, sequences, sequences_top, results, options, seconds);
+    }
+    else
+    {
+        corpus_write_report(out, results, options, seconds);
+    }
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#include "work_pool.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+struct WorkQueue
+{
+    std::mutex lock;
+    std::deque<size_t> jobs;
+};
+
+
+// Takes a job from the back of the worker's own queue
+static bool __pop(WorkQueue& queue, size_t& job)
+{
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.jobs.empty())
+    {
+        return false;
+    }
+    job = queue.jobs.back();
+    queue.jobs.pop_back();
+    return true;
+}
+
+
+// Takes a job from the front of another worker's queue
+static bool __steal(WorkQueue& queue, size_t& job)
+{
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.jobs.empty())
+    {
+        return false;
+    }
+    job = queue.jobs.front();
+    queue.jobs.pop_front();
+    return true;
+}
+
+
+static void __worker(std::vector<std::unique_ptr<WorkQueue>>& queues, unsigned int self, const std::function<void(size_t job)>& work)
+{
+    const unsigned int workers = (unsigned int)queues.size();
+    size_t job;
+
+    for (;;)
+    {
+        if (__pop(*queues[self], job))
+        {
+            work(job);
+            continue;
+        }
+
+        // No job is ever added once the pool runs, so a pass over every other
+        // queue that finds nothing means the work is done
+        bool stolen = false;
+        for (unsigned int i = 1; i < workers && !stolen; ++i)
+        {
+            stolen = __steal(*queues[(self + i) % workers], job);
+        }
+        if (!stolen)
+        {
+            return;
+        }
+        work(job);
+    }
+}
+
+
+void work_pool_run(size_t count, unsigned int threads, const std::function<void(size_t job)>& work)
+{
+    if (threads == 0)
+    {
+        threads = 1;
+    }
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    for (unsigned int i = 0; i < threads; ++i)
+    {
+        queues.emplace_back(new WorkQueue());
+    }
+    for (size_t job = 0; job < count; ++job)
+    {
+        queues[job % threads]->jobs.push_front(job);
+    }
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; ++i)
+    {
+        workers.emplace_back(__worker, std::ref(queues), i, std::cref(work));
+    }
+    __worker(queues, 0, work);
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
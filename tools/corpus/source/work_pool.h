@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+#include <functional>
+
+
+// Runs `work` for every job in [0, count) on `threads` worker threads.
+// Jobs are dealt round-robin into one queue per worker. A worker takes jobs from
+// the back of its own queue and, once it is empty, steals from the front of the
+// others, so a few slow jobs do not leave the remaining cores idle
+void work_pool_run(size_t count, unsigned int threads, const std::function<void(size_t job)>& work);
@@ -3,14 +3,22 @@
 #include "input.h"
 extern "C" {
     #include "chip8.h"
+    #include "chip8_callgraph.h"
+    #include "chip8_movie.h"
+    #include "chip8_rewind.h"
 }
 
 #include <SDL2/SDL_keycode.h>
 #include <algorithm>
+#include <math.h>
 #include <string.h>
+#include <time.h>
 
 
-constexpr double Chip8DelayTimerPeriod = 1.0 / CHIP8_DELAY_TIMER_FREQ;
+#define REWIND_CAPACITY (4 << 20) // Bytes, minutes of history for most games
+#define REWIND_KEYFRAME_INTERVAL CHIP8_DELAY_TIMER_FREQ // One keyframe per second of history
+#define CALLGRAPH_MAX_EVENTS (1 << 18) // Calls kept for the trace export, 6 MiB
+#define SECONDS_PER_FRAME (1.0 / CHIP8_DELAY_TIMER_FREQ)
 
 
 Emulator* emulator_new()
@@ -24,11 +32,44 @@ Emulator* emulator_new()
 
 void emulator_reset(Emulator* em)
 {
+    // The rewind buffer is large, keep it across resets and just empty it
+    Chip8Rewind* rewind = em->rewind;
+    Chip8Profile* profile = em->profile;
+    Chip8CallGraph* callgraph = em->callgraph;
+    int quirks = em->configuration.quirks;
+    bool player = em->configuration.player;
+    if (em->movie)
+    {
+        chip8_movie_delete(em->movie);
+    }
+
+    chip8_delete(em->ch8);
     memset(em, 0, sizeof(Emulator));
     em->configuration.speed = 800;
     em->configuration.mode = Emulator_None;
+    em->configuration.rewind_speed = 2;
+    em->configuration.quirks = quirks;
+    em->configuration.player = player;
     em->ch8 = chip8_new();
     chip8_init(em->ch8);
+    if (chip8_set_quirks(em->ch8, (Chip8Quirks)quirks) != 0)
+    {
+        em->configuration.quirks = CHIP8_QUIRKS_DEFAULT;
+    }
+    em->state.seed = (uint32_t)time(NULL);
+    chip8_seed(em->ch8, em->state.seed);
+
+    // Without memory for it, rewinding stays off (see emulator_can_rewind) until a later reset
+    em->rewind = rewind ? rewind : chip8_rewind_new(REWIND_CAPACITY, REWIND_KEYFRAME_INTERVAL);
+    if (em->rewind)
+    {
+        chip8_rewind_clear(em->rewind);
+    }
+
+    em->profile = profile ? profile : new Chip8Profile();
+    chip8_profile_reset(em->profile);
+    em->callgraph = callgraph ? callgraph : chip8_callgraph_new(CALLGRAPH_MAX_EVENTS);
+    chip8_callgraph_reset(em->callgraph);
 }
 
 
@@ -41,6 +82,16 @@ void emulator_restart(Emulator* em)
 
 void emulator_delete(Emulator* em)
 {
+    if (em->movie)
+    {
+        chip8_movie_delete(em->movie);
+    }
+    if (em->rewind)
+    {
+        chip8_rewind_delete(em->rewind);
+    }
+    delete em->profile;
+    chip8_callgraph_delete(em->callgraph);
     chip8_delete(em->ch8);
     delete em;
 }
@@ -56,63 +107,167 @@ bool emulator_load_rom(Emulator* em, const std::string& rompath)
 }
 
 
-// Runs the emulator in Running mode, executing multiple instructions
-static void __tick_running(Emulator* em, double delta_time)
+// Host key for each CHIP-8 key
+static const unsigned int Chip8Keymap[CHIP8_KEYBOARD_SIZE] = {
+    SDLK_0, SDLK_1, SDLK_2, SDLK_3, SDLK_4, SDLK_5, SDLK_6, SDLK_7,
+    SDLK_8, SDLK_9, SDLK_a, SDLK_b, SDLK_c, SDLK_d, SDLK_e, SDLK_f,
+};
+
+
+static uint32_t __cycles_per_timer_tick(const Emulator* em)
 {
-    double seconds_per_instruction = 1.0 / em->configuration.speed;
-    em->state.execution_accumulator += delta_time;
-    while (em->state.execution_accumulator >= seconds_per_instruction)
+    return std::max(1u, (em->configuration.speed + CHIP8_DELAY_TIMER_FREQ / 2) / CHIP8_DELAY_TIMER_FREQ);
+}
+
+
+bool emulator_record_start(Emulator* em)
+{
+    emulator_restart(em);
+    if (em->configuration.mode == Emulator_None)
+    {
+        return false;
+    }
+
+    const Chip8* ch8 = em->ch8;
+    em->movie = chip8_movie_new(em->state.seed, __cycles_per_timer_tick(em), (Chip8Quirks)ch8->quirks, &CHIP8_MEMORY(ch8)[CHIP8_PROGRAM_START_LOCATION], ch8->rom_size);
+    return em->movie != nullptr;
+}
+
+
+bool emulator_record_stop(Emulator* em, const std::string& path)
+{
+    if (!em->movie)
+    {
+        return false;
+    }
+
+    chip8_movie_end(em->movie, em->ch8->cycles);
+    bool save_ok = chip8_movie_save(em->movie, path.c_str()) == 0;
+    chip8_movie_delete(em->movie);
+    em->movie = nullptr;
+    return save_ok;
+}
+
+
+// Runs the CHIP-8 for the given number of instructions, timers ticking at 60 Hz of emulated time
+static void __run(Emulator* em, uint32_t instructions)
+{
+    Chip8RunConfig config{};
+    config.cycles_per_timer_tick = __cycles_per_timer_tick(em);
+    config.profile = em->profile;
+    config.callgraph = em->callgraph;
+    config.flags = CHIP8_RUN_SKIP_IDLE;
+
+    // Everything the run depends on besides the ROM and seed, as of the cycle it starts at
+    if (em->movie && (chip8_movie_record_keys(em->movie, em->ch8->cycles, em->ch8->keys) != 0 ||
+                      chip8_movie_record_timer(em->movie, em->ch8->cycles, config.cycles_per_timer_tick) != 0))
     {
-        em->state.execution_accumulator -= seconds_per_instruction;
-        chip8_execute(em->ch8);
+        // Out of memory: the movie misses this input and would not replay the run, drop it
+        chip8_movie_delete(em->movie);
+        em->movie = nullptr;
     }
 
-    em->state.timer_accumulator += delta_time;
-    while (em->state.timer_accumulator >= Chip8DelayTimerPeriod)
+    uint64_t idle_cycles = em->ch8->idle_cycles;
+    if (chip8_run(em->ch8, instructions, &config) == CHIP8_STOP_FAULT)
+    {
+        em->configuration.mode = Emulator_Paused;
+    }
+    em->state.idle = (em->ch8->idle_cycles - idle_cycles) * 2 >= instructions;
+}
+
+
+// Records a rewind frame once per 1/60 s. When the host falls behind
+// by several frames, only the latest state is kept
+static void __record_rewind(Emulator* em, double delta_time)
+{
+    em->state.rewind_accumulator += delta_time;
+    if (em->state.rewind_accumulator >= SECONDS_PER_FRAME)
     {
-        em->state.timer_accumulator -= Chip8DelayTimerPeriod;
-        em->ch8->delay_timer = std::max(0, em->ch8->delay_timer - 1);
+        em->state.rewind_accumulator = fmod(em->state.rewind_accumulator, SECONDS_PER_FRAME);
+        if (em->rewind)
+        {
+            chip8_rewind_push(em->rewind, em->ch8);
+        }
     }
 }
 
 
+// Runs the emulator in Running mode, executing multiple instructions
+static void __tick_running(Emulator* em, double delta_time)
+{
+    double seconds_per_instruction = 1.0 / em->configuration.speed;
+    em->state.execution_accumulator += delta_time;
+
+    uint32_t instructions = (uint32_t)(em->state.execution_accumulator / seconds_per_instruction);
+    em->state.execution_accumulator -= instructions * seconds_per_instruction;
+    __run(em, instructions);
+    __record_rewind(em, delta_time);
+}
+
+
 // Runs the emulator in Ticking mode, executing only one instruction
 // at a time, and returning to Pause mode at the end
 static void __tick_single(Emulator* em, double delta_time)
 {
-    double seconds_per_instruction = 1.0 / em->configuration.speed;
+    __run(em, 1);
+    if (em->rewind)
+    {
+        chip8_rewind_push(em->rewind, em->ch8); // So single steps can be undone one by one
+    }
+    em->configuration.mode = Emulator_Paused;
+}
 
-    chip8_execute(em->ch8);
 
-    em->state.timer_accumulator += seconds_per_instruction;
-    while (em->state.timer_accumulator >= Chip8DelayTimerPeriod)
+// Steps back through the recorded frames, rewind_speed times faster than they were recorded
+static void __tick_rewind(Emulator* em, double delta_time)
+{
+    em->state.rewind_accumulator += delta_time * em->configuration.rewind_speed;
+    while (em->state.rewind_accumulator >= SECONDS_PER_FRAME)
     {
-        em->state.timer_accumulator -= Chip8DelayTimerPeriod;
-        em->ch8->delay_timer = std::max(0, em->ch8->delay_timer - 1);
+        em->state.rewind_accumulator -= SECONDS_PER_FRAME;
+        if (chip8_rewind_pop(em->rewind, em->ch8) != 0)
+        {
+            em->state.rewind_accumulator = 0;
+            break;
+        }
     }
 
-    em->configuration.mode = Emulator_Paused;
+    // Recording goes on from the restored frame
+    if (em->movie)
+    {
+        chip8_movie_truncate(em->movie, em->ch8->cycles);
+    }
+}
+
+
+bool emulator_can_rewind(const Emulator* em)
+{
+    return em->rewind && !em->ch8->xo && !em->ch8->mega;
+}
+
+
+bool emulator_is_idle(const Emulator* em)
+{
+    return em->configuration.mode != Emulator_Running || em->state.idle;
 }
 
 
 void emulator_tick(Emulator* em, double delta_time)
 {
-    em->ch8->keyboard[0x0] = input_is_key_held(SDLK_0)? 1:0;
-    em->ch8->keyboard[0x1] = input_is_key_held(SDLK_1)? 1:0;
-    em->ch8->keyboard[0x2] = input_is_key_held(SDLK_2)? 1:0;
-    em->ch8->keyboard[0x3] = input_is_key_held(SDLK_3)? 1:0;
-    em->ch8->keyboard[0x4] = input_is_key_held(SDLK_4)? 1:0;
-    em->ch8->keyboard[0x5] = input_is_key_held(SDLK_5)? 1:0;
-    em->ch8->keyboard[0x6] = input_is_key_held(SDLK_6)? 1:0;
-    em->ch8->keyboard[0x7] = input_is_key_held(SDLK_7)? 1:0;
-    em->ch8->keyboard[0x8] = input_is_key_held(SDLK_8)? 1:0;
-    em->ch8->keyboard[0x9] = input_is_key_held(SDLK_9)? 1:0;
-    em->ch8->keyboard[0xA] = input_is_key_held(SDLK_a)? 1:0;
-    em->ch8->keyboard[0xB] = input_is_key_held(SDLK_b)? 1:0;
-    em->ch8->keyboard[0xC] = input_is_key_held(SDLK_c)? 1:0;
-    em->ch8->keyboard[0xD] = input_is_key_held(SDLK_d)? 1:0;
-    em->ch8->keyboard[0xE] = input_is_key_held(SDLK_e)? 1:0;
-    em->ch8->keyboard[0xF] = input_is_key_held(SDLK_f)? 1:0;
+    uint16_t keys = 0;
+    for (int key = 0; key < CHIP8_KEYBOARD_SIZE; ++key)
+    {
+        keys |= input_is_key_held(Chip8Keymap[key])? CHIP8_KEY(key) : 0;
+    }
+    em->ch8->keys = keys;
+
+    bool rewinding = em->state.rewind_requested || input_is_key_held(SDLK_BACKSPACE);
+    em->state.rewind_requested = false;
+    if (rewinding && em->configuration.mode != Emulator_None && emulator_can_rewind(em))
+    {
+        __tick_rewind(em, delta_time);
+        return;
+    }
     
     switch(em->configuration.mode)
     {
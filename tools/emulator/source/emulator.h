@@ -1,9 +1,14 @@
 #pragma once
 
+#include <stdint.h>
 #include <string>
 
 
 typedef struct _Chip8 Chip8;
+typedef struct _Chip8Rewind Chip8Rewind;
+typedef struct _Chip8Movie Chip8Movie;
+typedef struct _Chip8Profile Chip8Profile;
+typedef struct _Chip8CallGraph Chip8CallGraph;
 
 
 enum EmulatorMode
@@ -19,15 +24,25 @@ struct Emulator
     struct {
         unsigned int speed; // instructions per second
         EmulatorMode mode; // emulator running mode
+        unsigned int rewind_speed; // rewind playback speed, times real time
+        int quirks; // Chip8Quirks of the machine, kept across resets
+        bool player; // Shows the display alone over the whole window instead of the debug windows, kept across resets
     } configuration;
 
     struct {
         std::string rompath;
         double execution_accumulator; // Acummulates time until execution speed is matched, point at which an instruction is executed
-        double timer_accumulator; // accumulates time until 16 ms, point at which it is reset and Chip8->delay is reduced
+        double rewind_accumulator; // Acummulates time until the next rewind frame is recorded or restored
+        bool rewind_requested; // Set while the UI rewind button is held, consumed by the next tick
+        uint32_t seed; // Cxnn seed of the current run, stored in movies
+        bool idle; // Most cycles of the last run were fast-forwarded through idle loops
     } state;
     
     Chip8* ch8;
+    Chip8Rewind* rewind; // One frame per 1/60 s run, restored while rewinding. NULL when out of memory
+    Chip8Movie* movie; // Input of the current run while recording, otherwise NULL
+    Chip8Profile* profile; // Execution counters since the ROM was loaded, when built with CHIP8_PROFILE
+    Chip8CallGraph* callgraph; // Counters by emulated subroutine, same as above
 };
 
 // Creates a new emulator with default values
@@ -44,6 +59,24 @@ void emulator_restart(Emulator* em);
 // Loads ROM from given path into the CHIP-8
 bool emulator_load_rom(Emulator* em, const std::string& rompath);
 
-// The emulator executes its CHIP-8 as many times as required by delta_time and its speed
+// Restarts the ROM and records its input from the first cycle on, until emulator_record_stop
+// Returns true if recording started (a ROM is loaded, and there was memory for the movie)
+bool emulator_record_start(Emulator* em);
+// Stops recording and writes the movie to given path. Loading or resetting also stops
+// a recording, discarding it, as running out of memory for its input does.
+// RAM edits made while recording are not part of the movie
+// Returns true if the movie was written
+bool emulator_record_stop(Emulator* em, const std::string& path);
+
+// False for XO-CHIP and MEGA-CHIP machines, whose memory rewind frames cannot hold,
+// and when there was no memory for the rewind history (Emulator::rewind is NULL)
+bool emulator_can_rewind(const Emulator* em);
+
+// True while the emulator has nothing to compute until the next frame: paused,
+// or running a ROM that just waits for its timers or keys. The host can sleep
+bool emulator_is_idle(const Emulator* em);
+
+// The emulator executes its CHIP-8 as many times as required by delta_time and its speed,
+// or rewinds it while backspace or the rewind button is held
 // delta_time in seconds
 void emulator_tick(Emulator* em, double delta_time);
\ No newline at end of file
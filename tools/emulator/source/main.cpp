@@ -14,12 +14,12 @@
 #endif
 
 #include <algorithm>
-#include <time.h>
 
 
 #define WINDOW_SCALE 10
 #define WINDOW_WIDTH WINDOW_SCALE*CHIP8_DISPLAY_WIDTH
 #define WINDOW_HEIGHT WINDOW_SCALE*CHIP8_DISPLAY_HEIGHT
+#define FRAME_MS (1000 / 60)
 
 
 static SDL_Window* window;
@@ -85,8 +85,6 @@ static bool init_platform()
 
 int main(int, char**)
 {
-    srand(time(NULL));
-
     if (!init_platform())
     {
         return -1;
@@ -152,6 +150,10 @@ int main(int, char**)
         {
             emulator->configuration.mode = Emulator_Paused;
         }
+        if (input_is_key_pressed(SDLK_F11))
+        {
+            emulator->configuration.player = !emulator->configuration.player;
+        }
 
         emulator_tick(emulator, delta_time);
 
@@ -163,6 +165,11 @@ int main(int, char**)
         ImGui_ImplSDL2_NewFrame();
         ImGui::NewFrame();
 
+        if (emulator->configuration.player)
+        {
+            ui_chip8_player(emulator->ch8);
+        }
+        else
         {
             ImGui::ShowDemoWindow(nullptr);
 
@@ -170,6 +177,7 @@ int main(int, char**)
             ui_chip8_ram(emulator->ch8);
             ui_chip8_inspector(emulator->ch8);
             ui_chip8_disassembly(emulator->ch8);
+            ui_chip8_profile(emulator);
             ui_chip8_vram(emulator->ch8);
         }
 
@@ -179,9 +187,18 @@ int main(int, char**)
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         SDL_GL_SwapWindow(window);
+
+        // Vsync normally paces the loop already. Where it does not (or is off),
+        // do not spin through frames while there is nothing to emulate
+        unsigned int frame_ms = SDL_GetTicks() - current_time;
+        if (emulator_is_idle(emulator) && frame_ms < FRAME_MS)
+        {
+            SDL_Delay(FRAME_MS - frame_ms);
+        }
     }
 
     // Cleanup
+    ui_chip8_vram_shutdown();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
@@ -2,10 +2,249 @@
 
 extern "C" {
     #include "chip8.h"
+    #include "chip8_analysis.h"
 }
 
 #include "imgui.h"
 
+#include <algorithm>
+#include <set>
+#include <stdio.h>
+#include <string>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+
+// Bytes shown per line of data
+#define DATA_LINE_BYTES 8
+
+
+// What a line of the window shows, in the order lines at the same address come in
+enum DisassemblyLineKind : uint8_t
+{
+    Line_Subroutine, // sub_2A4:
+    Line_Loop, // loop_2A4:
+    Line_Label, // label_2A4:
+    Line_Instruction,
+    Line_Data, // Up to DATA_LINE_BYTES bytes of the ROM the code never runs
+    Line_Sprite, // Same, when a Dxyn draws some of them
+};
+
+struct DisassemblyLine
+{
+    uint32_t at;
+    DisassemblyLineKind kind;
+
+    bool operator<(const DisassemblyLine& other) const
+    {
+        return at != other.at ? at < other.at : kind < other.kind;
+    }
+};
+
+
+/*
+The window lists the instructions reachable from the start of the ROM, or from
+an address the program counter was seen at (where Bnnn jumps went), as
+chip8_analysis finds them, with labels on the subroutines, loops and jump
+targets, and the rest of the ROM as data. Text is kept until memory changes: a
+copy of the code space is compared every frame, changed bytes drop the lines
+covering them and the code is analyzed again. Only the lines on screen are
+formatted, through ImGuiListClipper.
+*/
+struct DisassemblyView
+{
+    const uint8_t* memory = nullptr; // Code space the view was built from, a mode change swaps it
+    std::vector<uint8_t> copy; // Its bytes at the time
+    std::set<uint16_t> roots; // Start of the ROM and every program counter seen off the known code
+    Chip8Analysis* analysis = nullptr;
+    std::vector<DisassemblyLine> lines; // Ascending
+    std::unordered_map<uint64_t, std::string> text; // By kind and address, for the lines shown so far
+    uint64_t cycles = 0; // Of the machine when last drawn, going back means it was reset or rewound
+    uint32_t followed_pc = UINT32_MAX; // Last program counter scrolled to
+    bool follow = true;
+};
+
+static DisassemblyView view;
+
+
+// Bytes the program counter runs through: code only runs from the first 64 KB
+static uint32_t __code_size(const Chip8* ch8)
+{
+    return (ch8->xo || ch8->mega) ? CHIP8_XO_MEMORY_SIZE : CHIP8_MEMORY_SIZE;
+}
+
+
+// End of the ROM, as far as the analysis goes
+static uint32_t __rom_end(const Chip8* ch8)
+{
+    return std::min<uint32_t>(CHIP8_PROGRAM_START_LOCATION + ch8->rom_size, view.analysis->end);
+}
+
+
+static uint64_t __text_key(const DisassemblyLine& line)
+{
+    return ((uint64_t)line.kind << 32) | line.at;
+}
+
+
+// Analyzes the code from the roots again, and lists its lines
+static void __analyze(const Chip8* ch8)
+{
+    if (view.analysis)
+    {
+        chip8_analysis_delete(view.analysis);
+    }
+    std::vector<uint16_t> roots(view.roots.begin(), view.roots.end());
+    view.analysis = chip8_analysis_new(ch8, 0, __code_size(ch8), roots.data(), (uint32_t)roots.size());
+    view.lines.clear();
+    if (!view.analysis)
+    {
+        // Out of memory, tried again on the next update
+        return;
+    }
+    const uint8_t* map = view.analysis->map;
+
+    // Data rows end where code starts, which may have moved
+    for (auto text = view.text.begin(); text != view.text.end();)
+    {
+        text = ((text->first >> 32) >= Line_Data) ? view.text.erase(text) : std::next(text);
+    }
+
+    for (uint32_t i = 0; i < view.analysis->block_count; ++i)
+    {
+        const Chip8Block& block = view.analysis->blocks[i];
+        if (map[block.start] & CHIP8_MAP_SUBROUTINE)
+        {
+            view.lines.push_back({ block.start, Line_Subroutine });
+        }
+        else if (block.flags & CHIP8_BLOCK_LOOP)
+        {
+            view.lines.push_back({ block.start, Line_Loop });
+        }
+        else if (map[block.start] & CHIP8_MAP_LABEL)
+        {
+            view.lines.push_back({ block.start, Line_Label });
+        }
+    }
+    for (uint32_t at = 0; at < view.analysis->end; ++at)
+    {
+        if (map[at] & CHIP8_MAP_CODE)
+        {
+            view.lines.push_back({ at, Line_Instruction });
+        }
+    }
+
+    // ROM bytes no instruction covers, cut where code comes in between
+    const uint32_t rom_end = __rom_end(ch8);
+    uint32_t at = CHIP8_PROGRAM_START_LOCATION;
+    while (at < rom_end)
+    {
+        if (map[at] & (CHIP8_MAP_CODE | CHIP8_MAP_OPERAND))
+        {
+            ++at;
+            continue;
+        }
+        uint32_t bytes = 0;
+        bool sprite = false;
+        while (at + bytes < rom_end && bytes < DATA_LINE_BYTES && !(map[at + bytes] & (CHIP8_MAP_CODE | CHIP8_MAP_OPERAND)))
+        {
+            sprite |= (map[at + bytes] & CHIP8_MAP_SPRITE) != 0;
+            ++bytes;
+        }
+        view.lines.push_back({ at, sprite ? Line_Sprite : Line_Data });
+        at += bytes;
+    }
+    std::sort(view.lines.begin(), view.lines.end());
+}
+
+
+// Brings the view up to date with the machine, analyzing the code again only if needed
+static void __update(const Chip8* ch8)
+{
+    const uint8_t* memory = CHIP8_MEMORY(ch8);
+    const uint32_t size = __code_size(ch8);
+    bool analyze = false;
+
+    if (memory != view.memory || size != view.copy.size() || ch8->cycles < view.cycles)
+    {
+        // Another machine, mode or run: nothing carries over
+        view.memory = memory;
+        view.copy.assign(memory, memory + size);
+        view.roots = { CHIP8_PROGRAM_START_LOCATION };
+        view.text.clear();
+        analyze = true;
+    }
+    else if (memcmp(view.copy.data(), memory, size) != 0)
+    {
+        // Drops the text of every instruction covering a changed byte, up to 4 bytes long
+        for (uint32_t at = 0; at < size; ++at)
+        {
+            if (view.copy[at] != memory[at])
+            {
+                view.copy[at] = memory[at];
+                for (uint32_t back = 0; back < 4 && back <= at; ++back)
+                {
+                    view.text.erase(__text_key({ at - back, Line_Instruction }));
+                }
+            }
+        }
+        analyze = true;
+    }
+    view.cycles = ch8->cycles;
+
+    if (analyze || !view.analysis)
+    {
+        __analyze(ch8);
+    }
+    if (view.analysis && (uint32_t)ch8->pc + 2 <= size && !(view.analysis->map[ch8->pc] & CHIP8_MAP_CODE))
+    {
+        // Only Bnnn gets anywhere the analysis did not, keep it as a way in
+        view.roots.insert(ch8->pc);
+        __analyze(ch8);
+    }
+}
+
+
+// Text of a line, formatted the first time it is shown
+static const std::string& __line(const Chip8* ch8, const DisassemblyLine& line)
+{
+    auto cached = view.text.find(__text_key(line));
+    if (cached != view.text.end())
+    {
+        return cached->second;
+    }
+
+    char text[CHIP8_DISASSEMBLY_LINE_SIZE + 64];
+    switch(line.kind)
+    {
+        case Line_Subroutine: { snprintf(text, sizeof(text), "sub_%03X:", line.at); break; }
+        case Line_Loop: { snprintf(text, sizeof(text), "loop_%03X:", line.at); break; }
+        case Line_Label: { snprintf(text, sizeof(text), "label_%03X:", line.at); break; }
+        case Line_Instruction: {
+            size_t length = chip8_disassemble_at(ch8, (uint16_t)line.at, text);
+            text[length - 1] = '\0';
+            break;
+        }
+        case Line_Data:
+        case Line_Sprite: {
+            const uint8_t* memory = CHIP8_MEMORY(ch8);
+            const uint8_t* map = view.analysis->map;
+            int written = snprintf(text, sizeof(text), "$%04X | db", line.at);
+            for (uint32_t at = line.at; at < line.at + DATA_LINE_BYTES && at < __rom_end(ch8) && !(map[at] & (CHIP8_MAP_CODE | CHIP8_MAP_OPERAND)); ++at)
+            {
+                written += snprintf(text + written, sizeof(text) - written, "%s0x%02X", at == line.at ? " " : ", ", memory[at]);
+            }
+            if (line.kind == Line_Sprite)
+            {
+                snprintf(text + written, sizeof(text) - written, " -> sprite");
+            }
+            break;
+        }
+    }
+    return view.text.emplace(__text_key(line), text).first->second;
+}
+
 
 void ui_chip8_disassembly(Chip8* ch8)
 {
@@ -15,14 +254,52 @@ void ui_chip8_disassembly(Chip8* ch8)
         return;
     }
 
-    uint16_t pc = CHIP8_PROGRAM_START_LOCATION;
-    char disassembly_inst[256];
-    while (pc < CHIP8_PROGRAM_START_LOCATION + ch8->rom_size)
+    __update(ch8);
+    if (!view.analysis)
     {
-        chip8_disassemble_at(ch8, pc, disassembly_inst);
-        ImGui::TextColored(ch8->pc == pc? ImVec4{1.0f, 0.0f, 0.0f, 1.0f} : ImVec4{1.0f,1.0f,1.0f,1.0f}, disassembly_inst);
-        pc += 2;
+        ImGui::Text("Could not analyze the code, out of memory");
+        ImGui::End();
+        return;
     }
 
+    ImGui::Checkbox("Follow PC", &view.follow);
+    ImGui::SameLine();
+    ImGui::Text("%u instructions reachable, %u subroutines, %u loops", view.analysis->instructions, view.analysis->subroutine_count, view.analysis->loop_count);
+
+    if (ImGui::BeginChild("##Lines"))
+    {
+        const float line_height = ImGui::GetTextLineHeightWithSpacing();
+
+        // Scrolls to the program counter when it moved, leaving the scroll alone otherwise
+        if (view.follow && ch8->pc != view.followed_pc)
+        {
+            view.followed_pc = ch8->pc;
+            auto line = std::lower_bound(view.lines.begin(), view.lines.end(), DisassemblyLine{ ch8->pc, Line_Instruction });
+            float y = (float)(line - view.lines.begin()) * line_height;
+            ImGui::SetScrollY(std::max(0.0f, y - 0.5f * (ImGui::GetWindowHeight() - line_height)));
+        }
+
+        ImGuiListClipper clipper;
+        clipper.Begin((int)view.lines.size(), line_height);
+        while (clipper.Step())
+        {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+            {
+                const DisassemblyLine& line = view.lines[i];
+                ImVec4 color{1.0f, 1.0f, 1.0f, 1.0f};
+                switch(line.kind)
+                {
+                    case Line_Instruction: { color = (ch8->pc == line.at) ? ImVec4{1.0f, 0.0f, 0.0f, 1.0f} : color; break; }
+                    case Line_Data:
+                    case Line_Sprite: { color = ImVec4{0.6f, 0.6f, 0.6f, 1.0f}; break; }
+                    default: { color = ImVec4{1.0f, 0.8f, 0.3f, 1.0f}; break; }
+                }
+                ImGui::TextColored(color, "%s", __line(ch8, line).c_str());
+            }
+        }
+        clipper.End();
+    }
+    ImGui::EndChild();
+
     ImGui::End();
-}
\ No newline at end of file
+}
@@ -38,6 +38,36 @@ void ui_chip8_inspector(Chip8* ch8)
     ImGui::SameLine();
     ImGui::TextColored(White, "%d", ch8->sound_timer);
 
+    if (ch8->xo)
+    {
+        ImGui::TextColored(White, "Planes");
+        ImGui::SameLine();
+        ImGui::TextColored(White, "%d", ch8->xo->planes);
+
+        ImGui::TextColored(White, "Pitch");
+        ImGui::SameLine();
+        ImGui::TextColored(White, "%d", ch8->xo->pitch);
+    }
+
+    if (ch8->mega)
+    {
+        ImGui::TextColored(White, "I (24-bit)");
+        ImGui::SameLine();
+        ImGui::TextColored(White, "0x%06X", ((unsigned)ch8->mega->I_high << 16) | ch8->I);
+
+        ImGui::TextColored(White, "MEGA-CHIP");
+        ImGui::SameLine();
+        ImGui::TextColored(ch8->mega->on ? White : Faded, ch8->mega->on ? "On" : "Off");
+
+        ImGui::TextColored(White, "Sprite");
+        ImGui::SameLine();
+        ImGui::TextColored(White, "%dx%d", ch8->mega->sprite_width, ch8->mega->sprite_height);
+
+        ImGui::TextColored(White, "Sample");
+        ImGui::SameLine();
+        ImGui::TextColored(ch8->mega->sound_playing ? White : Faded, "0x%06X, %u Hz", ch8->mega->sound_address, ch8->mega->sound_rate);
+    }
+
     ImGui::Separator();
 
     ImGui::Text("Registers");
@@ -0,0 +1,257 @@
+#include "ui.h"
+
+#include "emulator.h"
+extern "C" {
+    #include "chip8.h"
+    #include "chip8_callgraph.h"
+}
+
+#include "imgui.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+
+static bool executed_only = true;
+static std::vector<uint16_t> rows; // Addresses listed by __profile_disassembly, kept to spare an allocation per frame
+
+static const char* folded_path = "callgraph.folded";
+static const char* folded_pixels_path = "callgraph_pixels.folded";
+static const char* trace_path = "callgraph_trace.json";
+
+
+// Fades from white to red as `count` gets closer to `hottest`
+static ImVec4 __heat(uint64_t count, uint64_t hottest)
+{
+    float heat = hottest ? (float)count / hottest : 0.0f;
+    return ImVec4{1.0f, 1.0f - heat, 1.0f - heat, 1.0f};
+}
+
+
+// Quirk profiles the counted instructions ran in, with their share of them
+static void __profile_quirks(const Chip8Profile* profile, uint64_t total)
+{
+    std::string text;
+    for (int quirks = 0; quirks < CHIP8_QUIRKS_COUNT; ++quirks)
+    {
+        if (profile->quirks[quirks])
+        {
+            char share[64];
+            snprintf(share, sizeof(share), "%s%s %.1f%%", text.empty() ? "" : ", ", chip8_quirks_name((Chip8Quirks)quirks), 100.0 * profile->quirks[quirks] / total);
+            text += share;
+        }
+    }
+    ImGui::LabelText("Quirk Profiles", "%s", text.empty() ? "-" : text.c_str());
+}
+
+
+// How `op` behaved in the quirk profiles it ran in, named when there are several
+static std::string __behavior(const Chip8Profile* profile, Chip8Op op)
+{
+    int profiles = 0;
+    for (int quirks = 0; quirks < CHIP8_QUIRKS_COUNT; ++quirks)
+    {
+        profiles += profile->quirks[quirks] ? 1 : 0;
+    }
+
+    std::string text;
+    for (int quirks = 0; quirks < CHIP8_QUIRKS_COUNT; ++quirks)
+    {
+        const char* behavior = chip8_quirks_behavior(op, (Chip8Quirks)quirks);
+        if (!profile->quirks[quirks] || !behavior)
+        {
+            continue;
+        }
+        if (!text.empty())
+        {
+            text += "; ";
+        }
+        if (profiles > 1)
+        {
+            text += chip8_quirks_name((Chip8Quirks)quirks);
+            text += ": ";
+        }
+        text += behavior;
+    }
+    return text;
+}
+
+
+static void __profile_ops(const Chip8Profile* profile, uint64_t total)
+{
+    if (!ImGui::BeginTable("Instructions", 4))
+    {
+        return;
+    }
+
+    ImGui::TableSetupColumn("Instruction");
+    ImGui::TableSetupColumn("Count");
+    ImGui::TableSetupColumn("Quirks");
+    ImGui::TableSetupColumn("Paths");
+    ImGui::TableHeadersRow();
+
+    for (int op = 0; op < CHIP8_OP_COUNT; ++op)
+    {
+        if (!profile->ops[op])
+        {
+            continue;
+        }
+
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::Text("%s", chip8_op_name((Chip8Op)op));
+        ImGui::TableNextColumn();
+        ImGui::Text("%llu (%.1f%%)", (unsigned long long)profile->ops[op], 100.0 * profile->ops[op] / total);
+        ImGui::TableNextColumn();
+        ImGui::Text("%s", __behavior(profile, (Chip8Op)op).c_str());
+
+        // Only instructions with several paths list them
+        ImGui::TableNextColumn();
+        if (chip8_profile_path_name((Chip8Op)op, 1))
+        {
+            std::string paths;
+            for (uint32_t path = 0; path < CHIP8_PROFILE_PATHS; ++path)
+            {
+                const char* name = chip8_profile_path_name((Chip8Op)op, path);
+                if (name && profile->paths[op][path])
+                {
+                    char count[64];
+                    snprintf(count, sizeof(count), "%s%s %llu", paths.empty() ? "" : ", ", name, (unsigned long long)profile->paths[op][path]);
+                    paths += count;
+                }
+            }
+            ImGui::Text("%s", paths.c_str());
+        }
+    }
+
+    ImGui::EndTable();
+}
+
+
+// Disassembly of the ROM with the execution count of each address next to it
+static void __profile_disassembly(Chip8* ch8, const Chip8Profile* profile, uint64_t total)
+{
+    uint64_t hottest = 0;
+    for (int at = 0; at < CHIP8_MEMORY_SIZE; ++at)
+    {
+        hottest = (profile->pcs[at] > hottest) ? profile->pcs[at] : hottest;
+    }
+
+    if (!ImGui::BeginTable("Hot Addresses", 3))
+    {
+        return;
+    }
+
+    ImGui::TableSetupColumn("Count");
+    ImGui::TableSetupColumn("%");
+    ImGui::TableSetupColumn("Disassembly");
+    ImGui::TableHeadersRow();
+
+    // Counts only cover the first CHIP8_MEMORY_SIZE addresses, larger XO-CHIP and MEGA-CHIP ROMs are cut there
+    const uint32_t rom_end = CHIP8_PROGRAM_START_LOCATION + ch8->rom_size;
+    const uint32_t end = (rom_end < CHIP8_MEMORY_SIZE) ? rom_end : CHIP8_MEMORY_SIZE;
+    rows.clear();
+    for (uint32_t at = CHIP8_PROGRAM_START_LOCATION; at < end; ++at)
+    {
+        // Code may run from odd addresses too, those only show up once executed
+        if (!(executed_only || (at & 0x1)) || profile->pcs[at])
+        {
+            rows.push_back((uint16_t)at);
+        }
+    }
+
+    // Only the rows in view are disassembled
+    char disassembly_inst[CHIP8_DISASSEMBLY_LINE_SIZE];
+    ImGuiListClipper clipper;
+    clipper.Begin((int)rows.size());
+    while (clipper.Step())
+    {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+        {
+            const uint16_t at = rows[row];
+            const uint64_t count = profile->pcs[at];
+            ImVec4 color = __heat(count, hottest);
+            chip8_disassemble_at(ch8, at, disassembly_inst);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextColored(color, "%llu", (unsigned long long)count);
+            ImGui::TableNextColumn();
+            ImGui::TextColored(color, "%.2f", total ? 100.0 * count / total : 0.0);
+            ImGui::TableNextColumn();
+            ImGui::TextColored(color, "%s", disassembly_inst);
+        }
+    }
+    clipper.End();
+
+    ImGui::EndTable();
+}
+
+
+// Writes the call graph as folded stacks (instructions and pixels) and as a Chrome trace
+static void __export_callgraph(Emulator* emulator)
+{
+    const Chip8CallGraph* callgraph = emulator->callgraph;
+    if (FILE* out = fopen(folded_path, "w"))
+    {
+        chip8_callgraph_write_folded(callgraph, out, CHIP8_CALLGRAPH_INSTRUCTIONS);
+        fclose(out);
+    }
+    if (FILE* out = fopen(folded_pixels_path, "w"))
+    {
+        chip8_callgraph_write_folded(callgraph, out, CHIP8_CALLGRAPH_PIXELS);
+        fclose(out);
+    }
+    if (FILE* out = fopen(trace_path, "w"))
+    {
+        chip8_callgraph_write_trace(callgraph, out, emulator->configuration.speed);
+        fclose(out);
+    }
+}
+
+
+void ui_chip8_profile(Emulator* emulator)
+{
+    Chip8* ch8 = emulator->ch8;
+    Chip8Profile* profile = emulator->profile;
+
+    if (!ImGui::Begin("Profile"))
+    {
+        ImGui::End();
+        return;
+    }
+
+#ifndef CHIP8_PROFILE
+    // Counters stay at zero
+    ImGui::Text("Execution counters are compiled out, configure with -DCHIP8_PROFILE=ON to count instructions.");
+#endif
+
+    uint64_t total = 0;
+    for (int op = 0; op < CHIP8_OP_COUNT; ++op)
+    {
+        total += profile->ops[op];
+    }
+
+    if (ImGui::Button("Reset"))
+    {
+        chip8_profile_reset(profile);
+        chip8_callgraph_reset(emulator->callgraph);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Export Call Graph"))
+    {
+        __export_callgraph(emulator);
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Executed only", &executed_only);
+    ImGui::LabelText("Instructions", "%llu", (unsigned long long)total);
+    ImGui::LabelText("Calls Not Traced", "%u", chip8_callgraph_dropped(emulator->callgraph));
+    __profile_quirks(profile, total ? total : 1);
+
+    ImGui::Separator();
+    __profile_ops(profile, total ? total : 1);
+    ImGui::Separator();
+    __profile_disassembly(ch8, profile, total);
+
+    ImGui::End();
+}
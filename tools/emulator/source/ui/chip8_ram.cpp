@@ -9,5 +9,5 @@ static MemoryEditor memory_editor;
 
 void ui_chip8_ram(Chip8* ch8)
 {
-    memory_editor.DrawWindow("RAM Viewer", ch8->memory, CHIP8_MEMORY_SIZE);
+    memory_editor.DrawWindow("RAM Viewer", CHIP8_MEMORY(ch8), CHIP8_MEMORY_BYTES(ch8));
 }
\ No newline at end of file
@@ -1,26 +1,174 @@
 #include "ui.h"
 
-#include "chip8.h"
+extern "C" {
+    #include "chip8.h"
+}
 
 #include "imgui.h"
 
+#include "SDL2/SDL.h"
+#ifdef IMGUI_IMPL_OPENGL_ES2
+#include <SDL2/SDL_opengles2.h>
+#else
+#include <SDL2/SDL_opengl.h>
+#endif
 
-void ui_chip8_vram(Chip8* ch8)
+#include <stdint.h>
+#include <string.h>
+
+
+// By VRAM_COLOR: off, first plane, second XO-CHIP plane, both
+static const ImU32 palette[] = {
+    IM_COL32(51, 51, 51, 255),
+    IM_COL32(255, 255, 255, 255),
+    IM_COL32(255, 153, 0, 255),
+    IM_COL32(153, 76, 25, 255),
+};
+
+
+/*
+The display is one GL texture, drawn by ImGui as a single quad. Each frame the
+machine's display is converted to RGBA (ImU32, the same byte order as
+GL_RGBA) and compared with what the texture holds, so the texture is only
+uploaded again when a pixel changed, or recreated when the mode changed size.
+Largest of all is the MEGA-CHIP display, the buffers are sized for it.
+*/
+static struct {
+    GLuint id;
+    int width, height; // Of the texture, 0 before the first upload
+    int frame; // ImGui frame of the last update, so the VRAM and player views share it
+    ImU32 shown[CHIP8_MEGA_WIDTH * CHIP8_MEGA_HEIGHT];
+    ImU32 pixels[CHIP8_MEGA_WIDTH * CHIP8_MEGA_HEIGHT];
+} texture = { 0, 0, 0, -1, {}, {} };
+
+
+// Converts the display of the current mode into texture.pixels, returning its size
+static void __unpack(const Chip8* ch8, int* width, int* height)
 {
-    if (!ImGui::Begin("VRAM"))
+    if (ch8->mega && ch8->mega->on)
     {
-        ImGui::End();
+        static uint32_t argb[CHIP8_MEGA_WIDTH * CHIP8_MEGA_HEIGHT];
+        chip8_mega_unpack(ch8, argb);
+        for (int i = 0; i < CHIP8_MEGA_WIDTH * CHIP8_MEGA_HEIGHT; ++i)
+        {
+            uint32_t c = argb[i];
+            texture.pixels[i] = IM_COL32((c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF, c >> 24);
+        }
+        *width = CHIP8_MEGA_WIDTH;
+        *height = CHIP8_MEGA_HEIGHT;
         return;
     }
 
-    for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; ++y)
+    uint8_t vram[CHIP8_VRAM_SIZE];
+    chip8_vram_unpack(ch8, vram);
+    *width = VRAM_WIDTH(ch8);
+    *height = VRAM_HEIGHT(ch8);
+    for (int y = 0; y < *height; ++y)
     {
-        for (int x = 0; x < CHIP8_DISPLAY_WIDTH; ++x)
+        for (int x = 0; x < *width; ++x)
         {
-            ImGui::TextColored(ch8->VRAM[VRAM_AT(x, y)] != 0? ImVec4{1.0, 1.0, 1.0, 1.0} : ImVec4{0.2, 0.2, 0.2, 1.0}, "X");
-            if (x != CHIP8_DISPLAY_WIDTH-1) ImGui::SameLine();
+            texture.pixels[x + y * *width] = palette[vram[VRAM_AT(x, y)]];
         }
     }
+}
+
+
+// Brings the texture up to date with the display, once per ImGui frame
+static void __update_texture(const Chip8* ch8)
+{
+    if (texture.frame == ImGui::GetFrameCount())
+    {
+        return;
+    }
+    texture.frame = ImGui::GetFrameCount();
+
+    int width, height;
+    __unpack(ch8, &width, &height);
+    const size_t bytes = (size_t)width * height * sizeof(ImU32);
+
+    if (!texture.id)
+    {
+        glGenTextures(1, &texture.id);
+    }
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (width != texture.width || height != texture.height)
+    {
+        // Nearest filtering keeps the pixels sharp at any scale
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture.pixels);
+        texture.width = width;
+        texture.height = height;
+        memcpy(texture.shown, texture.pixels, bytes);
+    }
+    else if (memcmp(texture.shown, texture.pixels, bytes) != 0)
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, texture.pixels);
+        memcpy(texture.shown, texture.pixels, bytes);
+    }
+}
 
+
+// Draws the texture at the largest whole multiple of its size fitting `room`, centered in it
+static void __draw_scaled(ImVec2 room)
+{
+    int scale = (int)room.x / texture.width;
+    scale = ((int)room.y / texture.height < scale) ? (int)room.y / texture.height : scale;
+    scale = (scale < 1) ? 1 : scale;
+
+    ImVec2 size{(float)(texture.width * scale), (float)(texture.height * scale)};
+    ImVec2 cursor = ImGui::GetCursorPos();
+    ImGui::SetCursorPos(ImVec2{cursor.x + (room.x > size.x ? (int)(room.x - size.x) / 2 : 0),
+                               cursor.y + (room.y > size.y ? (int)(room.y - size.y) / 2 : 0)});
+    ImGui::Image((ImTextureID)(intptr_t)texture.id, size);
+}
+
+
+void ui_chip8_vram(Chip8* ch8)
+{
+    if (!ImGui::Begin("VRAM"))
+    {
+        ImGui::End();
+        return;
+    }
+
+    __update_texture(ch8);
+    __draw_scaled(ImGui::GetContentRegionAvail());
+
+    ImGui::End();
+}
+
+
+void ui_chip8_player(Chip8* ch8)
+{
+    // Covers the whole window, without decorations or padding
+    const ImGuiViewport* viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(viewport->WorkPos);
+    ImGui::SetNextWindowSize(viewport->WorkSize);
+    ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2{0.0f, 0.0f});
+    ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0.0f);
+    const ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove |
+                                   ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoBringToFrontOnFocus;
+    if (ImGui::Begin("Player", nullptr, flags))
+    {
+        __update_texture(ch8);
+        __draw_scaled(ImGui::GetContentRegionAvail());
+    }
     ImGui::End();
-}
\ No newline at end of file
+    ImGui::PopStyleVar(2);
+}
+
+
+void ui_chip8_vram_shutdown()
+{
+    if (texture.id)
+    {
+        glDeleteTextures(1, &texture.id);
+    }
+    texture.id = 0;
+    texture.width = 0;
+    texture.height = 0;
+}
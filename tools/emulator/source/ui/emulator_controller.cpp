@@ -1,12 +1,23 @@
 #include "ui.h"
 
 #include "emulator.h"
+extern "C" {
+    #include "chip8.h"
+    #include "chip8_rewind.h"
+}
 
 #include "imgui.h"
 
 
 static unsigned int speed_min = 1;
 static unsigned int speed_max = 1000;
+static unsigned int rewind_speed_min = 1;
+static unsigned int rewind_speed_max = 8;
+
+static const char* movie_path = "movie.c8m";
+
+// Same order as Chip8Quirks
+static const char* quirks_names[] = { "Default", "COSMAC VIP", "CHIP-48", "SUPER-CHIP", "XO-CHIP", "MEGA-CHIP" };
 
 static int rompath_idx; // Here we store our selection data as an index.
 static std::string rom_paths[] = {
@@ -58,8 +69,64 @@ void ui_emulation_controls(Emulator* emulator)
 
     ImGui::SliderScalar("Speed [Hz]", ImGuiDataType_U32, &emulator->configuration.speed, &speed_min, &speed_max, "%u");
 
+    // Hold to rewind, same as holding backspace. Not recorded in XO-CHIP and MEGA-CHIP, nor without memory for it
+    const bool can_rewind = emulator_can_rewind(emulator);
+    ImGui::BeginDisabled(!can_rewind);
+    ImGui::Button("Rewind");
+    if (ImGui::IsItemActive())
+    {
+        emulator->state.rewind_requested = true;
+    }
+    ImGui::SameLine();
+    ImGui::SliderScalar("Rewind Speed", ImGuiDataType_U32, &emulator->configuration.rewind_speed, &rewind_speed_min, &rewind_speed_max, "x%u");
+    ImGui::EndDisabled();
+    if (can_rewind)
+    {
+        ImGui::LabelText("Rewind History [s]", "%.1f (%u KiB)",
+            chip8_rewind_frames(emulator->rewind) / (float)CHIP8_DELAY_TIMER_FREQ, chip8_rewind_bytes(emulator->rewind) / 1024);
+    }
+    else if (!emulator->rewind)
+    {
+        ImGui::LabelText("Rewind History [s]", "not available, out of memory");
+    }
+    else
+    {
+        ImGui::LabelText("Rewind History [s]", "not available in %s", quirks_names[emulator->configuration.quirks]);
+    }
+
+    // Restarts the ROM and records its input, for replaying with chip8_corpus --replay
+    if (!emulator->movie)
+    {
+        if (ImGui::Button("Record") && emulator->configuration.mode != Emulator_None)
+        {
+            emulator_record_start(emulator);
+        }
+    }
+    else if (ImGui::Button("Stop Recording"))
+    {
+        emulator_record_stop(emulator, movie_path);
+    }
+    ImGui::SameLine();
+    ImGui::LabelText("Movie", "%s", emulator->movie ? movie_path : "-");
+
+    // Applies right away, but not while recording: movies replay with one profile.
+    // Frames recorded in another profile are dropped, they may not restore in this one
+    int quirks = emulator->configuration.quirks;
+    if (ImGui::Combo("Quirks", &quirks, quirks_names, IM_ARRAYSIZE(quirks_names)) && !emulator->movie &&
+        quirks != emulator->configuration.quirks && chip8_set_quirks(emulator->ch8, (Chip8Quirks)quirks) == 0)
+    {
+        emulator->configuration.quirks = quirks;
+        if (emulator->rewind)
+        {
+            chip8_rewind_clear(emulator->rewind);
+        }
+    }
+
+    // The display alone over the whole window, F11 to come back
+    ImGui::Checkbox("Player View (F11)", &emulator->configuration.player);
+
     ImGui::LabelText("Exec. Acc. [ms]", "%.04f", &emulator->state.execution_accumulator);
-    ImGui::LabelText("Timer Acc. [ms]", "%.04f", &emulator->state.timer_accumulator);
+    ImGui::LabelText("Timer Cycles", "%u", emulator->ch8->timer_cycles);
 
     if(ImGui::Button("Load ROM"))
     {
@@ -9,4 +9,9 @@ void ui_emulation_controls(Emulator* emulator);
 void ui_chip8_ram(Chip8* ch8);
 void ui_chip8_inspector(Chip8* ch8);
 void ui_chip8_disassembly(Chip8* ch8);
-void ui_chip8_vram(Chip8* ch8);
\ No newline at end of file
+void ui_chip8_profile(Emulator* emulator);
+void ui_chip8_vram(Chip8* ch8);
+// The display alone, filling the whole window
+void ui_chip8_player(Chip8* ch8);
+// Frees the display texture, while the GL context is still current
+void ui_chip8_vram_shutdown();
\ No newline at end of file
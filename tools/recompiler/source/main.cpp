@@ -0,0 +1,110 @@
+#include "recompiler.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static void __usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [options] ROM\n"
+        "Translates the code reachable in a CHIP-8 ROM into a C file, one function\n"
+        "per basic block, to be compiled in and run with chip8_aot_run (chip8_aot.h).\n"
+        "Code it cannot find or translate runs on the interpreter instead.\n"
+        "\n"
+        "  --output FILE  write the C file to FILE instead of stdout\n"
+        "  --name NAME    name of the Chip8AotProgram it defines\n"
+        "                 (default: rom_ followed by the ROM file name)\n",
+        program);
+}
+
+
+// C identifier made out of the ROM file name
+static std::string __default_name(const std::string& rom)
+{
+    size_t slash = rom.find_last_of("/\\");
+    std::string file = (slash == std::string::npos) ? rom : rom.substr(slash + 1);
+    std::string name = "rom_" + file.substr(0, file.find('.'));
+    for (char& c : name)
+    {
+        c = isalnum((unsigned char)c) ? c : '_';
+    }
+    return name;
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* output = nullptr;
+    std::string name;
+    std::string rom;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (strcmp(arg, "--output") == 0 && value) { output = value; ++i; }
+        else if (strcmp(arg, "--name") == 0 && value) { name = value; ++i; }
+        else if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) { __usage(argv[0]); return EXIT_SUCCESS; }
+        else if (strncmp(arg, "--", 2) == 0 || !rom.empty()) { __usage(argv[0]); return EXIT_FAILURE; }
+        else { rom = arg; }
+    }
+
+    if (rom.empty())
+    {
+        __usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (name.empty())
+    {
+        name = __default_name(rom);
+    }
+
+    Chip8* chip8 = chip8_new();
+    chip8_init(chip8);
+    Chip8LoadResult loaded = chip8_load_rom(chip8, rom.c_str());
+    if (loaded != CHIP8_LOAD_OK)
+    {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], rom.c_str(), chip8_load_result_string(loaded));
+        chip8_delete(chip8);
+        return EXIT_FAILURE;
+    }
+
+    Chip8Analysis* analysis = chip8_analysis_new(chip8, CHIP8_PROGRAM_START_LOCATION, CHIP8_PROGRAM_START_LOCATION + chip8->rom_size, nullptr, 0);
+    if (!analysis)
+    {
+        fprintf(stderr, "%s: %s: out of memory\n", argv[0], rom.c_str());
+        chip8_delete(chip8);
+        return EXIT_FAILURE;
+    }
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "%s: could not open %s\n", argv[0], output);
+        chip8_analysis_delete(analysis);
+        chip8_delete(chip8);
+        return EXIT_FAILURE;
+    }
+
+    RecompilerStats stats;
+    int written = recompiler_write_c(out, chip8, analysis, name, rom, &stats);
+    if (out != stdout)
+    {
+        written |= fclose(out);
+    }
+    const uint32_t computed_jumps = analysis->computed_jump_count;
+    chip8_analysis_delete(analysis);
+    chip8_delete(chip8);
+    if (written != 0)
+    {
+        fprintf(stderr, "%s: could not write %s\n", argv[0], output ? output : "the output");
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "%s: %u blocks, %u instructions translated, %u left to the interpreter, %u computed jumps\n",
+        rom.c_str(), stats.blocks, stats.translated, stats.interpreted, computed_jumps);
+    return EXIT_SUCCESS;
+}
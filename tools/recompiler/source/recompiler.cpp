@@ -0,0 +1,373 @@
+#include "recompiler.h"
+
+extern "C" {
+    #include "chip8_movie.h"
+}
+
+#include <stdarg.h>
+#include <string.h>
+#include <vector>
+
+
+// Run of instructions written out as one function
+struct RecompilerBlock
+{
+    uint16_t start;
+    uint16_t end;
+    bool terminated; // its last instruction decides where control goes, otherwise it falls through to `end`
+};
+
+
+static std::string __format(const char* format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return buffer;
+}
+
+
+// Whether `ins` can be translated, at `position` in its block. Instructions
+// using the timers only come first, as chip8_aot_run settles ticks once the
+// block is done
+static bool __translatable(const Chip8Instruction& ins, uint32_t position)
+{
+    switch(ins.op)
+    {
+        case CHIP8_OP_SYS:
+        case CHIP8_OP_INVALID:
+        case CHIP8_OP_LD_VX_K: { return false; }
+        // SUPER-CHIP display and flag instructions are rare, the interpreter runs them
+        case CHIP8_OP_SCD:
+        case CHIP8_OP_SCR:
+        case CHIP8_OP_SCL:
+        case CHIP8_OP_EXIT:
+        case CHIP8_OP_LOW:
+        case CHIP8_OP_HIGH:
+        case CHIP8_OP_LD_HF_VX:
+        case CHIP8_OP_LD_R_VX:
+        case CHIP8_OP_LD_VX_R: { return false; }
+        // XO-CHIP instructions only run in their own profile, never translated
+        case CHIP8_OP_SAVE_RANGE:
+        case CHIP8_OP_LOAD_RANGE:
+        case CHIP8_OP_LD_I_LONG:
+        case CHIP8_OP_PLANE:
+        case CHIP8_OP_AUDIO:
+        case CHIP8_OP_PITCH: { return false; }
+        // Neither are the MEGA-CHIP ones
+        case CHIP8_OP_MEGA_OFF:
+        case CHIP8_OP_MEGA_ON:
+        case CHIP8_OP_SCU:
+        case CHIP8_OP_LD_I_24:
+        case CHIP8_OP_LDPAL:
+        case CHIP8_OP_SPRW:
+        case CHIP8_OP_SPRH:
+        case CHIP8_OP_ALPHA:
+        case CHIP8_OP_DIGISND:
+        case CHIP8_OP_STOPSND:
+        case CHIP8_OP_BMODE:
+        case CHIP8_OP_CCOL: { return false; }
+        case CHIP8_OP_LD_VX_DT:
+        case CHIP8_OP_LD_DT_VX:
+        case CHIP8_OP_LD_ST_VX: { return position == 0; }
+        default: { return true; }
+    }
+}
+
+
+// Whether `ins` ends its block: it branches, or writes memory that may hold the
+// instructions after it
+static bool __terminator(const Chip8Instruction& ins)
+{
+    switch(ins.op)
+    {
+        case CHIP8_OP_RET:
+        case CHIP8_OP_JP:
+        case CHIP8_OP_CALL:
+        case CHIP8_OP_SE_VX_NN:
+        case CHIP8_OP_SNE_VX_NN:
+        case CHIP8_OP_SE_VX_VY:
+        case CHIP8_OP_SNE_VX_VY:
+        case CHIP8_OP_JP_V0:
+        case CHIP8_OP_SKP:
+        case CHIP8_OP_SKNP:
+        case CHIP8_OP_LD_B_VX:
+        case CHIP8_OP_LD_MEM_VX: { return true; }
+        default: { return false; }
+    }
+}
+
+
+// Splits the analyzed blocks into the runs that can be translated
+static std::vector<RecompilerBlock> __split(const uint8_t* memory, const Chip8Analysis* analysis, RecompilerStats* stats)
+{
+    std::vector<RecompilerBlock> blocks;
+    for (uint32_t i = 0; i < analysis->block_count; ++i)
+    {
+        const Chip8Block& analyzed = analysis->blocks[i];
+        uint16_t at = analyzed.start;
+        while (at < analyzed.end)
+        {
+            RecompilerBlock block{ at, at, false };
+            while (block.end < analyzed.end && block.end - block.start < 2 * RECOMPILER_MAX_BLOCK)
+            {
+                Chip8Instruction ins = chip8_decode(memory[block.end], memory[block.end + 1]);
+                if (!__translatable(ins, (block.end - block.start) / 2))
+                {
+                    break;
+                }
+                block.end += 2;
+                if (__terminator(ins))
+                {
+                    block.terminated = true;
+                    break;
+                }
+            }
+
+            if (block.end == block.start)
+            {
+                // Left to the interpreter, the next instruction starts a block again
+                stats->interpreted++;
+                at += 2;
+                continue;
+            }
+
+            stats->blocks++;
+            stats->translated += (block.end - block.start) / 2;
+            blocks.push_back(block);
+            at = block.end;
+        }
+    }
+    return blocks;
+}
+
+
+// C statements performing the instruction at `at`, setting the program counter if it ends the block
+static std::vector<std::string> __translate(const Chip8Instruction& ins, uint16_t at)
+{
+    const unsigned x = ins.x;
+    const unsigned y = ins.y;
+    const unsigned skip = (uint16_t)(at + 4);
+    const unsigned next = (uint16_t)(at + 2);
+
+    switch(ins.op)
+    {
+        case CHIP8_OP_CLS: { return { "memset(chip8->VRAM, 0x0, sizeof(chip8->VRAM));" }; }
+        case CHIP8_OP_RET: {
+            return { "chip8->sp--;", "chip8->pc = chip8->stack[chip8->sp] + 2;" };
+        }
+        case CHIP8_OP_JP: { return { __format("chip8->pc = 0x%03X;", ins.nnn) }; }
+        case CHIP8_OP_CALL: {
+            return {
+                __format("chip8->stack[chip8->sp] = 0x%03X;", at),
+                "chip8->sp++;",
+                __format("chip8->pc = 0x%03X;", ins.nnn),
+            };
+        }
+        case CHIP8_OP_SE_VX_NN: { return { __format("chip8->pc = (v[0x%X] == 0x%02X) ? 0x%03X : 0x%03X;", x, ins.nn, skip, next) }; }
+        case CHIP8_OP_SNE_VX_NN: { return { __format("chip8->pc = (v[0x%X] != 0x%02X) ? 0x%03X : 0x%03X;", x, ins.nn, skip, next) }; }
+        // Comparing a register with itself has a known outcome, spelled out so compilers do not warn
+        case CHIP8_OP_SE_VX_VY: {
+            if (x == y) return { __format("chip8->pc = 0x%03X;", skip) };
+            return { __format("chip8->pc = (v[0x%X] == v[0x%X]) ? 0x%03X : 0x%03X;", x, y, skip, next) };
+        }
+        case CHIP8_OP_SNE_VX_VY: {
+            if (x == y) return { __format("chip8->pc = 0x%03X;", next) };
+            return { __format("chip8->pc = (v[0x%X] != v[0x%X]) ? 0x%03X : 0x%03X;", x, y, skip, next) };
+        }
+        case CHIP8_OP_LD_VX_NN: { return { __format("v[0x%X] = 0x%02X;", x, ins.nn) }; }
+        case CHIP8_OP_ADD_VX_NN: { return { __format("v[0x%X] += 0x%02X;", x, ins.nn) }; }
+        case CHIP8_OP_LD_VX_VY: { return { __format("v[0x%X] = v[0x%X];", x, y) }; }
+        case CHIP8_OP_OR: { return { __format("v[0x%X] |= v[0x%X];", x, y) }; }
+        case CHIP8_OP_AND: { return { __format("v[0x%X] &= v[0x%X];", x, y) }; }
+        case CHIP8_OP_XOR: { return { __format("v[0x%X] ^= v[0x%X];", x, y) }; }
+        // Flags are written in the same order as chip8_run, which matters when x is F
+        case CHIP8_OP_ADD_VX_VY: {
+            return {
+                __format("result = v[0x%X] + v[0x%X];", x, y),
+                __format("v[0x%X] = result & 0xFF;", x),
+                "v[0xF] = (result > 0xFF) ? 0x1 : 0x0;",
+            };
+        }
+        case CHIP8_OP_SUB: {
+            return {
+                __format("result = v[0x%X] - v[0x%X];", x, y),
+                (x == y) ? "v[0xF] = 0x1;" : __format("v[0xF] = (v[0x%X] < v[0x%X]) ? 0x0 : 0x1;", x, y),
+                __format("v[0x%X] = result & 0xFF;", x),
+            };
+        }
+        case CHIP8_OP_SHR: {
+            return { __format("v[0xF] = v[0x%X] & 0x01;", x), __format("v[0x%X] = v[0x%X] >> 1;", x, x) };
+        }
+        case CHIP8_OP_SUBN: {
+            return {
+                __format("result = v[0x%X] - v[0x%X];", y, x),
+                (x == y) ? "v[0xF] = 0x1;" : __format("v[0xF] = (v[0x%X] > v[0x%X]) ? 0x0 : 0x1;", x, y),
+                __format("v[0x%X] = result & 0xFF;", x),
+            };
+        }
+        case CHIP8_OP_SHL: {
+            return { __format("v[0xF] = (v[0x%X] >> 7) & 0x1;", x), __format("v[0x%X] = v[0x%X] << 1;", x, x) };
+        }
+        case CHIP8_OP_LD_I: { return { __format("chip8->I = 0x%03X;", ins.nnn) }; }
+        case CHIP8_OP_JP_V0: { return { __format("chip8->pc = 0x%03X + v[0x0];", ins.nnn) }; }
+        case CHIP8_OP_RND: { return { __format("chip8_aot_random(chip8, 0x%X, 0x%02X);", x, ins.nn) }; }
+        case CHIP8_OP_DRW: { return { __format("chip8_aot_draw(chip8, 0x%X, 0x%X, %u);", x, y, ins.n) }; }
+        case CHIP8_OP_SKP: { return { __format("chip8->pc = (chip8->keys & CHIP8_KEY(v[0x%X] & 0xF)) ? 0x%03X : 0x%03X;", x, skip, next) }; }
+        case CHIP8_OP_SKNP: { return { __format("chip8->pc = (chip8->keys & CHIP8_KEY(v[0x%X] & 0xF)) ? 0x%03X : 0x%03X;", x, next, skip) }; }
+        case CHIP8_OP_LD_VX_DT: { return { __format("v[0x%X] = chip8->delay_timer;", x) }; }
+        case CHIP8_OP_LD_DT_VX: { return { __format("chip8->delay_timer = v[0x%X];", x) }; }
+        case CHIP8_OP_LD_ST_VX: { return { __format("chip8->sound_timer = v[0x%X];", x) }; }
+        case CHIP8_OP_ADD_I_VX: { return { __format("chip8->I += v[0x%X];", x) }; }
+        case CHIP8_OP_LD_F_VX: { return { __format("chip8->I = 5 * v[0x%X];", x) }; }
+        case CHIP8_OP_LD_B_VX: { return { __format("chip8_aot_store_bcd(chip8, 0x%X);", x), __format("chip8->pc = 0x%03X;", next) }; }
+        case CHIP8_OP_LD_MEM_VX: { return { __format("chip8_aot_store_registers(chip8, 0x%X);", x), __format("chip8->pc = 0x%03X;", next) }; }
+        case CHIP8_OP_LD_VX_MEM: {
+            std::vector<std::string> lines;
+            for (unsigned r = 0; r <= x; ++r)
+            {
+                lines.push_back(__format("v[0x%X] = chip8->memory[(chip8->I + %u) & 0x%03X];", r, r, CHIP8_MEMORY_SIZE - 1));
+            }
+            return lines;
+        }
+        default: { return {}; } // Not translatable
+    }
+}
+
+
+// Whether the translation of `ins` reads or writes the registers itself, rather than through a library call
+static bool __uses_registers(const Chip8Instruction& ins)
+{
+    switch(ins.op)
+    {
+        case CHIP8_OP_CLS:
+        case CHIP8_OP_RET:
+        case CHIP8_OP_JP:
+        case CHIP8_OP_CALL:
+        case CHIP8_OP_LD_I:
+        case CHIP8_OP_RND:
+        case CHIP8_OP_DRW:
+        case CHIP8_OP_LD_B_VX:
+        case CHIP8_OP_LD_MEM_VX: { return false; }
+        case CHIP8_OP_SE_VX_VY:
+        case CHIP8_OP_SNE_VX_VY: { return ins.x != ins.y; }
+        default: { return true; }
+    }
+}
+
+
+// Writes the C function running `block`. The emitted function returns 1 once the block ran,
+// or 0 without changing anything when it hands control back to the interpreter: its code
+// was overwritten since, or the stack would overflow or underflow
+static void __write_block(FILE* out, const Chip8* chip8, const RecompilerBlock& block)
+{
+    const uint8_t* memory = chip8->memory;
+    bool calls = false;
+    bool returns = false;
+    bool registers = false;
+    bool result = false;
+    std::vector<std::string> lines;
+
+    for (uint16_t at = block.start; at < block.end; at += 2)
+    {
+        Chip8Instruction ins = chip8_decode(memory[at], memory[at + 1]);
+        calls |= ins.op == CHIP8_OP_CALL;
+        returns |= ins.op == CHIP8_OP_RET;
+        registers |= __uses_registers(ins);
+        result |= ins.op == CHIP8_OP_ADD_VX_VY || ins.op == CHIP8_OP_SUB || ins.op == CHIP8_OP_SUBN;
+
+        char disassembly[CHIP8_DISASSEMBLY_LINE_SIZE];
+        size_t length = chip8_disassemble_at(chip8, at, disassembly);
+        disassembly[length - 1] = '\0';
+        lines.push_back(std::string("// ") + disassembly);
+
+        for (const std::string& line : __translate(ins, at))
+        {
+            lines.push_back(line);
+        }
+    }
+    if (!block.terminated)
+    {
+        lines.push_back(__format("chip8->pc = 0x%03X;", block.end));
+    }
+
+    fprintf(out, "static int block_%03X(Chip8* chip8)\n{\n", block.start);
+    fprintf(out, "    static const uint8_t code[%u] = {", block.end - block.start);
+    for (uint16_t at = block.start; at < block.end; ++at)
+    {
+        fprintf(out, "%s0x%02X", at == block.start ? " " : ", ", memory[at]);
+    }
+    fprintf(out, " };\n");
+    if (registers)
+    {
+        fprintf(out, "    uint8_t* v = chip8->v;\n");
+    }
+    if (result)
+    {
+        fprintf(out, "    uint16_t result;\n");
+    }
+
+    fprintf(out, "\n    if (memcmp(&chip8->memory[0x%03X], code, sizeof(code)) != 0) return 0;\n", block.start);
+    if (calls)
+    {
+        fprintf(out, "    if (chip8->sp >= CHIP8_STACK_SIZE) return 0;\n");
+    }
+    if (returns)
+    {
+        fprintf(out, "    if (chip8->sp == 0) return 0;\n");
+    }
+
+    for (const std::string& line : lines)
+    {
+        fprintf(out, "%s    %s\n", line.rfind("//", 0) == 0 ? "\n" : "", line.c_str());
+    }
+    fprintf(out, "    return 1;\n}\n\n\n");
+}
+
+
+int recompiler_write_c(FILE* out, const Chip8* chip8, const Chip8Analysis* analysis, const std::string& name, const std::string& rom, RecompilerStats* stats)
+{
+    *stats = RecompilerStats{};
+    std::vector<RecompilerBlock> blocks = __split(chip8->memory, analysis, stats);
+
+    fprintf(out, "// Generated by chip8_recompile from %s, do not edit.\n", rom.c_str());
+    fprintf(out, "// %u blocks, %u instructions. Compile as C with the chip8 library, then run with\n", stats->blocks, stats->translated);
+    fprintf(out, "//     extern const Chip8AotProgram %s;\n", name.c_str());
+    fprintf(out, "//     chip8_aot_run(&%s, chip8, cycles, &config);\n\n", name.c_str());
+    fprintf(out, "#include \"chip8_aot.h\"\n\n#include <string.h>\n\n\n");
+
+    for (const RecompilerBlock& block : blocks)
+    {
+        __write_block(out, chip8, block);
+    }
+
+    // Blocks run in turn from a switch on the program counter, which compilers turn
+    // into a jump table with the blocks inlined, rather than calls through pointers
+    fprintf(out, "static uint32_t run(Chip8* chip8, uint32_t budget, uint32_t period)\n{\n");
+    fprintf(out, "    uint32_t executed = 0;\n%s    for (;;)\n    {\n        uint32_t length;\n", blocks.empty() ? "    (void)budget;\n" : "");
+    fprintf(out, "        switch(chip8->pc)\n        {\n");
+    for (const RecompilerBlock& block : blocks)
+    {
+        fprintf(out, "            case 0x%03X: { length = %u; if (budget - executed < length || !block_%03X(chip8)) return executed; break; }\n",
+            block.start, (block.end - block.start) / 2, block.start);
+    }
+    fprintf(out, "            default: { return executed; }\n        }\n\n");
+    fprintf(out, "        executed += length;\n        chip8->cycles += length;\n");
+    fprintf(out, "        if (period)\n        {\n            chip8->timer_cycles += length;\n");
+    fprintf(out, "            if (chip8->timer_cycles >= period) chip8_aot_tick(chip8, period);\n        }\n    }\n}\n\n\n");
+
+    // An initializer cannot be empty, for ROMs with nothing to translate
+    fprintf(out, "static const uint8_t lengths[CHIP8_MEMORY_SIZE] = {\n%s", blocks.empty() ? "    0,\n" : "");
+    for (const RecompilerBlock& block : blocks)
+    {
+        fprintf(out, "    [0x%03X] = %u,\n", block.start, (block.end - block.start) / 2);
+    }
+    fprintf(out, "};\n\n");
+
+    uint64_t hash = chip8_rom_hash(&chip8->memory[CHIP8_PROGRAM_START_LOCATION], chip8->rom_size);
+    fprintf(out, "const Chip8AotProgram %s = { 0x%016llXull, run, lengths };\n", name.c_str(), (unsigned long long)hash);
+
+    return ferror(out) ? -1 : 0;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+extern "C" {
+    #include "chip8_analysis.h"
+}
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+
+// Blocks longer than this are split, chip8_aot_run keeps lengths in a byte
+#define RECOMPILER_MAX_BLOCK 64
+
+struct RecompilerStats
+{
+    uint32_t blocks; // functions written
+    uint32_t translated; // instructions in them
+    uint32_t interpreted; // reachable instructions left to the interpreter (Fx0A, invalid)
+};
+
+// Writes a C file translating the blocks of `analysis` out of `chip8`'s memory, defining
+// `const Chip8AotProgram <name>` for chip8_aot_run. `rom` names the ROM in the
+// header comment. Returns 0 if OK, -1 on write errors
+int recompiler_write_c(FILE* out, const Chip8* chip8, const Chip8Analysis* analysis, const std::string& name, const std::string& rom, RecompilerStats* stats);